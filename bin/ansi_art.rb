@@ -16,29 +16,19 @@ begin
 
   loop do
     d11 = knd.get_depth
-    d16 = NL::KndClient::Kinutils.unpack11_to_16_lut(d11)
-
-    # img will contain full 3D coordinates after this, but we'll only use Z here.
-    # img[y][x] will return the voxel at (x, y) in the 640x480 data.
-    img = d16.unpack('S*').map { |v|
-      NL::KndClient::Kinutils::DEPTH_LUT[v]
-    }.each_slice(640).map.with_index { |row, y|
-      row.map.with_index { |zw, x|
-        if zw > 4000
-          {x: 0, y: 0, z: -1}
-        else
-          {
-            x: NL::KndClient::Kinutils.xworld(x, zw),
-            y: NL::KndClient::Kinutils.yworld(y, zw),
-            z: zw
-          }
-        end
-      }
-    }
+
+    # Sample every 11th column and 15th row to fit the terminal.  Each point
+    # is an [x, y, z] triple in world-space millimeters; pixels without a
+    # depth reading come back as [0, 0, 0].
+    img = NL::KndClient::Kinutils.unpack_to_world(d11, skip_invalid: false, stride: [11, 15])
+      .unpack('s*')
+      .each_slice(3)
+      .each_slice(59)
+      .map { |row| row.map { |_x, _y, z| z > 4000 ? 0 : z } }
 
     charmap = [".", '-', "\e[1m-\e[0m", 'o', "\e[1mo\e[0m", 'O', "\e[1mO\e[0m"].reverse
 
-    puts img.each_slice(15).map(&:first).map { |z| z.each_slice(11).map(&:first) }.map { |z| z.map { |v| [0, v[:z] - 200].max / 450 } }.map { |z| z.map { |v| charmap[v] }.join }
+    puts img.map { |z| z.map { |v| charmap[[0, v - 200].max / 450] }.join }
 
     STDOUT.write "\e[H"
   end
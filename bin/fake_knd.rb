@@ -0,0 +1,42 @@
+#!/usr/bin/env ruby
+# Runs a stand-in KND server that serves a depth recording or a synthetic
+# scene, for testing clients without a Kinect.  Prints frame statistics every
+# second.
+#
+# (C)2026 Mike Bourgeous
+
+require 'bundler/setup'
+require 'optparse'
+
+require 'nl/knd_client'
+
+options = { port: 14308 }
+zones = {}
+
+OptionParser.new do |opts|
+  opts.banner = "Usage: #{$0} [options] [recording.knr]"
+
+  opts.on('-p', '--port PORT', Integer, 'Port to listen on (default 14308)') { |v| options[:port] = v }
+  opts.on('-r', '--fps FPS', Float, 'Depth frames per second (default 30)') { |v| options[:fps] = v }
+  opts.on('-n', '--count COUNT', Integer, 'Stop after COUNT frames') { |v| options[:count] = v }
+  opts.on('-u', '--zone-rate RATE', Float, 'Zone updates per second (default 10)') { |v| options[:zone_rate] = v }
+  opts.on('-q', '--max-queue FRAMES', Integer, 'Frames queued per client before dropping (default 2)') { |v| options[:max_queue] = v }
+  opts.on('-z', '--zone NAME,XMIN,YMIN,ZMIN,XMAX,YMAX,ZMAX', Array, 'Add a zone (repeatable)') do |v|
+    raise OptionParser::InvalidArgument, v.join(',') unless v.length == 7
+    zones[v[0]] = %w{xmin ymin zmin xmax ymax zmax}.zip(v[1..-1].map(&:to_i)).to_h
+  end
+end.parse!
+
+options[:frames] = ARGV[0] if ARGV[0]
+options[:zones] = zones
+
+server = NL::KndClient::FakeKndServer.new(**options).start
+puts "Serving #{ARGV[0] || 'synthetic frames'} on port #{server.port}"
+
+begin
+  until server.wait(1)
+    puts "#{server.frame_count} frames, #{server.frames_sent} sent, #{server.frames_dropped} dropped, #{server.client_count} clients"
+  end
+ensure
+  server.stop
+end
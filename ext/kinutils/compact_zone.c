@@ -0,0 +1,579 @@
+/*
+ * Compact struct-backed zones for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * A CompactZone keeps a zone's numeric attributes in a packed C struct
+ * instead of a Hash of boxed values, while still allowing Hash-style access
+ * with String keys.  Key-value lines from KND are parsed straight into the
+ * struct.  Attributes without special handling (such as version) are kept
+ * in a small Hash.
+ */
+#include <string.h>
+#include <ruby.h>
+#include <ruby/encoding.h>
+
+#include "kinutils.h"
+#include "zone_kvp.h"
+
+struct compact_zone {
+	int32_t ints[KU_ZA_INT_COUNT];
+	uint32_t present; // Bit for each attribute that has been set
+	uint8_t negate;
+	uint8_t occupied;
+	uint8_t param;
+	VALUE name;
+	VALUE extra; // Hash of other attributes, or Qnil
+};
+
+static VALUE CompactZone = Qnil;
+static VALUE param_strings[KU_ZONE_PARAM_COUNT];
+static ID id_to_i, id_to_f;
+
+static void compact_zone_mark(void *data)
+{
+	struct compact_zone *zone = data;
+	rb_gc_mark(zone->name);
+	rb_gc_mark(zone->extra);
+}
+
+static size_t compact_zone_size(const void *data)
+{
+	return sizeof(struct compact_zone);
+}
+
+static const rb_data_type_t compact_zone_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::CompactZone",
+	.function = {
+		.dmark = compact_zone_mark,
+		.dfree = RUBY_TYPED_DEFAULT_FREE,
+		.dsize = compact_zone_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE compact_zone_alloc(VALUE klass)
+{
+	struct compact_zone *zone;
+	VALUE obj = TypedData_Make_Struct(klass, struct compact_zone, &compact_zone_type, zone);
+
+	zone->name = Qnil;
+	zone->extra = Qnil;
+
+	return obj;
+}
+
+static struct compact_zone *get_zone(VALUE self)
+{
+	struct compact_zone *zone;
+	TypedData_Get_Struct(self, struct compact_zone, &compact_zone_type, zone);
+	return zone;
+}
+
+// Returns nonzero if value is a Kinutils::CompactZone.
+int ku_is_compact_zone(VALUE value)
+{
+	return rb_typeddata_is_kind_of(value, &compact_zone_type);
+}
+
+// Returns the attribute at attr, which must be set.
+static VALUE attr_value(struct compact_zone *zone, int attr)
+{
+	if(attr < KU_ZA_INT_COUNT) {
+		return INT2NUM(zone->ints[attr]);
+	}
+
+	switch(attr) {
+		case KU_ZA_NEGATE:
+			return zone->negate ? Qtrue : Qfalse;
+
+		case KU_ZA_OCCUPIED:
+			return zone->occupied ? Qtrue : Qfalse;
+
+		case KU_ZA_PARAM:
+			return param_strings[zone->param];
+
+		default:
+			return zone->name;
+	}
+}
+
+// Returns the attribute stored in the struct for key (a String or Symbol),
+// or -1 if key is kept in the extra Hash.
+static int key_attr(VALUE key)
+{
+	int attr;
+
+	if(SYMBOL_P(key)) {
+		key = rb_sym2str(key);
+	}
+	if(!RB_TYPE_P(key, T_STRING)) {
+		return -1;
+	}
+
+	attr = ku_zone_attr_find(StringValueCStr(key));
+	return attr == KU_ZA_VERSION ? -1 : attr;
+}
+
+// Returns the value for key, or Qundef if it is not set.
+static VALUE zone_get(struct compact_zone *zone, VALUE key)
+{
+	int attr = key_attr(key);
+
+	if(attr >= 0) {
+		return (zone->present & (1u << attr)) ? attr_value(zone, attr) : Qundef;
+	}
+
+	if(NIL_P(zone->extra)) {
+		return Qundef;
+	}
+
+	return rb_hash_lookup2(zone->extra, key, Qundef);
+}
+
+// Returns the named attribute of a CompactZone, or Qundef if it is not set.
+VALUE ku_compact_zone_get(VALUE zone, const char *key)
+{
+	struct compact_zone *z = get_zone(zone);
+	int attr = ku_zone_attr_find(key);
+
+	if(attr >= 0 && attr != KU_ZA_VERSION) {
+		return (z->present & (1u << attr)) ? attr_value(z, attr) : Qundef;
+	}
+
+	return zone_get(z, rb_str_new_cstr(key));
+}
+
+// Converts v to an Integer the way Zone#normalize! does (using to_i).
+static int32_t zone_int(VALUE v)
+{
+	if(!RB_INTEGER_TYPE_P(v)) {
+		v = rb_funcall(v, id_to_i, 0);
+	}
+	return NUM2INT(v);
+}
+
+// Converts a negate or occupied value the way Zone#normalize! does.
+static int zone_bool(VALUE v, int strings)
+{
+	if(strings && RB_TYPE_P(v, T_STRING)) {
+		if(!strcmp(StringValueCStr(v), "true")) {
+			return 1;
+		}
+		if(!strcmp(StringValueCStr(v), "false")) {
+			return 0;
+		}
+	}
+	if(rb_respond_to(v, id_to_i)) {
+		return zone_int(v) == 1;
+	}
+	return RTEST(v);
+}
+
+// Sets or clears (if value is nil) the attribute for key.  Values are
+// converted as by Zone#normalize!, invalid params are removed, and names are
+// fixed as by Zone.fix_name!.
+static void zone_set(struct compact_zone *zone, VALUE key, VALUE value)
+{
+	int attr = key_attr(key);
+	VALUE str;
+	int param;
+
+	if(attr < 0) {
+		if(NIL_P(zone->extra)) {
+			zone->extra = rb_hash_new();
+		}
+		rb_hash_aset(zone->extra, key, value);
+		return;
+	}
+
+	if(NIL_P(value)) {
+		zone->present &= ~(1u << attr);
+		if(attr == KU_ZA_NAME) {
+			zone->name = Qnil;
+		}
+		return;
+	}
+
+	if(attr < KU_ZA_INT_COUNT) {
+		zone->ints[attr] = zone_int(value);
+	} else {
+		switch(attr) {
+			case KU_ZA_NEGATE:
+				zone->negate = zone_bool(value, 1);
+				break;
+
+			case KU_ZA_OCCUPIED:
+				zone->occupied = zone_bool(value, 0);
+				break;
+
+			case KU_ZA_PARAM:
+				if(SYMBOL_P(value)) {
+					value = rb_sym2str(value);
+				}
+				param = RB_TYPE_P(value, T_STRING) ? ku_zone_param_find(StringValueCStr(value)) : -1;
+				if(param < 0) {
+					zone->present &= ~(1u << attr);
+					return;
+				}
+				zone->param = param;
+				break;
+
+			default:
+				if(RB_TYPE_P(value, T_STRING)) {
+					str = ku_zone_fixed_name(RSTRING_PTR(value), RSTRING_LEN(value));
+					rb_enc_copy(str, value);
+					value = str;
+				}
+				zone->name = value;
+				break;
+		}
+	}
+
+	zone->present |= 1u << attr;
+}
+
+// Stores each attribute parsed from a key-value line directly in the struct.
+static void zone_kvp_cb(void *data, int attr, const char *key, long integer, VALUE value)
+{
+	struct compact_zone *zone = data;
+
+	if(attr < 0 || attr == KU_ZA_VERSION) {
+		if(NIL_P(zone->extra)) {
+			zone->extra = rb_hash_new();
+		}
+		rb_hash_aset(zone->extra, attr < 0 ? rb_str_new2(key) : ku_zone_attr_strings[attr], value);
+		return;
+	}
+
+	if(attr < KU_ZA_INT_COUNT) {
+		zone->ints[attr] = integer;
+	} else {
+		switch(attr) {
+			case KU_ZA_NEGATE:
+				zone->negate = RTEST(value);
+				break;
+
+			case KU_ZA_OCCUPIED:
+				zone->occupied = RTEST(value);
+				break;
+
+			case KU_ZA_PARAM:
+				zone->param = integer;
+				break;
+
+			default:
+				zone->name = value;
+				break;
+		}
+	}
+
+	zone->present |= 1u << attr;
+}
+
+// Parses a NUL-terminated line of key-value pairs directly into a
+// CompactZone.
+void ku_compact_zone_merge_line(VALUE zone, const char *line)
+{
+	ku_parse_zone_kvp(line, zone_kvp_cb, get_zone(zone));
+}
+
+// Parses a line of key-value pairs from KND (e.g. from a SUB or ADD message)
+// directly into the zone, converting values as Zone#normalize! would.
+// Returns self.
+static VALUE compact_zone_merge_kvp(VALUE self, VALUE line)
+{
+	rb_check_frozen(self);
+	ku_compact_zone_merge_line(self, StringValueCStr(line));
+	RB_GC_GUARD(line);
+
+	return self;
+}
+
+// State for merging a Hash into a CompactZone.
+struct merge_hash {
+	struct compact_zone *zone;
+	int meters; // Nonzero if world coordinates are in meters (version 1)
+};
+
+// Returns the version given in hash (with a String or Symbol key), or
+// Qundef.
+static VALUE hash_version(VALUE hash)
+{
+	VALUE version = rb_hash_lookup2(hash, ku_zone_attr_strings[KU_ZA_VERSION], Qundef);
+
+	if(version == Qundef) {
+		version = rb_hash_lookup2(hash, ID2SYM(rb_intern("version")), Qundef);
+	}
+
+	return version;
+}
+
+static int merge_hash_cb(VALUE key, VALUE value, VALUE data)
+{
+	struct merge_hash *merge = (struct merge_hash *)data;
+	int attr = key_attr(key);
+
+	if(merge->meters && attr >= KU_ZA_XMIN && attr <= KU_ZA_ZMAX && !NIL_P(value)) {
+		// Version 1 zones used floating point meters
+		merge->zone->ints[attr] = (int32_t)(NUM2DBL(rb_funcall(value, id_to_f, 0)) * 1000.0);
+		merge->zone->present |= 1u << attr;
+	} else {
+		zone_set(merge->zone, key, value);
+	}
+
+	return ST_CONTINUE;
+}
+
+// Merges the attributes of another CompactZone, or of a Hash with String or
+// Symbol keys.  A Hash's values are converted as by Zone#normalize!: world
+// coordinates are converted from meters if the Hash (or else this zone) has
+// a version below 2, and names are fixed as by Zone.fix_name!.  Returns
+// self.
+static VALUE compact_zone_merge(VALUE self, VALUE other)
+{
+	struct compact_zone *zone = get_zone(self);
+	struct compact_zone *src;
+	struct merge_hash merge;
+	VALUE version;
+	int i;
+
+	rb_check_frozen(self);
+
+	if(ku_is_compact_zone(other)) {
+		src = get_zone(other);
+		for(i = 0; i < KU_ZA_INT_COUNT; i++) {
+			if(src->present & (1u << i)) {
+				zone->ints[i] = src->ints[i];
+			}
+		}
+		if(src->present & (1u << KU_ZA_NEGATE)) {
+			zone->negate = src->negate;
+		}
+		if(src->present & (1u << KU_ZA_OCCUPIED)) {
+			zone->occupied = src->occupied;
+		}
+		if(src->present & (1u << KU_ZA_PARAM)) {
+			zone->param = src->param;
+		}
+		if(src->present & (1u << KU_ZA_NAME)) {
+			zone->name = src->name;
+		}
+		zone->present |= src->present;
+
+		if(!NIL_P(src->extra)) {
+			if(NIL_P(zone->extra)) {
+				zone->extra = rb_hash_new();
+			}
+			rb_funcall(zone->extra, rb_intern("update"), 1, src->extra);
+		}
+	} else {
+		other = rb_convert_type(other, T_HASH, "Hash", "to_hash");
+		version = hash_version(other);
+		if(version == Qundef) {
+			version = zone_get(zone, ku_zone_attr_strings[KU_ZA_VERSION]);
+		}
+
+		merge = (struct merge_hash){
+			.zone = zone,
+			.meters = version != Qundef && !NIL_P(version) && zone_int(version) < 2,
+		};
+		rb_hash_foreach(other, merge_hash_cb, (VALUE)&merge);
+	}
+
+	return self;
+}
+
+// Initializes a zone from an optional line of key-value pairs, Hash, or
+// other CompactZone.
+static VALUE compact_zone_initialize(int argc, VALUE *argv, VALUE self)
+{
+	VALUE attrs;
+
+	rb_scan_args(argc, argv, "01", &attrs);
+
+	if(RB_TYPE_P(attrs, T_STRING)) {
+		compact_zone_merge_kvp(self, attrs);
+	} else if(!NIL_P(attrs)) {
+		compact_zone_merge(self, attrs);
+	}
+
+	return self;
+}
+
+// Copies another zone's attributes for dup and clone.
+static VALUE compact_zone_initialize_copy(VALUE self, VALUE orig)
+{
+	struct compact_zone *zone = get_zone(self);
+
+	if(self == orig) {
+		return self;
+	}
+
+	rb_check_frozen(self);
+	*zone = *get_zone(orig);
+	if(!NIL_P(zone->extra)) {
+		zone->extra = rb_hash_dup(zone->extra);
+	}
+
+	return self;
+}
+
+// Returns the value for key (a String or Symbol), or nil if it is not set.
+static VALUE compact_zone_aref(VALUE self, VALUE key)
+{
+	VALUE v = zone_get(get_zone(self), key);
+	return v == Qundef ? Qnil : v;
+}
+
+// Sets the value for key, converting known attributes as Zone#normalize!
+// would.  Setting a known attribute to nil removes it.
+static VALUE compact_zone_aset(VALUE self, VALUE key, VALUE value)
+{
+	rb_check_frozen(self);
+	zone_set(get_zone(self), key, value);
+	return value;
+}
+
+// Returns true if key is set.
+static VALUE compact_zone_has_key(VALUE self, VALUE key)
+{
+	return zone_get(get_zone(self), key) == Qundef ? Qfalse : Qtrue;
+}
+
+// Removes key, returning its old value or nil.
+static VALUE compact_zone_delete(VALUE self, VALUE key)
+{
+	struct compact_zone *zone = get_zone(self);
+	VALUE old = zone_get(zone, key);
+
+	rb_check_frozen(self);
+
+	if(old == Qundef) {
+		return Qnil;
+	}
+
+	if(key_attr(key) >= 0) {
+		zone_set(zone, key, Qnil);
+	} else {
+		rb_hash_delete(zone->extra, key);
+	}
+
+	return old;
+}
+
+// Returns the zone's attributes as a new Hash with String keys.
+static VALUE compact_zone_to_h(VALUE self)
+{
+	struct compact_zone *zone = get_zone(self);
+	VALUE h = rb_hash_new();
+	int i;
+
+	for(i = 0; i < KU_ZA_COUNT; i++) {
+		if(zone->present & (1u << i)) {
+			rb_hash_aset(h, ku_zone_attr_strings[i], attr_value(zone, i));
+		}
+	}
+
+	if(!NIL_P(zone->extra)) {
+		rb_funcall(h, rb_intern("update"), 1, zone->extra);
+	}
+
+	return h;
+}
+
+// Returns the number of attributes that are set.
+static VALUE compact_zone_count(VALUE self)
+{
+	struct compact_zone *zone = get_zone(self);
+	long count = 0;
+	int i;
+
+	for(i = 0; i < KU_ZA_COUNT; i++) {
+		count += !!(zone->present & (1u << i));
+	}
+	if(!NIL_P(zone->extra)) {
+		count += RHASH_SIZE(zone->extra);
+	}
+
+	return LONG2NUM(count);
+}
+
+static VALUE compact_zone_enum_size(VALUE self, VALUE args, VALUE eobj)
+{
+	return compact_zone_count(self);
+}
+
+// Yields each [key, value] pair, known attributes first.
+static VALUE compact_zone_each(VALUE self)
+{
+	VALUE h;
+	VALUE pairs;
+	long i;
+
+	RETURN_SIZED_ENUMERATOR(self, 0, 0, compact_zone_enum_size);
+
+	// Iterate over a snapshot so the block can change the zone
+	h = compact_zone_to_h(self);
+	pairs = rb_funcall(h, rb_intern("to_a"), 0);
+	for(i = 0; i < RARRAY_LEN(pairs); i++) {
+		rb_yield(RARRAY_AREF(pairs, i));
+	}
+
+	return self;
+}
+
+// Returns an Array of the keys that are set.
+static VALUE compact_zone_keys(VALUE self)
+{
+	return rb_funcall(compact_zone_to_h(self), rb_intern("keys"), 0);
+}
+
+// Returns true if other is a CompactZone or Hash with the same attributes.
+static VALUE compact_zone_equal(VALUE self, VALUE other)
+{
+	if(ku_is_compact_zone(other)) {
+		other = compact_zone_to_h(other);
+	} else if(!RB_TYPE_P(other, T_HASH)) {
+		return Qfalse;
+	}
+
+	return rb_equal(compact_zone_to_h(self), other);
+}
+
+// Defines the Kinutils::CompactZone class.  Must be called after
+// init_zone_list().
+void init_compact_zone(VALUE kinutils)
+{
+	int i;
+
+	id_to_i = rb_intern("to_i");
+	id_to_f = rb_intern("to_f");
+
+	for(i = 0; i < KU_ZONE_PARAM_COUNT; i++) {
+		param_strings[i] = rb_obj_freeze(rb_str_new_cstr(ku_zone_params[i]));
+		rb_gc_register_mark_object(param_strings[i]);
+	}
+
+	CompactZone = rb_define_class_under(kinutils, "CompactZone", rb_cObject);
+	rb_define_alloc_func(CompactZone, compact_zone_alloc);
+	rb_include_module(CompactZone, rb_mEnumerable);
+
+	rb_define_method(CompactZone, "initialize", compact_zone_initialize, -1);
+	rb_define_method(CompactZone, "initialize_copy", compact_zone_initialize_copy, 1);
+	rb_define_method(CompactZone, "merge_kvp", compact_zone_merge_kvp, 1);
+	rb_define_method(CompactZone, "merge!", compact_zone_merge, 1);
+	rb_define_method(CompactZone, "[]", compact_zone_aref, 1);
+	rb_define_method(CompactZone, "[]=", compact_zone_aset, 2);
+	rb_define_method(CompactZone, "key?", compact_zone_has_key, 1);
+	rb_define_method(CompactZone, "has_key?", compact_zone_has_key, 1);
+	rb_define_method(CompactZone, "include?", compact_zone_has_key, 1);
+	rb_define_method(CompactZone, "member?", compact_zone_has_key, 1);
+	rb_define_method(CompactZone, "delete", compact_zone_delete, 1);
+	rb_define_method(CompactZone, "to_h", compact_zone_to_h, 0);
+	rb_define_method(CompactZone, "size", compact_zone_count, 0);
+	rb_define_method(CompactZone, "length", compact_zone_count, 0);
+	rb_define_method(CompactZone, "each", compact_zone_each, 0);
+	rb_define_method(CompactZone, "each_pair", compact_zone_each, 0);
+	rb_define_method(CompactZone, "keys", compact_zone_keys, 0);
+	rb_define_method(CompactZone, "==", compact_zone_equal, 1);
+}
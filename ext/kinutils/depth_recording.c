@@ -0,0 +1,326 @@
+/*
+ * Indexed, memory-mapped recordings of packed 11-bit depth frames.
+ * (C)2026 Mike Bourgeous
+ *
+ * Frames are written back to back after a small header, followed by an index
+ * of timestamps and offsets.  Readers map the whole file, so seeking to a
+ * frame is an index lookup and frames are handed out as pointers into the
+ * mapping.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "depth_recording.h"
+
+// Byte offsets of the header fields.
+#define HDR_MAGIC 0
+#define HDR_VERSION 8
+#define HDR_HEADER_SIZE 12
+#define HDR_FRAME_SIZE 16
+#define HDR_FRAME_COUNT 24
+#define HDR_INDEX_OFFSET 32
+
+// Size of an index entry in the file.
+#define ENTRY_SIZE 16
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+	put_le32(p, v);
+	put_le32(p + 4, v >> 32);
+}
+
+// Writes all len bytes.  Returns 0 on success, or -1 with errno set on error.
+static int write_full(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t ret;
+
+	while(len > 0) {
+		ret = write(fd, buf, len);
+		if(ret < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+// Fills in rec->count and rec->index from the mapped file.  Returns 0 on
+// success, or -1 with errno set to EINVAL or ENOMEM.
+static int read_index(struct ku_recording *rec)
+{
+	const uint8_t *hdr = rec->map;
+	uint32_t header_size = get_le32(hdr + HDR_HEADER_SIZE);
+	uint64_t count = get_le64(hdr + HDR_FRAME_COUNT);
+	uint64_t index_offset = get_le64(hdr + HDR_INDEX_OFFSET);
+	const uint8_t *p;
+	size_t i;
+
+	if(memcmp(hdr + HDR_MAGIC, KU_REC_MAGIC, sizeof(KU_REC_MAGIC)) ||
+			get_le32(hdr + HDR_VERSION) != KU_REC_VERSION ||
+			header_size < KU_REC_HEADER_SIZE || header_size > rec->map_size ||
+			get_le32(hdr + HDR_FRAME_SIZE) != KU_REC_FRAME_SIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if(index_offset == 0) {
+		// Never closed; use every complete frame
+		count = (rec->map_size - header_size) / KU_REC_FRAME_SIZE;
+	} else if(index_offset > rec->map_size || count > (rec->map_size - index_offset) / ENTRY_SIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	rec->count = count;
+	rec->index = calloc(count ? count : 1, sizeof(struct ku_rec_entry));
+	if(rec->index == NULL) {
+		return -1;
+	}
+
+	for(i = 0; i < count; i++) {
+		if(index_offset == 0) {
+			rec->index[i].timestamp = 0;
+			rec->index[i].offset = header_size + (uint64_t)i * KU_REC_FRAME_SIZE;
+			continue;
+		}
+
+		p = rec->map + index_offset + i * ENTRY_SIZE;
+		rec->index[i].timestamp = (int64_t)get_le64(p);
+		rec->index[i].offset = get_le64(p + 8);
+		if(rec->index[i].offset < header_size || rec->index[i].offset > rec->map_size ||
+				rec->map_size - rec->index[i].offset < KU_REC_FRAME_SIZE) {
+			free(rec->index);
+			rec->index = NULL;
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Maps the recording at path.  Returns 0 on success, or -1 with errno set on
+// error (EINVAL if the file is not a valid recording).
+int ku_recording_open(struct ku_recording *rec, const char *path)
+{
+	struct stat st;
+	void *map;
+	int fd, err;
+
+	*rec = (struct ku_recording){ .map = NULL };
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return -1;
+	}
+
+	if(fstat(fd, &st)) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	if(st.st_size < KU_REC_HEADER_SIZE) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	err = errno;
+	close(fd);
+	if(map == MAP_FAILED) {
+		errno = err;
+		return -1;
+	}
+
+	// Replay usually reads straight through
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	rec->map = map;
+	rec->map_size = st.st_size;
+
+	if(read_index(rec)) {
+		err = errno;
+		ku_recording_close(rec);
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Unmaps the recording and frees its index.  Frame pointers from the
+// recording may not be used afterward.
+void ku_recording_close(struct ku_recording *rec)
+{
+	if(rec->map) {
+		munmap((void *)rec->map, rec->map_size);
+	}
+	free(rec->index);
+	*rec = (struct ku_recording){ .map = NULL };
+}
+
+// Returns a pointer to frame i (KU_REC_FRAME_SIZE bytes) within the mapping.
+const uint8_t *ku_recording_frame(const struct ku_recording *rec, size_t i)
+{
+	return rec->map + rec->index[i].offset;
+}
+
+// Returns the timestamp of frame i in microseconds since the Unix epoch.
+int64_t ku_recording_timestamp(const struct ku_recording *rec, size_t i)
+{
+	return rec->index[i].timestamp;
+}
+
+// Returns the index of the first frame recorded at or after the given time
+// (microseconds since the Unix epoch), or the frame count if there is none.
+// Timestamps are assumed to be in nondecreasing order.
+size_t ku_recording_seek(const struct ku_recording *rec, int64_t timestamp)
+{
+	size_t lo = 0, hi = rec->count, mid;
+
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(rec->index[mid].timestamp < timestamp) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+// Creates (or truncates) a recording at path and writes its header.  Returns
+// 0 on success, or -1 with errno set on error.
+int ku_recorder_open(struct ku_recorder *rec, const char *path)
+{
+	uint8_t hdr[KU_REC_HEADER_SIZE] = { 0 };
+	int err;
+
+	*rec = (struct ku_recorder){ .fd = -1, .offset = KU_REC_HEADER_SIZE };
+
+	memcpy(hdr + HDR_MAGIC, KU_REC_MAGIC, sizeof(KU_REC_MAGIC));
+	put_le32(hdr + HDR_VERSION, KU_REC_VERSION);
+	put_le32(hdr + HDR_HEADER_SIZE, KU_REC_HEADER_SIZE);
+	put_le32(hdr + HDR_FRAME_SIZE, KU_REC_FRAME_SIZE);
+
+	rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(rec->fd < 0) {
+		return -1;
+	}
+
+	if(write_full(rec->fd, hdr, sizeof(hdr))) {
+		err = errno;
+		close(rec->fd);
+		rec->fd = -1;
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Appends a packed frame (KU_REC_FRAME_SIZE bytes) recorded at the given time
+// (microseconds since the Unix epoch).  Returns 0 on success, or -1 with errno
+// set on error.
+int ku_recorder_add(struct ku_recorder *rec, const uint8_t *frame, int64_t timestamp)
+{
+	struct ku_rec_entry *index;
+	size_t capacity;
+
+	if(rec->count == rec->capacity) {
+		capacity = rec->capacity ? rec->capacity * 2 : 256;
+		index = realloc(rec->index, capacity * sizeof(struct ku_rec_entry));
+		if(index == NULL) {
+			return -1;
+		}
+		rec->index = index;
+		rec->capacity = capacity;
+	}
+
+	if(write_full(rec->fd, frame, KU_REC_FRAME_SIZE)) {
+		// Put the file back where the next frame belongs
+		lseek(rec->fd, rec->offset, SEEK_SET);
+		return -1;
+	}
+
+	rec->index[rec->count] = (struct ku_rec_entry){ .timestamp = timestamp, .offset = rec->offset };
+	rec->count++;
+	rec->offset += KU_REC_FRAME_SIZE;
+
+	return 0;
+}
+
+// Writes the index, fills in the header, and closes the file.  The recorder
+// is freed even if writing fails.  Returns 0 on success, or -1 with errno set
+// on error.
+int ku_recorder_close(struct ku_recorder *rec)
+{
+	uint8_t buf[ENTRY_SIZE * 256];
+	uint8_t counts[16];
+	size_t i, n;
+	int ret = 0, err = 0;
+
+	for(i = 0, n = 0; i < rec->count && !ret; i++) {
+		put_le64(buf + n, rec->index[i].timestamp);
+		put_le64(buf + n + 8, rec->index[i].offset);
+		n += ENTRY_SIZE;
+
+		if(n == sizeof(buf) || i == rec->count - 1) {
+			ret = write_full(rec->fd, buf, n);
+			n = 0;
+		}
+	}
+
+	if(!ret) {
+		put_le64(counts, rec->count);
+		put_le64(counts + 8, rec->offset);
+		if(pwrite(rec->fd, counts, sizeof(counts), HDR_FRAME_COUNT) != sizeof(counts)) {
+			ret = -1;
+		}
+	}
+	if(ret) {
+		err = errno;
+	}
+
+	if(close(rec->fd) && !ret) {
+		err = errno;
+		ret = -1;
+	}
+
+	free(rec->index);
+	*rec = (struct ku_recorder){ .fd = -1 };
+
+	errno = err;
+	return ret;
+}
@@ -0,0 +1,89 @@
+/*
+ * Indexed, memory-mapped recordings of packed 11-bit depth frames.
+ * (C)2026 Mike Bourgeous
+ */
+#ifndef DEPTH_RECORDING_H_
+#define DEPTH_RECORDING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// File layout (all integers little-endian):
+//
+//     Header (KU_REC_HEADER_SIZE bytes, zero padded):
+//         char magic[8]           "KNDREC1\0"
+//         uint32_t version        KU_REC_VERSION
+//         uint32_t header_size    KU_REC_HEADER_SIZE
+//         uint32_t frame_size     KU_REC_FRAME_SIZE
+//         uint32_t reserved       0
+//         uint64_t frame_count    0 until the recording is closed
+//         uint64_t index_offset   0 until the recording is closed
+//     Frames: packed 11-bit frames, back to back
+//     Index: frame_count entries of
+//         int64_t timestamp       microseconds since the Unix epoch
+//         uint64_t offset         file offset of the frame
+//
+// Frames start on 64-byte boundaries.  A recording that was never closed
+// (e.g. because the recorder crashed) has no index, but its complete frames
+// can still be read, with timestamps of 0.
+#define KU_REC_MAGIC "KNDREC1"
+#define KU_REC_VERSION 1
+#define KU_REC_HEADER_SIZE 64
+#define KU_REC_FRAME_SIZE (640 * 480 * 11 / 8)
+
+struct ku_rec_entry {
+	int64_t timestamp; // Microseconds since the Unix epoch
+	uint64_t offset; // Offset of the frame in the file
+};
+
+// A recording opened for reading.  The whole file is mapped read-only, so
+// frames are read in place without copying.
+struct ku_recording {
+	const uint8_t *map;
+	size_t map_size;
+	size_t count; // Number of frames
+	struct ku_rec_entry *index;
+};
+
+// A recording opened for writing.
+struct ku_recorder {
+	int fd;
+	uint64_t offset; // Offset of the next frame
+	size_t count, capacity;
+	struct ku_rec_entry *index;
+};
+
+// Maps the recording at path.  Returns 0 on success, or -1 with errno set on
+// error (EINVAL if the file is not a valid recording).
+int ku_recording_open(struct ku_recording *rec, const char *path);
+
+// Unmaps the recording and frees its index.  Frame pointers from the
+// recording may not be used afterward.
+void ku_recording_close(struct ku_recording *rec);
+
+// Returns a pointer to frame i (KU_REC_FRAME_SIZE bytes) within the mapping.
+const uint8_t *ku_recording_frame(const struct ku_recording *rec, size_t i);
+
+// Returns the timestamp of frame i in microseconds since the Unix epoch.
+int64_t ku_recording_timestamp(const struct ku_recording *rec, size_t i);
+
+// Returns the index of the first frame recorded at or after the given time
+// (microseconds since the Unix epoch), or the frame count if there is none.
+// Timestamps are assumed to be in nondecreasing order.
+size_t ku_recording_seek(const struct ku_recording *rec, int64_t timestamp);
+
+// Creates (or truncates) a recording at path and writes its header.  Returns
+// 0 on success, or -1 with errno set on error.
+int ku_recorder_open(struct ku_recorder *rec, const char *path);
+
+// Appends a packed frame (KU_REC_FRAME_SIZE bytes) recorded at the given time
+// (microseconds since the Unix epoch).  Returns 0 on success, or -1 with errno
+// set on error.
+int ku_recorder_add(struct ku_recorder *rec, const uint8_t *frame, int64_t timestamp);
+
+// Writes the index, fills in the header, and closes the file.  The recorder
+// is freed even if writing fails.  Returns 0 on success, or -1 with errno set
+// on error.
+int ku_recorder_close(struct ku_recorder *rec);
+
+#endif /* DEPTH_RECORDING_H_ */
@@ -3,6 +3,9 @@ extension_name='kinutils'
 
 find_library('nlutils', 'nl_unescape_string', '/usr/local/lib')
 raise 'libnlutils not found' unless have_library("nlutils", "nl_unescape_string", 'nlutils/nlutils.h')
+raise 'libpthread not found' unless have_library('pthread', 'pthread_create', 'pthread.h')
+have_header('sys/eventfd.h')
+have_library('rt', 'shm_open') # Part of libc since glibc 2.34
 
 with_cflags("#{$CFLAGS} -O3 -Wall -Wextra #{ENV['EXTRACFLAGS']} -std=c99 -D_XOPEN_SOURCE=700 -D_ISOC99_SOURCE -D_GNU_SOURCE") do
   create_makefile('nl/knd_client/kinutils')
@@ -0,0 +1,322 @@
+/*
+ * Streaming depth frame assembly for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * A FrameAssembler receives a packed depth frame in chunks of any size, as
+ * they arrive from the network, and unpacks and plots each group of complete
+ * rows into a FrameContext right away.  By the time the last byte arrives,
+ * only the last few rows are left to process, so transfer and processing
+ * time overlap instead of adding up.  Rows are plotted in order into the
+ * same views, so the result is identical to FrameContext#unpack and
+ * #plot_views on the whole frame.
+ */
+#include <string.h>
+#include <ruby.h>
+#include <ruby/thread.h>
+
+#include "unpack.h"
+#include "kinutils.h"
+
+// Bytes in one row of packed 11-bit depth data.
+#define PACKED_ROW (640 * 11 / 8)
+
+struct frame_assembler {
+	VALUE data; // Hidden packed frame buffer, always KU_PACKED_SIZE bytes long
+	long received;
+	int rows_done; // Rows already unpacked and plotted
+	int batch_rows; // Complete rows to wait for before processing
+	VALUE ctx; // Output FrameContext from #start, or Qnil
+	struct ku_frame_buffers out; // NULL buffers are skipped
+};
+
+struct rows_info {
+	struct frame_assembler *as;
+	int y0, y1;
+};
+
+static VALUE FrameAssembler = Qnil;
+
+static void frame_assembler_mark(void *data)
+{
+	struct frame_assembler *as = data;
+
+	// rb_gc_mark() pins the buffer that rows are processed from
+	rb_gc_mark(as->data);
+	rb_gc_mark(as->ctx);
+}
+
+static size_t frame_assembler_size(const void *data)
+{
+	return sizeof(struct frame_assembler);
+}
+
+static const rb_data_type_t frame_assembler_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::FrameAssembler",
+	.function = {
+		.dmark = frame_assembler_mark,
+		.dfree = RUBY_TYPED_DEFAULT_FREE,
+		.dsize = frame_assembler_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE frame_assembler_alloc(VALUE klass)
+{
+	struct frame_assembler *as;
+	VALUE obj = TypedData_Make_Struct(klass, struct frame_assembler, &frame_assembler_type, as);
+
+	as->data = Qnil;
+	as->ctx = Qnil;
+	as->batch_rows = 16;
+
+	return obj;
+}
+
+static struct frame_assembler *get_assembler(VALUE self)
+{
+	struct frame_assembler *as;
+	TypedData_Get_Struct(self, struct frame_assembler, &frame_assembler_type, as);
+	if(NIL_P(as->data)) {
+		rb_raise(rb_eRuntimeError, "FrameAssembler was not initialized.");
+	}
+	return as;
+}
+
+// Returns nonzero if value is a Kinutils::FrameAssembler.
+int ku_is_frame_assembler(VALUE value)
+{
+	return rb_typeddata_is_kind_of(value, &frame_assembler_type);
+}
+
+// Unpacks and plots rows y0 through y1 - 1 into the output buffers.
+static void *process_rows_blocking(void *data)
+{
+	struct rows_info *info = data;
+	struct frame_assembler *as = info->as;
+	const uint8_t *in = (const uint8_t *)RSTRING_PTR(as->data);
+	uint8_t **views = as->out.views;
+
+	if(as->out.depth) {
+		ku_unpack11_to_16_buf(
+				in + info->y0 * PACKED_ROW,
+				as->out.depth + info->y0 * 640,
+				(info->y1 - info->y0) * PACKED_ROW
+				);
+	}
+
+	if(views[KU_VIEW_LINEAR] || views[KU_VIEW_OVERHEAD] || views[KU_VIEW_SIDE] || views[KU_VIEW_FRONT]) {
+		plot_views11_rows(in, info->y0, info->y1,
+				views[KU_VIEW_LINEAR], views[KU_VIEW_OVERHEAD], views[KU_VIEW_SIDE], views[KU_VIEW_FRONT]);
+	}
+
+	return NULL;
+}
+
+// Processes any complete rows not yet processed, if there are at least
+// batch_rows of them or the frame is complete.
+static void process_rows(struct frame_assembler *as)
+{
+	struct rows_info info = { .as = as, .y0 = as->rows_done, .y1 = as->received / PACKED_ROW };
+
+	if(info.y1 - info.y0 < (as->received == KU_PACKED_SIZE ? 1 : as->batch_rows)) {
+		return;
+	}
+
+	if(!NIL_P(as->ctx)) {
+		rb_thread_call_without_gvl(process_rows_blocking, &info, NULL, NULL);
+	}
+	as->rows_done = info.y1;
+}
+
+// Starts a new frame in the same outputs, clearing the accumulated views.
+static void rewind_frame(struct frame_assembler *as)
+{
+	int i;
+
+	as->received = 0;
+	as->rows_done = 0;
+
+	// The linear view and depth image are overwritten row by row
+	for(i = KU_VIEW_OVERHEAD; i < KU_VIEW_COUNT; i++) {
+		if(as->out.views[i]) {
+			memset(as->out.views[i], 0, ku_view_sizes[i]);
+		}
+	}
+}
+
+// Discards any bytes received so far, so the assembler's next bytes start a
+// new frame in the same outputs.
+void ku_frame_assembler_rewind(VALUE self)
+{
+	rewind_frame(get_assembler(self));
+}
+
+// Adds up to len bytes at p to the frame, processing complete rows as they
+// arrive.  Returns the number of bytes used, which is less than len once the
+// frame is complete.
+long ku_frame_assembler_add(VALUE self, const char *p, long len)
+{
+	struct frame_assembler *as = get_assembler(self);
+
+	if(len > KU_PACKED_SIZE - as->received) {
+		len = KU_PACKED_SIZE - as->received;
+	}
+	if(len == 0) {
+		return 0;
+	}
+	if(RSTRING_LEN(as->data) != KU_PACKED_SIZE) {
+		rb_raise(rb_eRuntimeError, "FrameAssembler buffer was resized.");
+	}
+
+	memcpy(RSTRING_PTR(as->data) + as->received, p, len);
+	as->received += len;
+	process_rows(as);
+
+	return len;
+}
+
+// Initializes an assembler that processes rows in batches of at least
+// +rows+ (default 16), balancing per-batch overhead against how much is left
+// to do when the last byte arrives.
+static VALUE frame_assembler_initialize(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[1];
+	struct frame_assembler *as;
+	VALUE opts, kw[1];
+
+	TypedData_Get_Struct(self, struct frame_assembler, &frame_assembler_type, as);
+
+	if(!kw_ids[0]) {
+		kw_ids[0] = rb_intern("rows");
+	}
+
+	rb_scan_args(argc, argv, "0:", &opts);
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, 1, kw);
+		if(kw[0] != Qundef) {
+			as->batch_rows = NUM2INT(kw[0]);
+			if(as->batch_rows < 1 || as->batch_rows > 480) {
+				rb_raise(rb_eArgError, "FrameAssembler batch size must be from 1 to 480 rows (got %d).", as->batch_rows);
+			}
+		}
+	}
+
+	// Hidden so Ruby code can never resize the buffer rows are copied into
+	as->data = rb_obj_hide(ku_output_buffer(Qnil, KU_PACKED_SIZE));
+
+	return self;
+}
+
+// Starts assembling a new frame into the given FrameContext, which stays
+// busy until #finish.  The :depth keyword unpacks the frame into the
+// context's #depth buffer, and :linear, :overhead, :side, and :front plot
+// those views into the context's view buffers.  Returns self.
+static VALUE frame_assembler_start(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[KU_VIEW_COUNT + 1];
+	static const char *names[KU_VIEW_COUNT + 1] = { "depth", "linear", "overhead", "side", "front" };
+	struct frame_assembler *as = get_assembler(self);
+	struct ku_frame_buffers bufs;
+	VALUE ctx, opts, kw[KU_VIEW_COUNT + 1];
+	int i;
+
+	if(!kw_ids[0]) {
+		for(i = 0; i <= KU_VIEW_COUNT; i++) {
+			kw_ids[i] = rb_intern(names[i]);
+		}
+	}
+
+	rb_scan_args(argc, argv, "1:", &ctx, &opts);
+	for(i = 0; i <= KU_VIEW_COUNT; i++) {
+		kw[i] = Qundef;
+	}
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, KU_VIEW_COUNT + 1, kw);
+	}
+
+	if(!NIL_P(as->ctx)) {
+		rb_raise(rb_eRuntimeError, "FrameAssembler is already assembling a frame; call #finish first.");
+	}
+
+	ku_frame_context_begin(ctx, as->data, &bufs);
+	as->ctx = ctx;
+	as->out.depth = (kw[0] != Qundef && RTEST(kw[0])) ? bufs.depth : NULL;
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		as->out.views[i] = (kw[i + 1] != Qundef && RTEST(kw[i + 1])) ? bufs.views[i] : NULL;
+	}
+
+	rewind_frame(as);
+
+	return self;
+}
+
+// Adds a chunk of packed frame data, processing any complete rows.  Returns
+// the number of bytes used, which is less than the chunk's length once the
+// frame is complete.
+static VALUE frame_assembler_add(VALUE self, VALUE chunk)
+{
+	StringValue(chunk);
+	return LONG2NUM(ku_frame_assembler_add(self, RSTRING_PTR(chunk), RSTRING_LEN(chunk)));
+}
+
+// Returns true once all 640*480*11/8 bytes of the frame have been added.
+static VALUE frame_assembler_complete(VALUE self)
+{
+	return get_assembler(self)->received == KU_PACKED_SIZE ? Qtrue : Qfalse;
+}
+
+// Returns the number of bytes added to the current frame.
+static VALUE frame_assembler_received(VALUE self)
+{
+	return LONG2NUM(get_assembler(self)->received);
+}
+
+// Returns a copy of the #received bytes of the current frame.
+static VALUE frame_assembler_data(VALUE self)
+{
+	struct frame_assembler *as = get_assembler(self);
+	return rb_str_new(RSTRING_PTR(as->data), as->received);
+}
+
+// Returns the FrameContext given to #start, or nil.
+static VALUE frame_assembler_context(VALUE self)
+{
+	return get_assembler(self)->ctx;
+}
+
+// Finishes the frame started by #start, marking its FrameContext idle again,
+// and returns the context (or nil if there was none).  The context's buffers
+// are only complete if the frame was.  The next bytes added start a new
+// frame without outputs, until #start is called again.
+static VALUE frame_assembler_finish(VALUE self)
+{
+	struct frame_assembler *as = get_assembler(self);
+	VALUE ctx = as->ctx;
+
+	if(!NIL_P(ctx)) {
+		ku_frame_context_end(ctx);
+	}
+
+	as->ctx = Qnil;
+	memset(&as->out, 0, sizeof(as->out));
+	as->received = 0;
+	as->rows_done = 0;
+
+	return ctx;
+}
+
+// Defines the Kinutils::FrameAssembler class.
+void init_frame_assembler(VALUE kinutils)
+{
+	FrameAssembler = rb_define_class_under(kinutils, "FrameAssembler", rb_cObject);
+	rb_define_alloc_func(FrameAssembler, frame_assembler_alloc);
+
+	rb_define_method(FrameAssembler, "initialize", frame_assembler_initialize, -1);
+	rb_define_method(FrameAssembler, "start", frame_assembler_start, -1);
+	rb_define_method(FrameAssembler, "add", frame_assembler_add, 1);
+	rb_define_method(FrameAssembler, "complete?", frame_assembler_complete, 0);
+	rb_define_method(FrameAssembler, "received", frame_assembler_received, 0);
+	rb_define_method(FrameAssembler, "data", frame_assembler_data, 0);
+	rb_define_method(FrameAssembler, "context", frame_assembler_context, 0);
+	rb_define_method(FrameAssembler, "finish", frame_assembler_finish, 0);
+}
@@ -0,0 +1,415 @@
+/*
+ * Reusable per-frame buffers for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * A FrameContext owns one preallocated buffer for the unpacked depth frame
+ * and one for each view.  Processing a frame overwrites those buffers in
+ * place, so steady-state processing allocates no Ruby objects.  Because the
+ * views persist, #plot_incremental can update them from one frame to the next
+ * by replotting only the pixels that changed.
+ */
+#include <string.h>
+#include <ruby.h>
+#include <ruby/thread.h>
+
+#include "unpack.h"
+#include "kinutils.h"
+
+struct frame_context {
+	VALUE depth;
+	VALUE views[KU_VIEW_COUNT];
+	struct ku_plot_state *plot_state; // Allocated by the first #plot_incremental
+	int busy;
+};
+
+struct incremental_info {
+	struct ku_plot_state *state;
+	const uint8_t *in;
+	uint8_t *views[KU_VIEW_COUNT];
+	int changed;
+};
+
+static VALUE FrameContext = Qnil;
+
+static void frame_context_mark(void *data)
+{
+	struct frame_context *ctx = data;
+	int i;
+
+	// rb_gc_mark() pins the buffers so compaction never moves them
+	rb_gc_mark(ctx->depth);
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		rb_gc_mark(ctx->views[i]);
+	}
+}
+
+static void frame_context_free(void *data)
+{
+	struct frame_context *ctx = data;
+	xfree(ctx->plot_state);
+	xfree(ctx);
+}
+
+static size_t frame_context_size(const void *data)
+{
+	const struct frame_context *ctx = data;
+	return sizeof(struct frame_context) + (ctx->plot_state ? sizeof(struct ku_plot_state) : 0);
+}
+
+static const rb_data_type_t frame_context_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::FrameContext",
+	.function = {
+		.dmark = frame_context_mark,
+		.dfree = frame_context_free,
+		.dsize = frame_context_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE frame_context_alloc(VALUE klass)
+{
+	struct frame_context *ctx;
+	VALUE obj = TypedData_Make_Struct(klass, struct frame_context, &frame_context_type, ctx);
+	int i;
+
+	ctx->depth = Qnil;
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		ctx->views[i] = Qnil;
+	}
+
+	return obj;
+}
+
+static struct frame_context *get_context(VALUE self)
+{
+	struct frame_context *ctx;
+	TypedData_Get_Struct(self, struct frame_context, &frame_context_type, ctx);
+	if(NIL_P(ctx->depth)) {
+		rb_raise(rb_eRuntimeError, "FrameContext was not initialized.");
+	}
+	return ctx;
+}
+
+// Raises an error if the context is already processing a frame in another
+// thread, then marks it busy.
+static void begin_frame(struct frame_context *ctx, VALUE data)
+{
+	Check_Type(data, T_STRING);
+	if(RSTRING_LEN(data) < KU_PACKED_SIZE) {
+		rb_raise(rb_eArgError, "Input data must be at least 640*480*11/8 bytes (got %ld).", RSTRING_LEN(data));
+	}
+
+	if(ctx->busy) {
+		rb_raise(rb_eRuntimeError, "FrameContext is already processing a frame in another thread.");
+	}
+	ctx->busy = 1;
+}
+
+// Forces the next #plot_incremental to replot every point, for when the
+// context's own view buffers are about to be overwritten by something else.
+static void invalidate_views(struct frame_context *ctx)
+{
+	if(ctx->plot_state) {
+		ku_plot_state_reset(ctx->plot_state);
+	}
+}
+
+// Allocates a frozen buffer of len bytes that will be overwritten in place.
+static VALUE new_frozen_buffer(long len)
+{
+	VALUE buf = ku_output_buffer(Qnil, len);
+	memset(RSTRING_PTR(buf), 0, len);
+	return rb_obj_freeze(buf);
+}
+
+// Allocates the context's buffers.
+static VALUE frame_context_initialize(VALUE self)
+{
+	struct frame_context *ctx;
+	int i;
+
+	TypedData_Get_Struct(self, struct frame_context, &frame_context_type, ctx);
+
+	ctx->depth = new_frozen_buffer(KU_UNPACKED_SIZE);
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		ctx->views[i] = new_frozen_buffer(ku_view_sizes[i]);
+	}
+
+	return self;
+}
+
+// Unpacks a packed 11-bit depth frame to 16-bit left-aligned values (like
+// Kinutils.unpack11_to_16).  Writes into the given output string if one is
+// given, or into the context's own #depth buffer otherwise.  Returns the
+// output string.
+static VALUE frame_context_unpack(int argc, VALUE *argv, VALUE self)
+{
+	struct frame_context *ctx = get_context(self);
+	VALUE data, out;
+
+	rb_scan_args(argc, argv, "11", &data, &out);
+
+	out = NIL_P(out) ? ctx->depth : ku_output_buffer(out, KU_UNPACKED_SIZE);
+
+	begin_frame(ctx, data);
+	ku_unpack_string(0, data, KU_PACKED_SIZE, out);
+	ctx->busy = 0;
+
+	return out;
+}
+
+// Common code for plotting a single view from packed data.
+static VALUE plot_view(enum ku_view view, int argc, VALUE *argv, VALUE self)
+{
+	struct frame_context *ctx = get_context(self);
+	VALUE data, out;
+
+	rb_scan_args(argc, argv, "11", &data, &out);
+
+	out = NIL_P(out) ? ctx->views[view] : ku_output_buffer(out, ku_view_sizes[view]);
+
+	// Incremental state is only discarded once the context is known to be
+	// idle, since #plot_incremental may be using it without the GVL
+	begin_frame(ctx, data);
+	if(out == ctx->views[view]) {
+		invalidate_views(ctx);
+	}
+	ku_plot11_string(data, out, view);
+	ctx->busy = 0;
+
+	return out;
+}
+
+// Plots the linear view of a packed 11-bit depth frame.  Writes into the given
+// output string if one is given, or into the context's own #linear buffer
+// otherwise.  Returns the output string.
+static VALUE frame_context_plot_linear(int argc, VALUE *argv, VALUE self)
+{
+	return plot_view(KU_VIEW_LINEAR, argc, argv, self);
+}
+
+// Plots the overhead view of a packed 11-bit depth frame.  Writes into the
+// given output string if one is given, or into the context's own #overhead
+// buffer otherwise.  Returns the output string.
+static VALUE frame_context_plot_overhead(int argc, VALUE *argv, VALUE self)
+{
+	return plot_view(KU_VIEW_OVERHEAD, argc, argv, self);
+}
+
+// Plots the side view of a packed 11-bit depth frame.  Writes into the given
+// output string if one is given, or into the context's own #side buffer
+// otherwise.  Returns the output string.
+static VALUE frame_context_plot_side(int argc, VALUE *argv, VALUE self)
+{
+	return plot_view(KU_VIEW_SIDE, argc, argv, self);
+}
+
+// Plots the front view of a packed 11-bit depth frame.  Writes into the given
+// output string if one is given, or into the context's own #front buffer
+// otherwise.  Returns the output string.
+static VALUE frame_context_plot_front(int argc, VALUE *argv, VALUE self)
+{
+	return plot_view(KU_VIEW_FRONT, argc, argv, self);
+}
+
+// Plots several views of a packed 11-bit depth frame in a single pass (like
+// Kinutils.plot_views11).  Views are selected with the :linear, :overhead,
+// :side, and :front keyword arguments.  A value of true plots into the
+// context's own buffer for that view; a String plots into that string
+// instead.  Returns self.
+//
+// Views may also be given as Symbol arguments, which plots into the
+// context's own buffers without allocating an options Hash:
+//     ctx.plot_views(data, :overhead, :side)
+static VALUE frame_context_plot_views(int argc, VALUE *argv, VALUE self)
+{
+	static const char *names[KU_VIEW_COUNT] = { "linear", "overhead", "side", "front" };
+	static ID view_ids[KU_VIEW_COUNT];
+	struct frame_context *ctx = get_context(self);
+	VALUE data, views[KU_VIEW_COUNT];
+	uint8_t *out[KU_VIEW_COUNT] = { NULL, NULL, NULL, NULL };
+	int i, v, own = 0;
+
+	if(!view_ids[0]) {
+		for(v = 0; v < KU_VIEW_COUNT; v++) {
+			view_ids[v] = rb_intern(names[v]);
+		}
+	}
+
+	rb_check_arity(argc, 1, UNLIMITED_ARGUMENTS);
+	data = argv[0];
+
+	if(argc > 1 && RB_TYPE_P(argv[argc - 1], T_HASH)) {
+		ku_view_options(argv[argc - 1], views);
+		argc--;
+	} else {
+		ku_view_options(Qnil, views);
+	}
+
+	for(i = 1; i < argc; i++) {
+		for(v = 0; v < KU_VIEW_COUNT; v++) {
+			if(argv[i] == ID2SYM(view_ids[v])) {
+				views[v] = Qtrue;
+				break;
+			}
+		}
+		if(v == KU_VIEW_COUNT) {
+			rb_raise(rb_eArgError, "Unknown view %"PRIsVALUE".", rb_inspect(argv[i]));
+		}
+	}
+
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		if(views[i] == Qtrue) {
+			out[i] = (uint8_t *)RSTRING_PTR(ctx->views[i]);
+			own = 1;
+		} else if(views[i] != Qundef && RTEST(views[i])) {
+			out[i] = (uint8_t *)RSTRING_PTR(ku_output_buffer(views[i], ku_view_sizes[i]));
+		}
+	}
+
+	begin_frame(ctx, data);
+	if(own) {
+		invalidate_views(ctx);
+	}
+	rb_thread_call_without_gvl(
+			plot_views_blocking,
+			&(struct views_info){
+				.in = RSTRING_PTR(data), .packed = 1,
+				.linear = out[KU_VIEW_LINEAR], .overhead = out[KU_VIEW_OVERHEAD],
+				.side = out[KU_VIEW_SIDE], .front = out[KU_VIEW_FRONT]
+			},
+			NULL,
+			NULL
+			);
+	ctx->busy = 0;
+
+	return self;
+}
+
+static void *plot_incremental_blocking(void *data)
+{
+	struct incremental_info *info = data;
+
+	info->changed = plot_views11_incremental(
+			info->state, info->in,
+			info->views[KU_VIEW_LINEAR], info->views[KU_VIEW_OVERHEAD],
+			info->views[KU_VIEW_SIDE], info->views[KU_VIEW_FRONT]
+			);
+
+	return NULL;
+}
+
+// Plots all four views of a packed 11-bit depth frame into the context's own
+// buffers, replotting only the pixels whose depth changed since the last
+// call.  In a mostly static scene this is several times faster than
+// #plot_views.  The first call, and the first call after #plot_views or a
+// plot_* method writes to the context's buffers, plots every point.  Returns
+// the number of depth pixels that changed.
+static VALUE frame_context_plot_incremental(VALUE self, VALUE data)
+{
+	struct frame_context *ctx = get_context(self);
+	struct incremental_info info;
+	int i;
+
+	if(ctx->plot_state == NULL) {
+		ctx->plot_state = ALLOC(struct ku_plot_state);
+		ku_plot_state_reset(ctx->plot_state);
+	}
+
+	begin_frame(ctx, data);
+
+	info.state = ctx->plot_state;
+	info.in = (uint8_t *)RSTRING_PTR(data);
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		info.views[i] = (uint8_t *)RSTRING_PTR(ctx->views[i]);
+	}
+
+	rb_thread_call_without_gvl(plot_incremental_blocking, &info, NULL, NULL);
+	ctx->busy = 0;
+
+	return INT2FIX(info.changed);
+}
+
+// Marks a FrameContext busy for processing data outside of Ruby, raising an
+// error if it is already busy, and fills bufs with pointers to its buffers.
+// Views written this way are fully replotted by the next #plot_incremental.
+// Call ku_frame_context_end() when done.
+void ku_frame_context_begin(VALUE self, VALUE data, struct ku_frame_buffers *bufs)
+{
+	struct frame_context *ctx = get_context(self);
+	int i;
+
+	begin_frame(ctx, data);
+	invalidate_views(ctx);
+
+	bufs->depth = (uint16_t *)RSTRING_PTR(ctx->depth);
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		bufs->views[i] = (uint8_t *)RSTRING_PTR(ctx->views[i]);
+	}
+}
+
+// Marks a FrameContext given to ku_frame_context_begin() idle again.
+void ku_frame_context_end(VALUE self)
+{
+	get_context(self)->busy = 0;
+}
+
+// Returns the context's frozen 16-bit depth buffer (640x480x16bit).  The
+// contents are overwritten by the next call to #unpack.
+//
+// Ruby copies of a frozen String (dup, +@, String.new) share its memory, so
+// they will change too.  Use an output string argument for data that must
+// outlive the current frame.
+static VALUE frame_context_depth(VALUE self)
+{
+	return get_context(self)->depth;
+}
+
+// Returns the context's frozen linear view buffer (640x480 8-bit).  See
+// #depth regarding the lifetime of the contents.
+static VALUE frame_context_linear(VALUE self)
+{
+	return get_context(self)->views[KU_VIEW_LINEAR];
+}
+
+// Returns the context's frozen overhead view buffer (XPIXxZPIX 8-bit).  See
+// #depth regarding the lifetime of the contents.
+static VALUE frame_context_overhead(VALUE self)
+{
+	return get_context(self)->views[KU_VIEW_OVERHEAD];
+}
+
+// Returns the context's frozen side view buffer (ZPIXxYPIX 8-bit).  See
+// #depth regarding the lifetime of the contents.
+static VALUE frame_context_side(VALUE self)
+{
+	return get_context(self)->views[KU_VIEW_SIDE];
+}
+
+// Returns the context's frozen front view buffer (XPIXxYPIX 8-bit).  See
+// #depth regarding the lifetime of the contents.
+static VALUE frame_context_front(VALUE self)
+{
+	return get_context(self)->views[KU_VIEW_FRONT];
+}
+
+void init_frame_context(VALUE kinutils)
+{
+	FrameContext = rb_define_class_under(kinutils, "FrameContext", rb_cObject);
+	rb_define_alloc_func(FrameContext, frame_context_alloc);
+
+	rb_define_method(FrameContext, "initialize", frame_context_initialize, 0);
+	rb_define_method(FrameContext, "unpack", frame_context_unpack, -1);
+	rb_define_method(FrameContext, "plot_linear", frame_context_plot_linear, -1);
+	rb_define_method(FrameContext, "plot_overhead", frame_context_plot_overhead, -1);
+	rb_define_method(FrameContext, "plot_side", frame_context_plot_side, -1);
+	rb_define_method(FrameContext, "plot_front", frame_context_plot_front, -1);
+	rb_define_method(FrameContext, "plot_views", frame_context_plot_views, -1);
+	rb_define_method(FrameContext, "plot_incremental", frame_context_plot_incremental, 1);
+
+	rb_define_method(FrameContext, "depth", frame_context_depth, 0);
+	rb_define_method(FrameContext, "linear", frame_context_linear, 0);
+	rb_define_method(FrameContext, "overhead", frame_context_overhead, 0);
+	rb_define_method(FrameContext, "side", frame_context_side, 0);
+	rb_define_method(FrameContext, "front", frame_context_front, 0);
+}
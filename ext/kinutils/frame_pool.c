@@ -0,0 +1,707 @@
+/*
+ * Native worker pool for depth frame processing in the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * A FramePool unpacks and plots depth frames into FrameContexts on its own
+ * threads, which never touch Ruby objects or the GVL.  Finished frames are
+ * signaled through an eventfd (or a pipe where eventfd is unavailable), so an
+ * event loop can watch #io and collect them with #each_completed instead of
+ * waking a Ruby thread for every frame.  The number of frames in the pool is
+ * bounded, so a slow consumer causes #submit to refuse frames rather than
+ * letting them pile up.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <ruby.h>
+#include <ruby/thread.h>
+
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#include "unpack.h"
+#include "plot_threads.h"
+#include "kinutils.h"
+
+#define MAX_POOL_THREADS 16
+#define MAX_POOL_QUEUE 256
+
+enum job_state {
+	JOB_FREE,
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_DONE
+};
+
+struct frame_job {
+	enum job_state state;
+	unsigned long seq;
+	VALUE ctx;
+	VALUE data; // Frozen copy of the packed frame
+	VALUE tag;
+	const uint8_t *in;
+	struct ku_frame_buffers out; // NULL buffers are skipped
+};
+
+struct frame_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t threads[MAX_POOL_THREADS];
+	int thread_count; // Threads currently running
+	int threads_wanted;
+	struct frame_job *jobs;
+	int queue;
+	unsigned long next_seq; // Sequence number for the next submitted frame
+	unsigned long next_done; // Sequence number of the next frame to collect
+	int stopping;
+	int read_fd; // Becomes readable when a frame finishes
+	int write_fd; // Same as read_fd for eventfd
+	VALUE io;
+	pid_t pid;
+	int closed;
+	struct frame_pool *prev_open, *next_open; // Links in open_pools
+	int listed; // Nonzero if in open_pools
+};
+
+static VALUE FramePool = Qnil;
+
+// Pools whose workers may be running.  A pool's jobs are marked through
+// pool_registry instead of the pool itself, so an unclosed pool that becomes
+// garbage can't have its FrameContexts and data freed in the same sweep,
+// before its dfree stops the workers writing into them.  The pool leaves the
+// list once its workers have stopped, and the objects are freed by a later
+// collection.
+static struct frame_pool *open_pools;
+static VALUE pool_registry = Qnil;
+
+// Marks the Ruby objects of each frame in the pool.  Only Ruby threads
+// change a job to or from JOB_FREE, so this is safe without the lock.
+// rb_gc_mark() pins the buffers the workers use.
+static void mark_jobs(struct frame_pool *pool)
+{
+	int i;
+
+	for(i = 0; i < pool->queue; i++) {
+		if(pool->jobs[i].state != JOB_FREE) {
+			rb_gc_mark(pool->jobs[i].ctx);
+			rb_gc_mark(pool->jobs[i].data);
+			rb_gc_mark(pool->jobs[i].tag);
+		}
+	}
+}
+
+static void pool_registry_mark(void *data)
+{
+	struct frame_pool *pool;
+
+	for(pool = *(struct frame_pool **)data; pool != NULL; pool = pool->next_open) {
+		mark_jobs(pool);
+	}
+}
+
+static const rb_data_type_t pool_registry_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::FramePool registry",
+	.function = {
+		.dmark = pool_registry_mark,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+// Adds the pool to open_pools.
+static void list_pool(struct frame_pool *pool)
+{
+	pool->prev_open = NULL;
+	pool->next_open = open_pools;
+	if(open_pools != NULL) {
+		open_pools->prev_open = pool;
+	}
+	open_pools = pool;
+	pool->listed = 1;
+}
+
+// Removes the pool from open_pools, if it is there.  Its workers must be
+// stopped.
+static void unlist_pool(struct frame_pool *pool)
+{
+	if(!pool->listed) {
+		return;
+	}
+
+	if(pool->prev_open != NULL) {
+		pool->prev_open->next_open = pool->next_open;
+	} else {
+		open_pools = pool->next_open;
+	}
+	if(pool->next_open != NULL) {
+		pool->next_open->prev_open = pool->prev_open;
+	}
+	pool->prev_open = NULL;
+	pool->next_open = NULL;
+	pool->listed = 0;
+}
+
+static void frame_pool_mark(void *data)
+{
+	struct frame_pool *pool = data;
+
+	// Jobs are marked by pool_registry while the pool is open
+	if(!pool->listed && pool->jobs) {
+		mark_jobs(pool);
+	}
+	rb_gc_mark(pool->io);
+}
+
+// Tells the workers to exit and waits for them.
+static void *stop_threads(void *data)
+{
+	struct frame_pool *pool = data;
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(i = 0; i < pool->thread_count; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	pool->thread_count = 0;
+	pool->stopping = 0;
+
+	return NULL;
+}
+
+static void close_fds(struct frame_pool *pool)
+{
+	if(pool->write_fd >= 0 && pool->write_fd != pool->read_fd) {
+		close(pool->write_fd);
+	}
+	if(pool->read_fd >= 0) {
+		close(pool->read_fd);
+	}
+	pool->read_fd = -1;
+	pool->write_fd = -1;
+}
+
+static void frame_pool_free(void *data)
+{
+	struct frame_pool *pool = data;
+
+	if(!pool->closed && pool->pid == getpid()) {
+		stop_threads(pool);
+		close_fds(pool);
+	}
+	unlist_pool(pool);
+	if(pool->jobs) {
+		pthread_mutex_destroy(&pool->lock);
+		pthread_cond_destroy(&pool->cond);
+	}
+	xfree(pool->jobs);
+	xfree(pool);
+}
+
+static size_t frame_pool_size(const void *data)
+{
+	const struct frame_pool *pool = data;
+	return sizeof(struct frame_pool) + pool->queue * sizeof(struct frame_job);
+}
+
+static const rb_data_type_t frame_pool_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::FramePool",
+	.function = {
+		.dmark = frame_pool_mark,
+		.dfree = frame_pool_free,
+		.dsize = frame_pool_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE frame_pool_alloc(VALUE klass)
+{
+	struct frame_pool *pool;
+	VALUE obj = TypedData_Make_Struct(klass, struct frame_pool, &frame_pool_type, pool);
+
+	pool->read_fd = -1;
+	pool->write_fd = -1;
+	pool->io = Qnil;
+	pool->closed = 1;
+
+	return obj;
+}
+
+// Signals the completion file descriptor.  A full pipe is already readable,
+// so errors are ignored.
+static void notify(struct frame_pool *pool)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	uint64_t one = 1;
+	ssize_t ret = write(pool->write_fd, &one, sizeof(one));
+#else
+	ssize_t ret = write(pool->write_fd, "", 1);
+#endif
+	(void)ret;
+}
+
+// Clears the completion file descriptor.
+static void drain(struct frame_pool *pool)
+{
+	char buf[64];
+
+	while(read(pool->read_fd, buf, sizeof(buf)) > 0) {
+	}
+}
+
+// Unpacks and plots one frame.
+static void process_job(struct frame_job *job)
+{
+	uint8_t **views = job->out.views;
+
+	if(job->out.depth) {
+		ku_unpack11_to_16_buf(job->in, job->out.depth, KU_PACKED_SIZE);
+	}
+
+	if(views[KU_VIEW_LINEAR] || views[KU_VIEW_OVERHEAD] || views[KU_VIEW_SIDE] || views[KU_VIEW_FRONT]) {
+		ku_plot_views_mt(job->in, 1, views[KU_VIEW_LINEAR], views[KU_VIEW_OVERHEAD], views[KU_VIEW_SIDE], views[KU_VIEW_FRONT]);
+	}
+}
+
+// Returns the oldest queued job, or NULL.  The caller must hold the lock.
+static struct frame_job *next_job(struct frame_pool *pool)
+{
+	struct frame_job *job = NULL;
+	int i;
+
+	for(i = 0; i < pool->queue; i++) {
+		if(pool->jobs[i].state == JOB_QUEUED && (job == NULL || pool->jobs[i].seq < job->seq)) {
+			job = &pool->jobs[i];
+		}
+	}
+
+	return job;
+}
+
+static void *worker_main(void *data)
+{
+	struct frame_pool *pool = data;
+	struct frame_job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		while((job = next_job(pool)) == NULL && !pool->stopping) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+		if(pool->stopping) {
+			break;
+		}
+		job->state = JOB_RUNNING;
+
+		pthread_mutex_unlock(&pool->lock);
+		process_job(job);
+		pthread_mutex_lock(&pool->lock);
+
+		job->state = JOB_DONE;
+		notify(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+// Creates the completion file descriptor.  Returns 0 on success, or -1 with
+// errno set.
+static int open_fds(struct frame_pool *pool)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+	pool->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(pool->read_fd < 0) {
+		return -1;
+	}
+	pool->write_fd = pool->read_fd;
+#else
+	int fds[2];
+
+	if(pipe(fds)) {
+		return -1;
+	}
+	pool->read_fd = fds[0];
+	pool->write_fd = fds[1];
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+	return 0;
+}
+
+// Starts the pool's worker threads.  Returns 0 on success, or an error
+// number.
+static int start_threads(struct frame_pool *pool)
+{
+	sigset_t all, old;
+	int ret = 0;
+
+	// Workers never handle signals; leave them to the application's threads
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	while(pool->thread_count < pool->threads_wanted) {
+		ret = pthread_create(&pool->threads[pool->thread_count], NULL, worker_main, pool);
+		if(ret) {
+			break;
+		}
+		pool->thread_count++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	return ret;
+}
+
+// Drops every frame in the pool, marking its FrameContext idle again.  The
+// workers must be stopped.
+static void clear_jobs(struct frame_pool *pool)
+{
+	int i;
+
+	for(i = 0; i < pool->queue; i++) {
+		if(pool->jobs[i].state != JOB_FREE) {
+			pool->jobs[i].state = JOB_FREE;
+			ku_frame_context_end(pool->jobs[i].ctx);
+		}
+	}
+	pool->next_done = pool->next_seq;
+}
+
+// Worker threads and the completion descriptor are not shared with a forked
+// child, so the child drops any frames in progress and starts over.
+static void restart_after_fork(struct frame_pool *pool)
+{
+	int ret;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->thread_count = 0;
+	pool->stopping = 0;
+	pool->pid = getpid();
+	pool->io = Qnil;
+
+	clear_jobs(pool);
+	close_fds(pool);
+
+	if(open_fds(pool)) {
+		pool->closed = 1;
+		rb_sys_fail("Error creating FramePool notification descriptor");
+	}
+
+	ret = start_threads(pool);
+	if(ret) {
+		errno = ret;
+		rb_sys_fail("Error starting FramePool threads");
+	}
+}
+
+static struct frame_pool *get_pool(VALUE self)
+{
+	struct frame_pool *pool;
+
+	TypedData_Get_Struct(self, struct frame_pool, &frame_pool_type, pool);
+	if(pool->closed) {
+		rb_raise(rb_eRuntimeError, "FramePool is closed.");
+	}
+	if(pool->pid != getpid()) {
+		restart_after_fork(pool);
+	}
+
+	return pool;
+}
+
+// Initializes a pool that processes frames on +threads+ native threads
+// (default 2), holding at most +queue+ frames (default 4) that are waiting,
+// being processed, or finished but not yet collected by #each_completed.
+static VALUE frame_pool_initialize(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[2];
+	struct frame_pool *pool;
+	VALUE opts, kw[2];
+	int threads = 2, queue = 4;
+	int ret;
+
+	TypedData_Get_Struct(self, struct frame_pool, &frame_pool_type, pool);
+	if(pool->jobs) {
+		rb_raise(rb_eRuntimeError, "FramePool is already initialized.");
+	}
+
+	if(!kw_ids[0]) {
+		kw_ids[0] = rb_intern("threads");
+		kw_ids[1] = rb_intern("queue");
+	}
+
+	rb_scan_args(argc, argv, "0:", &opts);
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, 2, kw);
+		if(kw[0] != Qundef) {
+			threads = NUM2INT(kw[0]);
+		}
+		if(kw[1] != Qundef) {
+			queue = NUM2INT(kw[1]);
+		}
+	}
+
+	if(threads < 1 || threads > MAX_POOL_THREADS) {
+		rb_raise(rb_eArgError, "FramePool thread count must be from 1 to %d (got %d).", MAX_POOL_THREADS, threads);
+	}
+	if(queue < 1 || queue > MAX_POOL_QUEUE) {
+		rb_raise(rb_eArgError, "FramePool queue depth must be from 1 to %d (got %d).", MAX_POOL_QUEUE, queue);
+	}
+
+	if(open_fds(pool)) {
+		rb_sys_fail("Error creating FramePool notification descriptor");
+	}
+
+	pool->jobs = ALLOC_N(struct frame_job, queue);
+	memset(pool->jobs, 0, queue * sizeof(struct frame_job));
+	pool->queue = queue;
+	pool->threads_wanted = threads;
+	pool->pid = getpid();
+	pool->closed = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	ret = start_threads(pool);
+	if(ret) {
+		rb_thread_call_without_gvl(stop_threads, pool, NULL, NULL);
+		close_fds(pool);
+		pool->closed = 1;
+		errno = ret;
+		rb_sys_fail("Error starting FramePool threads");
+	}
+	list_pool(pool);
+
+	return self;
+}
+
+// Queues a packed 11-bit depth frame to be processed into the given
+// FrameContext, which stays busy until the frame is yielded by
+// #each_completed.  The :depth keyword unpacks the frame into the context's
+// #depth buffer, and :linear, :overhead, :side, and :front plot those views
+// into the context's view buffers.  The optional +tag+ is yielded along with
+// the context.
+//
+// Returns true if the frame was queued, or false without touching the
+// context if the pool already holds its maximum number of frames.
+static VALUE frame_pool_submit(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[KU_VIEW_COUNT + 1];
+	static const char *names[KU_VIEW_COUNT + 1] = { "depth", "linear", "overhead", "side", "front" };
+	struct frame_pool *pool = get_pool(self);
+	struct frame_job *job = NULL;
+	struct ku_frame_buffers bufs;
+	VALUE ctx, data, tag, opts, kw[KU_VIEW_COUNT + 1];
+	int i;
+
+	if(!kw_ids[0]) {
+		for(i = 0; i <= KU_VIEW_COUNT; i++) {
+			kw_ids[i] = rb_intern(names[i]);
+		}
+	}
+
+	rb_scan_args(argc, argv, "21:", &ctx, &data, &tag, &opts);
+	for(i = 0; i <= KU_VIEW_COUNT; i++) {
+		kw[i] = Qundef;
+	}
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, KU_VIEW_COUNT + 1, kw);
+	}
+
+	for(i = 0; i < pool->queue; i++) {
+		if(pool->jobs[i].state == JOB_FREE) {
+			job = &pool->jobs[i];
+			break;
+		}
+	}
+	if(job == NULL) {
+		return Qfalse;
+	}
+
+	// A frozen copy shares the caller's bytes unless they are modified
+	data = rb_str_new_frozen(StringValue(data));
+	ku_frame_context_begin(ctx, data, &bufs);
+
+	job->ctx = ctx;
+	job->data = data;
+	job->tag = tag;
+	job->in = (const uint8_t *)RSTRING_PTR(data);
+	job->out.depth = (kw[0] != Qundef && RTEST(kw[0])) ? bufs.depth : NULL;
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		job->out.views[i] = (kw[i + 1] != Qundef && RTEST(kw[i + 1])) ? bufs.views[i] : NULL;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	job->seq = pool->next_seq++;
+	job->state = JOB_QUEUED;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	return Qtrue;
+}
+
+// Yields the FrameContext and tag of each finished frame, in the order the
+// frames were submitted, marking each context idle before it is yielded.
+// Also clears the notification on #io, so call this whenever #io becomes
+// readable.  Returns the number of frames yielded.
+static VALUE frame_pool_each_completed(VALUE self)
+{
+	struct frame_pool *pool = get_pool(self);
+	struct frame_job *job;
+	VALUE ctx, tag;
+	int i, count = 0;
+
+	rb_need_block();
+
+	drain(pool);
+
+	for(;;) {
+		job = NULL;
+
+		pthread_mutex_lock(&pool->lock);
+		for(i = 0; i < pool->queue; i++) {
+			if(pool->jobs[i].state == JOB_DONE && pool->jobs[i].seq == pool->next_done) {
+				job = &pool->jobs[i];
+				break;
+			}
+		}
+		if(job != NULL) {
+			pool->next_done++;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		if(job == NULL) {
+			break;
+		}
+
+		ctx = job->ctx;
+		tag = job->tag;
+		job->state = JOB_FREE;
+		job->data = Qnil;
+		job->tag = Qnil;
+
+		ku_frame_context_end(ctx);
+		rb_yield_values(2, ctx, tag);
+		count++;
+	}
+
+	return INT2FIX(count);
+}
+
+// Returns the number of frames in the pool, whether waiting, being processed,
+// or finished but not yet collected.
+static VALUE frame_pool_pending(VALUE self)
+{
+	struct frame_pool *pool = get_pool(self);
+	int i, count = 0;
+
+	for(i = 0; i < pool->queue; i++) {
+		if(pool->jobs[i].state != JOB_FREE) {
+			count++;
+		}
+	}
+
+	return INT2FIX(count);
+}
+
+// Returns the maximum number of frames the pool holds (see #pending).
+static VALUE frame_pool_queue(VALUE self)
+{
+	return INT2FIX(get_pool(self)->queue);
+}
+
+// Returns the number of worker threads.
+static VALUE frame_pool_threads(VALUE self)
+{
+	return INT2FIX(get_pool(self)->threads_wanted);
+}
+
+// Returns the file descriptor that becomes readable when a frame finishes.
+static VALUE frame_pool_fd(VALUE self)
+{
+	return INT2FIX(get_pool(self)->read_fd);
+}
+
+// Returns an IO for #fd, for use with IO.select or EM.watch.  The
+// descriptor belongs to the pool, and is closed by #close.
+static VALUE frame_pool_io(VALUE self)
+{
+	struct frame_pool *pool = get_pool(self);
+
+	if(NIL_P(pool->io)) {
+		pool->io = rb_funcall(rb_cIO, rb_intern("for_fd"), 2, INT2FIX(pool->read_fd), rb_str_new_cstr("rb"));
+		rb_funcall(pool->io, rb_intern("autoclose="), 1, Qfalse);
+	}
+
+	return pool->io;
+}
+
+// Stops the worker threads after their current frames, drops any frames
+// that have not been collected (marking their contexts idle), and closes
+// #io.  Detach any event loop watcher from #io first.  Does nothing if the
+// pool is already closed.
+static VALUE frame_pool_close(VALUE self)
+{
+	struct frame_pool *pool;
+
+	TypedData_Get_Struct(self, struct frame_pool, &frame_pool_type, pool);
+	if(pool->closed) {
+		return Qnil;
+	}
+	pool = get_pool(self);
+
+	rb_thread_call_without_gvl(stop_threads, pool, NULL, NULL);
+	clear_jobs(pool);
+	unlist_pool(pool);
+
+	if(!NIL_P(pool->io)) {
+		rb_funcall(pool->io, rb_intern("close"), 0);
+		pool->io = Qnil;
+	}
+	close_fds(pool);
+	pool->closed = 1;
+
+	return Qnil;
+}
+
+// Returns true if #close has been called.
+static VALUE frame_pool_closed(VALUE self)
+{
+	struct frame_pool *pool;
+
+	TypedData_Get_Struct(self, struct frame_pool, &frame_pool_type, pool);
+	return pool->closed ? Qtrue : Qfalse;
+}
+
+// Defines the Kinutils::FramePool class.
+void init_frame_pool(VALUE kinutils)
+{
+	// The GC skips dmark for a NULL data pointer
+	pool_registry = TypedData_Wrap_Struct(0, &pool_registry_type, &open_pools);
+	rb_gc_register_mark_object(pool_registry);
+
+	FramePool = rb_define_class_under(kinutils, "FramePool", rb_cObject);
+	rb_define_alloc_func(FramePool, frame_pool_alloc);
+
+	rb_define_method(FramePool, "initialize", frame_pool_initialize, -1);
+	rb_define_method(FramePool, "submit", frame_pool_submit, -1);
+	rb_define_method(FramePool, "each_completed", frame_pool_each_completed, 0);
+	rb_define_method(FramePool, "pending", frame_pool_pending, 0);
+	rb_define_method(FramePool, "queue", frame_pool_queue, 0);
+	rb_define_method(FramePool, "threads", frame_pool_threads, 0);
+	rb_define_method(FramePool, "fd", frame_pool_fd, 0);
+	rb_define_method(FramePool, "io", frame_pool_io, 0);
+	rb_define_method(FramePool, "close", frame_pool_close, 0);
+	rb_define_method(FramePool, "closed?", frame_pool_closed, 0);
+}
@@ -7,24 +7,15 @@
  * http://www.ruby-doc.org/docs/ProgrammingRuby/html/ext_ruby.html
  */
 #include <ctype.h>
+#include <string.h>
 #include <ruby.h>
 #include <ruby/encoding.h>
 #include <ruby/thread.h>
 #include <nlutils/nlutils.h>
 
 #include "unpack.h"
-
-struct plot_info {
-	const uint16_t *in;
-	uint8_t *out;
-};
-
-struct unpack_info {
-	const uint8_t *in;
-	uint16_t *out;
-	size_t len;
-	unsigned int lut_range:1;
-};
+#include "plot_threads.h"
+#include "kinutils.h"
 
 struct kvp_info {
 	VALUE hash;
@@ -35,39 +26,54 @@ struct kvp_info {
 VALUE KinUtils = Qnil;
 static rb_encoding *utf8;
 
+// Size in bytes of each view's 8-bit image.
+const long ku_view_sizes[KU_VIEW_COUNT] = { 640 * 480, XPIX * ZPIX, ZPIX * YPIX, XPIX * YPIX };
+
+// Prepares a Ruby string to receive len bytes of output.  If out is nil, a
+// new string is allocated.  Otherwise out must be a modifiable String, which
+// is resized to len bytes, set to binary encoding, and returned, so callers
+// can reuse an output string from frame to frame instead of allocating a new
+// one every time.
+VALUE ku_output_buffer(VALUE out, long len)
+{
+	if(NIL_P(out)) {
+		// It seems rb_str_buf_new() adds a byte for terminating NUL, but
+		// rb_str_resize() does not.
+		out = rb_str_buf_new(len - 1);
+		rb_str_resize(out, len);
+		return out;
+	}
+
+	Check_Type(out, T_STRING);
+	rb_str_modify(out);
+	rb_str_resize(out, len);
+	rb_enc_associate(out, rb_ascii8bit_encoding());
+
+	return out;
+}
+
 void *unpack_blocking(void *data)
 {
 	struct unpack_info *info = data;
-	size_t i, o;
 
 	if (info->lut_range) {
-		for(i = 0, o = 0; i < info->len; i += 11, o += 8) {
-			unpack11_to_16_lut(info->in + i, info->out + o);
-		}
+		ku_unpack11_to_16_lut_buf(info->in, info->out, info->len);
 	} else {
-		for(i = 0, o = 0; i < info->len; i += 11, o += 8) {
-			unpack11_to_16(info->in + i, info->out + o);
-		}
+		ku_unpack11_to_16_buf(info->in, info->out, info->len);
 	}
 
 	return NULL;
 }
 
-// Ruby function to unpack 11-bit depth data to 16-bit left-aligned or right-aligned values.
-static VALUE internal_unpack11_to_16(int lut_range, VALUE data)
+// Unpacks the first len bytes of 11-bit depth data from the data string to
+// 16-bit left-aligned or right-aligned values in outbuf, which must already be
+// len * 16 / 11 bytes long.  Releases the GVL while unpacking.
+void ku_unpack_string(int lut_range, VALUE data, size_t len, VALUE outbuf)
 {
-	size_t len, newlen;
-	VALUE outbuf;
+	size_t newlen = len * 16 / 11;
 
-	Check_Type(data, T_STRING);
-	len = RSTRING_LEN(data);
-	if(len < 11) {
-		rb_raise(rb_eArgError, "Input data must be at least 11 bytes long (got %zu).", len);
-	}
-
-	newlen = len * 16 / 11;
-	outbuf = rb_str_buf_new(newlen - 1);
-	rb_str_resize(outbuf, newlen); // Prevent GC from shrinking the buffer
+	// Bytes past the last complete 11-byte group are not unpacked
+	memset(RSTRING_PTR(outbuf) + len / 11 * 16, 0, newlen - len / 11 * 16);
 
 	rb_thread_call_without_gvl(
 			unpack_blocking,
@@ -75,37 +81,115 @@ static VALUE internal_unpack11_to_16(int lut_range, VALUE data)
 			NULL,
 			NULL
 			);
+}
+
+// Ruby function to unpack 11-bit depth data to 16-bit left-aligned or right-aligned values.
+static VALUE internal_unpack11_to_16(int lut_range, int argc, VALUE *argv)
+{
+	VALUE data, outbuf;
+	size_t len;
+
+	rb_scan_args(argc, argv, "11", &data, &outbuf);
+
+	Check_Type(data, T_STRING);
+	len = RSTRING_LEN(data);
+	if(len < 11) {
+		rb_raise(rb_eArgError, "Input data must be at least 11 bytes long (got %zu).", len);
+	}
+
+	outbuf = ku_output_buffer(outbuf, len * 16 / 11);
+	ku_unpack_string(lut_range, data, len, outbuf);
 
 	return outbuf;
 }
 
-// Unpacks to 16-bit left-aligned values (for presentation, or passing into plot_linear)
-VALUE rb_unpack11_to_16(VALUE self, VALUE data)
+// Unpacks to 16-bit left-aligned values (for presentation, or passing into
+// plot_linear).  An optional output string may be given for reuse.
+VALUE rb_unpack11_to_16(int argc, VALUE *argv, VALUE self)
 {
-	return internal_unpack11_to_16(0, data);
+	return internal_unpack11_to_16(0, argc, argv);
 }
 
-// Unpacks to 16-bit right-aligned values (for direct use in DEPTH_LUT)
-VALUE rb_unpack11_to_16_lut(VALUE self, VALUE data)
+// Unpacks to 16-bit right-aligned values (for direct use in DEPTH_LUT).  An
+// optional output string may be given for reuse.
+VALUE rb_unpack11_to_16_lut(int argc, VALUE *argv, VALUE self)
 {
-	return internal_unpack11_to_16(1, data);
+	return internal_unpack11_to_16(1, argc, argv);
 }
 
-void *plot_linear_blocking(void *data)
+// Returns the name of the unpacking implementation in use (e.g. "avx2").
+VALUE rb_unpack_impl(VALUE self)
 {
-	struct plot_info *info = data;
-	plot_linear(info->in, info->out);
-	return NULL;
+	return rb_str_new2(ku_unpack_impl());
 }
 
-// Ruby function to plot perspective view of linear depth data.  Input:
-// 640x480x16bit gray depth image.  Output: 640x480 8-bit gray image.
-VALUE rb_plot_linear(VALUE self, VALUE data)
+// Switches unpacking to the named implementation, which must be one of the
+// names in UNPACK_IMPLS.  This is mainly useful for testing and benchmarking;
+// the fastest supported implementation is selected at load time.
+VALUE rb_set_unpack_impl(VALUE self, VALUE name)
+{
+	if(ku_select_unpack(StringValueCStr(name))) {
+		rb_raise(rb_eArgError, "Unpacking implementation %s is not supported on this CPU.", StringValueCStr(name));
+	}
+
+	return name;
+}
+
+// Returns the number of threads used for plotting views (1 if plotting is
+// serial).
+VALUE rb_plot_threads(VALUE self)
+{
+	return INT2FIX(ku_plot_threads());
+}
+
+// Sets the number of threads used for plotting views, including the calling
+// thread.  Each thread plots a band of rows into a private image, and the
+// images are merged, giving output identical to serial plotting.  1 plots
+// serially (the default), and 0 uses one thread per online CPU.
+VALUE rb_set_plot_threads(VALUE self, VALUE count)
+{
+	int n = NUM2INT(count);
+
+	if(n < 0 || n > KU_MAX_PLOT_THREADS) {
+		rb_raise(rb_eArgError, "Plot thread count must be from 0 to %d (got %d).", KU_MAX_PLOT_THREADS, n);
+	}
+	if(ku_set_plot_threads(n)) {
+		rb_sys_fail("Error starting plot threads");
+	}
+
+	return count;
+}
+
+// Plots one view with the GVL released.
+static void plot_view_nogvl(const void *in, int packed, uint8_t *out, enum ku_view view)
 {
-	VALUE outbuf;
+	struct views_info info = { .in = in, .packed = !!packed };
+
+	switch(view) {
+		case KU_VIEW_LINEAR:
+			info.linear = out;
+			break;
+		case KU_VIEW_OVERHEAD:
+			info.overhead = out;
+			break;
+		case KU_VIEW_SIDE:
+			info.side = out;
+			break;
+		default:
+			info.front = out;
+			break;
+	}
+
+	rb_thread_call_without_gvl(plot_views_blocking, &info, NULL, NULL);
+}
+
+// Common code for plotting a single view from 16-bit depth data.
+static VALUE plot16(int argc, VALUE *argv, enum ku_view view)
+{
+	VALUE data, outbuf;
 	size_t len;
 
-	// TODO: Allow reusing a previously-allocated output string
+	rb_scan_args(argc, argv, "11", &data, &outbuf);
 
 	Check_Type(data, T_STRING);
 	len = RSTRING_LEN(data);
@@ -113,126 +197,294 @@ VALUE rb_plot_linear(VALUE self, VALUE data)
 		rb_raise(rb_eArgError, "Input data must be at least 640*480*2 bytes (got %zu).", len);
 	}
 
-	// It seems rb_str_buf_new() adds a byte for terminating NUL, but
-	// rb_str_resize() does not.
-	outbuf = rb_str_buf_new(640 * 480 - 1);
-	rb_str_resize(outbuf, 640 * 480);
+	outbuf = ku_output_buffer(outbuf, ku_view_sizes[view]);
+	plot_view_nogvl(RSTRING_PTR(data), 0, (uint8_t *)RSTRING_PTR(outbuf), view);
 
-	rb_thread_call_without_gvl(
-			plot_linear_blocking,
-			&(struct plot_info){.in = (uint16_t *)RSTRING_PTR(data), .out = (uint8_t *)RSTRING_PTR(outbuf)},
-			NULL,
-			NULL
-			);
 	return outbuf;
 }
 
-void *plot_overhead_blocking(void *data)
+// Ruby function to plot perspective view of linear depth data.  Input:
+// 640x480x16bit gray depth image, and an optional output string to reuse.
+// Output: 640x480 8-bit gray image.
+VALUE rb_plot_linear(int argc, VALUE *argv, VALUE self)
 {
-	struct plot_info *info = data;
-	plot_overhead(info->in, info->out);
-	return NULL;
+	return plot16(argc, argv, KU_VIEW_LINEAR);
 }
 
 // Ruby function to plot overhead view of depth data.  Input: 640x480x16bit
-// gray depth image.  Output: XPIXxZPIX 8-bit gray image.
-VALUE rb_plot_overhead(VALUE self, VALUE data)
+// gray depth image, and an optional output string to reuse.  Output:
+// XPIXxZPIX 8-bit gray image.
+VALUE rb_plot_overhead(int argc, VALUE *argv, VALUE self)
 {
-	VALUE outbuf;
-	size_t len;
+	return plot16(argc, argv, KU_VIEW_OVERHEAD);
+}
 
-	// TODO: Allow reusing a previously-allocated output string
+// Ruby function to plot side view of depth data.  Input: 640x480x16bit gray
+// depth image, and an optional output string to reuse.  Output: ZPIXxYPIX
+// 8-bit gray image.
+VALUE rb_plot_side(int argc, VALUE *argv, VALUE self)
+{
+	return plot16(argc, argv, KU_VIEW_SIDE);
+}
+
+// Ruby function to plot front view of depth data.  Input: 640x480x16bit gray
+// depth image, and an optional output string to reuse.  Output: XPIXxYPIX
+// 8-bit gray image.
+VALUE rb_plot_front(int argc, VALUE *argv, VALUE self)
+{
+	return plot16(argc, argv, KU_VIEW_FRONT);
+}
+
+// Plots a single view from packed 11-bit depth data into outbuf, which must
+// already be the right size for the view.  Releases the GVL while plotting.
+void ku_plot11_string(VALUE data, VALUE outbuf, enum ku_view view)
+{
+	size_t len;
 
 	Check_Type(data, T_STRING);
 	len = RSTRING_LEN(data);
-	if(len < 640 * 480 * 2) {
-		rb_raise(rb_eArgError, "Input data must be at least 640*480*2 bytes (got %zu).", len);
+	if(len < 640 * 480 * 11 / 8) {
+		rb_raise(rb_eArgError, "Input data must be at least 640*480*11/8 bytes (got %zu).", len);
 	}
 
-	// It seems rb_str_buf_new() adds a byte for terminating NUL, but
-	// rb_str_resize() does not.
-	outbuf = rb_str_buf_new(XPIX * ZPIX - 1);
-	rb_str_resize(outbuf, XPIX * ZPIX);
+	plot_view_nogvl(RSTRING_PTR(data), 1, (uint8_t *)RSTRING_PTR(outbuf), view);
+}
+
+// Common code for plotting a single view from packed 11-bit depth data.
+static VALUE plot11(int argc, VALUE *argv, enum ku_view view)
+{
+	VALUE data, outbuf;
+
+	rb_scan_args(argc, argv, "11", &data, &outbuf);
+	Check_Type(data, T_STRING);
+
+	outbuf = ku_output_buffer(outbuf, ku_view_sizes[view]);
+	ku_plot11_string(data, outbuf, view);
 
-	rb_thread_call_without_gvl(
-			plot_overhead_blocking,
-			&(struct plot_info){.in = (uint16_t *)RSTRING_PTR(data), .out = (uint8_t *)RSTRING_PTR(outbuf)},
-			NULL,
-			NULL
-			);
 	return outbuf;
 }
 
-void *plot_side_blocking(void *data)
+// Ruby function to plot perspective view of linear depth data.  Input:
+// 640x480x11bit packed depth data, and an optional output string to reuse.
+// Output: 640x480 8-bit gray image.
+VALUE rb_plot_linear11(int argc, VALUE *argv, VALUE self)
+{
+	return plot11(argc, argv, KU_VIEW_LINEAR);
+}
+
+// Ruby function to plot overhead view of depth data.  Input: 640x480x11bit
+// packed depth data, and an optional output string to reuse.  Output:
+// XPIXxZPIX 8-bit gray image.
+VALUE rb_plot_overhead11(int argc, VALUE *argv, VALUE self)
+{
+	return plot11(argc, argv, KU_VIEW_OVERHEAD);
+}
+
+// Ruby function to plot side view of depth data.  Input: 640x480x11bit packed
+// depth data, and an optional output string to reuse.  Output: ZPIXxYPIX
+// 8-bit gray image.
+VALUE rb_plot_side11(int argc, VALUE *argv, VALUE self)
 {
-	struct plot_info *info = data;
-	plot_side(info->in, info->out);
+	return plot11(argc, argv, KU_VIEW_SIDE);
+}
+
+// Ruby function to plot front view of depth data.  Input: 640x480x11bit
+// packed depth data, and an optional output string to reuse.  Output:
+// XPIXxYPIX 8-bit gray image.
+VALUE rb_plot_front11(int argc, VALUE *argv, VALUE self)
+{
+	return plot11(argc, argv, KU_VIEW_FRONT);
+}
+
+void *plot_views_blocking(void *data)
+{
+	struct views_info *info = data;
+
+	ku_plot_views_mt(info->in, info->packed, info->linear, info->overhead, info->side, info->front);
+
 	return NULL;
 }
 
-// Ruby function to plot side view of depth data.  Input: 640x480x16bit
-// gray depth image.  Output: ZPIXxYPIX 8-bit gray image.
-VALUE rb_plot_side(VALUE self, VALUE data)
+// Parses the :linear, :overhead, :side, and :front keyword options into
+// views (in that order).  Each value will be Qundef, false/nil, true, or a
+// String to reuse as output.
+void ku_view_options(VALUE opts, VALUE views[4])
 {
-	VALUE outbuf;
-	size_t len;
+	static ID view_ids[4];
 
-	// TODO: Allow reusing a previously-allocated output string
+	if(!view_ids[0]) {
+		view_ids[0] = rb_intern("linear");
+		view_ids[1] = rb_intern("overhead");
+		view_ids[2] = rb_intern("side");
+		view_ids[3] = rb_intern("front");
+	}
+
+	views[0] = views[1] = views[2] = views[3] = Qundef;
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, view_ids, 0, 4, views);
+	}
+}
+
+// Common code for plot_views and plot_views11.
+static VALUE internal_plot_views(int packed, int argc, VALUE *argv)
+{
+	static const char *names[4] = { "linear", "overhead", "side", "front" };
+	VALUE data, opts, views[4];
+	VALUE result;
+	uint8_t *out[4] = { NULL, NULL, NULL, NULL };
+	size_t len, minlen = packed ? 640 * 480 * 11 / 8 : 640 * 480 * 2;
+	int i;
+
+	rb_scan_args(argc, argv, "1:", &data, &opts);
+	ku_view_options(opts, views);
 
 	Check_Type(data, T_STRING);
 	len = RSTRING_LEN(data);
-	if(len < 640 * 480 * 2) {
-		rb_raise(rb_eArgError, "Input data must be at least 640*480*2 bytes (got %zu).", len);
+	if(len < minlen) {
+		rb_raise(rb_eArgError, "Input data must be at least %zu bytes (got %zu).", minlen, len);
 	}
 
-	// It seems rb_str_buf_new() adds a byte for terminating NUL, but
-	// rb_str_resize() does not.
-	outbuf = rb_str_buf_new(ZPIX * YPIX - 1);
-	rb_str_resize(outbuf, ZPIX * YPIX);
+	result = rb_hash_new();
+	for(i = 0; i < 4; i++) {
+		if(views[i] != Qundef && RTEST(views[i])) {
+			VALUE buf = ku_output_buffer(views[i] == Qtrue ? Qnil : views[i], ku_view_sizes[i]);
+			out[i] = (uint8_t *)RSTRING_PTR(buf);
+			rb_hash_aset(result, ID2SYM(rb_intern(names[i])), buf);
+		}
+	}
 
 	rb_thread_call_without_gvl(
-			plot_side_blocking,
-			&(struct plot_info){.in = (uint16_t *)RSTRING_PTR(data), .out = (uint8_t *)RSTRING_PTR(outbuf)},
+			plot_views_blocking,
+			&(struct views_info){.in = RSTRING_PTR(data), .packed = !!packed, .linear = out[0], .overhead = out[1], .side = out[2], .front = out[3]},
 			NULL,
 			NULL
 			);
 
-	return outbuf;
+	return result;
+}
+
+// Ruby function to plot several views of depth data in a single pass.  Input:
+// 640x480x16bit gray depth image, plus keyword arguments :linear, :overhead,
+// :side, and :front to select views (true for a new output string, or a
+// String to reuse).  Output: Hash from each selected view's name to its 8-bit
+// gray image.
+VALUE rb_plot_views(int argc, VALUE *argv, VALUE self)
+{
+	return internal_plot_views(0, argc, argv);
 }
 
-void *plot_front_blocking(void *data)
+// Like plot_views, but takes 640x480x11bit packed depth data.
+VALUE rb_plot_views11(int argc, VALUE *argv, VALUE self)
 {
-	struct plot_info *info = data;
-	plot_front(info->in, info->out);
+	return internal_plot_views(1, argc, argv);
+}
+
+struct world_info {
+	const uint8_t *in;
+	void *out;
+	int format;
+	int xstride;
+	int ystride;
+	int flags;
+	size_t count;
+};
+
+static void *world_blocking(void *data)
+{
+	struct world_info *info = data;
+	info->count = ku_unpack_to_world(info->in, info->out, info->format, info->xstride, info->ystride, info->flags);
 	return NULL;
 }
 
-// Ruby function to plot front view of depth data.  Input: 640x480x16bit
-// gray depth image.  Output: XPIXxYPIX 8-bit gray image.
-VALUE rb_plot_front(VALUE self, VALUE data)
+// Parses the stride: option for unpack_to_world, which may be an Integer or
+// an [xstride, ystride] Array.
+static void world_stride(VALUE stride, int *xstride, int *ystride)
 {
-	VALUE outbuf;
-	size_t len;
+	if(stride == Qundef || NIL_P(stride)) {
+		*xstride = *ystride = 1;
+	} else if(RB_TYPE_P(stride, T_ARRAY)) {
+		if(RARRAY_LEN(stride) != 2) {
+			rb_raise(rb_eArgError, "Stride array must have two elements (got %ld).", RARRAY_LEN(stride));
+		}
+		*xstride = NUM2INT(rb_ary_entry(stride, 0));
+		*ystride = NUM2INT(rb_ary_entry(stride, 1));
+	} else {
+		*xstride = *ystride = NUM2INT(stride);
+	}
+
+	if(*xstride < 1 || *xstride > 640 || *ystride < 1 || *ystride > 480) {
+		rb_raise(rb_eArgError, "Stride must be from 1 to 640 horizontally and 1 to 480 vertically.");
+	}
+}
+
+// Ruby function to convert packed 11-bit depth data to world-space points in
+// millimeters in a single native pass.  Input: 640x480x11bit packed depth
+// data, an optional output string to reuse, and keyword options:
+//
+// format: - :int16_xyz (default; native-endian int16, rounded like
+//           xworld/yworld) or :float32_xyz (native-endian float, unrounded)
+// skip_invalid: - true (default) omits pixels without a valid depth; false
+//                 writes them as 0, 0, 0 so the output stays a grid
+// stride: - sample every Nth column and row (default 1), or [xstride, ystride]
+// layout: - :interleaved (default) for XYZ triples, or :planar for all X
+//           values, then all Y values, then all Z values
+//
+// Output: String of packed coordinates; its size divided by 3 times the value
+// size is the number of points.  Without skip_invalid, points are in
+// row-major order, with (640 / xstride) points per row, rounded up.
+VALUE rb_unpack_to_world(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[4];
+	VALUE data, outbuf, opts, kw[4] = { Qundef, Qundef, Qundef, Qundef };
+	struct world_info info = { .format = KU_WORLD_INT16, .flags = KU_WORLD_SKIP_INVALID };
+	size_t len, elemsize;
+
+	if(!kw_ids[0]) {
+		kw_ids[0] = rb_intern("format");
+		kw_ids[1] = rb_intern("skip_invalid");
+		kw_ids[2] = rb_intern("stride");
+		kw_ids[3] = rb_intern("layout");
+	}
+
+	rb_scan_args(argc, argv, "11:", &data, &outbuf, &opts);
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, 4, kw);
+	}
+
+	if(kw[0] == Qundef || kw[0] == ID2SYM(rb_intern("int16_xyz"))) {
+		info.format = KU_WORLD_INT16;
+	} else if(kw[0] == ID2SYM(rb_intern("float32_xyz"))) {
+		info.format = KU_WORLD_FLOAT32;
+	} else {
+		rb_raise(rb_eArgError, "Unknown point format %"PRIsVALUE".", rb_inspect(kw[0]));
+	}
 
-	// TODO: Allow reusing a previously-allocated output string
+	if(kw[1] != Qundef && !RTEST(kw[1])) {
+		info.flags &= ~KU_WORLD_SKIP_INVALID;
+	}
+
+	world_stride(kw[2], &info.xstride, &info.ystride);
+
+	if(kw[3] == ID2SYM(rb_intern("planar"))) {
+		info.flags |= KU_WORLD_PLANAR;
+	} else if(kw[3] != Qundef && kw[3] != ID2SYM(rb_intern("interleaved"))) {
+		rb_raise(rb_eArgError, "Unknown point layout %"PRIsVALUE".", rb_inspect(kw[3]));
+	}
 
 	Check_Type(data, T_STRING);
 	len = RSTRING_LEN(data);
-	if(len < 640 * 480 * 2) {
-		rb_raise(rb_eArgError, "Input data must be at least 640*480*2 bytes (got %zu).", len);
+	if(len < KU_PACKED_SIZE) {
+		rb_raise(rb_eArgError, "Input data must be at least 640*480*11/8 bytes (got %zu).", len);
 	}
 
-	// It seems rb_str_buf_new() adds a byte for terminating NUL, but
-	// rb_str_resize() does not.
-	outbuf = rb_str_buf_new(XPIX * YPIX - 1);
-	rb_str_resize(outbuf, XPIX * YPIX);
+	elemsize = info.format == KU_WORLD_FLOAT32 ? sizeof(float) : sizeof(int16_t);
+	outbuf = ku_output_buffer(outbuf, ku_world_points(info.xstride, info.ystride) * 3 * elemsize);
 
-	rb_thread_call_without_gvl(
-			plot_front_blocking,
-			&(struct plot_info){.in = (uint16_t *)RSTRING_PTR(data), .out = (uint8_t *)RSTRING_PTR(outbuf)},
-			NULL,
-			NULL
-			);
+	info.in = (uint8_t *)RSTRING_PTR(data);
+	info.out = RSTRING_PTR(outbuf);
+	rb_thread_call_without_gvl(world_blocking, &info, NULL, NULL);
+
+	rb_str_resize(outbuf, info.count * 3 * elemsize);
 
 	return outbuf;
 }
@@ -402,6 +654,7 @@ VALUE ext_yworld(VALUE self, VALUE ypix, VALUE zw)
 void Init_kinutils()
 {
 	ku_init_lut();
+	ku_init_unpack();
 
 	VALUE nl = rb_define_module("NL");
 	VALUE knd_client = rb_define_module_under(nl, "KndClient");
@@ -427,12 +680,23 @@ void Init_kinutils()
 	rb_define_global_const("ESCAPE_DEQUOTE", INT2FIX(ESCAPE_DEQUOTE));
 	rb_define_global_const("ESCAPE_IF_QUOTED", INT2FIX(ESCAPE_IF_QUOTED));
 
-	rb_define_module_function(KinUtils, "unpack11_to_16", rb_unpack11_to_16, 1);
-	rb_define_module_function(KinUtils, "unpack11_to_16_lut", rb_unpack11_to_16_lut, 1);
-	rb_define_module_function(KinUtils, "plot_linear", rb_plot_linear, 1);
-	rb_define_module_function(KinUtils, "plot_overhead", rb_plot_overhead, 1);
-	rb_define_module_function(KinUtils, "plot_side", rb_plot_side, 1);
-	rb_define_module_function(KinUtils, "plot_front", rb_plot_front, 1);
+	rb_define_module_function(KinUtils, "unpack11_to_16", rb_unpack11_to_16, -1);
+	rb_define_module_function(KinUtils, "unpack11_to_16_lut", rb_unpack11_to_16_lut, -1);
+	rb_define_module_function(KinUtils, "unpack_impl", rb_unpack_impl, 0);
+	rb_define_module_function(KinUtils, "unpack_impl=", rb_set_unpack_impl, 1);
+	rb_define_module_function(KinUtils, "unpack_to_world", rb_unpack_to_world, -1);
+	rb_define_module_function(KinUtils, "plot_threads", rb_plot_threads, 0);
+	rb_define_module_function(KinUtils, "plot_threads=", rb_set_plot_threads, 1);
+	rb_define_module_function(KinUtils, "plot_linear", rb_plot_linear, -1);
+	rb_define_module_function(KinUtils, "plot_overhead", rb_plot_overhead, -1);
+	rb_define_module_function(KinUtils, "plot_side", rb_plot_side, -1);
+	rb_define_module_function(KinUtils, "plot_front", rb_plot_front, -1);
+	rb_define_module_function(KinUtils, "plot_views", rb_plot_views, -1);
+	rb_define_module_function(KinUtils, "plot_linear11", rb_plot_linear11, -1);
+	rb_define_module_function(KinUtils, "plot_overhead11", rb_plot_overhead11, -1);
+	rb_define_module_function(KinUtils, "plot_side11", rb_plot_side11, -1);
+	rb_define_module_function(KinUtils, "plot_front11", rb_plot_front11, -1);
+	rb_define_module_function(KinUtils, "plot_views11", rb_plot_views11, -1);
 
 	rb_define_method(rb_cString, "kin_unescape", rb_unescape, -1);
 	rb_define_method(rb_cString, "kin_unescape!", rb_unescape_modify, -1);
@@ -451,5 +715,24 @@ void Init_kinutils()
 	rb_ary_freeze(lut_array);
 	rb_define_const(KinUtils, "DEPTH_LUT", lut_array);
 
-	// TODO: Add reverse_lut,unpack_to_world/unpack_to_8 functions
+	// Unpacking implementations supported by this CPU
+	VALUE impl_array = rb_ary_new();
+	for (int i = 0; ku_unpack_impl_name(i); i++) {
+		rb_ary_push(impl_array, rb_obj_freeze(rb_str_new2(ku_unpack_impl_name(i))));
+	}
+	rb_ary_freeze(impl_array);
+	rb_define_const(KinUtils, "UNPACK_IMPLS", impl_array);
+
+	init_frame_context(KinUtils);
+	init_zone_set(KinUtils);
+	init_occupancy_grid(KinUtils);
+	init_recording(KinUtils);
+	init_zone_list(KinUtils);
+	init_compact_zone(KinUtils);
+	init_line_decoder(KinUtils);
+	init_frame_pool(KinUtils);
+	init_frame_assembler(KinUtils);
+	init_shared_frames(KinUtils);
+
+	// TODO: Add reverse_lut/unpack_to_8 functions
 }
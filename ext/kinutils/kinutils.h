@@ -0,0 +1,142 @@
+/*
+ * Definitions shared between the source files of the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ */
+#ifndef KINUTILS_H_
+#define KINUTILS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ruby.h>
+
+// Size of a packed 11-bit 640x480 depth frame.
+#define KU_PACKED_SIZE (640 * 480 * 11 / 8)
+
+// Size of an unpacked 16-bit 640x480 depth frame.
+#define KU_UNPACKED_SIZE (640 * 480 * 2)
+
+// Views that can be plotted, in the order used by plot_views().
+enum ku_view {
+	KU_VIEW_LINEAR,
+	KU_VIEW_OVERHEAD,
+	KU_VIEW_SIDE,
+	KU_VIEW_FRONT,
+	KU_VIEW_COUNT
+};
+
+// Size in bytes of each view's 8-bit image.
+extern const long ku_view_sizes[KU_VIEW_COUNT];
+
+struct views_info {
+	const void *in;
+	unsigned int packed:1;
+	uint8_t *linear;
+	uint8_t *overhead;
+	uint8_t *side;
+	uint8_t *front;
+};
+
+struct unpack_info {
+	const uint8_t *in;
+	uint16_t *out;
+	size_t len;
+	unsigned int lut_range:1;
+};
+
+// The KinUtils Ruby module
+extern VALUE KinUtils;
+
+// Functions for use with rb_thread_call_without_gvl().
+void *unpack_blocking(void *data);
+void *plot_views_blocking(void *data);
+
+// Prepares a Ruby string to receive len bytes of output.  If out is nil, a
+// new string is allocated.  Otherwise out must be a modifiable String, which
+// is resized to len bytes, set to binary encoding, and returned.
+VALUE ku_output_buffer(VALUE out, long len);
+
+// Unpacks the first len bytes of 11-bit depth data from the data string to
+// 16-bit left-aligned or right-aligned values in outbuf, which must already be
+// len * 16 / 11 bytes long.  Releases the GVL while unpacking.
+void ku_unpack_string(int lut_range, VALUE data, size_t len, VALUE outbuf);
+
+// Plots a single view from packed 11-bit depth data into outbuf, which must
+// already be the right size for the view.  Releases the GVL while plotting.
+void ku_plot11_string(VALUE data, VALUE outbuf, enum ku_view view);
+
+// Parses the :linear, :overhead, :side, and :front keyword options into
+// views (in that order).  Each value will be Qundef, false/nil, true, or a
+// String to reuse as output.
+void ku_view_options(VALUE opts, VALUE views[4]);
+
+// Pointers to a FrameContext's depth and view buffers.
+struct ku_frame_buffers {
+	uint16_t *depth;
+	uint8_t *views[KU_VIEW_COUNT];
+};
+
+// Marks a FrameContext busy for processing data outside of Ruby, raising an
+// error if it is already busy, and fills bufs with pointers to its buffers.
+// Views written this way are fully replotted by the next #plot_incremental.
+// Call ku_frame_context_end() when done.
+void ku_frame_context_begin(VALUE ctx, VALUE data, struct ku_frame_buffers *bufs);
+
+// Marks a FrameContext given to ku_frame_context_begin() idle again.
+void ku_frame_context_end(VALUE ctx);
+
+// Defines the Kinutils::FrameContext class.
+void init_frame_context(VALUE kinutils);
+
+// Reads a world-space box from a Zone, a Hash with String or Symbol keys
+// xmin, ymin, zmin, xmax, ymax, and zmax, or an Array of those six values,
+// into box (in that order).  Raises an error if any are missing.
+void ku_box_from_value(VALUE value, int box[6]);
+
+// Defines the Kinutils::ZoneSet class.
+void init_zone_set(VALUE kinutils);
+
+// Defines the Kinutils::OccupancyGrid class.
+void init_occupancy_grid(VALUE kinutils);
+
+// Defines the Kinutils::Recording and Kinutils::Recorder classes.
+void init_recording(VALUE kinutils);
+
+// Defines Kinutils.parse_zone_list.
+void init_zone_list(VALUE kinutils);
+
+// Returns nonzero if value is a Kinutils::CompactZone.
+int ku_is_compact_zone(VALUE value);
+
+// Returns the named attribute of a CompactZone, or Qundef if it is not set.
+VALUE ku_compact_zone_get(VALUE zone, const char *key);
+
+// Defines the Kinutils::CompactZone class.  Must be called after
+// init_zone_list().
+void init_compact_zone(VALUE kinutils);
+
+// Defines the Kinutils::LineDecoder class.  Must be called after
+// init_compact_zone().
+void init_line_decoder(VALUE kinutils);
+
+// Defines the Kinutils::FramePool class.
+void init_frame_pool(VALUE kinutils);
+
+// Returns nonzero if value is a Kinutils::FrameAssembler.
+int ku_is_frame_assembler(VALUE value);
+
+// Discards any bytes received so far, so the assembler's next bytes start a
+// new frame in the same outputs.
+void ku_frame_assembler_rewind(VALUE assembler);
+
+// Adds up to len bytes at p to the frame, processing complete rows as they
+// arrive.  Returns the number of bytes used, which is less than len once the
+// frame is complete.
+long ku_frame_assembler_add(VALUE assembler, const char *p, long len);
+
+// Defines the Kinutils::FrameAssembler class.
+void init_frame_assembler(VALUE kinutils);
+
+// Defines the Kinutils::FramePublisher and Kinutils::SharedFrames classes.
+void init_shared_frames(VALUE kinutils);
+
+#endif /* KINUTILS_H_ */
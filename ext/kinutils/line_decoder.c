@@ -0,0 +1,463 @@
+/*
+ * Incremental decoding of the KND protocol for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * A LineDecoder takes raw bytes from a KND connection in chunks of any size,
+ * splits them into lines and binary depth/video frames, classifies each line
+ * by its message type, and yields pre-parsed records.  Zone messages are
+ * parsed directly into Zone Hashes or CompactZones, so the Ruby side doesn't
+ * need to split, match, or re-parse lines.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ruby.h>
+
+#include "kinutils.h"
+#include "zone_kvp.h"
+
+// Largest line or binary frame accepted, like EventMachine's LineText2.
+#define MAX_LINE_LENGTH (1024 * 1024)
+#define MAX_BINARY_LENGTH (32 * 1024 * 1024)
+
+struct line_decoder {
+	VALUE line; // Partial line buffer
+	VALUE spare; // Buffer holding the line being processed, swapped with line
+	VALUE binary; // Binary frame being received, or Qnil
+	VALUE binary_type; // Record type for the binary frame
+	long binary_remaining;
+	VALUE zone_class; // Class for zone records, or nil for raw messages
+	VALUE frame_buffer; // Called for a String to receive each binary frame
+	long raw_lines; // Lines to yield without classifying
+	int busy;
+};
+
+// Message types, with the record types yielded for them.
+enum message_type {
+	MSG_DEPTH, MSG_VIDEO, MSG_SUB, MSG_ADD, MSG_BRIGHT, MSG_DEL, MSG_OK, MSG_ERR,
+	MSG_COUNT
+};
+static const char *message_names[MSG_COUNT] = {
+	"DEPTH", "VIDEO", "SUB", "ADD", "BRIGHT", "DEL", "OK", "ERR",
+};
+static const char *record_names[MSG_COUNT] = {
+	"depth", "video", "sub", "add", "bright", "del", "ok", "err",
+};
+static VALUE record_symbols[MSG_COUNT];
+static VALUE sym_line;
+
+static VALUE LineDecoder = Qnil;
+static VALUE ProtocolError = Qnil;
+
+static void line_decoder_mark(void *data)
+{
+	struct line_decoder *dec = data;
+	rb_gc_mark(dec->line);
+	rb_gc_mark(dec->spare);
+	rb_gc_mark(dec->binary);
+	rb_gc_mark(dec->binary_type);
+	rb_gc_mark(dec->zone_class);
+	rb_gc_mark(dec->frame_buffer);
+}
+
+static size_t line_decoder_size(const void *data)
+{
+	return sizeof(struct line_decoder);
+}
+
+static const rb_data_type_t line_decoder_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::LineDecoder",
+	.function = {
+		.dmark = line_decoder_mark,
+		.dfree = RUBY_TYPED_DEFAULT_FREE,
+		.dsize = line_decoder_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE line_decoder_alloc(VALUE klass)
+{
+	struct line_decoder *dec;
+	VALUE obj = TypedData_Make_Struct(klass, struct line_decoder, &line_decoder_type, dec);
+
+	dec->line = rb_str_buf_new(256);
+	dec->spare = rb_str_buf_new(256);
+	dec->binary = Qnil;
+	dec->binary_type = Qnil;
+	dec->zone_class = Qnil;
+	dec->frame_buffer = Qnil;
+
+	return obj;
+}
+
+static struct line_decoder *get_decoder(VALUE self)
+{
+	struct line_decoder *dec;
+	TypedData_Get_Struct(self, struct line_decoder, &line_decoder_type, dec);
+	return dec;
+}
+
+// Creates a decoder.  SUB and ADD zone messages are yielded as new instances
+// of the zone_class: keyword option, which may be Hash or a subclass (such as
+// Zone) for normalized Hashes, or Kinutils::CompactZone or a subclass.  If
+// zone_class is nil (the default), the message text is yielded instead.
+//
+// Binary frames are received into new Strings, unless the frame_buffer:
+// option gives an object whose #call(type, length) returns a modifiable
+// String to reuse (or nil to allocate one), such as a FrameRing.  It may
+// also return a Kinutils::FrameAssembler for a packed depth frame, which
+// then processes the frame's rows as they arrive, and is yielded in place of
+// the frame's data.
+static VALUE line_decoder_initialize(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[2];
+	struct line_decoder *dec = get_decoder(self);
+	VALUE opts, kw[2];
+
+	if(!kw_ids[0]) {
+		kw_ids[0] = rb_intern("zone_class");
+		kw_ids[1] = rb_intern("frame_buffer");
+	}
+
+	rb_scan_args(argc, argv, "0:", &opts);
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, 2, kw);
+		if(kw[0] != Qundef && !NIL_P(kw[0])) {
+			Check_Type(kw[0], T_CLASS);
+			dec->zone_class = kw[0];
+		}
+		if(kw[1] != Qundef) {
+			dec->frame_buffer = kw[1];
+		}
+	}
+
+	return self;
+}
+
+// Returns the first non-negative integer in len bytes at str, or def if
+// there is none.
+static long parse_length(const char *str, long len, long def)
+{
+	const char *end = str + len;
+	long value = 0;
+
+	while(str < end && (*str < '0' || *str > '9')) {
+		str++;
+	}
+	if(str == end) {
+		return def;
+	}
+
+	while(str < end && *str >= '0' && *str <= '9' && value <= MAX_BINARY_LENGTH) {
+		value = value * 10 + (*str - '0');
+		str++;
+	}
+
+	return value;
+}
+
+// Stores the name and bright values from a BRIGHT message.
+struct bright_info {
+	VALUE name;
+	VALUE bright;
+};
+
+static void bright_cb(void *data, int attr, const char *key, long integer, VALUE value)
+{
+	struct bright_info *info = data;
+
+	if(attr == KU_ZA_NAME) {
+		info->name = value;
+	} else if(attr == KU_ZA_BRIGHT) {
+		info->bright = LONG2NUM(integer);
+	}
+}
+
+// Returns a new zone_class instance parsed from a NUL-terminated message.
+static VALUE parse_zone(struct line_decoder *dec, const char *msg)
+{
+	VALUE zone = rb_obj_alloc(dec->zone_class);
+
+	if(ku_is_compact_zone(zone)) {
+		ku_compact_zone_merge_line(zone, msg);
+	} else {
+		Check_Type(zone, T_HASH);
+		ku_zone_hash_merge_line(zone, msg);
+	}
+
+	return zone;
+}
+
+// Starts receiving a binary frame of len bytes, yielding it right away if
+// it is empty.
+static void start_binary(struct line_decoder *dec, VALUE type, long len)
+{
+	VALUE buf = Qnil;
+
+	if(len > MAX_BINARY_LENGTH) {
+		rb_raise(ProtocolError, "Binary data length %ld is larger than %d.", len, MAX_BINARY_LENGTH);
+	}
+
+	if(len == 0) {
+		rb_yield_values(3, type, rb_str_new(NULL, 0), Qnil);
+		return;
+	}
+
+	if(!NIL_P(dec->frame_buffer)) {
+		buf = rb_funcall(dec->frame_buffer, rb_intern("call"), 2, type, LONG2NUM(len));
+	}
+	if(NIL_P(buf)) {
+		buf = rb_str_buf_new(len);
+	} else if(ku_is_frame_assembler(buf)) {
+		if(len != KU_PACKED_SIZE) {
+			rb_raise(rb_eArgError, "A FrameAssembler can only receive %d-byte depth frames (got %ld).", KU_PACKED_SIZE, len);
+		}
+		ku_frame_assembler_rewind(buf);
+	} else {
+		// Makes room for the frame, then appends to the empty buffer
+		buf = ku_output_buffer(buf, len);
+		rb_str_set_len(buf, 0);
+	}
+
+	dec->binary = buf;
+	dec->binary_type = type;
+	dec->binary_remaining = len;
+}
+
+// Classifies and yields the complete line in str, which must be
+// NUL-terminated.
+static void process_line(struct line_decoder *dec, VALUE str)
+{
+	char *line = RSTRING_PTR(str);
+	long len = RSTRING_LEN(str);
+	char *sep;
+	const char *msg;
+	long typelen, msglen;
+	struct bright_info bright;
+	int type;
+
+	if(len > 0 && line[len - 1] == '\r') {
+		line[--len] = 0;
+	}
+
+	if(dec->raw_lines > 0) {
+		dec->raw_lines--;
+		rb_yield_values(3, sym_line, rb_str_new(line, len), Qnil);
+		return;
+	}
+
+	sep = strstr(line, " - ");
+	typelen = sep ? sep - line : len;
+	msg = sep ? sep + 3 : NULL;
+	msglen = sep ? len - (msg - line) : 0;
+
+	for(type = 0; type < MSG_COUNT; type++) {
+		if((long)strlen(message_names[type]) == typelen && !strncmp(line, message_names[type], typelen)) {
+			break;
+		}
+	}
+
+	switch(type) {
+		case MSG_DEPTH:
+			start_binary(dec, record_symbols[type], msg ? parse_length(msg, msglen, KU_PACKED_SIZE) : KU_PACKED_SIZE);
+			break;
+
+		case MSG_VIDEO:
+			start_binary(dec, record_symbols[type], msg ? parse_length(msg, msglen, 640 * 480) : 640 * 480);
+			break;
+
+		case MSG_SUB:
+		case MSG_ADD:
+			if(msg == NULL) {
+				msg = "";
+			}
+			rb_yield_values(3, record_symbols[type],
+					NIL_P(dec->zone_class) ? rb_str_new(msg, msglen) : parse_zone(dec, msg),
+					Qnil);
+			break;
+
+		case MSG_BRIGHT:
+			bright = (struct bright_info){ .name = Qnil, .bright = Qnil };
+			if(msg != NULL) {
+				ku_parse_zone_kvp(msg, bright_cb, &bright);
+			}
+			rb_yield_values(3, record_symbols[type], bright.name, bright.bright);
+			break;
+
+		case MSG_DEL:
+		case MSG_OK:
+		case MSG_ERR:
+			rb_yield_values(3, record_symbols[type], msg ? rb_str_new(msg, msglen) : Qnil, Qnil);
+			break;
+
+		default:
+			rb_yield_values(3, sym_line, rb_str_new(line, len), Qnil);
+			break;
+	}
+}
+
+struct feed_info {
+	struct line_decoder *dec;
+	VALUE data;
+};
+
+static VALUE feed_body(VALUE arg)
+{
+	struct feed_info *info = (struct feed_info *)arg;
+	struct line_decoder *dec = info->dec;
+	const char *p = RSTRING_PTR(info->data);
+	const char *end = p + RSTRING_LEN(info->data);
+	const char *nl;
+	VALUE frame, line;
+	long n;
+
+	while(p < end) {
+		if(!NIL_P(dec->binary)) {
+			n = end - p < dec->binary_remaining ? end - p : dec->binary_remaining;
+			if(RB_TYPE_P(dec->binary, T_STRING)) {
+				rb_str_cat(dec->binary, p, n);
+			} else {
+				ku_frame_assembler_add(dec->binary, p, n);
+			}
+			dec->binary_remaining -= n;
+			p += n;
+
+			if(dec->binary_remaining == 0) {
+				frame = dec->binary;
+				dec->binary = Qnil;
+				rb_yield_values(3, dec->binary_type, frame, Qnil);
+			}
+			continue;
+		}
+
+		nl = memchr(p, '\n', end - p);
+		n = (nl ? nl : end) - p;
+		if(RSTRING_LEN(dec->line) + n > MAX_LINE_LENGTH) {
+			rb_str_set_len(dec->line, 0);
+			rb_raise(ProtocolError, "Line is longer than %d bytes.", MAX_LINE_LENGTH);
+		}
+
+		rb_str_cat(dec->line, p, n);
+		if(nl == NULL) {
+			break;
+		}
+		p = nl + 1;
+
+		// Swap in an empty line buffer before yielding, so the next line
+		// starts empty even if the block raises
+		line = dec->line;
+		dec->line = dec->spare;
+		dec->spare = line;
+		rb_str_set_len(dec->line, 0);
+		process_line(dec, line);
+	}
+
+	return Qnil;
+}
+
+static VALUE feed_ensure(VALUE arg)
+{
+	struct feed_info *info = (struct feed_info *)arg;
+	rb_str_unlocktmp(info->data);
+	info->dec->busy = 0;
+	return Qnil;
+}
+
+// Decodes the given bytes, which may end partway through a line or binary
+// frame, and yields a record for each complete message as type, value, and
+// extra:
+//
+//     :depth, :video - the frame's data (a binary String or FrameAssembler;
+//                      see #initialize)
+//     :sub, :add     - the zone (see #initialize), or the message text
+//     :bright        - the zone name and Integer brightness
+//     :del           - the zone name
+//     :ok, :err      - the message text, or nil
+//     :line          - any other line, such as the body of a command response
+//
+// Setting #raw_lines from the block (e.g. after a multi-line command's OK)
+// yields that many following lines as :line records without classifying
+// them.  Raises Kinutils::LineDecoder::ProtocolError for overlong lines or
+// frames.  Returns self.
+static VALUE line_decoder_feed(VALUE self, VALUE data)
+{
+	struct line_decoder *dec = get_decoder(self);
+	struct feed_info info = {
+		.dec = dec,
+		.data = StringValue(data),
+	};
+
+	rb_need_block();
+
+	if(dec->busy) {
+		rb_raise(rb_eRuntimeError, "LineDecoder#feed can't be called from its own block.");
+	}
+
+	// The data is read in place, so it can't be changed until feed returns.
+	// Callers may reuse it afterward (e.g. as an IO#readpartial buffer).
+	rb_str_locktmp(data);
+	dec->busy = 1;
+
+	rb_ensure(feed_body, (VALUE)&info, feed_ensure, (VALUE)&info);
+	RB_GC_GUARD(info.data);
+
+	return self;
+}
+
+// Returns the number of lines that will be yielded without classification.
+static VALUE line_decoder_raw_lines(VALUE self)
+{
+	return LONG2NUM(get_decoder(self)->raw_lines);
+}
+
+// Sets the number of following lines to yield as :line records without
+// classification, such as the body of a multi-line command response.
+static VALUE line_decoder_set_raw_lines(VALUE self, VALUE count)
+{
+	long n = NUM2LONG(count);
+	get_decoder(self)->raw_lines = n < 0 ? 0 : n;
+	return count;
+}
+
+// Returns true if the decoder is partway through a binary frame.
+static VALUE line_decoder_binary(VALUE self)
+{
+	return NIL_P(get_decoder(self)->binary) ? Qfalse : Qtrue;
+}
+
+// Discards any partial line or binary frame, e.g. after reconnecting.
+static VALUE line_decoder_reset(VALUE self)
+{
+	struct line_decoder *dec = get_decoder(self);
+
+	rb_str_set_len(dec->line, 0);
+	dec->binary = Qnil;
+	dec->binary_type = Qnil;
+	dec->binary_remaining = 0;
+	dec->raw_lines = 0;
+
+	return self;
+}
+
+// Defines the Kinutils::LineDecoder class.  Must be called after
+// init_compact_zone().
+void init_line_decoder(VALUE kinutils)
+{
+	int i;
+
+	for(i = 0; i < MSG_COUNT; i++) {
+		record_symbols[i] = ID2SYM(rb_intern(record_names[i]));
+	}
+	sym_line = ID2SYM(rb_intern("line"));
+
+	LineDecoder = rb_define_class_under(kinutils, "LineDecoder", rb_cObject);
+	rb_define_alloc_func(LineDecoder, line_decoder_alloc);
+
+	ProtocolError = rb_define_class_under(LineDecoder, "ProtocolError", rb_eRuntimeError);
+
+	rb_define_method(LineDecoder, "initialize", line_decoder_initialize, -1);
+	rb_define_method(LineDecoder, "feed", line_decoder_feed, 1);
+	rb_define_method(LineDecoder, "raw_lines", line_decoder_raw_lines, 0);
+	rb_define_method(LineDecoder, "raw_lines=", line_decoder_set_raw_lines, 1);
+	rb_define_method(LineDecoder, "binary?", line_decoder_binary, 0);
+	rb_define_method(LineDecoder, "reset", line_decoder_reset, 0);
+}
@@ -0,0 +1,159 @@
+/*
+ * Voxel occupancy counts with O(1) box queries for Kinect depth data.
+ * (C)2026 Mike Bourgeous
+ *
+ * Each frame's points are counted into a coarse voxel grid, then prefix sums
+ * are taken along x, y, and z.  Each table entry then holds the count
+ * of every voxel at or below it on all three axes, so the count inside any
+ * axis-aligned block of voxels takes eight lookups.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <nlutils/nlutils.h>
+
+#include "unpack.h"
+#include "occupancy.h"
+
+// Allocates a grid with XPIX/scale x YPIX/scale x ZPIX/scale voxels.
+// Returns 0 on success, or -1 with errno set on error.
+int ku_occupancy_init(struct ku_occupancy *grid, int scale)
+{
+	int i;
+
+	if(scale < 1 || scale > XPIX || scale > YPIX || scale > ZPIX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	grid->scale = scale;
+	grid->nx = (XPIX - 1) / scale + 1;
+	grid->ny = (YPIX - 1) / scale + 1;
+	grid->nz = (ZPIX - 1) / scale + 1;
+	grid->sums = calloc((size_t)(grid->nx + 1) * (grid->ny + 1) * (grid->nz + 1), sizeof(uint32_t));
+	if(grid->sums == NULL) {
+		return -1;
+	}
+
+	// Index 0 of each axis is zero padding
+	for(i = 0; i < XPIX; i++) {
+		grid->xoff[i] = i / scale + 1;
+	}
+	for(i = 0; i < YPIX; i++) {
+		grid->yoff[i] = (i / scale + 1) * (grid->nx + 1);
+	}
+	for(i = 0; i < ZPIX; i++) {
+		grid->zoff[i] = (i / scale + 1) * (grid->nx + 1) * (grid->ny + 1);
+	}
+
+	return 0;
+}
+
+// Frees the grid's table (but not the grid itself).
+void ku_occupancy_free(struct ku_occupancy *grid)
+{
+	free(grid->sums);
+	grid->sums = NULL;
+}
+
+// Counts the points of one frame of packed 11-bit depth data (640*480*11/8
+// bytes) in each voxel, placing them with the projection tables used by
+// plot_overhead() and plot_side(), then builds the summed-area table.
+void ku_occupancy_build(struct ku_occupancy *grid, const uint8_t *in)
+{
+	size_t ystep = grid->nx + 1;
+	size_t zstep = ystep * (grid->ny + 1);
+	uint32_t *sums = grid->sums;
+	uint32_t *p, *q;
+	uint16_t row[640];
+	int x, y, z, val, col, vrow;
+	size_t i;
+
+	memset(sums, 0, zstep * (grid->nz + 1) * sizeof(uint32_t));
+
+	// Count points
+	for(y = 0; y < 480; y++) {
+		ku_unpack11_to_16_lut_buf(in + y * 640 * 11 / 8, row, 640 * 11 / 8);
+
+		for(x = 0; x < 640; x++) {
+			val = row[x];
+			if(val >= KU_PROJ_DEPTHS || ku_depth_lut[val] >= ZMAX) {
+				continue;
+			}
+
+			col = ku_proj_xcol[val][x];
+			vrow = ku_proj_yrow[y][val];
+			if(col < 0 || col >= XPIX || vrow < 0 || vrow >= YPIX) {
+				continue;
+			}
+
+			sums[grid->zoff[ku_proj_zcol[val]] + grid->yoff[vrow] + grid->xoff[col]]++;
+		}
+	}
+
+	// Prefix sums along x, y, then z, one z slice at a time so each slice
+	// and the one before it stay in cache
+	for(z = 1; z <= grid->nz; z++) {
+		for(y = 1; y <= grid->ny; y++) {
+			p = sums + z * zstep + y * ystep;
+			q = p - ystep;
+			for(x = 1; x <= grid->nx; x++) {
+				p[x] += p[x - 1];
+			}
+			for(x = 1; x <= grid->nx; x++) {
+				p[x] += q[x];
+			}
+		}
+
+		p = sums + z * zstep;
+		q = p - zstep;
+		for(i = 0; i < zstep; i++) {
+			p[i] += q[i];
+		}
+	}
+}
+
+// Converts an inclusive range of view pixels lo..hi (in a view size pixels
+// wide) to padded table indices *lo_out (exclusive) and *hi_out (inclusive).
+// Returns 0 if the range misses the view.
+static int voxel_range(int64_t lo, int64_t hi, int size, int scale, int *lo_out, int *hi_out)
+{
+	if(hi < 0 || lo >= size || lo > hi) {
+		return 0;
+	}
+
+	*lo_out = CLAMP(0, size - 1, lo) / scale;
+	*hi_out = CLAMP(0, size - 1, hi) / scale + 1;
+
+	return 1;
+}
+
+// Returns the number of points in all voxels touched by the given world-space
+// box (millimeters, inclusive), using eight table lookups.  Every point in the
+// box is counted, along with any others sharing its boundary voxels.
+uint32_t ku_occupancy_count(const struct ku_occupancy *grid, int xmin, int ymin, int zmin, int xmax, int ymax, int zmax)
+{
+	size_t ystep = grid->nx + 1;
+	size_t zstep = ystep * (grid->ny + 1);
+	const uint32_t *s = grid->sums;
+	int x0, x1, y0, y1, z0, z1;
+
+	// Same mapping as the projection tables; rows increase downward
+	if(!voxel_range((int64_t)xmin * XPIX / XMAX + XPIX / 2, (int64_t)xmax * XPIX / XMAX + XPIX / 2, XPIX, grid->scale, &x0, &x1) ||
+			!voxel_range(-(int64_t)ymax * YPIX / YMAX + YPIX / 2, -(int64_t)ymin * YPIX / YMAX + YPIX / 2, YPIX, grid->scale, &y0, &y1) ||
+			!voxel_range((int64_t)zmin * ZPIX / ZMAX, (int64_t)zmax * ZPIX / ZMAX, ZPIX, grid->scale, &z0, &z1) ||
+			xmin > xmax || ymin > ymax || zmin > zmax) {
+		return 0;
+	}
+
+	// Unsigned wraparound cancels out in the inclusion-exclusion sum
+	return s[z1 * zstep + y1 * ystep + x1]
+		- s[z1 * zstep + y1 * ystep + x0]
+		- s[z1 * zstep + y0 * ystep + x1]
+		- s[z0 * zstep + y1 * ystep + x1]
+		+ s[z1 * zstep + y0 * ystep + x0]
+		+ s[z0 * zstep + y1 * ystep + x0]
+		+ s[z0 * zstep + y0 * ystep + x1]
+		- s[z0 * zstep + y0 * ystep + x0];
+}
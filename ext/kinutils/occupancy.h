@@ -0,0 +1,43 @@
+/*
+ * Voxel occupancy counts with O(1) box queries for Kinect depth data.
+ * (C)2026 Mike Bourgeous
+ */
+#ifndef OCCUPANCY_H_
+#define OCCUPANCY_H_
+
+#include <stdint.h>
+
+#include "unpack.h"
+
+// A 3D summed-area table of per-frame point counts.  Voxels are the
+// overhead/side view pixels (XPIX x YPIX x ZPIX) merged in scale x scale x
+// scale blocks.
+struct ku_occupancy {
+	int scale;
+	int nx, ny, nz; // Voxel grid dimensions
+	uint32_t *sums; // (nx + 1) * (ny + 1) * (nz + 1), x fastest, zero-padded
+
+	// Table offsets of each view column, row, and depth column's voxel
+	int xoff[XPIX];
+	int yoff[YPIX];
+	int zoff[ZPIX];
+};
+
+// Allocates a grid with XPIX/scale x YPIX/scale x ZPIX/scale voxels.
+// Returns 0 on success, or -1 with errno set on error.
+int ku_occupancy_init(struct ku_occupancy *grid, int scale);
+
+// Frees the grid's table (but not the grid itself).
+void ku_occupancy_free(struct ku_occupancy *grid);
+
+// Counts the points of one frame of packed 11-bit depth data (640*480*11/8
+// bytes) in each voxel, placing them with the projection tables used by
+// plot_overhead() and plot_side(), then builds the summed-area table.
+void ku_occupancy_build(struct ku_occupancy *grid, const uint8_t *in);
+
+// Returns the number of points in all voxels touched by the given world-space
+// box (millimeters, inclusive), using eight table lookups.  Every point in the
+// box is counted, along with any others sharing its boundary voxels.
+uint32_t ku_occupancy_count(const struct ku_occupancy *grid, int xmin, int ymin, int zmin, int xmax, int ymax, int zmax);
+
+#endif /* OCCUPANCY_H_ */
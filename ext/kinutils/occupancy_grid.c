@@ -0,0 +1,202 @@
+/*
+ * Voxel occupancy grid for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * An OccupancyGrid counts one frame's points per voxel and answers "how many
+ * points are in this box" for any number of world-space boxes in constant
+ * time per box.
+ */
+#include <errno.h>
+#include <ruby.h>
+#include <ruby/thread.h>
+
+#include "unpack.h"
+#include "occupancy.h"
+#include "kinutils.h"
+
+struct occupancy_grid {
+	struct ku_occupancy grid;
+	int busy;
+};
+
+struct build_info {
+	struct ku_occupancy *grid;
+	const uint8_t *in;
+};
+
+static VALUE OccupancyGrid = Qnil;
+
+static void occupancy_grid_free(void *data)
+{
+	struct occupancy_grid *og = data;
+	ku_occupancy_free(&og->grid);
+	xfree(og);
+}
+
+static size_t occupancy_grid_size(const void *data)
+{
+	const struct occupancy_grid *og = data;
+	return sizeof(struct occupancy_grid) +
+		(size_t)(og->grid.nx + 1) * (og->grid.ny + 1) * (og->grid.nz + 1) * sizeof(uint32_t);
+}
+
+static const rb_data_type_t occupancy_grid_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::OccupancyGrid",
+	.function = {
+		.dmark = NULL,
+		.dfree = occupancy_grid_free,
+		.dsize = occupancy_grid_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE occupancy_grid_alloc(VALUE klass)
+{
+	struct occupancy_grid *og;
+	return TypedData_Make_Struct(klass, struct occupancy_grid, &occupancy_grid_type, og);
+}
+
+// Returns the grid, raising an error if it was not initialized or is being
+// updated in another thread.
+static struct occupancy_grid *get_grid(VALUE self)
+{
+	struct occupancy_grid *og;
+
+	TypedData_Get_Struct(self, struct occupancy_grid, &occupancy_grid_type, og);
+	if(og->grid.sums == NULL) {
+		rb_raise(rb_eRuntimeError, "OccupancyGrid was not initialized.");
+	}
+	if(og->busy) {
+		rb_raise(rb_eRuntimeError, "OccupancyGrid is being updated in another thread.");
+	}
+
+	return og;
+}
+
+static void *build_blocking(void *data)
+{
+	struct build_info *info = data;
+	ku_occupancy_build(info->grid, info->in);
+	return NULL;
+}
+
+// Counts the points of a packed 11-bit depth frame into the grid, replacing
+// the previous frame's counts.  Returns self.
+static VALUE occupancy_grid_update(VALUE self, VALUE data)
+{
+	struct occupancy_grid *og = get_grid(self);
+
+	Check_Type(data, T_STRING);
+	if(RSTRING_LEN(data) < KU_PACKED_SIZE) {
+		rb_raise(rb_eArgError, "Input data must be at least 640*480*11/8 bytes (got %ld).", RSTRING_LEN(data));
+	}
+
+	og->busy = 1;
+	rb_thread_call_without_gvl(
+			build_blocking,
+			&(struct build_info){ .grid = &og->grid, .in = (uint8_t *)RSTRING_PTR(data) },
+			NULL,
+			NULL
+			);
+	og->busy = 0;
+
+	return self;
+}
+
+// Allocates a grid of XPIX/scale x YPIX/scale x ZPIX/scale voxels (default
+// scale 4, giving 125x125x125 voxels of about 61x46x56mm), and counts the
+// given packed 11-bit depth frame into it, if any.
+//
+// Scale 1 uses the overhead and side view resolution, but needs 500MB.
+static VALUE occupancy_grid_initialize(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[1];
+	struct occupancy_grid *og;
+	VALUE data, opts, kw[1];
+	int scale = 4;
+
+	if(!kw_ids[0]) {
+		kw_ids[0] = rb_intern("scale");
+	}
+
+	rb_scan_args(argc, argv, "01:", &data, &opts);
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, 1, kw);
+		if(kw[0] != Qundef) {
+			scale = NUM2INT(kw[0]);
+		}
+	}
+
+	TypedData_Get_Struct(self, struct occupancy_grid, &occupancy_grid_type, og);
+	if(og->grid.sums != NULL) {
+		rb_raise(rb_eRuntimeError, "OccupancyGrid was already initialized.");
+	}
+
+	if(ku_occupancy_init(&og->grid, scale)) {
+		if(errno == EINVAL) {
+			rb_raise(rb_eArgError, "Scale must be between 1 and %d (got %d).", XPIX, scale);
+		}
+		rb_raise(rb_eNoMemError, "Unable to allocate an occupancy grid with scale %d.", scale);
+	}
+
+	if(!NIL_P(data)) {
+		occupancy_grid_update(self, data);
+	}
+
+	return self;
+}
+
+// Returns an Array with the number of points from the last frame in each of
+// the given world-space boxes (in millimeters, inclusive).  Boxes may be
+// Zones, Hashes with xmin, ymin, zmin, xmax, ymax, and zmax keys, or Arrays
+// of [xmin, ymin, zmin, xmax, ymax, zmax].
+//
+// Counts are at voxel resolution: points in a voxel that touches a box are
+// counted even if they are just outside the box.
+static VALUE occupancy_grid_count_boxes(VALUE self, VALUE boxes)
+{
+	struct occupancy_grid *og = get_grid(self);
+	VALUE result;
+	long i, len;
+	int box[6];
+
+	Check_Type(boxes, T_ARRAY);
+
+	len = RARRAY_LEN(boxes);
+	result = rb_ary_new_capa(len);
+	for(i = 0; i < len; i++) {
+		ku_box_from_value(RARRAY_AREF(boxes, i), box);
+		rb_ary_push(result, UINT2NUM(ku_occupancy_count(&og->grid, box[0], box[1], box[2], box[3], box[4], box[5])));
+	}
+
+	return result;
+}
+
+// Returns the grid size in voxels as [x, y, z].
+static VALUE occupancy_grid_dimensions(VALUE self)
+{
+	struct occupancy_grid *og = get_grid(self);
+	return rb_ary_new_from_args(3, INT2FIX(og->grid.nx), INT2FIX(og->grid.ny), INT2FIX(og->grid.nz));
+}
+
+// Returns the size of a voxel in world-space millimeters as [x, y, z].
+static VALUE occupancy_grid_voxel_size(VALUE self)
+{
+	struct occupancy_grid *og = get_grid(self);
+	return rb_ary_new_from_args(3,
+			DBL2NUM((double)XMAX * og->grid.scale / XPIX),
+			DBL2NUM((double)YMAX * og->grid.scale / YPIX),
+			DBL2NUM((double)ZMAX * og->grid.scale / ZPIX));
+}
+
+void init_occupancy_grid(VALUE kinutils)
+{
+	OccupancyGrid = rb_define_class_under(kinutils, "OccupancyGrid", rb_cObject);
+	rb_define_alloc_func(OccupancyGrid, occupancy_grid_alloc);
+
+	rb_define_method(OccupancyGrid, "initialize", occupancy_grid_initialize, -1);
+	rb_define_method(OccupancyGrid, "update", occupancy_grid_update, 1);
+	rb_define_method(OccupancyGrid, "count_boxes", occupancy_grid_count_boxes, 1);
+	rb_define_method(OccupancyGrid, "dimensions", occupancy_grid_dimensions, 0);
+	rb_define_method(OccupancyGrid, "voxel_size", occupancy_grid_voxel_size, 0);
+}
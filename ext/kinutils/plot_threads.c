@@ -0,0 +1,379 @@
+/*
+ * Multithreaded view plotting for Kinect depth data.
+ * (C)2026 Mike Bourgeous
+ *
+ * The calling thread and count - 1 persistent workers each plot one band of
+ * input rows.  The calling thread plots straight into the output views, and
+ * each worker plots into its own partial images.  All threads then merge the
+ * partials into the output in parallel, each handling one slice of every
+ * view.  Every point adds a positive amount to a view, so the saturating sum
+ * of the bands equals the serial result.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "unpack.h"
+#include "plot_threads.h"
+
+// Size of a worker's partial overhead, side, and front views.
+#define PARTIAL_SIZE (XPIX * ZPIX + ZPIX * YPIX + XPIX * YPIX)
+
+struct plot_job {
+	const void *in;
+	int packed;
+	uint8_t *linear;
+	uint8_t *overhead;
+	uint8_t *side;
+	uint8_t *front;
+	int untabled[KU_MAX_PLOT_THREADS];
+};
+
+struct plot_worker {
+	pthread_t thread;
+	int index;
+	unsigned int generation; // Last job generation seen by this worker
+	uint8_t *partial; // Partial overhead, side, and front views, in that order
+};
+
+typedef void (*plot_task)(struct plot_job *job, int index);
+
+// Held for the duration of a multithreaded plot or thread count change.
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Protects the job dispatch variables below.
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int generation;
+static int pending;
+static int stopping;
+static plot_task current_task;
+static struct plot_job *current_job;
+
+// Worker 0 is the calling thread, and has no thread or partial images.
+static struct plot_worker workers[KU_MAX_PLOT_THREADS];
+static int thread_count = 1;
+
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static void *worker_main(void *data)
+{
+	struct plot_worker *w = data;
+
+	pthread_mutex_lock(&pool_lock);
+	for(;;) {
+		while(w->generation == generation && !stopping) {
+			pthread_cond_wait(&start_cond, &pool_lock);
+		}
+		if(stopping) {
+			break;
+		}
+		w->generation = generation;
+
+		pthread_mutex_unlock(&pool_lock);
+		current_task(current_job, w->index);
+		pthread_mutex_lock(&pool_lock);
+
+		pending--;
+		if(pending == 0) {
+			pthread_cond_signal(&done_cond);
+		}
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	return NULL;
+}
+
+// Runs task on every thread, including the calling thread as index 0, and
+// waits for all of them to finish.
+static void run_task(plot_task task, struct plot_job *job)
+{
+	pthread_mutex_lock(&pool_lock);
+	current_task = task;
+	current_job = job;
+	pending = thread_count - 1;
+	generation++;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&pool_lock);
+
+	task(job, 0);
+
+	pthread_mutex_lock(&pool_lock);
+	while(pending > 0) {
+		pthread_cond_wait(&done_cond, &pool_lock);
+	}
+	pthread_mutex_unlock(&pool_lock);
+}
+
+// Plots thread index's band of rows.
+static void plot_band(struct plot_job *job, int index)
+{
+	int y0 = 480 * index / thread_count;
+	int y1 = 480 * (index + 1) / thread_count;
+	uint8_t *overhead = job->overhead;
+	uint8_t *side = job->side;
+	uint8_t *front = job->front;
+
+	if(index > 0) {
+		overhead = overhead ? workers[index].partial : NULL;
+		side = side ? workers[index].partial + XPIX * ZPIX : NULL;
+		front = front ? workers[index].partial + XPIX * ZPIX + ZPIX * YPIX : NULL;
+	}
+
+	if(overhead) {
+		memset(overhead, 0, XPIX * ZPIX);
+	}
+	if(side) {
+		memset(side, 0, ZPIX * YPIX);
+	}
+	if(front) {
+		memset(front, 0, XPIX * YPIX);
+	}
+
+	if(job->packed) {
+		job->untabled[index] = plot_views11_rows(job->in, y0, y1, job->linear, overhead, side, front);
+	} else {
+		job->untabled[index] = plot_views_rows(job->in, y0, y1, job->linear, overhead, side, front);
+	}
+}
+
+// Adds thread index's slice of every worker's partial image at offset into
+// out (size bytes), saturating at 255.  Slices start on cache line
+// boundaries so threads don't write to the same line.
+static void merge_view(uint8_t *out, size_t offset, size_t size, int index)
+{
+	size_t start = (size * index / thread_count) & ~(size_t)63;
+	size_t end = index == thread_count - 1 ? size : (size * (index + 1) / thread_count) & ~(size_t)63;
+	const uint8_t *part;
+	size_t i;
+	int t, c;
+
+	for(t = 1; t < thread_count; t++) {
+		part = workers[t].partial + offset;
+		for(i = start; i < end; i++) {
+			c = out[i] + part[i];
+			out[i] = c > 255 ? 255 : c;
+		}
+	}
+}
+
+// Merges thread index's slice of each view.
+static void merge_slice(struct plot_job *job, int index)
+{
+	if(job->overhead) {
+		merge_view(job->overhead, 0, XPIX * ZPIX, index);
+	}
+	if(job->side) {
+		merge_view(job->side, XPIX * ZPIX, ZPIX * YPIX, index);
+	}
+	if(job->front) {
+		merge_view(job->front, XPIX * ZPIX + ZPIX * YPIX, XPIX * YPIX, index);
+	}
+}
+
+// Plots on the calling thread, using the single-view functions when only one
+// view is wanted.
+static void plot_serial(const void *in, int packed, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	int count = !!linear + !!overhead + !!side + !!front;
+
+	if(packed && count == 1) {
+		if(linear) {
+			plot_linear11(in, linear);
+		} else if(overhead) {
+			plot_overhead11(in, overhead);
+		} else if(side) {
+			plot_side11(in, side);
+		} else {
+			plot_front11(in, front);
+		}
+	} else if(packed) {
+		plot_views11(in, linear, overhead, side, front);
+	} else {
+		plot_views(in, linear, overhead, side, front);
+	}
+}
+
+// Plots any combination of views like plot_views() (if packed is 0) or
+// plot_views11() (if packed is 1), splitting the input rows into one band
+// per thread.  Each worker scatters its band into a private partial image,
+// and the partials are merged into the output with a saturating add.  The
+// output is identical to the serial functions'.  Falls back to the serial
+// functions if only one thread is configured, or if another thread is
+// already using the workers.
+void ku_plot_views_mt(const void *in, int packed, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	struct plot_job job = {
+		.in = in,
+		.packed = packed,
+		.linear = linear,
+		.overhead = overhead,
+		.side = side,
+		.front = front,
+	};
+	int i;
+
+	if(thread_count <= 1 || pthread_mutex_trylock(&job_lock)) {
+		plot_serial(in, packed, linear, overhead, side, front);
+		return;
+	}
+	if(thread_count <= 1) {
+		pthread_mutex_unlock(&job_lock);
+		plot_serial(in, packed, linear, overhead, side, front);
+		return;
+	}
+
+	run_task(plot_band, &job);
+	if(overhead || side || front) {
+		run_task(merge_slice, &job);
+	}
+
+	// Points beyond the projection tables can subtract from the front view,
+	// so its result depends on plotting order; redo it serially.
+	if(front) {
+		for(i = 0; i < thread_count; i++) {
+			if(job.untabled[i]) {
+				memset(front, 0, XPIX * YPIX);
+				if(packed) {
+					plot_views11_rows(in, 0, 480, NULL, NULL, NULL, front);
+				} else {
+					plot_views_rows(in, 0, 480, NULL, NULL, NULL, front);
+				}
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&job_lock);
+}
+
+// Stops all worker threads.  The caller must hold job_lock.
+static void stop_workers(void)
+{
+	int i;
+
+	pthread_mutex_lock(&pool_lock);
+	stopping = 1;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&pool_lock);
+
+	for(i = 1; i < thread_count; i++) {
+		pthread_join(workers[i].thread, NULL);
+		free(workers[i].partial);
+		workers[i].partial = NULL;
+	}
+
+	stopping = 0;
+	thread_count = 1;
+}
+
+// Starts count - 1 worker threads.  The caller must hold job_lock, and no
+// workers may be running.  Returns 0 on success, or an error number.
+static int start_workers(int count)
+{
+	sigset_t all, old;
+	int i, ret = 0;
+
+	// Workers never handle signals; leave them to the application's threads
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	for(i = 1; i < count; i++) {
+		workers[i].index = i;
+		workers[i].generation = generation;
+		workers[i].partial = malloc(PARTIAL_SIZE);
+		if(workers[i].partial == NULL) {
+			ret = ENOMEM;
+			break;
+		}
+
+		ret = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+		if(ret) {
+			free(workers[i].partial);
+			workers[i].partial = NULL;
+			break;
+		}
+
+		thread_count = i + 1;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if(ret) {
+		stop_workers();
+	}
+
+	return ret;
+}
+
+// Worker threads do not survive fork(), so the child plots serially.
+static void atfork_child(void)
+{
+	int i;
+
+	pthread_mutex_init(&job_lock, NULL);
+	pthread_mutex_init(&pool_lock, NULL);
+	pthread_cond_init(&start_cond, NULL);
+	pthread_cond_init(&done_cond, NULL);
+
+	for(i = 1; i < thread_count; i++) {
+		free(workers[i].partial);
+		workers[i].partial = NULL;
+	}
+	thread_count = 1;
+	stopping = 0;
+}
+
+static void register_atfork(void)
+{
+	pthread_atfork(NULL, NULL, atfork_child);
+}
+
+// Sets the number of threads used by ku_plot_views_mt(), including the
+// calling thread, starting or stopping worker threads as needed.  A count of
+// 1 plots serially.  A count of 0 uses one thread per online CPU.  Returns 0
+// on success, or -1 with errno set if count is out of range or a thread could
+// not be started (plotting is then serial).  Waits for any plot in progress
+// to finish.
+int ku_set_plot_threads(int count)
+{
+	long cpus;
+	int ret;
+
+	if(count == 0) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		count = cpus < 1 ? 1 : cpus > KU_MAX_PLOT_THREADS ? KU_MAX_PLOT_THREADS : cpus;
+	}
+	if(count < 1 || count > KU_MAX_PLOT_THREADS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_once(&atfork_once, register_atfork);
+
+	pthread_mutex_lock(&job_lock);
+	if(count == thread_count) {
+		pthread_mutex_unlock(&job_lock);
+		return 0;
+	}
+	stop_workers();
+	ret = start_workers(count);
+	pthread_mutex_unlock(&job_lock);
+
+	if(ret) {
+		errno = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Returns the number of threads used by ku_plot_views_mt().
+int ku_plot_threads(void)
+{
+	return thread_count;
+}
@@ -0,0 +1,33 @@
+/*
+ * Multithreaded view plotting for Kinect depth data.
+ * (C)2026 Mike Bourgeous
+ */
+#ifndef PLOT_THREADS_H_
+#define PLOT_THREADS_H_
+
+#include <stdint.h>
+
+// Maximum number of plotting threads (including the calling thread).
+#define KU_MAX_PLOT_THREADS 64
+
+// Sets the number of threads used by ku_plot_views_mt(), including the
+// calling thread, starting or stopping worker threads as needed.  A count of
+// 1 plots serially.  A count of 0 uses one thread per online CPU.  Returns 0
+// on success, or -1 with errno set if count is out of range or a thread could
+// not be started (plotting is then serial).  Waits for any plot in progress
+// to finish.
+int ku_set_plot_threads(int count);
+
+// Returns the number of threads used by ku_plot_views_mt().
+int ku_plot_threads(void);
+
+// Plots any combination of views like plot_views() (if packed is 0) or
+// plot_views11() (if packed is 1), splitting the input rows into one band
+// per thread.  Each worker scatters its band into a private partial image,
+// and the partials are merged into the output with a saturating add.  The
+// output is identical to the serial functions'.  Falls back to the serial
+// functions if only one thread is configured, or if another thread is
+// already using the workers.
+void ku_plot_views_mt(const void *in, int packed, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front);
+
+#endif /* PLOT_THREADS_H_ */
@@ -0,0 +1,366 @@
+/*
+ * Depth recording and replay for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * A Recorder writes packed depth frames to an indexed recording file.  A
+ * Recording maps one for replay, handing out frames as frozen Strings that
+ * point straight into the mapping, so every Kinutils function can read them
+ * without a copy.
+ */
+#include <errno.h>
+#include <time.h>
+#include <ruby.h>
+
+#include "depth_recording.h"
+#include "kinutils.h"
+
+struct recorder {
+	struct ku_recorder rec;
+	int open;
+};
+
+static VALUE Recording = Qnil;
+static VALUE Recorder = Qnil;
+
+// Hidden instance variable that keeps a Recording (and its mapping) alive as
+// long as any of its frame Strings.
+static ID id_recording;
+
+static void recording_free(void *data)
+{
+	struct ku_recording *rec = data;
+	ku_recording_close(rec);
+	xfree(rec);
+}
+
+static size_t recording_size(const void *data)
+{
+	const struct ku_recording *rec = data;
+	return sizeof(struct ku_recording) + rec->count * sizeof(struct ku_rec_entry);
+}
+
+static const rb_data_type_t recording_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::Recording",
+	.function = {
+		.dmark = NULL,
+		.dfree = recording_free,
+		.dsize = recording_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE recording_alloc(VALUE klass)
+{
+	struct ku_recording *rec;
+	return TypedData_Make_Struct(klass, struct ku_recording, &recording_type, rec);
+}
+
+static struct ku_recording *get_recording(VALUE self)
+{
+	struct ku_recording *rec;
+
+	TypedData_Get_Struct(self, struct ku_recording, &recording_type, rec);
+	if(rec->map == NULL) {
+		rb_raise(rb_eRuntimeError, "Recording was not initialized.");
+	}
+
+	return rec;
+}
+
+// Converts microseconds since the Unix epoch to a Time.
+static VALUE time_from_us(int64_t us)
+{
+	int64_t sec = us / 1000000;
+	int64_t usec = us % 1000000;
+
+	if(usec < 0) {
+		sec--;
+		usec += 1000000;
+	}
+
+	return rb_time_nano_new(sec, usec * 1000);
+}
+
+// Converts a Time or a Numeric number of seconds since the Unix epoch to
+// microseconds.
+static int64_t us_from_time(VALUE time)
+{
+	struct timespec ts = rb_time_timespec(time);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Converts a possibly negative frame index to an offset from the start,
+// returning -1 if it is out of range.
+static long frame_index(struct ku_recording *rec, VALUE index)
+{
+	long i = NUM2LONG(index);
+
+	if(i < 0) {
+		i += rec->count;
+	}
+	if(i < 0 || (size_t)i >= rec->count) {
+		return -1;
+	}
+
+	return i;
+}
+
+// Returns a frozen String that points at frame i in the mapping.
+static VALUE frame_string(VALUE self, struct ku_recording *rec, size_t i)
+{
+	VALUE str = rb_str_new_static((const char *)ku_recording_frame(rec, i), KU_REC_FRAME_SIZE);
+	rb_ivar_set(str, id_recording, self);
+	return rb_obj_freeze(str);
+}
+
+// Maps the recording at path for reading.  Raises SystemCallError if it
+// can't be opened, or ArgumentError if it is not a valid recording.
+static VALUE recording_initialize(VALUE self, VALUE path)
+{
+	struct ku_recording *rec;
+
+	TypedData_Get_Struct(self, struct ku_recording, &recording_type, rec);
+	if(rec->map != NULL) {
+		rb_raise(rb_eRuntimeError, "Recording was already initialized.");
+	}
+
+	FilePathValue(path);
+	if(ku_recording_open(rec, RSTRING_PTR(path))) {
+		if(errno == EINVAL) {
+			rb_raise(rb_eArgError, "%"PRIsVALUE" is not a valid depth recording.", path);
+		}
+		rb_sys_fail_str(path);
+	}
+
+	return self;
+}
+
+// Returns the number of frames in the recording.
+static VALUE recording_length(VALUE self)
+{
+	return SIZET2NUM(get_recording(self)->count);
+}
+
+// Returns the packed 11-bit data of the given frame (negative indices count
+// from the end), or nil if there is no such frame.  The frozen String points
+// directly into the mapped file rather than holding a copy, and keeps the
+// Recording alive.
+static VALUE recording_aref(VALUE self, VALUE index)
+{
+	struct ku_recording *rec = get_recording(self);
+	long i = frame_index(rec, index);
+
+	return i < 0 ? Qnil : frame_string(self, rec, i);
+}
+
+// Returns the Time at which the given frame was recorded, or nil if there is
+// no such frame.  Frames from a recording that was never closed have a time
+// of 0 (the Unix epoch).
+static VALUE recording_time(VALUE self, VALUE index)
+{
+	struct ku_recording *rec = get_recording(self);
+	long i = frame_index(rec, index);
+
+	return i < 0 ? Qnil : time_from_us(ku_recording_timestamp(rec, i));
+}
+
+// Returns the index of the first frame recorded at or after the given Time
+// (or Numeric seconds since the Unix epoch), or the number of frames if every
+// frame is older.
+static VALUE recording_seek(VALUE self, VALUE time)
+{
+	struct ku_recording *rec = get_recording(self);
+	return SIZET2NUM(ku_recording_seek(rec, us_from_time(time)));
+}
+
+// Yields the data and Time of each frame in order (see #[] and #time).
+// Returns an Enumerator if no block is given.
+static VALUE recording_each(VALUE self)
+{
+	struct ku_recording *rec;
+	size_t i;
+
+	RETURN_SIZED_ENUMERATOR(self, 0, 0, recording_length);
+
+	rec = get_recording(self);
+	for(i = 0; i < rec->count; i++) {
+		rb_yield_values(2, frame_string(self, rec, i), time_from_us(ku_recording_timestamp(rec, i)));
+	}
+
+	return self;
+}
+
+static void recorder_free(void *data)
+{
+	struct recorder *r = data;
+	if(r->open) {
+		ku_recorder_close(&r->rec);
+	}
+	xfree(r);
+}
+
+static size_t recorder_size(const void *data)
+{
+	const struct recorder *r = data;
+	return sizeof(struct recorder) + r->rec.capacity * sizeof(struct ku_rec_entry);
+}
+
+static const rb_data_type_t recorder_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::Recorder",
+	.function = {
+		.dmark = NULL,
+		.dfree = recorder_free,
+		.dsize = recorder_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE recorder_alloc(VALUE klass)
+{
+	struct recorder *r;
+	return TypedData_Make_Struct(klass, struct recorder, &recorder_type, r);
+}
+
+// Returns the recorder, raising an error if it is not open.
+static struct recorder *get_recorder(VALUE self)
+{
+	struct recorder *r;
+
+	TypedData_Get_Struct(self, struct recorder, &recorder_type, r);
+	if(!r->open) {
+		rb_raise(rb_eIOError, "Recorder is closed.");
+	}
+
+	return r;
+}
+
+// Creates (or truncates) a recording file at path.  The recording must be
+// closed with #close for its index to be written.
+static VALUE recorder_initialize(VALUE self, VALUE path)
+{
+	struct recorder *r;
+
+	TypedData_Get_Struct(self, struct recorder, &recorder_type, r);
+	if(r->open) {
+		rb_raise(rb_eRuntimeError, "Recorder was already initialized.");
+	}
+
+	FilePathValue(path);
+	if(ku_recorder_open(&r->rec, RSTRING_PTR(path))) {
+		rb_sys_fail_str(path);
+	}
+	r->open = 1;
+
+	return self;
+}
+
+// Appends a packed 11-bit depth frame recorded at the given Time (or Numeric
+// seconds since the Unix epoch; default now).  Returns self.
+static VALUE recorder_add(int argc, VALUE *argv, VALUE self)
+{
+	struct recorder *r = get_recorder(self);
+	VALUE data, time;
+	struct timespec ts;
+	int64_t us;
+
+	rb_scan_args(argc, argv, "11", &data, &time);
+
+	Check_Type(data, T_STRING);
+	if(RSTRING_LEN(data) < KU_PACKED_SIZE) {
+		rb_raise(rb_eArgError, "Input data must be at least 640*480*11/8 bytes (got %ld).", RSTRING_LEN(data));
+	}
+
+	if(NIL_P(time)) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	} else {
+		us = us_from_time(time);
+	}
+
+	if(ku_recorder_add(&r->rec, (uint8_t *)RSTRING_PTR(data), us)) {
+		rb_sys_fail("Error writing depth recording");
+	}
+
+	return self;
+}
+
+// Appends a packed 11-bit depth frame recorded now.  Returns self.
+static VALUE recorder_push(VALUE self, VALUE data)
+{
+	return recorder_add(1, &data, self);
+}
+
+// Returns the number of frames written so far.
+static VALUE recorder_length(VALUE self)
+{
+	return SIZET2NUM(get_recorder(self)->rec.count);
+}
+
+// Writes the recording's index and closes it.  Does nothing if the recorder
+// is already closed.
+static VALUE recorder_close(VALUE self)
+{
+	struct recorder *r;
+
+	TypedData_Get_Struct(self, struct recorder, &recorder_type, r);
+	if(r->open) {
+		r->open = 0;
+		if(ku_recorder_close(&r->rec)) {
+			rb_sys_fail("Error closing depth recording");
+		}
+	}
+
+	return Qnil;
+}
+
+// Returns true if the recorder has been closed.
+static VALUE recorder_closed_p(VALUE self)
+{
+	struct recorder *r;
+	TypedData_Get_Struct(self, struct recorder, &recorder_type, r);
+	return r->open ? Qfalse : Qtrue;
+}
+
+// Creates a Recorder.  With a block, yields it, closes it when the block
+// returns, and returns the block's value.
+static VALUE recorder_s_open(VALUE klass, VALUE path)
+{
+	VALUE recorder = rb_class_new_instance(1, &path, klass);
+
+	if(!rb_block_given_p()) {
+		return recorder;
+	}
+
+	return rb_ensure(rb_yield, recorder, recorder_close, recorder);
+}
+
+void init_recording(VALUE kinutils)
+{
+	id_recording = rb_intern("__recording__");
+
+	Recording = rb_define_class_under(kinutils, "Recording", rb_cObject);
+	rb_define_alloc_func(Recording, recording_alloc);
+	rb_include_module(Recording, rb_mEnumerable);
+
+	rb_define_const(Recording, "FRAME_SIZE", INT2FIX(KU_REC_FRAME_SIZE));
+
+	rb_define_method(Recording, "initialize", recording_initialize, 1);
+	rb_define_method(Recording, "length", recording_length, 0);
+	rb_define_method(Recording, "size", recording_length, 0);
+	rb_define_method(Recording, "[]", recording_aref, 1);
+	rb_define_method(Recording, "time", recording_time, 1);
+	rb_define_method(Recording, "seek", recording_seek, 1);
+	rb_define_method(Recording, "each", recording_each, 0);
+
+	Recorder = rb_define_class_under(kinutils, "Recorder", rb_cObject);
+	rb_define_alloc_func(Recorder, recorder_alloc);
+
+	rb_define_singleton_method(Recorder, "open", recorder_s_open, 1);
+	rb_define_method(Recorder, "initialize", recorder_initialize, 1);
+	rb_define_method(Recorder, "add", recorder_add, -1);
+	rb_define_method(Recorder, "<<", recorder_push, 1);
+	rb_define_method(Recorder, "length", recorder_length, 0);
+	rb_define_method(Recorder, "size", recorder_length, 0);
+	rb_define_method(Recorder, "close", recorder_close, 0);
+	rb_define_method(Recorder, "closed?", recorder_closed_p, 0);
+}
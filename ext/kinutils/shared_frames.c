@@ -0,0 +1,516 @@
+/*
+ * Shared memory frame rings for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * A FramePublisher copies each depth frame, its unpacked data, and its
+ * plotted views into a ring in POSIX shared memory (see shm_frames.h), and
+ * SharedFrames maps the ring in other processes, handing out frozen Strings
+ * that point straight into the shared memory, or copies on request.  One process can then read
+ * and process KND's frames once for any number of local consumers.
+ */
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <ruby.h>
+
+#include "shm_frames.h"
+#include "kinutils.h"
+
+struct publisher {
+	struct ku_shm_frames shm;
+	VALUE name;
+};
+
+static VALUE FramePublisher = Qnil;
+static VALUE SharedFrames = Qnil;
+
+// Hidden instance variable that keeps a SharedFrames (and its mapping) alive
+// as long as any of its buffer Strings.
+static ID id_shared_frames;
+
+// Keys of each frame's buffers, in enum ku_shm_buffer order.
+static const char *buffer_names[KU_SHM_BUFFER_COUNT] = { "packed", "depth", "linear", "overhead", "side", "front" };
+static ID buffer_ids[KU_SHM_BUFFER_COUNT];
+static VALUE buffer_syms[KU_SHM_BUFFER_COUNT];
+static VALUE sym_frame, sym_time;
+
+// Number of times SharedFrames#read retries a frame that was overwritten
+// while the block was using it.
+#define READ_TRIES 4
+
+// Fills sizes with the size of each buffer in a frame.
+static void buffer_sizes(uint32_t sizes[KU_SHM_BUFFER_COUNT])
+{
+	int i;
+
+	sizes[KU_SHM_PACKED] = KU_PACKED_SIZE;
+	sizes[KU_SHM_DEPTH] = KU_UNPACKED_SIZE;
+	for(i = 0; i < KU_VIEW_COUNT; i++) {
+		sizes[KU_SHM_LINEAR + i] = ku_view_sizes[i];
+	}
+}
+
+static void publisher_mark(void *data)
+{
+	struct publisher *p = data;
+	rb_gc_mark(p->name);
+}
+
+static void publisher_free(void *data)
+{
+	struct publisher *p = data;
+	ku_shm_close(&p->shm);
+	xfree(p);
+}
+
+static size_t publisher_size(const void *data)
+{
+	return sizeof(struct publisher);
+}
+
+static const rb_data_type_t publisher_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::FramePublisher",
+	.function = {
+		.dmark = publisher_mark,
+		.dfree = publisher_free,
+		.dsize = publisher_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE publisher_alloc(VALUE klass)
+{
+	struct publisher *p;
+	VALUE obj = TypedData_Make_Struct(klass, struct publisher, &publisher_type, p);
+	p->name = Qnil;
+	return obj;
+}
+
+// Returns the publisher, raising an error if it is not open.
+static struct publisher *get_publisher(VALUE self)
+{
+	struct publisher *p;
+
+	TypedData_Get_Struct(self, struct publisher, &publisher_type, p);
+	if(p->shm.map == NULL) {
+		rb_raise(rb_eIOError, "FramePublisher is closed.");
+	}
+
+	return p;
+}
+
+// Creates the shared memory ring called +name+ (e.g. "/knd-frames"; see
+// shm_open(3)) with room for the newest +slots+ frames (default 4) and the
+// given permissions (default 0600), or reuses an existing ring of the same
+// size, continuing its frame numbers.  Only one publisher may write to a
+// ring at a time.
+static VALUE publisher_initialize(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[2];
+	struct publisher *p;
+	uint32_t sizes[KU_SHM_BUFFER_COUNT];
+	VALUE name, opts, kw[2] = { Qundef, Qundef };
+	int slots = 4, mode = 0600;
+
+	TypedData_Get_Struct(self, struct publisher, &publisher_type, p);
+	if(p->shm.map != NULL) {
+		rb_raise(rb_eRuntimeError, "FramePublisher was already initialized.");
+	}
+
+	if(!kw_ids[0]) {
+		kw_ids[0] = rb_intern("slots");
+		kw_ids[1] = rb_intern("mode");
+	}
+
+	rb_scan_args(argc, argv, "1:", &name, &opts);
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, 2, kw);
+	}
+	if(kw[0] != Qundef) {
+		slots = NUM2INT(kw[0]);
+		if(slots < 1 || slots > 256) {
+			rb_raise(rb_eArgError, "FramePublisher slot count must be from 1 to 256 (got %d).", slots);
+		}
+	}
+	if(kw[1] != Qundef) {
+		mode = NUM2INT(kw[1]);
+	}
+
+	FilePathValue(name);
+	buffer_sizes(sizes);
+	if(ku_shm_create(&p->shm, RSTRING_PTR(name), slots, sizes, mode)) {
+		rb_sys_fail_str(name);
+	}
+	p->name = rb_str_new_frozen(name);
+
+	return self;
+}
+
+// Copies a packed 11-bit depth frame into the next slot of the ring, with any
+// of the given :depth (16-bit unpacked data), :linear, :overhead, :side, and
+// :front buffers, e.g. from a FrameContext.  The :time is a Time or Numeric
+// seconds since the Unix epoch (default now).  Returns the frame's number.
+static VALUE publisher_publish(int argc, VALUE *argv, VALUE self)
+{
+	static ID kw_ids[KU_SHM_BUFFER_COUNT];
+	struct publisher *p = get_publisher(self);
+	uint32_t sizes[KU_SHM_BUFFER_COUNT], present = 0;
+	VALUE bufs[KU_SHM_BUFFER_COUNT], opts, time;
+	VALUE kw[KU_SHM_BUFFER_COUNT]; // Buffers after :packed, then :time
+	struct ku_shm_slot *slot;
+	struct timespec ts;
+	int64_t us;
+	int i;
+
+	if(!kw_ids[0]) {
+		for(i = 1; i < KU_SHM_BUFFER_COUNT; i++) {
+			kw_ids[i - 1] = buffer_ids[i];
+		}
+		kw_ids[KU_SHM_BUFFER_COUNT - 1] = rb_intern("time");
+	}
+
+	rb_scan_args(argc, argv, "1:", &bufs[KU_SHM_PACKED], &opts);
+	for(i = 0; i < KU_SHM_BUFFER_COUNT; i++) {
+		kw[i] = Qundef;
+	}
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, KU_SHM_BUFFER_COUNT, kw);
+	}
+	for(i = 1; i < KU_SHM_BUFFER_COUNT; i++) {
+		bufs[i] = kw[i - 1];
+	}
+	time = kw[KU_SHM_BUFFER_COUNT - 1];
+
+	// Everything is checked before the slot is marked as being written
+	buffer_sizes(sizes);
+	for(i = 0; i < KU_SHM_BUFFER_COUNT; i++) {
+		if(bufs[i] == Qundef || !RTEST(bufs[i])) {
+			continue;
+		}
+
+		StringValue(bufs[i]);
+		if(RSTRING_LEN(bufs[i]) < (long)sizes[i]) {
+			rb_raise(rb_eArgError, "The %s buffer must be at least %u bytes (got %ld).",
+					buffer_names[i], sizes[i], RSTRING_LEN(bufs[i]));
+		}
+		present |= 1 << i;
+	}
+
+	if(time == Qundef || NIL_P(time)) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+	} else {
+		ts = rb_time_timespec(time);
+	}
+	us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	slot = ku_shm_begin(&p->shm);
+	for(i = 0; i < KU_SHM_BUFFER_COUNT; i++) {
+		if(present & (1 << i)) {
+			memcpy(ku_shm_buffer(&p->shm, slot, i), RSTRING_PTR(bufs[i]), sizes[i]);
+		}
+	}
+
+	return ULL2NUM(ku_shm_commit(&p->shm, slot, present, us));
+}
+
+// Returns the number of the newest published frame, or nil if there is none.
+static VALUE publisher_latest(VALUE self)
+{
+	uint64_t n = ku_shm_latest(&get_publisher(self)->shm);
+	return n ? ULL2NUM(n) : Qnil;
+}
+
+// Returns the number of frames kept in the ring.
+static VALUE publisher_slots(VALUE self)
+{
+	return UINT2NUM(get_publisher(self)->shm.slot_count);
+}
+
+// Returns the ring's shared memory name.
+static VALUE publisher_name(VALUE self)
+{
+	struct publisher *p;
+	TypedData_Get_Struct(self, struct publisher, &publisher_type, p);
+	return p->name;
+}
+
+// Unmaps the ring, leaving it in shared memory for readers and later
+// publishers (see FramePublisher.unlink).  Does nothing if already closed.
+static VALUE publisher_close(VALUE self)
+{
+	struct publisher *p;
+	TypedData_Get_Struct(self, struct publisher, &publisher_type, p);
+	ku_shm_close(&p->shm);
+	return Qnil;
+}
+
+// Returns true if the publisher has been closed.
+static VALUE publisher_closed_p(VALUE self)
+{
+	struct publisher *p;
+	TypedData_Get_Struct(self, struct publisher, &publisher_type, p);
+	return p->shm.map ? Qfalse : Qtrue;
+}
+
+// Removes the shared memory ring called +name+.  Processes that have it
+// mapped keep using it, but new publishers and readers get a new ring.
+// Returns true if it was removed, or false if there was no such ring.
+static VALUE publisher_s_unlink(VALUE klass, VALUE name)
+{
+	FilePathValue(name);
+	if(shm_unlink(RSTRING_PTR(name))) {
+		if(errno == ENOENT) {
+			return Qfalse;
+		}
+		rb_sys_fail_str(name);
+	}
+
+	return Qtrue;
+}
+
+static void shared_frames_free(void *data)
+{
+	struct ku_shm_frames *shm = data;
+	ku_shm_close(shm);
+	xfree(shm);
+}
+
+static size_t shared_frames_size(const void *data)
+{
+	return sizeof(struct ku_shm_frames);
+}
+
+static const rb_data_type_t shared_frames_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::SharedFrames",
+	.function = {
+		.dmark = NULL,
+		.dfree = shared_frames_free,
+		.dsize = shared_frames_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE shared_frames_alloc(VALUE klass)
+{
+	struct ku_shm_frames *shm;
+	return TypedData_Make_Struct(klass, struct ku_shm_frames, &shared_frames_type, shm);
+}
+
+static struct ku_shm_frames *get_shared_frames(VALUE self)
+{
+	struct ku_shm_frames *shm;
+
+	TypedData_Get_Struct(self, struct ku_shm_frames, &shared_frames_type, shm);
+	if(shm->map == NULL) {
+		rb_raise(rb_eRuntimeError, "SharedFrames was not initialized.");
+	}
+
+	return shm;
+}
+
+// Returns the frame number given to a SharedFrames method, or the newest
+// frame's number if nil.
+static uint64_t frame_number(struct ku_shm_frames *shm, VALUE n)
+{
+	return NIL_P(n) ? ku_shm_latest(shm) : NUM2ULL(n);
+}
+
+// Returns true if the options Hash given to a SharedFrames method (or nil)
+// asks for copies of the buffers.
+static int copy_option(VALUE opts)
+{
+	static ID kw_ids[1];
+	VALUE kw[1] = { Qundef };
+
+	if(!kw_ids[0]) {
+		kw_ids[0] = rb_intern("copy");
+	}
+
+	if(!NIL_P(opts)) {
+		rb_get_kwargs(opts, kw_ids, 0, 1, kw);
+	}
+
+	return kw[0] != Qundef && RTEST(kw[0]);
+}
+
+// Returns a Hash describing frame n, or nil if it is not in the ring.  The
+// buffers are copied into ordinary Strings if copy is nonzero, and otherwise
+// point into shared memory.
+static VALUE frame_hash(VALUE self, struct ku_shm_frames *shm, uint64_t n, int copy)
+{
+	struct ku_shm_slot *slot = ku_shm_read(shm, n);
+	VALUE hash, str;
+	int64_t us;
+	int i;
+
+	if(slot == NULL) {
+		return Qnil;
+	}
+
+	us = slot->timestamp;
+	hash = rb_hash_new();
+	rb_hash_aset(hash, sym_frame, ULL2NUM(n));
+	rb_hash_aset(hash, sym_time, rb_time_nano_new(us / 1000000, (us % 1000000) * 1000));
+
+	for(i = 0; i < KU_SHM_BUFFER_COUNT; i++) {
+		str = Qnil;
+		if(slot->buffers & (1 << i)) {
+			if(copy) {
+				str = rb_str_new((const char *)ku_shm_buffer(shm, slot, i), shm->sizes[i]);
+			} else {
+				str = rb_str_new_static((const char *)ku_shm_buffer(shm, slot, i), shm->sizes[i]);
+				rb_ivar_set(str, id_shared_frames, self);
+				rb_obj_freeze(str);
+			}
+		}
+		rb_hash_aset(hash, buffer_syms[i], str);
+	}
+
+	if(!ku_shm_valid(shm, n)) {
+		return Qnil;
+	}
+
+	return hash;
+}
+
+// Maps the shared memory ring called +name+, written by a FramePublisher in
+// this or another process, for reading.  Raises SystemCallError if it can't
+// be opened (e.g. Errno::ENOENT if no publisher has created it yet), or
+// ArgumentError if it is not a frame ring.
+static VALUE shared_frames_initialize(VALUE self, VALUE name)
+{
+	struct ku_shm_frames *shm;
+
+	TypedData_Get_Struct(self, struct ku_shm_frames, &shared_frames_type, shm);
+	if(shm->map != NULL) {
+		rb_raise(rb_eRuntimeError, "SharedFrames was already initialized.");
+	}
+
+	FilePathValue(name);
+	if(ku_shm_open(shm, RSTRING_PTR(name))) {
+		if(errno == EINVAL) {
+			rb_raise(rb_eArgError, "%"PRIsVALUE" is not a shared frame ring.", name);
+		}
+		rb_sys_fail_str(name);
+	}
+
+	return self;
+}
+
+// Returns the number of the newest published frame, or nil if there is none
+// yet.  Frame numbers increase by one for every frame published, so a
+// consumer can poll this to find new frames, and tell how many it missed.
+static VALUE shared_frames_latest(VALUE self)
+{
+	uint64_t n = ku_shm_latest(get_shared_frames(self));
+	return n ? ULL2NUM(n) : Qnil;
+}
+
+// Returns the number of frames kept in the ring.
+static VALUE shared_frames_slots(VALUE self)
+{
+	return UINT2NUM(get_shared_frames(self)->slot_count);
+}
+
+// Returns frame +n+ (default the newest) as a Hash with its :frame number,
+// :time, and :packed, :depth, :linear, :overhead, :side, and :front buffers
+// (nil for those not published), or nil if the frame is not in the ring.
+// The buffers are frozen Strings that point into shared memory without a
+// copy, so the publisher overwrites them once #slots newer frames have been
+// published; check #valid? after using them, or use #read.  Neither #dup nor
+// +str detaches them (the duplicate shares the same memory), and they must
+// not be used as Hash keys.  Pass copy: true to get ordinary Strings that
+// keep their contents, or nil if the frame was overwritten while copying.
+static VALUE shared_frames_frame(int argc, VALUE *argv, VALUE self)
+{
+	struct ku_shm_frames *shm = get_shared_frames(self);
+	VALUE n, opts;
+
+	rb_scan_args(argc, argv, "01:", &n, &opts);
+
+	return frame_hash(self, shm, frame_number(shm, n), copy_option(opts));
+}
+
+// Returns true if frame +n+ is still intact in the ring.
+static VALUE shared_frames_valid_p(VALUE self, VALUE n)
+{
+	struct ku_shm_frames *shm = get_shared_frames(self);
+	uint64_t num = NUM2ULL(n);
+
+	return num && ku_shm_read(shm, num) && ku_shm_valid(shm, num) ? Qtrue : Qfalse;
+}
+
+// Yields frame +n+ (default the newest) as from #frame, and returns the
+// block's value if the frame was still intact when the block returned.  If
+// the newest frame was overwritten while the block was using it, the block
+// is called again with the new newest frame, a few times at most, so it
+// should not have side effects other than its result.  Returns nil without
+// calling the block if there is no such frame, or if it was overwritten.
+// With copy: true, the block is given copies (see #frame) and called once.
+static VALUE shared_frames_read(int argc, VALUE *argv, VALUE self)
+{
+	struct ku_shm_frames *shm = get_shared_frames(self);
+	VALUE n, opts, frame, result;
+	uint64_t num;
+	int i, copy;
+
+	rb_need_block();
+	rb_scan_args(argc, argv, "01:", &n, &opts);
+	copy = copy_option(opts);
+
+	for(i = 0; i < READ_TRIES; i++) {
+		num = frame_number(shm, n);
+		frame = frame_hash(self, shm, num, copy);
+		if(NIL_P(frame)) {
+			if(num == 0 || !NIL_P(n)) {
+				return Qnil;
+			}
+			continue;
+		}
+
+		result = rb_yield(frame);
+		if(copy || ku_shm_valid(shm, num)) {
+			return result;
+		}
+		if(!NIL_P(n)) {
+			return Qnil;
+		}
+	}
+
+	return Qnil;
+}
+
+// Defines the Kinutils::FramePublisher and Kinutils::SharedFrames classes.
+void init_shared_frames(VALUE kinutils)
+{
+	int i;
+
+	id_shared_frames = rb_intern("__shared_frames__");
+	for(i = 0; i < KU_SHM_BUFFER_COUNT; i++) {
+		buffer_ids[i] = rb_intern(buffer_names[i]);
+		buffer_syms[i] = ID2SYM(buffer_ids[i]);
+	}
+	sym_frame = ID2SYM(rb_intern("frame"));
+	sym_time = ID2SYM(rb_intern("time"));
+
+	FramePublisher = rb_define_class_under(kinutils, "FramePublisher", rb_cObject);
+	rb_define_alloc_func(FramePublisher, publisher_alloc);
+	rb_define_singleton_method(FramePublisher, "unlink", publisher_s_unlink, 1);
+	rb_define_method(FramePublisher, "initialize", publisher_initialize, -1);
+	rb_define_method(FramePublisher, "publish", publisher_publish, -1);
+	rb_define_method(FramePublisher, "latest", publisher_latest, 0);
+	rb_define_method(FramePublisher, "slots", publisher_slots, 0);
+	rb_define_method(FramePublisher, "name", publisher_name, 0);
+	rb_define_method(FramePublisher, "close", publisher_close, 0);
+	rb_define_method(FramePublisher, "closed?", publisher_closed_p, 0);
+
+	SharedFrames = rb_define_class_under(kinutils, "SharedFrames", rb_cObject);
+	rb_define_alloc_func(SharedFrames, shared_frames_alloc);
+	rb_define_method(SharedFrames, "initialize", shared_frames_initialize, 1);
+	rb_define_method(SharedFrames, "latest", shared_frames_latest, 0);
+	rb_define_method(SharedFrames, "slots", shared_frames_slots, 0);
+	rb_define_method(SharedFrames, "frame", shared_frames_frame, -1);
+	rb_define_method(SharedFrames, "valid?", shared_frames_valid_p, 1);
+	rb_define_method(SharedFrames, "read", shared_frames_read, -1);
+}
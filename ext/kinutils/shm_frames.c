@@ -0,0 +1,291 @@
+/*
+ * A ring of depth frames in POSIX shared memory.
+ * (C)2026 Mike Bourgeous
+ *
+ * One writer process keeps the most recent frames (packed, unpacked, and any
+ * plotted views) in a fixed number of slots, and any number of reader
+ * processes map the same memory to use them in place.  Each slot has a
+ * sequence lock instead of a mutex, so the writer never waits for readers,
+ * and readers find out afterward whether a frame was overwritten while they
+ * were reading it.
+ */
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_frames.h"
+
+static size_t round64(size_t n)
+{
+	return (n + 63) & ~(size_t)63;
+}
+
+// Fills in shm->sizes and shm->offsets from the given buffer sizes and
+// returns the size of a slot.
+static size_t set_layout(struct ku_shm_frames *shm, const uint32_t sizes[KU_SHM_BUFFER_COUNT])
+{
+	size_t offset = KU_SHM_SLOT_HEADER_SIZE;
+	int i;
+
+	for(i = 0; i < KU_SHM_BUFFER_COUNT; i++) {
+		shm->sizes[i] = sizes[i];
+		shm->offsets[i] = offset;
+		offset = round64(offset + sizes[i]);
+	}
+
+	return offset;
+}
+
+// Returns nonzero if the mapped header describes slots of the given sizes.
+static int header_matches(const struct ku_shm_header *hdr, uint32_t slots, size_t slot_size,
+		const uint32_t sizes[KU_SHM_BUFFER_COUNT])
+{
+	return !memcmp(hdr->magic, KU_SHM_MAGIC, sizeof(hdr->magic)) &&
+		hdr->version == KU_SHM_VERSION &&
+		hdr->header_size == KU_SHM_HEADER_SIZE &&
+		hdr->slot_count == slots &&
+		hdr->slot_size == slot_size &&
+		!memcmp(hdr->buffer_sizes, sizes, sizeof(hdr->buffer_sizes));
+}
+
+// Returns nonzero if the ring still has the geometry it had when shm mapped
+// it.  A writer that reuses the ring with different sizes changes the header
+// before clearing the slots' sequence numbers, so a reader that checks this
+// after a slot's seq never uses a frame laid out differently from shm.
+static int same_geometry(const struct ku_shm_frames *shm)
+{
+	const struct ku_shm_header *hdr = shm->header;
+
+	return hdr->slot_count == shm->slot_count &&
+		hdr->slot_size == shm->slot_size &&
+		!memcmp(hdr->buffer_sizes, shm->sizes, sizeof(hdr->buffer_sizes));
+}
+
+// Maps size bytes of fd into shm, closing fd.  Returns 0 on success, or -1
+// with errno set on error.
+static int map_fd(struct ku_shm_frames *shm, int fd, size_t size, int writable)
+{
+	void *map;
+	int err;
+
+	map = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	err = errno;
+	close(fd);
+	if(map == MAP_FAILED) {
+		errno = err;
+		return -1;
+	}
+
+	shm->map = map;
+	shm->map_size = size;
+	shm->header = map;
+	shm->writable = writable;
+
+	return 0;
+}
+
+// Creates the shared memory object called name (see shm_open(3)) with the
+// given permissions, or reuses it if it already has the same slot count and
+// buffer sizes, and maps it for writing.  A reused ring keeps its frames and
+// numbering, so readers can stay open while a writer restarts.  A ring with
+// different sizes is cleared (but never shrunk, which would crash readers),
+// and readers see no frames in it until they reopen it.  Returns 0 on
+// success, or -1 with errno set on error.
+int ku_shm_create(struct ku_shm_frames *shm, const char *name, uint32_t slots,
+		const uint32_t sizes[KU_SHM_BUFFER_COUNT], mode_t mode)
+{
+	struct ku_shm_header *hdr;
+	struct stat st;
+	size_t slot_size, size;
+	uint32_t i;
+	int fd, err;
+
+	*shm = (struct ku_shm_frames){ .map = NULL };
+
+	if(slots == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	slot_size = set_layout(shm, sizes);
+	size = KU_SHM_HEADER_SIZE + slots * slot_size;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, mode);
+	if(fd < 0) {
+		return -1;
+	}
+
+	if(fstat(fd, &st) || ((size_t)st.st_size < size && ftruncate(fd, size))) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	if(map_fd(shm, fd, size, 1)) {
+		return -1;
+	}
+	shm->slot_count = slots;
+	shm->slot_size = slot_size;
+
+	hdr = shm->header;
+	if(header_matches(hdr, slots, slot_size, sizes)) {
+		return 0;
+	}
+
+	// The magic is written last, so a reader opening the ring meanwhile
+	// rejects it instead of seeing a partial header
+	memset(hdr, 0, KU_SHM_HEADER_SIZE);
+	hdr->version = KU_SHM_VERSION;
+	hdr->header_size = KU_SHM_HEADER_SIZE;
+	hdr->slot_count = slots;
+	hdr->slot_size = slot_size;
+	memcpy(hdr->buffer_sizes, sizes, sizeof(hdr->buffer_sizes));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for(i = 0; i < slots; i++) {
+		memset(shm->map + KU_SHM_HEADER_SIZE + i * slot_size, 0, KU_SHM_SLOT_HEADER_SIZE);
+	}
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(hdr->magic, KU_SHM_MAGIC, sizeof(hdr->magic));
+
+	return 0;
+}
+
+// Maps the shared memory object called name for reading.  Returns 0 on
+// success, or -1 with errno set on error (EINVAL if it is not a frame ring).
+int ku_shm_open(struct ku_shm_frames *shm, const char *name)
+{
+	const struct ku_shm_header *hdr;
+	struct stat st;
+	int fd, err;
+
+	*shm = (struct ku_shm_frames){ .map = NULL };
+
+	fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if(fd < 0) {
+		return -1;
+	}
+
+	if(fstat(fd, &st)) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	if(st.st_size < KU_SHM_HEADER_SIZE) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if(map_fd(shm, fd, st.st_size, 0)) {
+		return -1;
+	}
+
+	hdr = shm->header;
+	if(memcmp(hdr->magic, KU_SHM_MAGIC, sizeof(hdr->magic)) ||
+			hdr->version != KU_SHM_VERSION ||
+			hdr->header_size != KU_SHM_HEADER_SIZE ||
+			hdr->slot_count == 0 ||
+			hdr->slot_size != set_layout(shm, hdr->buffer_sizes) ||
+			KU_SHM_HEADER_SIZE + (size_t)hdr->slot_count * hdr->slot_size > shm->map_size) {
+		ku_shm_close(shm);
+		errno = EINVAL;
+		return -1;
+	}
+	shm->slot_count = hdr->slot_count;
+	shm->slot_size = hdr->slot_size;
+
+	return 0;
+}
+
+// Unmaps the ring.  Buffer pointers from the ring may not be used afterward.
+void ku_shm_close(struct ku_shm_frames *shm)
+{
+	if(shm->map) {
+		munmap(shm->map, shm->map_size);
+	}
+	*shm = (struct ku_shm_frames){ .map = NULL };
+}
+
+// Returns the number of the newest complete frame, or 0 if there is none.
+uint64_t ku_shm_latest(const struct ku_shm_frames *shm)
+{
+	return __atomic_load_n(&shm->header->latest, __ATOMIC_ACQUIRE);
+}
+
+// Returns the slot that holds (or will hold) frame number n.
+struct ku_shm_slot *ku_shm_slot(const struct ku_shm_frames *shm, uint64_t n)
+{
+	uint64_t i = (n - 1) % shm->slot_count;
+	return (struct ku_shm_slot *)(shm->map + KU_SHM_HEADER_SIZE + i * shm->slot_size);
+}
+
+// Returns a pointer to the given buffer within a slot.
+uint8_t *ku_shm_buffer(const struct ku_shm_frames *shm, struct ku_shm_slot *slot, enum ku_shm_buffer buf)
+{
+	return (uint8_t *)slot + shm->offsets[buf];
+}
+
+// Starts writing the next frame, marking its slot as being written, and
+// returns the slot.  Fill in its buffers, then call ku_shm_commit().
+struct ku_shm_slot *ku_shm_begin(struct ku_shm_frames *shm)
+{
+	uint64_t n = shm->header->latest + 1;
+	struct ku_shm_slot *slot = ku_shm_slot(shm, n);
+
+	__atomic_store_n(&slot->seq, 2 * n - 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->frame = n;
+
+	return slot;
+}
+
+// Completes the frame started by ku_shm_begin(), recording which buffers
+// were written (a bitmask of 1 << enum ku_shm_buffer) and its timestamp, and
+// makes it the latest frame.  Returns its frame number.
+uint64_t ku_shm_commit(struct ku_shm_frames *shm, struct ku_shm_slot *slot, uint32_t buffers, int64_t timestamp)
+{
+	uint64_t n = slot->frame;
+
+	slot->buffers = buffers;
+	slot->timestamp = timestamp;
+	__atomic_store_n(&slot->seq, 2 * n, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm->header->latest, n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+// Starts reading frame n.  Returns its slot, or NULL if frame n is not in the
+// ring (not yet written, being written, or overwritten), or if the ring's
+// slot count or buffer sizes changed since it was opened.  Use the sizes in
+// shm->sizes, not the header's.  Check ku_shm_valid() after reading the slot's
+// contents.
+struct ku_shm_slot *ku_shm_read(const struct ku_shm_frames *shm, uint64_t n)
+{
+	struct ku_shm_slot *slot;
+
+	if(n == 0 || n > ku_shm_latest(shm)) {
+		return NULL;
+	}
+
+	slot = ku_shm_slot(shm, n);
+	if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != 2 * n || !same_geometry(shm)) {
+		return NULL;
+	}
+
+	return slot;
+}
+
+// Returns nonzero if frame n, read from a slot returned by ku_shm_read(), has
+// not been overwritten since, and the ring still has the geometry it had when
+// it was opened.
+int ku_shm_valid(const struct ku_shm_frames *shm, uint64_t n)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return n != 0 && __atomic_load_n(&ku_shm_slot(shm, n)->seq, __ATOMIC_RELAXED) == 2 * n &&
+		same_geometry(shm);
+}
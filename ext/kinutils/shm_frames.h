@@ -0,0 +1,129 @@
+/*
+ * A ring of depth frames in POSIX shared memory, for sharing one connection's
+ * frames with other processes on the same host.
+ * (C)2026 Mike Bourgeous
+ */
+#ifndef SHM_FRAMES_H_
+#define SHM_FRAMES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Shared memory layout (native byte order, since it never leaves the host):
+//
+//     Header (KU_SHM_HEADER_SIZE bytes, zero padded):
+//         char magic[8]           "KNDSHM1\0"
+//         uint32_t version        KU_SHM_VERSION
+//         uint32_t header_size    KU_SHM_HEADER_SIZE
+//         uint32_t slot_count     Number of frames kept
+//         uint32_t slot_size      Bytes per slot, a multiple of 64
+//         uint32_t buffer_sizes[KU_SHM_BUFFER_COUNT]
+//         uint64_t latest         Number of the newest complete frame, or 0
+//     Slots: slot_count of
+//         Slot header (KU_SHM_SLOT_HEADER_SIZE bytes, zero padded):
+//             uint64_t seq        Sequence lock (see below)
+//             uint64_t frame      Frame number, starting at 1
+//             int64_t timestamp   Microseconds since the Unix epoch
+//             uint32_t buffers    Bit (1 << i) set if buffer i is present
+//         Buffers, in enum ku_shm_buffer order, each starting on a 64-byte
+//         boundary
+//
+// Frame n is written to slot (n - 1) % slot_count.  The slot's seq is odd
+// while the frame is being written, and 2 * n once frame n is complete.  A
+// reader may use frame n's buffers if seq was 2 * n before it started
+// reading and still is afterward; otherwise the writer overwrote the slot.
+#define KU_SHM_MAGIC "KNDSHM1"
+#define KU_SHM_VERSION 1
+#define KU_SHM_HEADER_SIZE 64
+#define KU_SHM_SLOT_HEADER_SIZE 64
+
+// Buffers kept for each frame.
+enum ku_shm_buffer {
+	KU_SHM_PACKED, // Packed 11-bit depth data
+	KU_SHM_DEPTH, // Unpacked 16-bit depth data
+	KU_SHM_LINEAR,
+	KU_SHM_OVERHEAD,
+	KU_SHM_SIDE,
+	KU_SHM_FRONT,
+	KU_SHM_BUFFER_COUNT
+};
+
+struct ku_shm_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t slot_count;
+	uint32_t slot_size;
+	uint32_t buffer_sizes[KU_SHM_BUFFER_COUNT];
+	uint64_t latest;
+};
+
+struct ku_shm_slot {
+	uint64_t seq;
+	uint64_t frame;
+	int64_t timestamp;
+	uint32_t buffers;
+};
+
+// A shared frame ring mapped by its writer (read/write) or a reader
+// (read-only).
+struct ku_shm_frames {
+	uint8_t *map;
+	size_t map_size;
+	struct ku_shm_header *header;
+	uint32_t slot_count; // Geometry when mapped, in case a writer changes it
+	size_t slot_size;
+	uint32_t sizes[KU_SHM_BUFFER_COUNT]; // Length of each buffer
+	size_t offsets[KU_SHM_BUFFER_COUNT]; // Offset of each buffer in a slot
+	int writable;
+};
+
+// Creates the shared memory object called name (see shm_open(3)) with the
+// given permissions, or reuses it if it already has the same slot count and
+// buffer sizes, and maps it for writing.  A reused ring keeps its frames and
+// numbering, so readers can stay open while a writer restarts.  A ring with
+// different sizes is cleared (but never shrunk, which would crash readers),
+// and readers see no frames in it until they reopen it.  Returns 0 on
+// success, or -1 with errno set on error.
+int ku_shm_create(struct ku_shm_frames *shm, const char *name, uint32_t slots,
+		const uint32_t sizes[KU_SHM_BUFFER_COUNT], mode_t mode);
+
+// Maps the shared memory object called name for reading.  Returns 0 on
+// success, or -1 with errno set on error (EINVAL if it is not a frame ring).
+int ku_shm_open(struct ku_shm_frames *shm, const char *name);
+
+// Unmaps the ring.  Buffer pointers from the ring may not be used afterward.
+void ku_shm_close(struct ku_shm_frames *shm);
+
+// Returns the number of the newest complete frame, or 0 if there is none.
+uint64_t ku_shm_latest(const struct ku_shm_frames *shm);
+
+// Returns the slot that holds (or will hold) frame number n.
+struct ku_shm_slot *ku_shm_slot(const struct ku_shm_frames *shm, uint64_t n);
+
+// Returns a pointer to the given buffer within a slot.
+uint8_t *ku_shm_buffer(const struct ku_shm_frames *shm, struct ku_shm_slot *slot, enum ku_shm_buffer buf);
+
+// Starts writing the next frame, marking its slot as being written, and
+// returns the slot.  Fill in its buffers, then call ku_shm_commit().
+struct ku_shm_slot *ku_shm_begin(struct ku_shm_frames *shm);
+
+// Completes the frame started by ku_shm_begin(), recording which buffers
+// were written (a bitmask of 1 << enum ku_shm_buffer) and its timestamp, and
+// makes it the latest frame.  Returns its frame number.
+uint64_t ku_shm_commit(struct ku_shm_frames *shm, struct ku_shm_slot *slot, uint32_t buffers, int64_t timestamp);
+
+// Starts reading frame n.  Returns its slot, or NULL if frame n is not in the
+// ring (not yet written, being written, or overwritten), or if the ring's
+// slot count or buffer sizes changed since it was opened.  Use the sizes in
+// shm->sizes, not the header's.  Check ku_shm_valid() after reading the slot's
+// contents.
+struct ku_shm_slot *ku_shm_read(const struct ku_shm_frames *shm, uint64_t n);
+
+// Returns nonzero if frame n, read from a slot returned by ku_shm_read(), has
+// not been overwritten since, and the ring still has the geometry it had when
+// it was opened.
+int ku_shm_valid(const struct ku_shm_frames *shm, uint64_t n);
+
+#endif /* SHM_FRAMES_H_ */
@@ -13,7 +13,34 @@
 // Depth look-up table (translates depth sample into world-space millimeters).
 int ku_depth_lut[2048];
 
-// Initializes the depth look-up table.
+// Projection tables (see unpack.h).
+int16_t ku_proj_xcol[KU_PROJ_DEPTHS][640];
+int16_t ku_proj_yrow[480][KU_PROJ_DEPTHS];
+int16_t ku_proj_zcol[KU_PROJ_DEPTHS];
+
+// Fills the projection tables from the depth look-up table.  Entries for
+// depths at or beyond ZMAX are never plotted, so they are left at zero.
+static void ku_init_projection()
+{
+	int val, x, y, zw;
+
+	for(val = 0; val < KU_PROJ_DEPTHS; val++) {
+		zw = ku_depth_lut[val];
+		if(zw >= ZMAX) {
+			continue;
+		}
+
+		ku_proj_zcol[val] = zw * ZPIX / ZMAX;
+		for(x = 0; x < 640; x++) {
+			ku_proj_xcol[val][x] = ku_xworld(x, zw) * XPIX / XMAX + XPIX / 2;
+		}
+		for(y = 0; y < 480; y++) {
+			ku_proj_yrow[y][val] = (-ku_yworld(y, zw)) * YPIX / YMAX + YPIX / 2;
+		}
+	}
+}
+
+// Initializes the depth look-up table and the projection tables.
 // Copied from the knd daemon code, based on:
 // http://groups.google.com/group/openkinect/browse_thread/thread/31351846fd33c78/e98a94ac605b9f21#e98a94ac605b9f21
 void ku_init_lut()
@@ -24,6 +51,8 @@ void ku_init_lut()
 		ku_depth_lut[i] = (int)(0.1236f * tanf(i / 2842.5f + 1.1863f) * 1000.0f);
 	}
 	ku_depth_lut[2047] = 1048576; // 2047 is returned by the sensor for shadowed or undetectable pixels
+
+	ku_init_projection();
 }
 
 // Finds the closest entry in the depth look-up table to the given world-space
@@ -54,6 +83,90 @@ int ku_reverse_lut(int zw)
 	return idx;
 }
 
+// Stores one point at index i of a world coordinate buffer holding count
+// points.
+static inline void store_world(void *out, int format, int planar, size_t i, size_t count, int x, int y, int zw)
+{
+	int16_t *o16 = out;
+	float *of = out;
+	float fx, fy;
+
+	if(format == KU_WORLD_FLOAT32) {
+		// Same as ku_xworld()/ku_yworld(), without rounding
+		fx = zw * (320 - x) * (1089.0f / 2048.0f / 320.0f);
+		fy = zw * (240 - y) * (1089.0f / 2048.0f / 320.0f);
+		if(planar) {
+			of[i] = fx;
+			of[count + i] = fy;
+			of[count * 2 + i] = zw;
+		} else {
+			of[i * 3] = fx;
+			of[i * 3 + 1] = fy;
+			of[i * 3 + 2] = zw;
+		}
+	} else {
+		if(planar) {
+			o16[i] = ku_xworld(x, zw);
+			o16[count + i] = ku_yworld(y, zw);
+			o16[count * 2 + i] = zw;
+		} else {
+			o16[i * 3] = ku_xworld(x, zw);
+			o16[i * 3 + 1] = ku_yworld(y, zw);
+			o16[i * 3 + 2] = zw;
+		}
+	}
+}
+
+// Converts packed 11-bit data (640*480*11/8 bytes) to world-space X, Y, and
+// Z coordinates in millimeters, sampling every xstride columns and every
+// ystride rows.  Points are written in row-major order in the given format
+// (KU_WORLD_INT16 or KU_WORLD_FLOAT32).  out must have room for three values
+// per point in ku_world_points(xstride, ystride).  Invalid points (no depth
+// reading, or depth beyond KU_WORLD_ZLIMIT) are written as 0, 0, 0 unless the
+// KU_WORLD_SKIP_INVALID flag is given.  Returns the number of points written.
+size_t ku_unpack_to_world(const uint8_t *in, void *out, int format, int xstride, int ystride, int flags)
+{
+	size_t count = ku_world_points(xstride, ystride);
+	size_t elemsize = format == KU_WORLD_FLOAT32 ? sizeof(float) : sizeof(int16_t);
+	int planar = !!(flags & KU_WORLD_PLANAR);
+	uint16_t row[640];
+	size_t n = 0;
+	int x, y, val, zw;
+
+	for(y = 0; y < 480; y += ystride) {
+		ku_unpack11_to_16_lut_buf(in + y * 640 * 11 / 8, row, 640 * 11 / 8);
+
+		for(x = 0; x < 640; x += xstride) {
+			val = row[x];
+			zw = ku_depth_lut[val];
+
+			if(val >= 2047 || zw <= 0 || zw > KU_WORLD_ZLIMIT) {
+				if(flags & KU_WORLD_SKIP_INVALID) {
+					continue;
+				}
+				store_world(out, format, planar, n, count, 0, 0, 0);
+			} else {
+				store_world(out, format, planar, n, count, x, y, zw);
+			}
+			n++;
+		}
+	}
+
+	// Close the gaps between the X, Y, and Z planes left by skipped points
+	if(planar && n < count) {
+		memmove((uint8_t *)out + n * elemsize, (uint8_t *)out + count * elemsize, n * elemsize);
+		memmove((uint8_t *)out + n * 2 * elemsize, (uint8_t *)out + count * 2 * elemsize, n * elemsize);
+	}
+
+	return n;
+}
+
+// Converts a world-space depth in millimeters to a linear 8-bit brightness.
+static inline uint8_t linear_px(int zw)
+{
+	return 255 - CLAMP(0, 255, ((int32_t)zw - 400) * 255 / ZMAX);
+}
+
 // Plots a linear depth version of the given perspective image on the 8-bit
 // output surface, which must be 640x480 bytes.
 void plot_linear(const uint16_t *in, uint8_t *out)
@@ -62,7 +175,7 @@ void plot_linear(const uint16_t *in, uint8_t *out)
 
 	for(pix = 0, y = 0; y < 640; y++) {
 		for(x = 0; x < 480; x++, pix++) {
-			out[pix] = 255 - CLAMP(0, 255, ((int32_t)ku_depth_lut[(65535 - in[pix]) >> 5] - 400) * 255 / ZMAX);
+			out[pix] = linear_px(ku_depth_lut[(65535 - in[pix]) >> 5]);
 		}
 	}
 }
@@ -70,13 +183,84 @@ void plot_linear(const uint16_t *in, uint8_t *out)
 // Turns overhead view coordinates into a pixel index.
 #define OVPX(xw, zw) (((zw) * ZPIX / ZMAX) * XPIX + ((xw) * XPIX / XMAX + XPIX / 2))
 
+// Turns side view coordinates into a pixel index.
+#define SVPX(zw, yw) (((-yw) * YPIX / YMAX + YPIX / 2) * ZPIX + ((zw) * ZPIX / ZMAX))
+
+// Turns front view coordinates into a pixel index.
+#define FVPX(xw, yw) (((-yw) * YPIX / YMAX + YPIX / 2) * XPIX + ((-xw) * XPIX / XMAX + XPIX / 2))
+
+// Returns the overhead view pixel index for perspective column x at raw depth
+// val (world depth zw).  Uses the projection tables when val is covered by
+// them, and the world-space arithmetic otherwise.
+static inline int overhead_index(int x, int val, int zw)
+{
+	if(val < KU_PROJ_DEPTHS) {
+		return ku_proj_zcol[val] * XPIX + ku_proj_xcol[val][x];
+	}
+	return OVPX(ku_xworld(x, zw), zw);
+}
+
+// Returns the side view pixel index for perspective row y at raw depth val.
+static inline int side_index(int y, int val, int zw)
+{
+	if(val < KU_PROJ_DEPTHS) {
+		return ku_proj_yrow[y][val] * ZPIX + ku_proj_zcol[val];
+	}
+	return SVPX(zw, ku_yworld(y, zw));
+}
+
+// Returns the front view pixel index for perspective pixel (x, y) at raw depth
+// val.  The front view is mirrored horizontally, and division truncates
+// toward zero, so its column is XPIX minus the overhead column.
+static inline int front_index(int x, int y, int val, int zw)
+{
+	if(val < KU_PROJ_DEPTHS) {
+		return ku_proj_yrow[y][val] * XPIX + (XPIX - ku_proj_xcol[val][x]);
+	}
+	return FVPX(ku_xworld(x, zw), ku_yworld(y, zw));
+}
+
+// Adds inc to pixel opx of a view of size bytes, saturating at 255.  Points
+// that fall outside the view are ignored.
+static inline void add_px(uint8_t *out, int opx, int size, int inc)
+{
+	int c;
+
+	if(opx < 0 || opx >= size) {
+		return;
+	}
+	c = out[opx];
+	c += inc;
+	if(c > 255) {
+		c = 255;
+	}
+	out[opx] = c;
+}
+
+// Adds a point to an overhead view.
+static inline void overhead_px(uint8_t *out, int x, int val, int zw)
+{
+	add_px(out, overhead_index(x, val, zw), XPIX * ZPIX, 2);
+}
+
+// Adds a point to a side view.
+static inline void side_px(uint8_t *out, int y, int val, int zw)
+{
+	add_px(out, side_index(y, val, zw), ZPIX * YPIX, 2);
+}
+
+// Adds a point to a front view.
+static inline void front_px(uint8_t *out, int x, int y, int val, int zw)
+{
+	add_px(out, front_index(x, y, val, zw), XPIX * YPIX, 1 + (zw - 512) / 256); // TODO: Scale intensity by surface area
+}
+
 // Plots an overhead view on the given raw linear 8-bit grayscale image
 // surface, which must be XPIX bytes wide by ZPIX bytes tall.
 void plot_overhead(const uint16_t *in, uint8_t *out)
 {
 	int y, x, pix, val;
-	int xw, zw, opx;
-	int c;
+	int zw;
 
 	memset(out, 0, XPIX * ZPIX);
 
@@ -89,32 +273,17 @@ void plot_overhead(const uint16_t *in, uint8_t *out)
 			if(val >= 2047 || zw >= ZMAX) {
 				continue;
 			}
-			xw = ku_xworld(x, zw);
-
-			opx = OVPX(xw, zw);
-			if(opx < 0 || opx >= XPIX * ZPIX) {
-				continue;
-			}
-			c = out[opx];
-			c += 2;
-			if(c > 255) {
-				c = 255;
-			}
-			out[opx] = c;
+			overhead_px(out, x, val, zw);
 		}
 	}
 }
 
-// Turns side view coordinates into a pixel index.
-#define SVPX(zw, yw) (((-yw) * YPIX / YMAX + YPIX / 2) * ZPIX + ((zw) * ZPIX / ZMAX))
-
 // Plots a side view on the given raw linear 8-bit grayscale image surface,
 // which must be ZPIX bytes wide by YPIX bytes tall.
 void plot_side(const uint16_t *in, uint8_t *out)
 {
 	int y, x, pix, val;
-	int yw, zw, opx;
-	int c;
+	int zw;
 
 	memset(out, 0, ZPIX * YPIX);
 
@@ -128,32 +297,17 @@ void plot_side(const uint16_t *in, uint8_t *out)
 			if(val >= 2047 || zw >= ZMAX) {
 				continue;
 			}
-			yw = ku_yworld(y, zw);
-
-			opx = SVPX(zw, yw);
-			if(opx < 0 || opx >= ZPIX * YPIX) {
-				continue;
-			}
-			c = out[opx];
-			c += 2;
-			if(c > 255) {
-				c = 255;
-			}
-			out[opx] = c;
+			side_px(out, y, val, zw);
 		}
 	}
 }
 
-// Turns front view coordinates into a pixel index.
-#define FVPX(xw, yw) (((-yw) * YPIX / YMAX + YPIX / 2) * XPIX + ((-xw) * XPIX / XMAX + XPIX / 2))
-
 // Plots a front view on the given raw linear 8-bit grayscale image surface,
 // which must be XPIX bytes wide by YPIX bytes tall.
 void plot_front(const uint16_t *in, uint8_t *out)
 {
 	int y, x, pix, val;
-	int xw, yw, zw, opx;
-	int c;
+	int zw;
 
 	memset(out, 0, XPIX * YPIX);
 
@@ -167,20 +321,319 @@ void plot_front(const uint16_t *in, uint8_t *out)
 			if(val >= 2047 || zw >= ZMAX) {
 				continue;
 			}
-			xw = ku_xworld(x, zw);
-			yw = ku_yworld(y, zw);
+			front_px(out, x, y, val, zw);
+		}
+	}
+}
+
+// Clears whichever of the overhead, side, and front views are not NULL.
+static void clear_views(uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	if(overhead) {
+		memset(overhead, 0, XPIX * ZPIX);
+	}
+	if(side) {
+		memset(side, 0, ZPIX * YPIX);
+	}
+	if(front) {
+		memset(front, 0, XPIX * YPIX);
+	}
+}
+
+// Adds perspective rows y0 through y1 - 1 of in (a full 640x480 image) to the
+// given views without clearing them first.  Only rows y0 through y1 - 1 of
+// the linear view are written.  Returns the number of plotted points whose
+// depth fell outside the projection tables (see plot_views_rows() in
+// unpack.h).
+int plot_views_rows(const uint16_t *in, int y0, int y1, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	int y, x, pix, val;
+	int zw;
+	int untabled = 0;
 
-			opx = FVPX(xw, yw);
-			if(opx < 0 || opx >= XPIX * YPIX) {
+	for(pix = y0 * 640, y = y0; y < y1; y++) {
+		for(x = 0; x < 640; x++, pix++) {
+			val = (65535 - in[pix]) >> 5;
+			zw = ku_depth_lut[val];
+
+			if(linear) {
+				linear[pix] = linear_px(zw);
+			}
+
+			if(val >= 2047 || zw >= ZMAX) {
 				continue;
 			}
-			c = out[opx];
-			c += 1 + (zw - 512) / 256; // TODO: Scale intensity by surface area
-			if(c > 255) {
-				c = 255;
+			if(val >= KU_PROJ_DEPTHS) {
+				untabled++;
+			}
+
+			if(overhead) {
+				overhead_px(overhead, x, val, zw);
+			}
+			if(side) {
+				side_px(side, y, val, zw);
+			}
+			if(front) {
+				front_px(front, x, y, val, zw);
 			}
-			out[opx] = c;
 		}
 	}
+
+	return untabled;
+}
+
+// Plots any combination of the linear, overhead, side, and front views in a
+// single pass over the given perspective image.  Views that are not wanted
+// should be NULL.  The output is identical to calling each plot_* function
+// separately, but depth is only looked up once per pixel.
+void plot_views(const uint16_t *in, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	clear_views(overhead, side, front);
+	plot_views_rows(in, 0, 480, linear, overhead, side, front);
+}
+
+// Plots rows y0 through y1 - 1 of packed 11-bit data, unpacking each group of
+// 8 pixels inline.  Always inlined so the single-view wrappers below get a
+// copy with the unused views optimized out.
+static inline __attribute__((always_inline)) int plot_views11_inline(const uint8_t *in, int y0, int y1, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	uint16_t vals[8];
+	int y, x, i, pix, val;
+	int zw;
+	int untabled = 0;
+
+	in += y0 * 640 * 11 / 8;
+
+	for(pix = y0 * 640, y = y0; y < y1; y++) {
+		for(x = 0; x < 640; x += 8, in += 11) {
+			unpack11_to_16_lut(in, vals);
+
+			for(i = 0; i < 8; i++, pix++) {
+				val = vals[i];
+				zw = ku_depth_lut[val];
+
+				if(linear) {
+					linear[pix] = linear_px(zw);
+				}
+
+				if(val >= 2047 || zw >= ZMAX) {
+					continue;
+				}
+				if(val >= KU_PROJ_DEPTHS) {
+					untabled++;
+				}
+
+				if(overhead) {
+					overhead_px(overhead, x + i, val, zw);
+				}
+				if(side) {
+					side_px(side, y, val, zw);
+				}
+				if(front) {
+					front_px(front, x + i, y, val, zw);
+				}
+			}
+		}
+	}
+
+	return untabled;
+}
+
+// Like plot_views_rows(), but reads packed 11-bit data (640*480*11/8 bytes).
+int plot_views11_rows(const uint8_t *in, int y0, int y1, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	return plot_views11_inline(in, y0, y1, linear, overhead, side, front);
+}
+
+// Like plot_linear(), but reads packed 11-bit data (640*480*11/8 bytes).
+void plot_linear11(const uint8_t *in, uint8_t *out)
+{
+	plot_views11_inline(in, 0, 480, out, NULL, NULL, NULL);
+}
+
+// Like plot_overhead(), but reads packed 11-bit data (640*480*11/8 bytes).
+void plot_overhead11(const uint8_t *in, uint8_t *out)
+{
+	clear_views(out, NULL, NULL);
+	plot_views11_inline(in, 0, 480, NULL, out, NULL, NULL);
+}
+
+// Like plot_side(), but reads packed 11-bit data (640*480*11/8 bytes).
+void plot_side11(const uint8_t *in, uint8_t *out)
+{
+	clear_views(NULL, out, NULL);
+	plot_views11_inline(in, 0, 480, NULL, NULL, out, NULL);
+}
+
+// Like plot_front(), but reads packed 11-bit data (640*480*11/8 bytes).
+void plot_front11(const uint8_t *in, uint8_t *out)
+{
+	clear_views(NULL, NULL, out);
+	plot_views11_inline(in, 0, 480, NULL, NULL, NULL, out);
+}
+
+// Like plot_views(), but reads packed 11-bit data (640*480*11/8 bytes).
+void plot_views11(const uint8_t *in, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	clear_views(overhead, side, front);
+	plot_views11_inline(in, 0, 480, linear, overhead, side, front);
+}
+
+// Above this many changed pixels, plot_views11_incremental() starts over
+// with a full rebuild, which touches each point once instead of twice.
+#define KU_INCREMENTAL_LIMIT (640 * 480 / 8)
+
+// Returns the 8-bit view value for an incremental plotting sum.
+static inline uint8_t sum_px(uint16_t sum)
+{
+	return sum > 255 ? 255 : sum;
 }
 
+// Sets each view pixel from its incremental plotting sum.
+static void sum_view(const uint16_t *sums, uint8_t *out, int size)
+{
+	int i;
+
+	for(i = 0; i < size; i++) {
+		out[i] = sum_px(sums[i]);
+	}
+}
+
+// Adds (sign 1) or removes (sign -1) a point's contribution to the
+// incremental plotting sums, and updates the matching pixels of whichever
+// views are not NULL.
+static inline void update_point(struct ku_plot_state *state, int x, int y, int val, int sign, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	int zw = ku_depth_lut[val];
+	int opx;
+
+	if(val >= 2047 || zw >= ZMAX) {
+		return;
+	}
+	if(val >= KU_PROJ_DEPTHS) {
+		state->untabled += sign;
+	}
+
+	opx = overhead_index(x, val, zw);
+	if(opx >= 0 && opx < XPIX * ZPIX) {
+		state->overhead[opx] += 2 * sign;
+		if(overhead) {
+			overhead[opx] = sum_px(state->overhead[opx]);
+		}
+	}
+
+	opx = side_index(y, val, zw);
+	if(opx >= 0 && opx < ZPIX * YPIX) {
+		state->side[opx] += 2 * sign;
+		if(side) {
+			side[opx] = sum_px(state->side[opx]);
+		}
+	}
+
+	opx = front_index(x, y, val, zw);
+	if(opx >= 0 && opx < XPIX * YPIX) {
+		state->front[opx] += sign * (1 + (zw - 512) / 256);
+		if(front) {
+			front[opx] = sum_px(state->front[opx]);
+		}
+	}
+}
+
+// Marks the state as not matching any output, so the next call to
+// plot_views11_incremental() plots every point.
+void ku_plot_state_reset(struct ku_plot_state *state)
+{
+	state->valid = 0;
+}
+
+// Updates all four views (none may be NULL) from packed 11-bit depth data,
+// touching only the pixels whose raw depth changed since the previous call.
+// Returns the number of perspective pixels that were replotted.
+//
+// Unchanged rows are skipped with one memcmp(), then unchanged 11-byte groups
+// of 8 pixels.  Each changed pixel subtracts its old point from the view sums
+// and adds its new one, so a mostly static scene costs a fraction of a full
+// plot.  Clamping a sum to 255 gives the same value as plot_views11()'s
+// saturating adds, because every point adds a positive amount, except for
+// front view points with untabled depths (see plot_views_rows()).  The front
+// view is plotted in full while any of those are in the frame.
+int plot_views11_incremental(struct ku_plot_state *state, const uint8_t *in, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	const size_t rowbytes = 640 * 11 / 8;
+	uint16_t oldvals[8], newvals[8];
+	const uint8_t *row;
+	uint8_t *prev;
+	uint8_t *overhead_out = overhead, *side_out = side, *front_out;
+	int rebuild = !state->valid;
+	int y, x, i;
+	int changed = 0;
+
+	if(rebuild) {
+		// Raw depth 2047 is never plotted, so starting from a frame of all
+		// 2047 makes every point of the new frame count as changed.  The
+		// projected views are filled from the sums afterward.
+		memset(state->prev, 0xff, sizeof(state->prev));
+		memset(state->overhead, 0, sizeof(state->overhead));
+		memset(state->side, 0, sizeof(state->side));
+		memset(state->front, 0, sizeof(state->front));
+		memset(linear, linear_px(ku_depth_lut[2047]), 640 * 480);
+		state->untabled = 0;
+		state->front_summed = 0;
+		state->valid = 1;
+		overhead_out = NULL;
+		side_out = NULL;
+	}
+
+	front_out = state->front_summed ? front : NULL;
+
+	for(y = 0; y < 480; y++) {
+		row = in + y * rowbytes;
+		prev = state->prev + y * rowbytes;
+		if(!memcmp(row, prev, rowbytes)) {
+			continue;
+		}
+
+		for(x = 0; x < 640; x += 8, row += 11, prev += 11) {
+			if(!memcmp(row, prev, 11)) {
+				continue;
+			}
+
+			unpack11_to_16_lut(prev, oldvals);
+			unpack11_to_16_lut(row, newvals);
+			memcpy(prev, row, 11);
+
+			for(i = 0; i < 8; i++) {
+				if(oldvals[i] == newvals[i]) {
+					continue;
+				}
+
+				changed++;
+				linear[y * 640 + x + i] = linear_px(ku_depth_lut[newvals[i]]);
+				update_point(state, x + i, y, oldvals[i], -1, overhead_out, side_out, front_out);
+				update_point(state, x + i, y, newvals[i], 1, overhead_out, side_out, front_out);
+			}
+		}
+
+		if(!rebuild && changed > KU_INCREMENTAL_LIMIT) {
+			state->valid = 0;
+			return plot_views11_incremental(state, in, linear, overhead, side, front);
+		}
+	}
+
+	if(rebuild) {
+		sum_view(state->overhead, overhead, XPIX * ZPIX);
+		sum_view(state->side, side, ZPIX * YPIX);
+	}
+
+	if(state->untabled) {
+		if(changed || state->front_summed) {
+			plot_front11(in, front);
+			state->front_summed = 0;
+		}
+	} else if(!state->front_summed) {
+		sum_view(state->front, front, XPIX * YPIX);
+		state->front_summed = 1;
+	}
+
+	return changed;
+}
@@ -5,6 +5,7 @@
 #ifndef UNPACK_H_
 #define UNPACK_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef UNPACK_INLINE
@@ -25,6 +26,24 @@
 // Depth look-up table (translates depth sample into world-space millimeters).
 extern int ku_depth_lut[2048];
 
+// Number of raw depth values covered by the projection tables.  Every raw
+// value whose depth is closer than ZMAX is below this.
+#define KU_PROJ_DEPTHS PXZMAX
+
+// Projection tables, filled by ku_init_lut(), that map a raw depth value and
+// a perspective column or row straight to an output view coordinate, so the
+// plot_* functions need no per-pixel world-space arithmetic.  ku_proj_xcol is
+// indexed [raw depth][column], and ku_proj_yrow [row][raw depth], so that
+// while plotting one row of the frame, ku_proj_yrow's lookups all stay in a
+// single row of the table.  Only depths closer than ZMAX are filled in.
+//
+// ku_proj_xcol: overhead view column (the front view column is XPIX - this)
+// ku_proj_yrow: side and front view row
+// ku_proj_zcol: overhead view row and side view column
+extern int16_t ku_proj_xcol[KU_PROJ_DEPTHS][640];
+extern int16_t ku_proj_yrow[480][KU_PROJ_DEPTHS];
+extern int16_t ku_proj_zcol[KU_PROJ_DEPTHS];
+
 // Unpacks and inverts 8 11-bit pixels (11 bytes) from in and stores them as
 // LSB-aligned 16-bit values in out (16 bytes), which can be used directly as
 // indices in ku_depth_lut.
@@ -121,7 +140,54 @@ UNPACK_INLINE int ku_yworld(int y, int zw)
 	return ku_xworld(y + (640 - 480) / 2, zw);
 }
 
-// Initializes the depth look-up table.
+// Point formats for ku_unpack_to_world().
+#define KU_WORLD_INT16 0 // int16_t millimeters, rounded like ku_xworld()
+#define KU_WORLD_FLOAT32 1 // float millimeters, unrounded
+
+// Flags for ku_unpack_to_world().
+#define KU_WORLD_SKIP_INVALID 1 // Omit invalid points instead of writing 0, 0, 0
+#define KU_WORLD_PLANAR 2 // Write all X, then all Y, then all Z instead of XYZ triples
+
+// Depths beyond this many millimeters (near the depth LUT's asymptote) are
+// treated as invalid by ku_unpack_to_world(), keeping coordinates within
+// int16_t range.
+#define KU_WORLD_ZLIMIT 32767
+
+// Returns the number of points in a frame sampled every xstride columns and
+// every ystride rows.
+UNPACK_INLINE size_t ku_world_points(int xstride, int ystride)
+{
+	return (size_t)((640 + xstride - 1) / xstride) * ((480 + ystride - 1) / ystride);
+}
+
+// Unpacks len bytes of 11-bit data into out, which must have room for
+// len / 11 * 8 16-bit values.  Any trailing partial group is ignored.  The
+// output matches calling unpack11_to_16() on every 11-byte group, but uses
+// the fastest implementation selected by ku_init_unpack() (SSSE3, AVX2, or
+// NEON where available).
+extern void (*ku_unpack11_to_16_buf)(const uint8_t *in, uint16_t *out, size_t len);
+
+// Like ku_unpack11_to_16_buf(), but matches unpack11_to_16_lut().
+extern void (*ku_unpack11_to_16_lut_buf)(const uint8_t *in, uint16_t *out, size_t len);
+
+// Selects the fastest unpacking implementation supported by the CPU.
+// Returns the name of the selected implementation.  Until this is called,
+// the scalar implementation is used.
+const char *ku_init_unpack(void);
+
+// Switches to the named unpacking implementation ("scalar", "ssse3", "avx2",
+// or "neon").  Returns 0 on success, or -1 if the implementation does not
+// exist or is not supported by the CPU.
+int ku_select_unpack(const char *name);
+
+// Returns the name of the unpacking implementation currently in use.
+const char *ku_unpack_impl(void);
+
+// Returns the name of the index'th unpacking implementation supported by this
+// CPU, or NULL if index is past the end of the list.
+const char *ku_unpack_impl_name(int index);
+
+// Initializes the depth look-up table and the projection tables.
 // Copied from the knd daemon code, based on:
 // http://groups.google.com/group/openkinect/browse_thread/thread/31351846fd33c78/e98a94ac605b9f21#e98a94ac605b9f21
 void ku_init_lut();
@@ -130,6 +196,15 @@ void ku_init_lut();
 // depth value in millimeters without going over.  Uses a binary search.
 int ku_reverse_lut(int zw);
 
+// Converts packed 11-bit data (640*480*11/8 bytes) to world-space X, Y, and
+// Z coordinates in millimeters, sampling every xstride columns and every
+// ystride rows.  Points are written in row-major order in the given format
+// (KU_WORLD_INT16 or KU_WORLD_FLOAT32).  out must have room for three values
+// per point in ku_world_points(xstride, ystride).  Invalid points (no depth
+// reading, or depth beyond KU_WORLD_ZLIMIT) are written as 0, 0, 0 unless the
+// KU_WORLD_SKIP_INVALID flag is given.  Returns the number of points written.
+size_t ku_unpack_to_world(const uint8_t *in, void *out, int format, int xstride, int ystride, int flags);
+
 // Plots a linear depth version of the given perspective image on the 8-bit
 // output surface, which must be 640x480 bytes.
 void plot_linear(const uint16_t *in, uint8_t *out);
@@ -146,4 +221,60 @@ void plot_side(const uint16_t *in, uint8_t *out);
 // which must be XPIX bytes wide by YPIX bytes tall.
 void plot_front(const uint16_t *in, uint8_t *out);
 
+// Plots any combination of the linear, overhead, side, and front views in a
+// single pass over the given perspective image.  Views that are not wanted
+// should be NULL.  The output is identical to calling each plot_* function
+// separately, but depth is only looked up once per pixel.
+void plot_views(const uint16_t *in, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front);
+
+// The *11 plotting functions behave exactly like their 16-bit counterparts,
+// but read packed 11-bit data (640*480*11/8 bytes) directly, unpacking each
+// group of 8 pixels inline.  This skips the full-frame 16-bit intermediate
+// when only the views are needed.
+void plot_linear11(const uint8_t *in, uint8_t *out);
+void plot_overhead11(const uint8_t *in, uint8_t *out);
+void plot_side11(const uint8_t *in, uint8_t *out);
+void plot_front11(const uint8_t *in, uint8_t *out);
+void plot_views11(const uint8_t *in, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front);
+
+// Adds perspective rows y0 through y1 - 1 of a full 640x480 depth image to
+// the given views (any of which may be NULL) without clearing them first, so
+// an image can be plotted in bands.  Only rows y0 through y1 - 1 of the
+// linear view are written.  Every point adds a positive amount to the
+// overhead and side views, so bands plotted into separate images can be
+// merged with a saturating add.  The same holds for the front view unless the
+// return value is nonzero: raw depths from KU_PROJ_DEPTHS up give negative
+// world depths and can subtract from the front view, making the result
+// depend on plotting order.
+int plot_views_rows(const uint16_t *in, int y0, int y1, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front);
+int plot_views11_rows(const uint8_t *in, int y0, int y1, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front);
+
+// Persistent state for plot_views11_incremental(): the previous packed frame,
+// and each projected view's unsaturated per-pixel sums.  The sums wrap at
+// 16 bits, but removing a point subtracts exactly what adding it added, so
+// they stay exact as long as no pixel's true sum passes 65535 (real scenes
+// peak in the tens of thousands).
+struct ku_plot_state {
+	uint8_t prev[640 * 480 * 11 / 8];
+	uint16_t overhead[XPIX * ZPIX];
+	uint16_t side[ZPIX * YPIX];
+	uint16_t front[XPIX * YPIX];
+	int untabled; // Points in prev with raw depth KU_PROJ_DEPTHS or more
+	unsigned int valid:1; // Whether prev, the sums, and the views match
+	unsigned int front_summed:1; // Whether the front view came from the sums
+};
+
+// Marks the state as not matching any output, so the next call to
+// plot_views11_incremental() plots every point.
+void ku_plot_state_reset(struct ku_plot_state *state);
+
+// Updates all four views (none may be NULL) from packed 11-bit depth data,
+// touching only the pixels whose raw depth changed since the previous call.
+// The views must be the same buffers, unmodified, as on the previous call
+// with the same state; after ku_plot_state_reset() they are rebuilt from
+// scratch, as they are when most of the frame has changed.  The output is
+// identical to plot_views11().  Returns the number of perspective pixels that
+// were replotted.
+int plot_views11_incremental(struct ku_plot_state *state, const uint8_t *in, uint8_t *linear, uint8_t *overhead, uint8_t *side, uint8_t *front);
+
 #endif /* UNPACK_H_ */
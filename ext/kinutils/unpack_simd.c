@@ -0,0 +1,323 @@
+/*
+ * Whole-buffer 11-bit depth unpacking, with SIMD implementations selected at
+ * runtime based on the CPU.
+ * (C)2026 Mike Bourgeous
+ */
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KU_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define KU_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "unpack.h"
+
+/*
+ * All of the vector versions use the same approach.  Each 11-byte group holds
+ * 8 big-endian 11-bit pixels.  Pixel i starts at bit 11*i, which is byte
+ * b=(11*i)/8 at bit offset o=(11*i)%8.  A byte shuffle builds the 16-bit
+ * value (in[b] << 8) | in[b + 1] in each lane, which a multiply by 1 << o
+ * shifts left so the pixel starts at the MSB.  Pixels 2 and 5 (o=6 and o=7)
+ * span three bytes, so a second shuffle places in[b + 2] in those lanes
+ * (zero elsewhere), and ((in[b + 2] << o) >> 8) fills in the missing low
+ * bits.  The result is each pixel MSB-aligned with 5 garbage bits below it,
+ * which is either shifted right by 5 (LUT range) or inverted with the low 5
+ * bits set (65535 - (val << 5)).
+ *
+ * The vector loads read 16 bytes per 11-byte group, so the last group or two
+ * of a buffer is always left to the scalar code.
+ */
+
+// Shuffle indices for (in[b] << 8) | in[b + 1], in little-endian lane order.
+#define HI_SHUF 1, 0, 2, 1, 3, 2, 5, 4, 6, 5, 7, 6, 9, 8, 10, 9
+
+// Shuffle indices for in[b + 2] in the lanes of pixels 2 and 5 (-1 is zero).
+#define LO_SHUF -1, -1, -1, -1, 4, -1, -1, -1, -1, -1, 8, -1, -1, -1, -1, -1
+
+// Multipliers for shifting each lane left by its bit offset.
+#define SHIFT_MUL 1, 8, 64, 2, 16, 128, 4, 32
+
+// Number of leading 11-byte groups whose 16-byte vector loads stay within len
+// bytes.
+static size_t vector_groups(size_t len)
+{
+	return len >= 16 ? (len - 16) / 11 + 1 : 0;
+}
+
+static void unpack11_to_16_scalar(const uint8_t *in, uint16_t *out, size_t len)
+{
+	size_t i, o;
+
+	for(i = 0, o = 0; i + 11 <= len; i += 11, o += 8) {
+		unpack11_to_16(in + i, out + o);
+	}
+}
+
+static void unpack11_to_16_lut_scalar(const uint8_t *in, uint16_t *out, size_t len)
+{
+	size_t i, o;
+
+	for(i = 0, o = 0; i + 11 <= len; i += 11, o += 8) {
+		unpack11_to_16_lut(in + i, out + o);
+	}
+}
+
+#ifdef KU_HAVE_X86_SIMD
+// Unpacks one group to MSB-aligned pixels with 5 trailing garbage bits.
+__attribute__((target("ssse3")))
+static inline __m128i unpack_group_ssse3(const uint8_t *in)
+{
+	const __m128i hi_shuf = _mm_setr_epi8(HI_SHUF);
+	const __m128i lo_shuf = _mm_setr_epi8(LO_SHUF);
+	const __m128i mul = _mm_setr_epi16(SHIFT_MUL);
+	__m128i v, hi, lo;
+
+	v = _mm_loadu_si128((const __m128i *)in);
+	hi = _mm_mullo_epi16(_mm_shuffle_epi8(v, hi_shuf), mul);
+	lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(v, lo_shuf), mul), 8);
+
+	return _mm_or_si128(hi, lo);
+}
+
+__attribute__((target("ssse3")))
+static void unpack11_to_16_ssse3(const uint8_t *in, uint16_t *out, size_t len)
+{
+	const __m128i low_bits = _mm_set1_epi16(0x1f);
+	const __m128i ones = _mm_set1_epi16(-1);
+	size_t groups = vector_groups(len);
+	size_t g;
+	__m128i a, b;
+
+	for(g = 0; g + 2 <= groups; g += 2) {
+		a = unpack_group_ssse3(in + g * 11);
+		b = unpack_group_ssse3(in + g * 11 + 11);
+		_mm_storeu_si128((__m128i *)(out + g * 8), _mm_or_si128(_mm_andnot_si128(a, ones), low_bits));
+		_mm_storeu_si128((__m128i *)(out + g * 8 + 8), _mm_or_si128(_mm_andnot_si128(b, ones), low_bits));
+	}
+
+	unpack11_to_16_scalar(in + g * 11, out + g * 8, len - g * 11);
+}
+
+__attribute__((target("ssse3")))
+static void unpack11_to_16_lut_ssse3(const uint8_t *in, uint16_t *out, size_t len)
+{
+	size_t groups = vector_groups(len);
+	size_t g;
+	__m128i a, b;
+
+	for(g = 0; g + 2 <= groups; g += 2) {
+		a = unpack_group_ssse3(in + g * 11);
+		b = unpack_group_ssse3(in + g * 11 + 11);
+		_mm_storeu_si128((__m128i *)(out + g * 8), _mm_srli_epi16(a, 5));
+		_mm_storeu_si128((__m128i *)(out + g * 8 + 8), _mm_srli_epi16(b, 5));
+	}
+
+	unpack11_to_16_lut_scalar(in + g * 11, out + g * 8, len - g * 11);
+}
+
+// Unpacks two consecutive groups (one per 128-bit lane) to MSB-aligned pixels
+// with 5 trailing garbage bits.
+__attribute__((target("avx2")))
+static inline __m256i unpack_groups_avx2(const uint8_t *in)
+{
+	const __m256i hi_shuf = _mm256_setr_epi8(HI_SHUF, HI_SHUF);
+	const __m256i lo_shuf = _mm256_setr_epi8(LO_SHUF, LO_SHUF);
+	const __m256i mul = _mm256_setr_epi16(SHIFT_MUL, SHIFT_MUL);
+	__m256i v, hi, lo;
+
+	v = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)in)),
+			_mm_loadu_si128((const __m128i *)(in + 11)),
+			1
+			);
+	hi = _mm256_mullo_epi16(_mm256_shuffle_epi8(v, hi_shuf), mul);
+	lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(v, lo_shuf), mul), 8);
+
+	return _mm256_or_si256(hi, lo);
+}
+
+__attribute__((target("avx2")))
+static void unpack11_to_16_avx2(const uint8_t *in, uint16_t *out, size_t len)
+{
+	const __m256i low_bits = _mm256_set1_epi16(0x1f);
+	const __m256i ones = _mm256_set1_epi16(-1);
+	size_t groups = vector_groups(len);
+	size_t g;
+	__m256i a, b;
+
+	for(g = 0; g + 4 <= groups; g += 4) {
+		a = unpack_groups_avx2(in + g * 11);
+		b = unpack_groups_avx2(in + g * 11 + 22);
+		_mm256_storeu_si256((__m256i *)(out + g * 8), _mm256_or_si256(_mm256_andnot_si256(a, ones), low_bits));
+		_mm256_storeu_si256((__m256i *)(out + g * 8 + 16), _mm256_or_si256(_mm256_andnot_si256(b, ones), low_bits));
+	}
+
+	unpack11_to_16_scalar(in + g * 11, out + g * 8, len - g * 11);
+}
+
+__attribute__((target("avx2")))
+static void unpack11_to_16_lut_avx2(const uint8_t *in, uint16_t *out, size_t len)
+{
+	size_t groups = vector_groups(len);
+	size_t g;
+	__m256i a, b;
+
+	for(g = 0; g + 4 <= groups; g += 4) {
+		a = unpack_groups_avx2(in + g * 11);
+		b = unpack_groups_avx2(in + g * 11 + 22);
+		_mm256_storeu_si256((__m256i *)(out + g * 8), _mm256_srli_epi16(a, 5));
+		_mm256_storeu_si256((__m256i *)(out + g * 8 + 16), _mm256_srli_epi16(b, 5));
+	}
+
+	unpack11_to_16_lut_scalar(in + g * 11, out + g * 8, len - g * 11);
+}
+#endif /* KU_HAVE_X86_SIMD */
+
+#ifdef KU_HAVE_NEON
+// Unpacks one group to MSB-aligned pixels with 5 trailing garbage bits.
+static inline uint16x8_t unpack_group_neon(const uint8_t *in)
+{
+	static const uint8_t hi_shuf[16] = { HI_SHUF };
+	static const uint8_t lo_shuf[16] = { // Out-of-range indices produce zero
+		0xff, 0xff, 0xff, 0xff, 4, 0xff, 0xff, 0xff, 0xff, 0xff, 8, 0xff, 0xff, 0xff, 0xff, 0xff
+	};
+	static const uint16_t mul[8] = { SHIFT_MUL };
+	uint8x16_t v = vld1q_u8(in);
+	uint16x8_t m = vld1q_u16(mul);
+	uint16x8_t hi, lo;
+
+	hi = vmulq_u16(vreinterpretq_u16_u8(vqtbl1q_u8(v, vld1q_u8(hi_shuf))), m);
+	lo = vshrq_n_u16(vmulq_u16(vreinterpretq_u16_u8(vqtbl1q_u8(v, vld1q_u8(lo_shuf))), m), 8);
+
+	return vorrq_u16(hi, lo);
+}
+
+static void unpack11_to_16_neon(const uint8_t *in, uint16_t *out, size_t len)
+{
+	const uint16x8_t low_bits = vdupq_n_u16(0x1f);
+	size_t groups = vector_groups(len);
+	size_t g;
+
+	for(g = 0; g + 2 <= groups; g += 2) {
+		vst1q_u16(out + g * 8, vorrq_u16(vmvnq_u16(unpack_group_neon(in + g * 11)), low_bits));
+		vst1q_u16(out + g * 8 + 8, vorrq_u16(vmvnq_u16(unpack_group_neon(in + g * 11 + 11)), low_bits));
+	}
+
+	unpack11_to_16_scalar(in + g * 11, out + g * 8, len - g * 11);
+}
+
+static void unpack11_to_16_lut_neon(const uint8_t *in, uint16_t *out, size_t len)
+{
+	size_t groups = vector_groups(len);
+	size_t g;
+
+	for(g = 0; g + 2 <= groups; g += 2) {
+		vst1q_u16(out + g * 8, vshrq_n_u16(unpack_group_neon(in + g * 11), 5));
+		vst1q_u16(out + g * 8 + 8, vshrq_n_u16(unpack_group_neon(in + g * 11 + 11), 5));
+	}
+
+	unpack11_to_16_lut_scalar(in + g * 11, out + g * 8, len - g * 11);
+}
+#endif /* KU_HAVE_NEON */
+
+struct unpack_impl {
+	const char *name;
+	void (*to_16)(const uint8_t *in, uint16_t *out, size_t len);
+	void (*to_16_lut)(const uint8_t *in, uint16_t *out, size_t len);
+};
+
+// Implementations in order of increasing preference.
+static const struct unpack_impl unpack_impls[] = {
+	{ "scalar", unpack11_to_16_scalar, unpack11_to_16_lut_scalar },
+#ifdef KU_HAVE_X86_SIMD
+	{ "ssse3", unpack11_to_16_ssse3, unpack11_to_16_lut_ssse3 },
+	{ "avx2", unpack11_to_16_avx2, unpack11_to_16_lut_avx2 },
+#endif
+#ifdef KU_HAVE_NEON
+	{ "neon", unpack11_to_16_neon, unpack11_to_16_lut_neon },
+#endif
+};
+
+#define NUM_IMPLS (sizeof(unpack_impls) / sizeof(unpack_impls[0]))
+
+static const struct unpack_impl *current_impl = &unpack_impls[0];
+
+void (*ku_unpack11_to_16_buf)(const uint8_t *in, uint16_t *out, size_t len) = unpack11_to_16_scalar;
+void (*ku_unpack11_to_16_lut_buf)(const uint8_t *in, uint16_t *out, size_t len) = unpack11_to_16_lut_scalar;
+
+// Returns nonzero if the CPU can run the given implementation.
+static int impl_supported(const struct unpack_impl *impl)
+{
+#ifdef KU_HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if(!strcmp(impl->name, "ssse3")) {
+		return __builtin_cpu_supports("ssse3");
+	}
+	if(!strcmp(impl->name, "avx2")) {
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+
+	(void)impl;
+	return 1;
+}
+
+// Returns the name of the index'th unpacking implementation supported by this
+// CPU, or NULL if index is past the end of the list.
+const char *ku_unpack_impl_name(int index)
+{
+	size_t i;
+
+	for(i = 0; i < NUM_IMPLS; i++) {
+		if(impl_supported(&unpack_impls[i]) && index-- == 0) {
+			return unpack_impls[i].name;
+		}
+	}
+
+	return NULL;
+}
+
+// Returns the name of the unpacking implementation currently in use.
+const char *ku_unpack_impl(void)
+{
+	return current_impl->name;
+}
+
+// Switches to the named unpacking implementation.  Returns 0 on success, or
+// -1 if the implementation does not exist or is not supported by the CPU.
+int ku_select_unpack(const char *name)
+{
+	size_t i;
+
+	for(i = 0; i < NUM_IMPLS; i++) {
+		if(!strcmp(unpack_impls[i].name, name) && impl_supported(&unpack_impls[i])) {
+			current_impl = &unpack_impls[i];
+			ku_unpack11_to_16_buf = current_impl->to_16;
+			ku_unpack11_to_16_lut_buf = current_impl->to_16_lut;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+// Selects the fastest unpacking implementation supported by the CPU.
+// Returns the name of the selected implementation.
+const char *ku_init_unpack(void)
+{
+	size_t i;
+
+	for(i = NUM_IMPLS; i > 0; i--) {
+		if(impl_supported(&unpack_impls[i - 1])) {
+			ku_select_unpack(unpack_impls[i - 1].name);
+			break;
+		}
+	}
+
+	return ku_unpack_impl();
+}
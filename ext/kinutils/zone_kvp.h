@@ -0,0 +1,66 @@
+/*
+ * Normalized parsing of KND zone key-value pairs.
+ * (C)2026 Mike Bourgeous
+ */
+#ifndef ZONE_KVP_H_
+#define ZONE_KVP_H_
+
+#include <ruby.h>
+
+// Zone attributes that are converted while parsing.  Integer attributes come
+// first, starting with the world-space coordinates in this order.
+enum ku_zone_attr {
+	KU_ZA_XMIN, KU_ZA_YMIN, KU_ZA_ZMIN, KU_ZA_XMAX, KU_ZA_YMAX, KU_ZA_ZMAX,
+	KU_ZA_PX_XMIN, KU_ZA_PX_YMIN, KU_ZA_PX_ZMIN, KU_ZA_PX_XMAX, KU_ZA_PX_YMAX, KU_ZA_PX_ZMAX,
+	KU_ZA_POP, KU_ZA_MAXPOP, KU_ZA_XC, KU_ZA_YC, KU_ZA_ZC, KU_ZA_SA, KU_ZA_BRIGHT,
+	KU_ZA_ON_LEVEL, KU_ZA_OFF_LEVEL, KU_ZA_ON_DELAY, KU_ZA_OFF_DELAY,
+	KU_ZA_NEGATE, KU_ZA_OCCUPIED, KU_ZA_PARAM, KU_ZA_NAME, KU_ZA_VERSION,
+	KU_ZA_COUNT
+};
+
+// Number of integer attributes (KU_ZA_XMIN through KU_ZA_OFF_DELAY).
+#define KU_ZA_INT_COUNT (KU_ZA_OFF_DELAY + 1)
+
+// Number of valid zone parameters (see ku_zone_params).
+#define KU_ZONE_PARAM_COUNT 6
+
+// Attribute names, and frozen Strings of those names for use as Hash keys.
+extern const char *ku_zone_attr_names[KU_ZA_COUNT];
+extern VALUE ku_zone_attr_strings[KU_ZA_COUNT];
+
+// Names of the parameters a zone's occupancy can be based on.
+extern const char *ku_zone_params[KU_ZONE_PARAM_COUNT];
+
+// Called for each attribute on a zone line.  attr is the attribute, or -1
+// for keys without special handling (key holds the name).  Integer
+// attributes are given in integer with value set to Qundef.  Other
+// attributes are given in value: true or false for negate and occupied, the
+// fixed name for name, and the parameter name for param (with its index in
+// integer).  Invalid params are skipped.  Version 1 coordinates are given
+// again, in millimeters, after the rest of the line.
+typedef void (*ku_zone_attr_fn)(void *data, int attr, const char *key, long integer, VALUE value);
+
+// Returns the attribute with the given name, or -1.
+int ku_zone_attr_find(const char *key);
+
+// Returns the index of the named zone parameter, or -1.
+int ku_zone_param_find(const char *name);
+
+// Returns a copy of the len-byte zone name with commas removed and
+// whitespace replaced by underscores, like Zone.fix_name!.
+VALUE ku_zone_fixed_name(const char *name, long len);
+
+// Parses a NUL-terminated line of key-value pairs, normalized as by
+// Zone#normalize!, calling cb with data for each one.  Returns the number of
+// pairs found.
+int ku_parse_zone_kvp(const char *line, ku_zone_attr_fn cb, void *data);
+
+// Parses a NUL-terminated line of key-value pairs into a Hash, normalized as
+// by Zone#normalize!.  Returns the number of pairs found.
+int ku_zone_hash_merge_line(VALUE hash, const char *line);
+
+// Parses a NUL-terminated line of key-value pairs directly into a
+// CompactZone.
+void ku_compact_zone_merge_line(VALUE zone, const char *line);
+
+#endif /* ZONE_KVP_H_ */
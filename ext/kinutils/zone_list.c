@@ -0,0 +1,320 @@
+/*
+ * Native parsing of KND zone listings for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * Parses every line of a zones command response in one call, producing
+ * Hashes that have already been normalized the way Zone#normalize! would,
+ * so they can be passed straight to Zone.new without normalization.  The
+ * normalizing parser is shared with Kinutils::CompactZone.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ruby.h>
+#include <nlutils/nlutils.h>
+
+#include "kinutils.h"
+#include "zone_kvp.h"
+
+const char *ku_zone_attr_names[KU_ZA_COUNT] = {
+	"xmin", "ymin", "zmin", "xmax", "ymax", "zmax",
+	"px_xmin", "px_ymin", "px_zmin", "px_xmax", "px_ymax", "px_zmax",
+	"pop", "maxpop", "xc", "yc", "zc", "sa", "bright",
+	"on_level", "off_level", "on_delay", "off_delay",
+	"negate", "occupied", "param", "name", "version",
+};
+VALUE ku_zone_attr_strings[KU_ZA_COUNT];
+
+const char *ku_zone_params[KU_ZONE_PARAM_COUNT] = { "pop", "sa", "bright", "xc", "yc", "zc" };
+
+// State for the zone on a single line.  World coordinates are also kept as
+// doubles until the end of the line, since the version that decides whether
+// they are in meters may come after them.
+struct zone_line {
+	ku_zone_attr_fn cb;
+	void *data;
+	int count;
+	double coords[6];
+	unsigned int coords_set;
+	long version;
+	unsigned int has_version:1;
+};
+
+// Returns the attribute with the given name, or -1.
+int ku_zone_attr_find(const char *key)
+{
+	int i;
+
+	for(i = 0; i < KU_ZA_COUNT; i++) {
+		if(!strcmp(key, ku_zone_attr_names[i])) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// Returns the index of the named zone parameter, or -1.
+int ku_zone_param_find(const char *name)
+{
+	int i;
+
+	for(i = 0; i < KU_ZONE_PARAM_COUNT; i++) {
+		if(!strcmp(name, ku_zone_params[i])) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// Returns the text of a parsed value.
+static const char *value_string(char *strvalue, struct nl_variant value)
+{
+	return value.type == STRING ? value.value.string : strvalue;
+}
+
+// Converts a parsed value to an integer the way Ruby's to_i would.
+static long value_to_long(char *strvalue, struct nl_variant value)
+{
+	switch(value.type) {
+		case INTEGER:
+			return value.value.integer;
+
+		case FLOAT:
+			return (long)value.value.floating;
+
+		default:
+			return strtol(value_string(strvalue, value), NULL, 10);
+	}
+}
+
+// Converts a parsed value to a Ruby object the same way String#kin_kvp does.
+static VALUE value_to_ruby(char *strvalue, struct nl_variant value)
+{
+	switch(value.type) {
+		case INTEGER:
+			return INT2NUM(value.value.integer);
+
+		case FLOAT:
+			return rb_float_new(value.value.floating);
+
+		default:
+			return rb_str_new2(value_string(strvalue, value));
+	}
+}
+
+// Returns a copy of the len-byte zone name with commas removed and
+// whitespace replaced by underscores, like Zone.fix_name!.
+VALUE ku_zone_fixed_name(const char *name, long len)
+{
+	VALUE str = rb_str_buf_new(len);
+	const char *p;
+
+	for(p = name; p < name + len; p++) {
+		switch(*p) {
+			case ',':
+				break;
+
+			case ' ':
+			case '\t':
+			case '\r':
+			case '\n':
+				rb_str_buf_cat(str, "_", 1);
+				break;
+
+			default:
+				rb_str_buf_cat(str, p, 1);
+				break;
+		}
+	}
+
+	return str;
+}
+
+// Parsing callback for each key-value pair on a zone line.
+static void zone_line_cb(void *data, char *key, char *strvalue, struct nl_variant value)
+{
+	struct zone_line *line = data;
+	int k = ku_zone_attr_find(key);
+	const char *s;
+	int param;
+
+	line->count++;
+
+	switch(k) {
+		case -1:
+			line->cb(line->data, k, key, 0, value_to_ruby(strvalue, value));
+			break;
+
+		case KU_ZA_XMIN:
+		case KU_ZA_YMIN:
+		case KU_ZA_ZMIN:
+		case KU_ZA_XMAX:
+		case KU_ZA_YMAX:
+		case KU_ZA_ZMAX:
+			switch(value.type) {
+				case INTEGER:
+					line->coords[k] = value.value.integer;
+					break;
+
+				case FLOAT:
+					line->coords[k] = value.value.floating;
+					break;
+
+				default:
+					line->coords[k] = strtod(value_string(strvalue, value), NULL);
+					break;
+			}
+			line->coords_set |= 1 << k;
+			line->cb(line->data, k, key, value_to_long(strvalue, value), Qundef);
+			break;
+
+		case KU_ZA_NEGATE:
+			s = value_string(strvalue, value);
+			if(value.type == STRING && !strcmp(s, "true")) {
+				line->cb(line->data, k, key, 1, Qtrue);
+			} else if(value.type == STRING && !strcmp(s, "false")) {
+				line->cb(line->data, k, key, 0, Qfalse);
+			} else {
+				line->cb(line->data, k, key, 0, value_to_long(strvalue, value) == 1 ? Qtrue : Qfalse);
+			}
+			break;
+
+		case KU_ZA_OCCUPIED:
+			line->cb(line->data, k, key, 0, value_to_long(strvalue, value) == 1 ? Qtrue : Qfalse);
+			break;
+
+		case KU_ZA_PARAM:
+			// Unknown parameters are dropped, as in Zone#normalize!
+			param = value.type == STRING ? ku_zone_param_find(value.value.string) : -1;
+			if(param >= 0) {
+				line->cb(line->data, k, key, param, rb_str_new2(ku_zone_params[param]));
+			}
+			break;
+
+		case KU_ZA_NAME:
+			s = value_string(strvalue, value);
+			line->cb(line->data, k, key, 0, ku_zone_fixed_name(s, strlen(s)));
+			break;
+
+		case KU_ZA_VERSION:
+			line->version = value_to_long(strvalue, value);
+			line->has_version = 1;
+			line->cb(line->data, k, key, line->version, value_to_ruby(strvalue, value));
+			break;
+
+		default:
+			line->cb(line->data, k, key, value_to_long(strvalue, value), Qundef);
+			break;
+	}
+}
+
+// Parses a NUL-terminated line of key-value pairs, normalized as by
+// Zone#normalize!, calling cb with data for each one.  Returns the number of
+// pairs found.
+int ku_parse_zone_kvp(const char *line, ku_zone_attr_fn cb, void *data)
+{
+	struct zone_line info = {
+		.cb = cb,
+		.data = data,
+	};
+	int i;
+
+	nl_parse_kvp(line, nl_kvp_wrapper, &(struct nl_kvp_wrap){zone_line_cb, &info});
+
+	// Version 1 zones used floating point meters
+	if(info.has_version && info.version < 2) {
+		for(i = 0; i < 6; i++) {
+			if(info.coords_set & (1 << i)) {
+				cb(data, i, ku_zone_attr_names[i], (long)(info.coords[i] * 1000.0), Qundef);
+			}
+		}
+	}
+
+	return info.count;
+}
+
+// Stores each parsed attribute in a Hash.
+static void zone_hash_cb(void *data, int attr, const char *key, long integer, VALUE value)
+{
+	VALUE hash = (VALUE)data;
+	VALUE rbkey = attr >= 0 ? ku_zone_attr_strings[attr] : rb_str_new2(key);
+
+	rb_hash_aset(hash, rbkey, value == Qundef ? LONG2NUM(integer) : value);
+}
+
+// Parses a NUL-terminated line of key-value pairs into a Hash, normalized as
+// by Zone#normalize!.  Returns the number of pairs found.
+int ku_zone_hash_merge_line(VALUE hash, const char *line)
+{
+	return ku_parse_zone_kvp(line, zone_hash_cb, (void *)hash);
+}
+
+// Appends the zone parsed from len bytes at str to zones, reusing the String
+// buf for a NUL-terminated copy of the line.  Lines without any key-value
+// pairs are skipped.
+static void add_zone_line(VALUE zones, const char *str, long len, VALUE buf)
+{
+	VALUE zone = rb_hash_new();
+
+	rb_str_resize(buf, len);
+	memcpy(RSTRING_PTR(buf), str, len);
+
+	if(ku_zone_hash_merge_line(zone, RSTRING_PTR(buf)) > 0) {
+		rb_ary_push(zones, zone);
+	}
+}
+
+// Parses a zone listing, given as a String with one zone per line or as an
+// Array of lines, into an Array of Hashes with one Hash per zone.  The Hashes
+// are normalized as by Zone#normalize! (version 1 coordinates converted to
+// millimeters, numbers converted to Integers, negate and occupied converted
+// to booleans, invalid params removed, and names fixed), so they may be
+// given to Zone.new with normalize set to false.  Blank lines are skipped.
+static VALUE rb_parse_zone_list(VALUE self, VALUE text)
+{
+	VALUE zones = rb_ary_new();
+	VALUE buf = rb_str_buf_new(256);
+	const char *start, *end, *nl;
+	VALUE line;
+	long i;
+
+	if(RB_TYPE_P(text, T_ARRAY)) {
+		for(i = 0; i < RARRAY_LEN(text); i++) {
+			line = rb_ary_entry(text, i);
+			StringValue(line);
+			add_zone_line(zones, RSTRING_PTR(line), RSTRING_LEN(line), buf);
+		}
+	} else {
+		StringValue(text);
+		start = RSTRING_PTR(text);
+		end = start + RSTRING_LEN(text);
+
+		while(start < end) {
+			nl = memchr(start, '\n', end - start);
+			if(nl == NULL) {
+				nl = end;
+			}
+
+			add_zone_line(zones, start, nl - start, buf);
+			start = nl + 1;
+		}
+	}
+
+	RB_GC_GUARD(buf);
+
+	return zones;
+}
+
+// Defines Kinutils.parse_zone_list.
+void init_zone_list(VALUE kinutils)
+{
+	int i;
+
+	for(i = 0; i < KU_ZA_COUNT; i++) {
+		ku_zone_attr_strings[i] = rb_obj_freeze(rb_str_new_cstr(ku_zone_attr_names[i]));
+		rb_gc_register_mark_object(ku_zone_attr_strings[i]);
+	}
+
+	rb_define_module_function(kinutils, "parse_zone_list", rb_parse_zone_list, 1);
+}
@@ -0,0 +1,456 @@
+/*
+ * Native zone evaluation for the Kinutils Ruby extension.
+ * (C)2026 Mike Bourgeous
+ *
+ * A ZoneSet holds a set of named zones and computes their statistics and
+ * occupancy from depth frames in a single pass per frame, producing values
+ * that can be merged into Zone objects with Zone#merge_zone.  The set keeps
+ * a zone index up to date as zones are added, changed, and removed.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ruby.h>
+#include <ruby/thread.h>
+
+#include "unpack.h"
+#include "zones.h"
+#include "kinutils.h"
+
+struct zone_set {
+	struct ku_zone *zones;
+	struct ku_zone_index index;
+	VALUE names; // Array of zone names, parallel to zones
+	VALUE indices; // Hash of zone names to indices in zones
+	int count;
+	int capacity;
+	int busy;
+};
+
+struct evaluate_info {
+	const uint8_t *in;
+	struct ku_zone *zones;
+	int count;
+	const struct ku_zone_index *index;
+};
+
+static const char *param_names[] = { "pop", "sa", "bright", "xc", "yc", "zc" };
+
+// Zone attribute names, whose String and Symbol keys are created once so
+// frequent updates and results don't allocate key Strings.
+enum zone_key {
+	KEY_XMIN, KEY_YMIN, KEY_ZMIN, KEY_XMAX, KEY_YMAX, KEY_ZMAX,
+	KEY_PARAM, KEY_ON_LEVEL, KEY_OFF_LEVEL, KEY_ON_DELAY, KEY_OFF_DELAY, KEY_NEGATE,
+	KEY_POP, KEY_MAXPOP, KEY_XC, KEY_YC, KEY_ZC, KEY_SA, KEY_OCCUPIED,
+	KEY_PX_XMIN, KEY_PX_YMIN, KEY_PX_ZMIN, KEY_PX_XMAX, KEY_PX_YMAX, KEY_PX_ZMAX,
+	KEY_COUNT
+};
+static const char *key_names[KEY_COUNT] = {
+	"xmin", "ymin", "zmin", "xmax", "ymax", "zmax",
+	"param", "on_level", "off_level", "on_delay", "off_delay", "negate",
+	"pop", "maxpop", "xc", "yc", "zc", "sa", "occupied",
+	"px_xmin", "px_ymin", "px_zmin", "px_xmax", "px_ymax", "px_zmax",
+};
+static VALUE key_strings[KEY_COUNT];
+static VALUE key_symbols[KEY_COUNT];
+
+static VALUE ZoneSet = Qnil;
+
+static void zone_set_mark(void *data)
+{
+	struct zone_set *set = data;
+	rb_gc_mark(set->names);
+	rb_gc_mark(set->indices);
+}
+
+static void zone_set_free(void *data)
+{
+	struct zone_set *set = data;
+	free(set->zones);
+	ku_zone_index_free(&set->index);
+	xfree(set);
+}
+
+static size_t zone_set_size(const void *data)
+{
+	const struct zone_set *set = data;
+	return sizeof(struct zone_set) + set->capacity * sizeof(struct ku_zone);
+}
+
+static const rb_data_type_t zone_set_type = {
+	.wrap_struct_name = "NL::KndClient::Kinutils::ZoneSet",
+	.function = {
+		.dmark = zone_set_mark,
+		.dfree = zone_set_free,
+		.dsize = zone_set_size,
+	},
+	.flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE zone_set_alloc(VALUE klass)
+{
+	struct zone_set *set;
+	VALUE obj = TypedData_Make_Struct(klass, struct zone_set, &zone_set_type, set);
+
+	set->names = rb_ary_new();
+	set->indices = rb_hash_new();
+	ku_zone_index_init(&set->index);
+
+	return obj;
+}
+
+static struct zone_set *get_set(VALUE self)
+{
+	struct zone_set *set;
+	TypedData_Get_Struct(self, struct zone_set, &zone_set_type, set);
+	return set;
+}
+
+// Raises an error if the set is evaluating a frame in another thread.
+static void check_busy(struct zone_set *set)
+{
+	if(set->busy) {
+		rb_raise(rb_eRuntimeError, "ZoneSet is already evaluating a frame in another thread.");
+	}
+}
+
+// Returns the index of the named zone, or -1 if there is no such zone.
+static int find_zone(struct zone_set *set, VALUE name)
+{
+	VALUE idx = rb_hash_lookup2(set->indices, name, Qnil);
+	return NIL_P(idx) ? -1 : FIX2INT(idx);
+}
+
+// Returns nonzero if the zones have the same world-space bounds.
+static int same_bounds(const struct ku_zone *a, const struct ku_zone *b)
+{
+	return a->xmin == b->xmin && a->ymin == b->ymin && a->zmin == b->zmin &&
+		a->xmax == b->xmax && a->ymax == b->ymax && a->zmax == b->zmax;
+}
+
+// Looks up key in attrs as a String, then as a Symbol.  Returns Qundef if
+// neither is present.
+static VALUE zone_attr(VALUE attrs, enum zone_key key)
+{
+	VALUE v;
+
+	if(ku_is_compact_zone(attrs)) {
+		return ku_compact_zone_get(attrs, key_names[key]);
+	}
+
+	v = rb_hash_lookup2(attrs, key_strings[key], Qundef);
+	if(v == Qundef) {
+		v = rb_hash_lookup2(attrs, key_symbols[key], Qundef);
+	}
+	return v;
+}
+
+// Stores the integer value of key from attrs in *out, if present.  Raises an
+// error if required is nonzero and the key is missing.
+static void zone_int(VALUE attrs, enum zone_key key, int *out, int required)
+{
+	VALUE v = zone_attr(attrs, key);
+
+	if(v == Qundef || NIL_P(v)) {
+		if(required) {
+			rb_raise(rb_eArgError, "Zone is missing %s.", key_names[key]);
+		}
+		return;
+	}
+
+	*out = NUM2INT(rb_Integer(v));
+}
+
+// Reads a world-space box from a Zone, a Hash with String or Symbol keys
+// xmin, ymin, zmin, xmax, ymax, and zmax, or an Array of those six values,
+// into box (in that order).  Raises an error if any are missing.
+void ku_box_from_value(VALUE value, int box[6])
+{
+	int i;
+
+	if(RB_TYPE_P(value, T_ARRAY)) {
+		if(RARRAY_LEN(value) != 6) {
+			rb_raise(rb_eArgError, "Box arrays must have 6 elements (got %ld).", RARRAY_LEN(value));
+		}
+		for(i = 0; i < 6; i++) {
+			box[i] = NUM2INT(rb_Integer(RARRAY_AREF(value, i)));
+		}
+		return;
+	}
+
+	if(!ku_is_compact_zone(value)) {
+		Check_Type(value, T_HASH);
+	}
+	for(i = 0; i < 6; i++) {
+		zone_int(value, KEY_XMIN + i, &box[i], 1);
+	}
+}
+
+// Converts a Zone-style negate value (true/false, 0/1, or "true"/"false").
+static int zone_negate(VALUE v)
+{
+	if(RB_TYPE_P(v, T_STRING)) {
+		return !strcmp(StringValueCStr(v), "true") || !strcmp(StringValueCStr(v), "1");
+	}
+	if(RB_INTEGER_TYPE_P(v)) {
+		return NUM2INT(v) == 1;
+	}
+	return RTEST(v);
+}
+
+// Fills zone from a Zone or a Hash with String or Symbol keys.
+static void zone_from_hash(struct ku_zone *zone, VALUE attrs)
+{
+	VALUE v;
+	unsigned int i;
+	int box[6];
+
+	if(!ku_is_compact_zone(attrs)) {
+		Check_Type(attrs, T_HASH);
+	}
+
+	ku_box_from_value(attrs, box);
+	zone->xmin = box[0];
+	zone->ymin = box[1];
+	zone->zmin = box[2];
+	zone->xmax = box[3];
+	zone->ymax = box[4];
+	zone->zmax = box[5];
+
+	zone_int(attrs, KEY_ON_LEVEL, &zone->on_level, 0);
+	zone_int(attrs, KEY_OFF_LEVEL, &zone->off_level, 0);
+	zone_int(attrs, KEY_ON_DELAY, &zone->on_delay, 0);
+	zone_int(attrs, KEY_OFF_DELAY, &zone->off_delay, 0);
+
+	v = zone_attr(attrs, KEY_NEGATE);
+	if(v != Qundef) {
+		zone->negate = zone_negate(v);
+	}
+
+	v = zone_attr(attrs, KEY_PARAM);
+	if(v != Qundef && !NIL_P(v)) {
+		if(SYMBOL_P(v)) {
+			v = rb_sym2str(v);
+		}
+		for(i = 0; i < sizeof(param_names) / sizeof(param_names[0]); i++) {
+			if(!strcmp(StringValueCStr(v), param_names[i])) {
+				zone->param = i;
+				break;
+			}
+		}
+		if(i == sizeof(param_names) / sizeof(param_names[0])) {
+			rb_raise(rb_eArgError, "Unknown zone parameter %"PRIsVALUE".", rb_inspect(v));
+		}
+	}
+
+	ku_zone_bounds(zone);
+}
+
+// Adds a zone, or replaces the zone with the same name.  Attributes come from
+// a Zone or a Hash with String or Symbol keys; xmin, ymin, zmin, xmax, ymax,
+// and zmax are required, and param, on_level, off_level, on_delay, off_delay,
+// and negate are optional.  Replacing a zone keeps its occupancy state, and
+// only updates the zone index if the bounds changed.  Returns self.
+static VALUE zone_set_set(VALUE self, VALUE name, VALUE attrs)
+{
+	struct zone_set *set = get_set(self);
+	struct ku_zone zone, *zones;
+	int idx, capacity;
+
+	name = rb_str_new_frozen(StringValue(name));
+	check_busy(set);
+
+	idx = find_zone(set, name);
+	if(idx >= 0) {
+		zone = set->zones[idx];
+	} else {
+		ku_zone_init(&zone);
+	}
+
+	zone_from_hash(&zone, attrs);
+
+	if(idx >= 0) {
+		if(!same_bounds(&zone, &set->zones[idx])) {
+			ku_zone_index_remove(&set->index, set->zones, idx);
+			set->zones[idx] = zone;
+			if(ku_zone_index_add(&set->index, set->zones, idx)) {
+				// Keep the zone, but empty, so the index stays valid
+				set->zones[idx].xmin = 1;
+				set->zones[idx].xmax = 0;
+				ku_zone_bounds(&set->zones[idx]);
+				rb_raise(rb_eNoMemError, "Unable to allocate zone index space for %"PRIsVALUE".", name);
+			}
+		} else {
+			set->zones[idx] = zone;
+		}
+	} else {
+		if(set->count == set->capacity) {
+			capacity = set->capacity ? set->capacity * 2 : 16;
+			zones = realloc(set->zones, capacity * sizeof(struct ku_zone));
+			if(zones == NULL) {
+				rb_raise(rb_eNoMemError, "Unable to allocate space for %d zones.", capacity);
+			}
+			set->zones = zones;
+			set->capacity = capacity;
+		}
+
+		set->zones[set->count] = zone;
+		if(ku_zone_index_add(&set->index, set->zones, set->count)) {
+			rb_raise(rb_eNoMemError, "Unable to allocate zone index space for %"PRIsVALUE".", name);
+		}
+
+		rb_hash_aset(set->indices, name, INT2FIX(set->count));
+		rb_ary_push(set->names, name);
+		set->count++;
+	}
+
+	return self;
+}
+
+// Removes the named zone.  Returns true if the zone existed, false otherwise.
+static VALUE zone_set_delete(VALUE self, VALUE name)
+{
+	struct zone_set *set = get_set(self);
+	int idx;
+
+	StringValue(name);
+	check_busy(set);
+
+	idx = find_zone(set, name);
+	if(idx < 0) {
+		return Qfalse;
+	}
+
+	ku_zone_index_remove(&set->index, set->zones, idx);
+	rb_hash_delete(set->indices, name);
+
+	// Move the last zone into the gap
+	set->count--;
+	if(idx != set->count) {
+		ku_zone_index_move(&set->index, &set->zones[set->count], set->count, idx);
+		set->zones[idx] = set->zones[set->count];
+		rb_ary_store(set->names, idx, RARRAY_AREF(set->names, set->count));
+		rb_hash_aset(set->indices, RARRAY_AREF(set->names, idx), INT2FIX(idx));
+	}
+	rb_ary_pop(set->names);
+
+	return Qtrue;
+}
+
+// Removes all zones.  Returns self.
+static VALUE zone_set_clear(VALUE self)
+{
+	struct zone_set *set = get_set(self);
+
+	check_busy(set);
+
+	ku_zone_index_free(&set->index);
+	set->count = 0;
+	rb_ary_clear(set->names);
+	rb_hash_clear(set->indices);
+
+	return self;
+}
+
+static void *evaluate_blocking(void *data)
+{
+	struct evaluate_info *info = data;
+	ku_zones_evaluate(info->in, info->zones, info->count, info->index);
+	return NULL;
+}
+
+// Returns a Hash of a zone's statistics, using the same keys and types as
+// Zone.
+static VALUE zone_result(struct ku_zone *zone)
+{
+	VALUE h = rb_hash_new();
+
+	rb_hash_aset(h, key_strings[KEY_POP], INT2FIX(zone->pop));
+	rb_hash_aset(h, key_strings[KEY_MAXPOP], INT2FIX(zone->maxpop));
+	rb_hash_aset(h, key_strings[KEY_XC], INT2FIX(zone->xc));
+	rb_hash_aset(h, key_strings[KEY_YC], INT2FIX(zone->yc));
+	rb_hash_aset(h, key_strings[KEY_ZC], INT2FIX(zone->zc));
+	rb_hash_aset(h, key_strings[KEY_SA], INT2FIX(zone->sa));
+	rb_hash_aset(h, key_strings[KEY_OCCUPIED], zone->occupied ? Qtrue : Qfalse);
+	rb_hash_aset(h, key_strings[KEY_PX_XMIN], INT2FIX(zone->px_xmin));
+	rb_hash_aset(h, key_strings[KEY_PX_YMIN], INT2FIX(zone->px_ymin));
+	rb_hash_aset(h, key_strings[KEY_PX_ZMIN], INT2FIX(zone->px_zmin));
+	rb_hash_aset(h, key_strings[KEY_PX_XMAX], INT2FIX(zone->px_xmax));
+	rb_hash_aset(h, key_strings[KEY_PX_YMAX], INT2FIX(zone->px_ymax));
+	rb_hash_aset(h, key_strings[KEY_PX_ZMAX], INT2FIX(zone->px_zmax));
+
+	return h;
+}
+
+// Evaluates every zone against a packed 11-bit depth frame, updating
+// occupancy.  Returns a Hash mapping zone names to Hashes of pop, maxpop, xc,
+// yc, zc, sa, occupied, and the screen-space bounds, suitable for
+// Zone#merge_zone.
+static VALUE zone_set_evaluate(VALUE self, VALUE data)
+{
+	struct zone_set *set = get_set(self);
+	VALUE result;
+	int i;
+
+	Check_Type(data, T_STRING);
+	if(RSTRING_LEN(data) < KU_PACKED_SIZE) {
+		rb_raise(rb_eArgError, "Input data must be at least 640*480*11/8 bytes (got %ld).", RSTRING_LEN(data));
+	}
+
+	check_busy(set);
+
+	set->busy = 1;
+	rb_thread_call_without_gvl(
+			evaluate_blocking,
+			&(struct evaluate_info){ .in = (uint8_t *)RSTRING_PTR(data), .zones = set->zones, .count = set->count, .index = &set->index },
+			NULL,
+			NULL
+			);
+	set->busy = 0;
+
+	result = rb_hash_new();
+	for(i = 0; i < set->count; i++) {
+		rb_hash_aset(result, RARRAY_AREF(set->names, i), zone_result(&set->zones[i]));
+	}
+
+	return result;
+}
+
+// Returns the number of zones in the set.
+static VALUE zone_set_count(VALUE self)
+{
+	return INT2FIX(get_set(self)->count);
+}
+
+// Returns the names of the zones in the set.
+static VALUE zone_set_names(VALUE self)
+{
+	return rb_ary_dup(get_set(self)->names);
+}
+
+// Returns true if the set has a zone with the given name.
+static VALUE zone_set_include(VALUE self, VALUE name)
+{
+	return find_zone(get_set(self), StringValue(name)) >= 0 ? Qtrue : Qfalse;
+}
+
+void init_zone_set(VALUE kinutils)
+{
+	int i;
+
+	for(i = 0; i < KEY_COUNT; i++) {
+		key_strings[i] = rb_obj_freeze(rb_str_new_cstr(key_names[i]));
+		rb_gc_register_mark_object(key_strings[i]);
+		key_symbols[i] = ID2SYM(rb_intern(key_names[i]));
+	}
+
+	ZoneSet = rb_define_class_under(kinutils, "ZoneSet", rb_cObject);
+	rb_define_alloc_func(ZoneSet, zone_set_alloc);
+
+	rb_define_method(ZoneSet, "set", zone_set_set, 2);
+	rb_define_method(ZoneSet, "delete", zone_set_delete, 1);
+	rb_define_method(ZoneSet, "clear", zone_set_clear, 0);
+	rb_define_method(ZoneSet, "evaluate", zone_set_evaluate, 1);
+	rb_define_method(ZoneSet, "size", zone_set_count, 0);
+	rb_define_method(ZoneSet, "names", zone_set_names, 0);
+	rb_define_method(ZoneSet, "include?", zone_set_include, 1);
+}
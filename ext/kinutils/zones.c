@@ -0,0 +1,350 @@
+/*
+ * Client-side zone evaluation for Kinect depth data.
+ * (C)2026 Mike Bourgeous
+ *
+ * Zones are world-space boxes.  Each frame, every pixel whose world-space
+ * point falls within a zone adds to that zone's population, centroid, and
+ * surface area, and occupancy is then updated from the zone's thresholds.
+ *
+ * A zone index divides the screen into tiles, each listing the zones whose
+ * screen-space bounds overlap it and a mask of the raw depth ranges they
+ * cover, so most pixels are rejected without looking at any zone.  Zones are
+ * added to and removed from the index individually as they change.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <nlutils/nlutils.h>
+
+#include "unpack.h"
+#include "zones.h"
+
+// Width of one pixel in millimeters per millimeter of depth (tan(28) / 320,
+// as used by ku_xworld()).
+#define PX_SCALE (1089.0 / 2048.0 / 320.0)
+
+// Initializes a zone's settings to the defaults: occupied by any population,
+// no delays.  World bounds must still be set, followed by ku_zone_bounds().
+void ku_zone_init(struct ku_zone *zone)
+{
+	memset(zone, 0, sizeof(*zone));
+	zone->param = KU_ZONE_POP;
+	zone->on_level = 1;
+	zone->off_level = 1;
+}
+
+// Computes a zone's screen-space bounds and maxpop from its world bounds.
+// The screen-space bounds contain every pixel that could fall in the zone.
+void ku_zone_bounds(struct ku_zone *zone)
+{
+	double zlo, zhi, lo, hi, p[4];
+	int i;
+
+	if(zone->xmin > zone->xmax || zone->ymin > zone->ymax || zone->zmin > zone->zmax || zone->zmax <= 0) {
+		// Empty zone; no pixel can match
+		zone->px_xmin = zone->px_ymin = zone->px_zmin = 1;
+		zone->px_xmax = zone->px_ymax = zone->px_zmax = 0;
+		zone->maxpop = 0;
+		return;
+	}
+
+	// Screen position is monotonic in both world position and depth, so the
+	// extremes are at the corners.  A pixel of margin covers ku_xworld()
+	// rounding.
+	zlo = zone->zmin > 0 ? zone->zmin : 1;
+	zhi = zone->zmax;
+
+	p[0] = 320.0 - zone->xmin / (zlo * PX_SCALE);
+	p[1] = 320.0 - zone->xmin / (zhi * PX_SCALE);
+	p[2] = 320.0 - zone->xmax / (zlo * PX_SCALE);
+	p[3] = 320.0 - zone->xmax / (zhi * PX_SCALE);
+	for(lo = hi = p[0], i = 1; i < 4; i++) {
+		lo = fmin(lo, p[i]);
+		hi = fmax(hi, p[i]);
+	}
+	zone->px_xmin = CLAMP(0, 639, floor(lo) - 1);
+	zone->px_xmax = CLAMP(0, 639, ceil(hi) + 1);
+
+	p[0] = 240.0 - zone->ymin / (zlo * PX_SCALE);
+	p[1] = 240.0 - zone->ymin / (zhi * PX_SCALE);
+	p[2] = 240.0 - zone->ymax / (zlo * PX_SCALE);
+	p[3] = 240.0 - zone->ymax / (zhi * PX_SCALE);
+	for(lo = hi = p[0], i = 1; i < 4; i++) {
+		lo = fmin(lo, p[i]);
+		hi = fmax(hi, p[i]);
+	}
+	zone->px_ymin = CLAMP(0, 479, floor(lo) - 1);
+	zone->px_ymax = CLAMP(0, 479, ceil(hi) + 1);
+
+	zone->px_zmin = zone->zmin <= ku_depth_lut[0] ? 0 : ku_reverse_lut(zone->zmin);
+	zone->px_zmax = zone->zmax >= ku_depth_lut[PXZMAX - 1] ? PXZMAX - 1 : CLAMP(0, PXZMAX - 1, ku_reverse_lut(zone->zmax) + 1);
+
+	// Same formula as KND
+	zone->maxpop = (zone->px_xmax - zone->px_xmin) * (zone->px_ymax - zone->px_ymin);
+}
+
+// Returns the value of the zone's occupancy parameter.
+static int param_value(struct ku_zone *zone)
+{
+	switch(zone->param) {
+		case KU_ZONE_SA:
+			return zone->sa;
+		case KU_ZONE_XC:
+			return zone->xc;
+		case KU_ZONE_YC:
+			return zone->yc;
+		case KU_ZONE_ZC:
+			return zone->zc;
+		case KU_ZONE_POP:
+		case KU_ZONE_BRIGHT:
+		default:
+			return zone->pop;
+	}
+}
+
+// Updates a zone's occupancy from its thresholds and delays.
+static void update_occupancy(struct ku_zone *zone)
+{
+	int value = param_value(zone);
+
+	if(!zone->state) {
+		if(value >= zone->on_level) {
+			zone->delay_count++;
+			if(zone->delay_count > zone->on_delay) {
+				zone->state = 1;
+				zone->delay_count = 0;
+			}
+		} else {
+			zone->delay_count = 0;
+		}
+	} else {
+		if(value < zone->off_level) {
+			zone->delay_count++;
+			if(zone->delay_count > zone->off_delay) {
+				zone->state = 0;
+				zone->delay_count = 0;
+			}
+		} else {
+			zone->delay_count = 0;
+		}
+	}
+
+	zone->occupied = zone->state ^ !!zone->negate;
+}
+
+// Computes final statistics and occupancy after all pixels are counted.
+static void finish_zone(struct ku_zone *zone)
+{
+	if(zone->pop) {
+		zone->xc = zone->xsum / zone->pop;
+		zone->yc = zone->ysum / zone->pop;
+		zone->zc = zone->zsum / zone->pop;
+	} else {
+		zone->xc = zone->yc = zone->zc = 0;
+	}
+	zone->sa = lround(zone->sasum * (PX_SCALE * PX_SCALE));
+
+	update_occupancy(zone);
+}
+
+// Initializes an empty zone index.
+void ku_zone_index_init(struct ku_zone_index *index)
+{
+	memset(index, 0, sizeof(*index));
+}
+
+// Frees memory used by a zone index (but not the index itself).
+void ku_zone_index_free(struct ku_zone_index *index)
+{
+	int tx, ty;
+
+	for(ty = 0; ty < KU_ZONE_TILES_Y; ty++) {
+		for(tx = 0; tx < KU_ZONE_TILES_X; tx++) {
+			free(index->tiles[ty][tx].zones);
+		}
+	}
+
+	ku_zone_index_init(index);
+}
+
+// Returns a mask of the raw depth buckets covered by a zone.
+static uint64_t depth_mask(const struct ku_zone *zone)
+{
+	int lo = zone->px_zmin >> KU_ZONE_DEPTH_SHIFT;
+	int hi = zone->px_zmax >> KU_ZONE_DEPTH_SHIFT;
+
+	return ((~0ULL) >> (63 - hi)) & ~((1ULL << lo) - 1);
+}
+
+// Stores the range of tiles covered by a zone's screen-space bounds.
+// Returns 0 if the zone covers no pixels.
+static int zone_tiles(const struct ku_zone *zone, int *tx0, int *ty0, int *tx1, int *ty1)
+{
+	if(zone->px_xmin > zone->px_xmax || zone->px_ymin > zone->px_ymax || zone->px_zmin > zone->px_zmax) {
+		return 0;
+	}
+
+	*tx0 = zone->px_xmin >> KU_ZONE_TILE_SHIFT;
+	*ty0 = zone->px_ymin >> KU_ZONE_TILE_SHIFT;
+	*tx1 = zone->px_xmax >> KU_ZONE_TILE_SHIFT;
+	*ty1 = zone->px_ymax >> KU_ZONE_TILE_SHIFT;
+
+	return 1;
+}
+
+// Adds zones[i] to the tiles covered by its screen-space bounds.  Returns 0
+// on success, or -1 with errno set if memory could not be allocated (the
+// index is then unchanged).
+int ku_zone_index_add(struct ku_zone_index *index, const struct ku_zone *zones, int i)
+{
+	struct ku_zone_tile *tile;
+	uint64_t mask = depth_mask(&zones[i]);
+	int tx, ty, tx0, ty0, tx1, ty1, capacity;
+	int *list;
+
+	if(!zone_tiles(&zones[i], &tx0, &ty0, &tx1, &ty1)) {
+		return 0;
+	}
+
+	// Grow every list first so a failure leaves the index unchanged
+	for(ty = ty0; ty <= ty1; ty++) {
+		for(tx = tx0; tx <= tx1; tx++) {
+			tile = &index->tiles[ty][tx];
+			if(tile->count == tile->capacity) {
+				capacity = tile->capacity ? tile->capacity * 2 : 4;
+				list = realloc(tile->zones, capacity * sizeof(int));
+				if(list == NULL) {
+					return -1;
+				}
+				tile->zones = list;
+				tile->capacity = capacity;
+			}
+		}
+	}
+
+	for(ty = ty0; ty <= ty1; ty++) {
+		for(tx = tx0; tx <= tx1; tx++) {
+			tile = &index->tiles[ty][tx];
+			tile->zones[tile->count++] = i;
+			tile->depth_mask |= mask;
+		}
+		index->row_count[ty] += tx1 - tx0 + 1;
+	}
+
+	return 0;
+}
+
+// Removes zone i from the tiles covered by zones[i]'s screen-space bounds,
+// which must be the same bounds it was added with.
+void ku_zone_index_remove(struct ku_zone_index *index, const struct ku_zone *zones, int i)
+{
+	struct ku_zone_tile *tile;
+	int tx, ty, tx0, ty0, tx1, ty1, j;
+
+	if(!zone_tiles(&zones[i], &tx0, &ty0, &tx1, &ty1)) {
+		return;
+	}
+
+	for(ty = ty0; ty <= ty1; ty++) {
+		for(tx = tx0; tx <= tx1; tx++) {
+			tile = &index->tiles[ty][tx];
+			tile->depth_mask = 0;
+			for(j = 0; j < tile->count; j++) {
+				if(tile->zones[j] == i) {
+					tile->zones[j] = tile->zones[--tile->count];
+					index->row_count[ty]--;
+					j--;
+				} else {
+					tile->depth_mask |= depth_mask(&zones[tile->zones[j]]);
+				}
+			}
+		}
+	}
+}
+
+// Changes the index of zone from to zone to in the tiles covered by zone's
+// screen-space bounds, after the zone is moved within the zone array.
+void ku_zone_index_move(struct ku_zone_index *index, const struct ku_zone *zone, int from, int to)
+{
+	struct ku_zone_tile *tile;
+	int tx, ty, tx0, ty0, tx1, ty1, j;
+
+	if(!zone_tiles(zone, &tx0, &ty0, &tx1, &ty1)) {
+		return;
+	}
+
+	for(ty = ty0; ty <= ty1; ty++) {
+		for(tx = tx0; tx <= tx1; tx++) {
+			tile = &index->tiles[ty][tx];
+			for(j = 0; j < tile->count; j++) {
+				if(tile->zones[j] == from) {
+					tile->zones[j] = to;
+				}
+			}
+		}
+	}
+}
+
+// Computes pop, centroid, surface area, and occupancy for each of count
+// zones from one frame of packed 11-bit depth data (640*480*11/8 bytes), in
+// a single pass over the frame.  Every zone must be in the index.
+void ku_zones_evaluate(const uint8_t *in, struct ku_zone *zones, int count, const struct ku_zone_index *index)
+{
+	const struct ku_zone_tile *tile;
+	struct ku_zone *zone;
+	uint16_t row[640];
+	int x, y, tx, ty, val, xw, yw, zw, i;
+
+	for(i = 0; i < count; i++) {
+		zones[i].pop = 0;
+		zones[i].xsum = zones[i].ysum = zones[i].zsum = 0;
+		zones[i].sasum = 0;
+	}
+
+	for(y = 0; y < 480; y++) {
+		ty = y >> KU_ZONE_TILE_SHIFT;
+		if(index->row_count[ty] == 0) {
+			continue;
+		}
+
+		ku_unpack11_to_16_lut_buf(in + y * 640 * 11 / 8, row, 640 * 11 / 8);
+
+		for(tx = 0; tx < KU_ZONE_TILES_X; tx++) {
+			tile = &index->tiles[ty][tx];
+			if(tile->count == 0) {
+				continue;
+			}
+
+			for(x = tx << KU_ZONE_TILE_SHIFT; x < (tx + 1) << KU_ZONE_TILE_SHIFT; x++) {
+				val = row[x];
+				if(val >= PXZMAX || !((tile->depth_mask >> (val >> KU_ZONE_DEPTH_SHIFT)) & 1)) {
+					continue;
+				}
+
+				zw = ku_depth_lut[val];
+				xw = ku_xworld(x, zw);
+				yw = ku_yworld(y, zw);
+
+				for(i = 0; i < tile->count; i++) {
+					zone = &zones[tile->zones[i]];
+					if(xw < zone->xmin || xw > zone->xmax ||
+							yw < zone->ymin || yw > zone->ymax ||
+							zw < zone->zmin || zw > zone->zmax) {
+						continue;
+					}
+
+					zone->pop++;
+					zone->xsum += xw;
+					zone->ysum += yw;
+					zone->zsum += zw;
+					zone->sasum += (double)zw * zw;
+				}
+			}
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		finish_zone(&zones[i]);
+	}
+}
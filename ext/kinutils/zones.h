@@ -0,0 +1,108 @@
+/*
+ * Client-side zone evaluation for Kinect depth data.
+ * (C)2026 Mike Bourgeous
+ */
+#ifndef ZONES_H_
+#define ZONES_H_
+
+#include <stdint.h>
+
+// Zone parameters that can control occupancy (see Zone#range in Ruby).
+enum ku_zone_param {
+	KU_ZONE_POP,
+	KU_ZONE_SA,
+	KU_ZONE_BRIGHT, // Not available from depth data; uses pop instead
+	KU_ZONE_XC,
+	KU_ZONE_YC,
+	KU_ZONE_ZC,
+};
+
+struct ku_zone {
+	// World-space bounds in millimeters (inclusive)
+	int xmin, ymin, zmin;
+	int xmax, ymax, zmax;
+
+	// Screen-space bounds (columns, rows, raw depth values; inclusive),
+	// computed by ku_zone_bounds()
+	int px_xmin, px_ymin, px_zmin;
+	int px_xmax, px_ymax, px_zmax;
+	int maxpop;
+
+	// Occupancy settings
+	enum ku_zone_param param;
+	int on_level; // Becomes occupied when param >= on_level
+	int off_level; // Becomes unoccupied when param < off_level
+	int on_delay; // Frames param must stay at/above on_level first
+	int off_delay; // Frames param must stay below off_level first
+	int negate; // Reports occupied when the thresholds say unoccupied
+
+	// Results of the last ku_zones_evaluate()
+	int pop;
+	int xc, yc, zc; // Centroid in millimeters, or 0 if pop is 0
+	int sa; // Surface area in square millimeters
+	int occupied;
+
+	// Internal state
+	int64_t xsum, ysum, zsum;
+	double sasum;
+	int state; // Occupancy before negation
+	int delay_count; // Consecutive frames past the threshold for a change
+};
+
+// Zone index tiles are (1 << KU_ZONE_TILE_SHIFT) pixels square.
+#define KU_ZONE_TILE_SHIFT 4
+#define KU_ZONE_TILES_X (640 >> KU_ZONE_TILE_SHIFT)
+#define KU_ZONE_TILES_Y (480 >> KU_ZONE_TILE_SHIFT)
+
+// Each bit of a tile's depth mask covers (1 << KU_ZONE_DEPTH_SHIFT) raw depth
+// values.  PXZMAX >> KU_ZONE_DEPTH_SHIFT must be less than 64.
+#define KU_ZONE_DEPTH_SHIFT 5
+
+// The zones whose screen-space bounds overlap one tile of the screen.
+struct ku_zone_tile {
+	uint64_t depth_mask; // Raw depth buckets covered by any of the zones
+	int count;
+	int capacity;
+	int *zones; // Indices into the zone array
+};
+
+// Maps each pixel to the zones it could fall within, so pixels outside every
+// zone are rejected with one tile lookup and mask test.
+struct ku_zone_index {
+	struct ku_zone_tile tiles[KU_ZONE_TILES_Y][KU_ZONE_TILES_X];
+	int row_count[KU_ZONE_TILES_Y]; // Zone entries in each row of tiles
+};
+
+// Initializes a zone's settings to the defaults: occupied by any population,
+// no delays.  World bounds must still be set, followed by ku_zone_bounds().
+void ku_zone_init(struct ku_zone *zone);
+
+// Computes a zone's screen-space bounds and maxpop from its world bounds.
+// The screen-space bounds contain every pixel that could fall in the zone.
+void ku_zone_bounds(struct ku_zone *zone);
+
+// Initializes an empty zone index.
+void ku_zone_index_init(struct ku_zone_index *index);
+
+// Frees memory used by a zone index (but not the index itself).
+void ku_zone_index_free(struct ku_zone_index *index);
+
+// Adds zones[i] to the tiles covered by its screen-space bounds.  Returns 0
+// on success, or -1 with errno set if memory could not be allocated (the
+// index is then unchanged).
+int ku_zone_index_add(struct ku_zone_index *index, const struct ku_zone *zones, int i);
+
+// Removes zone i from the tiles covered by zones[i]'s screen-space bounds,
+// which must be the same bounds it was added with.
+void ku_zone_index_remove(struct ku_zone_index *index, const struct ku_zone *zones, int i);
+
+// Changes the index of zone from to zone to in the tiles covered by zone's
+// screen-space bounds, after the zone is moved within the zone array.
+void ku_zone_index_move(struct ku_zone_index *index, const struct ku_zone *zone, int from, int to);
+
+// Computes pop, centroid, surface area, and occupancy for each of count
+// zones from one frame of packed 11-bit depth data (640*480*11/8 bytes), in
+// a single pass over the frame.  Every zone must be in the index.
+void ku_zones_evaluate(const uint8_t *in, struct ku_zone *zones, int count, const struct ku_zone_index *index);
+
+#endif /* ZONES_H_ */
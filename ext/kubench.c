@@ -0,0 +1,624 @@
+/*
+ * Microbenchmarks for every depth processing kernel in unpack.c, the
+ * multithreaded plotter, and the key-value parser behind String#kin_kvp.
+ * Results are written to stdout as JSON, so runs from two commits can be
+ * diffed.
+ * (C)2026 Mike Bourgeous
+ *
+ * Usage: ./kubench [-n iterations] [-w warmup] [-k kernel] [frames.knr|frames.raw]
+ *
+ * Each kernel is run on a synthetic room scene, a frame of uniformly random
+ * depths, and any frames from the given recording or raw packed file.  Every
+ * measurement runs the kernel warmup times untimed, then times iterations
+ * calls, cycling through the input's frames.  Each call processes "items"
+ * (pixels for frame kernels, lines for the kvp parser, lookups for
+ * ku_reverse_lut), so ns is per call (per frame) and cycles and throughput are
+ * per item (per pixel).  CPU cycles are counted where perf_event_open() is
+ * permitted, and are null otherwise.
+ *
+ * plot_views11_incremental is given a cycle of slightly changed copies of
+ * each single-frame input (see setup_incremental()), so it measures
+ * replotting the changed pixels rather than skipping an unchanged frame.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <nlutils/nlutils.h>
+
+#include "unpack.h"
+#include "plot_threads.h"
+#include "depth_recording.h"
+
+#define PACKED_SIZE (640 * 480 * 11 / 8)
+#define PIXELS (640 * 480)
+
+// Maximum number of frames loaded from an input file
+#define MAX_RECORDED 64
+
+// Calls per measurement for the kernels that are too quick to time alone
+#define KVP_LINES 64
+#define LUT_LOOKUPS 65536
+
+// Perturbed frames cycled through by plot_views11_incremental for
+// single-frame inputs, and the share (1 in INCREMENTAL_CHANGE) of each
+// frame's 8-pixel groups that differ from the input frame
+#define INCREMENTAL_FRAMES 16
+#define INCREMENTAL_CHANGE 20
+
+// A set of frames to run each kernel on.
+struct input {
+	const char *name;
+	int count;
+	uint8_t **packed;
+	uint16_t **unpacked; // Left-aligned, as from unpack11_to_16()
+};
+
+// Output buffers shared by every kernel.
+struct buffers {
+	uint16_t depth[PIXELS];
+	uint8_t linear[PIXELS];
+	uint8_t overhead[XPIX * ZPIX];
+	uint8_t side[ZPIX * YPIX];
+	uint8_t front[XPIX * YPIX];
+	float world[PIXELS * 3];
+	struct ku_plot_state plot_state;
+};
+
+struct kernel {
+	const char *name;
+	const char *unit; // What one item is
+	int items; // Items processed per call
+	void (*run)(const struct input *in, int frame, struct buffers *b);
+	void (*setup)(const struct input *in); // Called before each measurement, if not NULL
+};
+
+static struct buffers bufs;
+static volatile size_t sink; // Keeps results from being optimized away
+
+// Frames for plot_views11_incremental (see setup_incremental())
+static uint8_t *incremental_frames[INCREMENTAL_FRAMES];
+static int incremental_count, incremental_next;
+
+// A KND zone line, as parsed by String#kin_kvp for every SUB update.
+static const char kvp_line[] = "xmin=-273 ymin=831 zmin=2660 xmax=273 ymax=1036 zmax=3108 "
+	"px_xmin=259 px_ymin=6 px_zmin=960 px_xmax=381 px_ymax=80 px_zmax=979 occupied=0 "
+	"pop=0 maxpop=9028 xc=0 yc=0 zc=0 sa=0 name=\"Projector\" negate=0 param=\"pop\" "
+	"on_level=2257 off_level=1805 on_delay=1 off_delay=1";
+
+static void run_unpack(const struct input *in, int frame, struct buffers *b)
+{
+	ku_unpack11_to_16_buf(in->packed[frame], b->depth, PACKED_SIZE);
+}
+
+static void run_unpack_lut(const struct input *in, int frame, struct buffers *b)
+{
+	ku_unpack11_to_16_lut_buf(in->packed[frame], b->depth, PACKED_SIZE);
+}
+
+static void run_reverse_lut(const struct input *in, int frame, struct buffers *b)
+{
+	size_t total = 0;
+	int i;
+
+	(void)in;
+	(void)frame;
+	(void)b;
+
+	for(i = 0; i < LUT_LOOKUPS; i++) {
+		total += ku_reverse_lut(i * 131 % 10000);
+	}
+	sink = total;
+}
+
+static void run_world_int16(const struct input *in, int frame, struct buffers *b)
+{
+	sink = ku_unpack_to_world(in->packed[frame], b->world, KU_WORLD_INT16, 1, 1, KU_WORLD_SKIP_INVALID);
+}
+
+static void run_world_float32(const struct input *in, int frame, struct buffers *b)
+{
+	sink = ku_unpack_to_world(in->packed[frame], b->world, KU_WORLD_FLOAT32, 1, 1, KU_WORLD_SKIP_INVALID);
+}
+
+static void run_linear(const struct input *in, int frame, struct buffers *b)
+{
+	plot_linear(in->unpacked[frame], b->linear);
+}
+
+static void run_overhead(const struct input *in, int frame, struct buffers *b)
+{
+	plot_overhead(in->unpacked[frame], b->overhead);
+}
+
+static void run_side(const struct input *in, int frame, struct buffers *b)
+{
+	plot_side(in->unpacked[frame], b->side);
+}
+
+static void run_front(const struct input *in, int frame, struct buffers *b)
+{
+	plot_front(in->unpacked[frame], b->front);
+}
+
+static void run_views(const struct input *in, int frame, struct buffers *b)
+{
+	plot_views(in->unpacked[frame], b->linear, b->overhead, b->side, b->front);
+}
+
+static void run_linear11(const struct input *in, int frame, struct buffers *b)
+{
+	plot_linear11(in->packed[frame], b->linear);
+}
+
+static void run_overhead11(const struct input *in, int frame, struct buffers *b)
+{
+	plot_overhead11(in->packed[frame], b->overhead);
+}
+
+static void run_side11(const struct input *in, int frame, struct buffers *b)
+{
+	plot_side11(in->packed[frame], b->side);
+}
+
+static void run_front11(const struct input *in, int frame, struct buffers *b)
+{
+	plot_front11(in->packed[frame], b->front);
+}
+
+static void run_views11(const struct input *in, int frame, struct buffers *b)
+{
+	plot_views11(in->packed[frame], b->linear, b->overhead, b->side, b->front);
+}
+
+static void run_views11_incremental(const struct input *in, int frame, struct buffers *b)
+{
+	const uint8_t *data = in->packed[frame];
+
+	if(incremental_count) {
+		data = incremental_frames[incremental_next++ % incremental_count];
+	}
+
+	sink = plot_views11_incremental(&b->plot_state, data, b->linear, b->overhead, b->side, b->front);
+}
+
+// Resets the incremental plot state.  Repeating a single frame would only
+// measure the unchanged-frame shortcut, so a single-frame input is replaced
+// by a cycle of copies that each have a random 1 in INCREMENTAL_CHANGE of
+// their 8-pixel groups disturbed, as if by sensor noise.  Consecutive frames
+// differ in about 10% of their groups.  Recordings already change from frame
+// to frame, and are used as they are.
+static void setup_incremental(const struct input *in)
+{
+	int i, g, b;
+
+	ku_plot_state_reset(&bufs.plot_state);
+	incremental_count = 0;
+	incremental_next = 0;
+
+	if(in->count > 1) {
+		return;
+	}
+
+	for(i = 0; i < INCREMENTAL_FRAMES; i++) {
+		if(incremental_frames[i] == NULL) {
+			incremental_frames[i] = malloc(PACKED_SIZE);
+			if(incremental_frames[i] == NULL) {
+				perror("Error allocating incremental frames");
+				exit(-1);
+			}
+		}
+
+		memcpy(incremental_frames[i], in->packed[0], PACKED_SIZE);
+		for(g = 0; g < PIXELS / 8; g++) {
+			if(rand() % INCREMENTAL_CHANGE == 0) {
+				// Flips a low-order bit of most of the group's pixels
+				for(b = 0; b < 11; b++) {
+					incremental_frames[i][g * 11 + b] ^= 1;
+				}
+			}
+		}
+	}
+
+	incremental_count = INCREMENTAL_FRAMES;
+}
+
+static void run_views11_mt(const struct input *in, int frame, struct buffers *b)
+{
+	ku_plot_views_mt(in->packed[frame], 1, b->linear, b->overhead, b->side, b->front);
+}
+
+// Counts parsed values the way kin_kvp's callback sees them.
+static void kvp_cb(void *data, char *key, char *strvalue, struct nl_variant value)
+{
+	(void)key;
+	(void)strvalue;
+	*(size_t *)data += value.type;
+}
+
+static void run_kvp(const struct input *in, int frame, struct buffers *b)
+{
+	size_t total = 0;
+	int i;
+
+	(void)in;
+	(void)frame;
+	(void)b;
+
+	for(i = 0; i < KVP_LINES; i++) {
+		nl_parse_kvp(kvp_line, nl_kvp_wrapper, &(struct nl_kvp_wrap){kvp_cb, &total});
+	}
+	sink = total;
+}
+
+static const struct kernel kernels[] = {
+	{ "unpack11_to_16", "pixel", PIXELS, run_unpack, NULL },
+	{ "unpack11_to_16_lut", "pixel", PIXELS, run_unpack_lut, NULL },
+	{ "reverse_lut", "lookup", LUT_LOOKUPS, run_reverse_lut, NULL },
+	{ "unpack_to_world_int16", "pixel", PIXELS, run_world_int16, NULL },
+	{ "unpack_to_world_float32", "pixel", PIXELS, run_world_float32, NULL },
+	{ "plot_linear", "pixel", PIXELS, run_linear, NULL },
+	{ "plot_overhead", "pixel", PIXELS, run_overhead, NULL },
+	{ "plot_side", "pixel", PIXELS, run_side, NULL },
+	{ "plot_front", "pixel", PIXELS, run_front, NULL },
+	{ "plot_views", "pixel", PIXELS, run_views, NULL },
+	{ "plot_linear11", "pixel", PIXELS, run_linear11, NULL },
+	{ "plot_overhead11", "pixel", PIXELS, run_overhead11, NULL },
+	{ "plot_side11", "pixel", PIXELS, run_side11, NULL },
+	{ "plot_front11", "pixel", PIXELS, run_front11, NULL },
+	{ "plot_views11", "pixel", PIXELS, run_views11, NULL },
+	{ "plot_views11_incremental", "pixel", PIXELS, run_views11_incremental, setup_incremental },
+	{ "plot_views11_mt", "pixel", PIXELS, run_views11_mt, NULL },
+	{ "parse_kvp", "line", KVP_LINES, run_kvp, NULL },
+};
+
+// Kernels that depend on the selected unpacking implementation are measured
+// once per implementation.
+static int uses_unpack_impl(const struct kernel *k)
+{
+	return k->run == run_unpack || k->run == run_unpack_lut;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Opens a CPU cycle counter for this thread, or returns -1.
+static int open_cycle_counter(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long read_counter(int fd)
+{
+	long long count;
+
+	if(fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count)) {
+		return -1;
+	}
+	return count;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Fills a frame of raw depth values with a floor, back wall, and a few
+// boxes, with a little noise.
+static void synthetic_frame(uint16_t *out)
+{
+	int x, y, val;
+
+	for(y = 0; y < 480; y++) {
+		for(x = 0; x < 640; x++) {
+			val = y > 300 ? 1000 - (y - 300) * 2 : 1000;
+			if(x > 100 && x < 220 && y > 150 && y < 400) {
+				val = 760;
+			} else if(x > 380 && x < 560 && y > 200 && y < 420) {
+				val = 880;
+			} else if(x > 260 && x < 320 && y > 60 && y < 300) {
+				val = 620;
+			}
+			val += rand() % 5 - 2;
+			out[y * 640 + x] = val;
+		}
+	}
+}
+
+// Fills a frame of raw depth values with uniformly random depths closer than
+// ZMAX, the worst case for cache locality.
+static void random_frame(uint16_t *out)
+{
+	int pix;
+
+	for(pix = 0; pix < PIXELS; pix++) {
+		out[pix] = rand() % 1040;
+	}
+}
+
+// Allocates an input with room for count frames.
+static struct input *new_input(const char *name, int count)
+{
+	struct input *in = calloc(1, sizeof(struct input));
+	int i;
+
+	if(in == NULL) {
+		return NULL;
+	}
+
+	in->name = name;
+	in->count = count;
+	in->packed = calloc(count, sizeof(uint8_t *));
+	in->unpacked = calloc(count, sizeof(uint16_t *));
+	if(in->packed == NULL || in->unpacked == NULL) {
+		return NULL;
+	}
+
+	for(i = 0; i < count; i++) {
+		in->packed[i] = malloc(PACKED_SIZE);
+		in->unpacked[i] = malloc(PIXELS * sizeof(uint16_t));
+		if(in->packed[i] == NULL || in->unpacked[i] == NULL) {
+			return NULL;
+		}
+	}
+
+	return in;
+}
+
+// Creates a one-frame input from a raw depth frame generator.
+static struct input *generated_input(const char *name, void (*generate)(uint16_t *out))
+{
+	struct input *in = new_input(name, 1);
+	int i;
+
+	if(in == NULL) {
+		return NULL;
+	}
+
+	generate(in->unpacked[0]);
+	for(i = 0; i < PIXELS / 8; i++) {
+		pack16_to_11(in->unpacked[0] + i * 8, in->packed[0] + i * 11);
+	}
+	ku_unpack11_to_16_buf(in->packed[0], in->unpacked[0], PACKED_SIZE);
+
+	return in;
+}
+
+// Loads up to MAX_RECORDED frames from a recording, or from a file of raw
+// packed frames.  Returns NULL with errno set on error.
+static struct input *file_input(const char *path)
+{
+	struct ku_recording rec;
+	struct input *in;
+	FILE *f;
+	int i, count;
+
+	if(!ku_recording_open(&rec, path)) {
+		count = rec.count < MAX_RECORDED ? rec.count : MAX_RECORDED;
+		in = count ? new_input("recorded", count) : NULL;
+		for(i = 0; in && i < count; i++) {
+			memcpy(in->packed[i], ku_recording_frame(&rec, i), PACKED_SIZE);
+		}
+		ku_recording_close(&rec);
+	} else if(errno == EINVAL) {
+		f = fopen(path, "rb");
+		if(f == NULL) {
+			return NULL;
+		}
+
+		in = new_input("recorded", MAX_RECORDED);
+		for(count = 0; in && count < MAX_RECORDED && fread(in->packed[count], PACKED_SIZE, 1, f) == 1; count++) {
+		}
+		fclose(f);
+
+		if(in) {
+			in->count = count;
+		}
+	} else {
+		return NULL;
+	}
+
+	if(in == NULL || in->count == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	for(i = 0; i < in->count; i++) {
+		ku_unpack11_to_16_buf(in->packed[i], in->unpacked[i], PACKED_SIZE);
+	}
+
+	return in;
+}
+
+// Times one kernel on one input and prints its JSON result object.
+static void measure(const struct kernel *k, const struct input *in, const char *impl,
+		int iterations, int warmup, int cycle_fd, int first)
+{
+	double *ns = malloc(iterations * sizeof(double));
+	double mean = 0, var = 0, start, elapsed;
+	long long cycles = 0;
+	int i;
+
+	if(ns == NULL) {
+		perror("Error allocating sample buffer");
+		exit(-1);
+	}
+
+	if(k->setup) {
+		k->setup(in);
+	}
+	for(i = 0; i < warmup; i++) {
+		k->run(in, i % in->count, &bufs);
+	}
+
+	if(cycle_fd >= 0) {
+		ioctl(cycle_fd, PERF_EVENT_IOC_RESET, 0);
+	}
+	for(i = 0; i < iterations; i++) {
+		if(cycle_fd >= 0) {
+			ioctl(cycle_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+		start = now_ns();
+		k->run(in, (warmup + i) % in->count, &bufs);
+		elapsed = now_ns() - start;
+		if(cycle_fd >= 0) {
+			ioctl(cycle_fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+
+		ns[i] = elapsed;
+		mean += elapsed;
+	}
+	cycles = read_counter(cycle_fd);
+
+	mean /= iterations;
+	for(i = 0; i < iterations; i++) {
+		var += (ns[i] - mean) * (ns[i] - mean);
+	}
+	var = iterations > 1 ? var / (iterations - 1) : 0;
+	qsort(ns, iterations, sizeof(double), compare_double);
+
+	printf("%s\n    {\"kernel\": \"%s\", \"impl\": \"%s\", \"input\": \"%s\", \"unit\": \"%s\", \"items\": %d,\n",
+			first ? "" : ",", k->name, impl, in->name, k->unit, k->items);
+	printf("     \"ns\": {\"mean\": %.0f, \"stddev\": %.0f, \"min\": %.0f, \"median\": %.0f, \"max\": %.0f},\n",
+			mean, sqrt(var), ns[0], ns[iterations / 2], ns[iterations - 1]);
+	if(cycles >= 0) {
+		printf("     \"cycles_per_item\": %.3f, ", (double)cycles / iterations / k->items);
+	} else {
+		printf("     \"cycles_per_item\": null, ");
+	}
+	printf("\"items_per_sec\": %.0f, \"calls_per_sec\": %.1f}",
+			k->items * 1e9 / mean, 1e9 / mean);
+	fflush(stdout);
+
+	free(ns);
+}
+
+static void usage(const char *name)
+{
+	size_t i;
+
+	fprintf(stderr, "Usage: %s [-n iterations] [-w warmup] [-k kernel] [frames.knr|frames.raw]\n", name);
+	fprintf(stderr, "Kernels:");
+	for(i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		fprintf(stderr, " %s", kernels[i].name);
+	}
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct input *inputs[3];
+	const char *only = NULL, *best_impl, *impl;
+	int iterations = 200, warmup = 20;
+	int ninputs = 0, cycle_fd, first = 1;
+	size_t k;
+	int opt, i, j;
+
+	while((opt = getopt(argc, argv, "n:w:k:h")) != -1) {
+		switch(opt) {
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+
+			case 'w':
+				warmup = atoi(optarg);
+				break;
+
+			case 'k':
+				only = optarg;
+				break;
+
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : -1;
+		}
+	}
+	if(iterations < 1 || warmup < 0 || optind < argc - 1) {
+		usage(argv[0]);
+		return -1;
+	}
+	if(only) {
+		for(k = 0; k < sizeof(kernels) / sizeof(kernels[0]) && strcmp(only, kernels[k].name); k++) {
+		}
+		if(k == sizeof(kernels) / sizeof(kernels[0])) {
+			fprintf(stderr, "%s: Unknown kernel %s.\n", argv[0], only);
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	ku_init_lut();
+	best_impl = ku_init_unpack();
+	srand(1);
+
+	inputs[ninputs++] = generated_input("synthetic", synthetic_frame);
+	inputs[ninputs++] = generated_input("random", random_frame);
+	if(optind < argc) {
+		inputs[ninputs] = file_input(argv[optind]);
+		if(inputs[ninputs] == NULL) {
+			fprintf(stderr, "Error loading frames from %s: %s\n", argv[optind],
+					errno == EINVAL ? "no complete frames" : strerror(errno));
+			return -1;
+		}
+		ninputs++;
+	}
+	for(i = 0; i < ninputs; i++) {
+		if(inputs[i] == NULL) {
+			perror("Error allocating frames");
+			return -1;
+		}
+	}
+
+	cycle_fd = open_cycle_counter();
+
+	printf("{\n  \"iterations\": %d,\n  \"warmup\": %d,\n  \"unpack_impl\": \"%s\",\n  \"plot_threads\": %d,\n",
+			iterations, warmup, best_impl, ku_plot_threads());
+	printf("  \"inputs\": {");
+	for(i = 0; i < ninputs; i++) {
+		printf("%s\"%s\": %d", i ? ", " : "", inputs[i]->name, inputs[i]->count);
+	}
+	printf("},\n  \"results\": [");
+
+	for(k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+		if(only && strcmp(only, kernels[k].name)) {
+			continue;
+		}
+
+		for(j = 0; (impl = uses_unpack_impl(&kernels[k]) ? ku_unpack_impl_name(j) : (j ? NULL : best_impl)); j++) {
+			ku_select_unpack(impl);
+
+			for(i = 0; i < ninputs; i++) {
+				measure(&kernels[k], inputs[i], impl, iterations, warmup, cycle_fd, first);
+				first = 0;
+			}
+		}
+
+		ku_select_unpack(best_impl);
+	}
+
+	printf("\n  ]\n}\n");
+
+	return 0;
+}
@@ -0,0 +1,689 @@
+/*
+ * Standalone tool for unpacking and projecting streams of raw Kinect depth
+ * data from the command line.
+ * (C)2011-2026 Mike Bourgeous
+ *
+ * One binary provides every mode.  The mode is taken from the name the
+ * program was run as (the Makefile links unpack, overhead, side, front, and
+ * the *_grid tools to it), or from the first argument:
+ *
+ *     cat depth11.raw | ./unpack -i | ./overhead > overhead.gray
+ *     cat depth11.raw | ./kutool overhead -p > overhead.gray
+ *
+ * Input is an endless stream of frames.  A reader thread fills one frame
+ * buffer while the previous frame is processed from the other, and each
+ * frame's output is written with a single write().  The unpack and plot modes
+ * can instead read a depth recording with -f, which is mapped into memory and
+ * processed in place.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "unpack.h"
+#include "plot_threads.h"
+#include "depth_recording.h"
+
+#define PACKED_FRAME (640 * 480 * 11 / 8)
+#define UNPACKED_FRAME (640 * 480 * 2)
+
+// Reads fixed-size frames from a file descriptor in a background thread.
+struct frame_reader {
+	int fd;
+	size_t size; // Bytes per frame
+	uint8_t *buf[2];
+	size_t len[2]; // Bytes read into each buffer (less than size at the end)
+	int full[2]; // Whether each buffer holds a frame not yet processed
+	int next; // Buffer that next_frame() returns next
+	int held; // Buffer last returned by next_frame(), or -1
+	int err; // errno from a failed read, or 0
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+// Where a mode's frames come from: stdin, or a recording given with -f.
+struct frame_source {
+	struct frame_reader reader;
+	struct ku_recording rec;
+	int mapped; // Whether frames come from rec
+	size_t next; // Next frame of rec
+};
+
+struct mode {
+	const char *name;
+	int (*run)(const struct mode *mode, int argc, char *argv[]);
+	int view; // Output view for plot modes, in plot_views() order
+	size_t size; // Output image size for plot and grid modes
+	void (*draw_grid)(uint8_t *grid, uint8_t color, int spacing);
+};
+
+// Reads up to len bytes, stopping early only at the end of input.  Returns
+// the number of bytes read, or -1 with errno set on error.
+static ssize_t read_full(int fd, uint8_t *buf, size_t len)
+{
+	size_t total = 0;
+	ssize_t ret;
+
+	while(total < len) {
+		ret = read(fd, buf + total, len - total);
+		if(ret == 0) {
+			break;
+		}
+		if(ret < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		total += ret;
+	}
+
+	return total;
+}
+
+// Writes all len bytes.  Returns 0 on success, or -1 with errno set on error.
+static int write_full(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t ret;
+
+	while(len > 0) {
+		ret = write(fd, buf, len);
+		if(ret < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+// Grows a pipe's buffer to hold at least one frame, so the other end of the
+// pipe can get a whole frame ahead.  Does nothing for files and terminals.
+static void set_pipe_size(int fd, size_t size)
+{
+#ifdef F_SETPIPE_SZ
+	int cur = fcntl(fd, F_GETPIPE_SZ);
+	if(cur >= 0 && (size_t)cur < size) {
+		fcntl(fd, F_SETPIPE_SZ, (int)size);
+	}
+#else
+	(void)fd;
+	(void)size;
+#endif
+}
+
+static void *reader_thread(void *data)
+{
+	struct frame_reader *r = data;
+	ssize_t len;
+	int i = 0;
+
+	do {
+		pthread_mutex_lock(&r->lock);
+		while(r->full[i]) {
+			pthread_cond_wait(&r->cond, &r->lock);
+		}
+		pthread_mutex_unlock(&r->lock);
+
+		len = read_full(r->fd, r->buf[i], r->size);
+
+		pthread_mutex_lock(&r->lock);
+		if(len < 0) {
+			r->err = errno;
+			len = 0;
+		}
+		if((size_t)len < r->size) {
+			// Lets a partial final group of pixels be processed as if padded
+			memset(r->buf[i] + len, 0, r->size - len);
+		}
+		r->len[i] = len;
+		r->full[i] = 1;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+
+		i ^= 1;
+	} while((size_t)len == r->size);
+
+	return NULL;
+}
+
+// Starts reading frames of size bytes from fd.  Returns 0 on success, or -1
+// with errno set on error.
+static int start_reader(struct frame_reader *r, int fd, size_t size)
+{
+	*r = (struct frame_reader){ .fd = fd, .size = size, .held = -1 };
+
+	r->buf[0] = malloc(size);
+	r->buf[1] = malloc(size);
+	if(r->buf[0] == NULL || r->buf[1] == NULL) {
+		return -1;
+	}
+
+	set_pipe_size(fd, size);
+
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+
+	errno = pthread_create(&r->thread, NULL, reader_thread, r);
+	return errno ? -1 : 0;
+}
+
+// Hands the previous frame's buffer back to the reader thread, then waits for
+// the next frame and stores its address in *data.  Returns the frame's
+// length, which is less than the frame size only at the end of input (0 if
+// no bytes were left; the rest of the buffer is zeroed), or -1 with errno set
+// on a read error.  Must not be called again after it returns less than a
+// full frame.
+static ssize_t next_frame(struct frame_reader *r, const uint8_t **data)
+{
+	ssize_t len;
+
+	pthread_mutex_lock(&r->lock);
+
+	if(r->held >= 0) {
+		r->full[r->held] = 0;
+		pthread_cond_broadcast(&r->cond);
+	}
+
+	while(!r->full[r->next]) {
+		pthread_cond_wait(&r->cond, &r->lock);
+	}
+
+	*data = r->buf[r->next];
+	len = r->len[r->next];
+	if(len == 0 && r->err) {
+		errno = r->err;
+		len = -1;
+	}
+
+	r->held = r->next;
+	r->next ^= 1;
+
+	pthread_mutex_unlock(&r->lock);
+
+	return len;
+}
+
+// Maps the recording at path.  Prints an error and returns -1 on error.
+static int open_recording(struct ku_recording *rec, const char *path)
+{
+	if(ku_recording_open(rec, path)) {
+		if(errno == EINVAL) {
+			fprintf(stderr, "%s: Not a valid depth recording.\n", path);
+		} else {
+			perror(path);
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+// Maps the recording at path if path is not NULL, or starts reading frames of
+// size bytes from stdin otherwise.  Prints an error and returns -1 on error.
+static int open_source(struct frame_source *src, const char *path, size_t size)
+{
+	*src = (struct frame_source){ .mapped = path != NULL };
+
+	if(path != NULL) {
+		return open_recording(&src->rec, path);
+	}
+
+	if(start_reader(&src->reader, STDIN_FILENO, size)) {
+		perror("Error starting input");
+		return -1;
+	}
+
+	return 0;
+}
+
+// Like next_frame(), but for either kind of source.  Frames from a recording
+// point into its mapping, and are always complete.
+static ssize_t source_frame(struct frame_source *src, const uint8_t **data)
+{
+	if(src->mapped) {
+		if(src->next >= src->rec.count) {
+			return 0;
+		}
+		*data = ku_recording_frame(&src->rec, src->next++);
+		return KU_REC_FRAME_SIZE;
+	}
+
+	return next_frame(&src->reader, data);
+}
+
+// Prints an error for a short final frame.  Returns -1.
+static int short_input(const char *name, ssize_t len, int frames, size_t size, const char *what)
+{
+	if(len < 0) {
+		perror("Error reading input");
+	} else if(frames == 0) {
+		fprintf(stderr, "%s: Must provide %zu bytes of %s to stdin.\n", name, size, what);
+	} else {
+		fprintf(stderr, "%s: Input ended with a partial frame of %zd bytes.\n", name, len);
+	}
+	return -1;
+}
+
+// Unpacks 11-bit data to 16-bit MSB-aligned inverted values (default), or to
+// 8-bit values (-8).  With -i, input must be whole 640x480 frames; otherwise
+// any number of 11-byte groups is accepted, with a partial final group
+// padded with zeros.  With -f, frames are read from a depth recording.
+static int run_unpack(const struct mode *mode, int argc, char *argv[])
+{
+	struct frame_source src;
+	const uint8_t *in = NULL;
+	uint8_t *out;
+	const char *path = NULL;
+	size_t padded, outlen, i;
+	ssize_t len;
+	int whole_frames = 0, to_8 = 0;
+	int frames = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "8if:")) != -1) {
+		switch(opt) {
+			case 'f':
+				path = optarg;
+				break;
+
+			case '8':
+				to_8 = 1;
+				break;
+
+			case 'i':
+				whole_frames = 1;
+				break;
+
+			default:
+				fprintf(stderr, "Usage: %s [-8|-i] [-f recording] < depth11.raw\n", mode->name);
+				return -1;
+		}
+	}
+
+	out = malloc(UNPACKED_FRAME);
+	if(out == NULL) {
+		perror("Error allocating output");
+		return -1;
+	}
+	if(open_source(&src, path, PACKED_FRAME)) {
+		return -1;
+	}
+	set_pipe_size(STDOUT_FILENO, to_8 ? 640 * 480 : UNPACKED_FRAME);
+
+	do {
+		len = source_frame(&src, &in);
+		if(len < PACKED_FRAME && (len < 0 || whole_frames)) {
+			if(len == 0 && (frames > 0 || src.mapped)) {
+				break;
+			}
+			return short_input(mode->name, len, frames, PACKED_FRAME, "packed depth data");
+		}
+
+		// The reader zeroes the rest of a short frame's buffer.  The
+		// read length itself is kept, since it tells the loop to stop.
+		padded = (len + 10) / 11 * 11;
+
+		if(to_8) {
+			for(i = 0; i < padded; i += 11) {
+				unpack11_to_8(in + i, out + i / 11 * 8);
+			}
+			outlen = padded / 11 * 8;
+		} else {
+			ku_unpack11_to_16_buf(in, (uint16_t *)out, padded);
+			outlen = padded / 11 * 16;
+		}
+
+		if(write_full(STDOUT_FILENO, out, outlen)) {
+			perror("Error writing output");
+			return -1;
+		}
+
+		frames++;
+	} while(len == PACKED_FRAME);
+
+	return 0;
+}
+
+// Plots one view per frame from 16-bit unpacked depth data, from packed
+// 11-bit data with -p, or from a depth recording with -f.
+static int run_plot(const struct mode *mode, int argc, char *argv[])
+{
+	struct frame_source src;
+	uint8_t *views[4] = { NULL, NULL, NULL, NULL };
+	const uint8_t *in;
+	uint8_t *out;
+	const char *path = NULL;
+	size_t size = UNPACKED_FRAME;
+	ssize_t len;
+	int packed = 0;
+	int frames = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "j:pf:")) != -1) {
+		switch(opt) {
+			case 'j':
+				// -j 0 uses one thread per CPU
+				if(ku_set_plot_threads(atoi(optarg))) {
+					perror("Error starting plot threads");
+					return -1;
+				}
+				break;
+
+			case 'f':
+				// Recordings hold packed frames
+				path = optarg;
+				packed = 1;
+				size = PACKED_FRAME;
+				break;
+
+			case 'p':
+				packed = 1;
+				size = PACKED_FRAME;
+				break;
+
+			default:
+				fprintf(stderr, "Usage: %s [-j threads] [-p] [-f recording] < depth16.raw\n", mode->name);
+				return -1;
+		}
+	}
+
+	ku_init_lut();
+
+	out = malloc(mode->size);
+	if(out == NULL) {
+		perror("Error allocating output");
+		return -1;
+	}
+	if(open_source(&src, path, size)) {
+		return -1;
+	}
+	set_pipe_size(STDOUT_FILENO, mode->size);
+	views[mode->view] = out;
+
+	for(;;) {
+		len = source_frame(&src, &in);
+		if((size_t)len != size) {
+			if(len == 0 && (frames > 0 || src.mapped)) {
+				break;
+			}
+			return short_input(mode->name, len, frames, size, packed ? "packed depth data" : "unpacked depth data");
+		}
+
+		ku_plot_views_mt(in, packed, views[0], views[1], views[2], views[3]);
+
+		if(write_full(STDOUT_FILENO, out, mode->size)) {
+			perror("Error writing output");
+			return -1;
+		}
+
+		frames++;
+	}
+
+	return 0;
+}
+
+// Returns the current time in microseconds since the Unix epoch.
+static int64_t now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Writes packed 11-bit frames from stdin to a depth recording, timestamped
+// as they arrive.
+static int run_record(const struct mode *mode, int argc, char *argv[])
+{
+	struct frame_reader reader;
+	struct ku_recorder rec;
+	const uint8_t *in;
+	ssize_t len;
+	int ret = 0;
+
+	if(argc != 2) {
+		fprintf(stderr, "Usage: %s recording < depth11.raw\n", mode->name);
+		return -1;
+	}
+
+	if(ku_recorder_open(&rec, argv[1])) {
+		perror(argv[1]);
+		return -1;
+	}
+	if(start_reader(&reader, STDIN_FILENO, PACKED_FRAME)) {
+		perror("Error starting input");
+		ku_recorder_close(&rec);
+		return -1;
+	}
+
+	while((len = next_frame(&reader, &in)) == PACKED_FRAME) {
+		if(ku_recorder_add(&rec, in, now_us())) {
+			perror("Error writing recording");
+			ret = -1;
+			break;
+		}
+	}
+	if(len < 0 || (len > 0 && len < PACKED_FRAME)) {
+		ret = short_input(mode->name, len, rec.count, PACKED_FRAME, "packed depth data");
+	}
+
+	// Keep the frames already written even after an error
+	if(ku_recorder_close(&rec)) {
+		perror("Error closing recording");
+		ret = -1;
+	}
+
+	return ret;
+}
+
+// Writes the packed frames of a depth recording to stdout, straight from
+// the mapping.  With -t, frames are paced to match their timestamps.
+static int run_replay(const struct mode *mode, int argc, char *argv[])
+{
+	struct ku_recording rec;
+	struct timespec start, when;
+	int64_t delay;
+	int timed = 0;
+	size_t i;
+	int opt;
+
+	while((opt = getopt(argc, argv, "t")) != -1) {
+		switch(opt) {
+			case 't':
+				timed = 1;
+				break;
+
+			default:
+				fprintf(stderr, "Usage: %s [-t] recording > depth11.raw\n", mode->name);
+				return -1;
+		}
+	}
+	if(optind != argc - 1) {
+		fprintf(stderr, "Usage: %s [-t] recording > depth11.raw\n", mode->name);
+		return -1;
+	}
+
+	if(open_recording(&rec, argv[optind])) {
+		return -1;
+	}
+	set_pipe_size(STDOUT_FILENO, PACKED_FRAME);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(i = 0; i < rec.count; i++) {
+		if(timed) {
+			delay = ku_recording_timestamp(&rec, i) - ku_recording_timestamp(&rec, 0);
+			when.tv_sec = start.tv_sec + delay / 1000000;
+			when.tv_nsec = start.tv_nsec + delay % 1000000 * 1000;
+			if(when.tv_nsec >= 1000000000) {
+				when.tv_sec++;
+				when.tv_nsec -= 1000000000;
+			}
+			while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL) == EINTR);
+		}
+
+		if(write_full(STDOUT_FILENO, ku_recording_frame(&rec, i), PACKED_FRAME)) {
+			perror("Error writing output");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Draws grid lines for the overhead view every spacing millimeters.
+static void draw_overhead_grid(uint8_t *grid, uint8_t color, int spacing)
+{
+	int x, z;
+
+	// Loop through x in world space, z in pixels
+	for(x = 0; x < XMAX / 2; x += spacing) {
+		for(z = 0; z < ZPIX; z++) {
+			grid[x * XPIX / XMAX + XPIX / 2 + z * XPIX] = color;
+			grid[XPIX / 2 - (x * XPIX / XMAX) + z * XPIX] = color;
+		}
+	}
+
+	// Loop through z in world space, x in pixels
+	for(z = 0; z < ZMAX; z += spacing) {
+		for(x = 0; x < XPIX; x++) {
+			grid[x + z * ZPIX / ZMAX * XPIX] = color;
+		}
+	}
+}
+
+// Draws grid lines for the side view every spacing millimeters.
+static void draw_side_grid(uint8_t *grid, uint8_t color, int spacing)
+{
+	int y, z;
+
+	// Loop through y in world space, z in pixels
+	for(y = 0; y < YMAX / 2; y += spacing) {
+		for(z = 0; z < ZPIX; z++) {
+			grid[y * YPIX / YMAX * ZPIX + YPIX / 2 * ZPIX + z] = color;
+			grid[YPIX / 2 * ZPIX - (y * YPIX / YMAX * ZPIX) + z] = color;
+		}
+	}
+
+	// Loop through z in world space, y in pixels
+	for(z = 0; z < ZMAX; z += spacing) {
+		for(y = 0; y < YPIX; y++) {
+			grid[y * ZPIX + z * ZPIX / ZMAX] = color;
+		}
+	}
+}
+
+// Draws grid lines for the front view every spacing millimeters.
+static void draw_front_grid(uint8_t *grid, uint8_t color, int spacing)
+{
+	int x, y;
+
+	// Loop through x in world space, y in pixels
+	for(x = 0; x < XMAX / 2; x += spacing) {
+		for(y = 0; y < YPIX; y++) {
+			grid[XPIX / 2 + x * XPIX / XMAX + y * XPIX] = color;
+			grid[XPIX / 2 - x * XPIX / XMAX + y * XPIX] = color;
+		}
+	}
+
+	// Loop through y in world space, x in pixels
+	for(y = 0; y < YMAX / 2; y += spacing) {
+		for(x = 0; x < XPIX; x++) {
+			grid[x + YPIX / 2 * XPIX + y * YPIX / YMAX * XPIX] = color;
+			grid[x + YPIX / 2 * XPIX - y * YPIX / YMAX * XPIX] = color;
+		}
+	}
+}
+
+// Writes a basic grid image for a view, for later manipulation.  The final
+// grids were created from this output using the GIMP.
+static int run_grid(const struct mode *mode, int argc, char *argv[])
+{
+	uint8_t *out;
+
+	(void)argc;
+	(void)argv;
+
+	out = calloc(1, mode->size);
+	if(out == NULL) {
+		perror("Error allocating grid");
+		return -1;
+	}
+
+	mode->draw_grid(out, 128, 500);
+	mode->draw_grid(out, 255, 1000);
+
+	if(write_full(STDOUT_FILENO, out, mode->size)) {
+		perror("Error writing output");
+		return -1;
+	}
+
+	return 0;
+}
+
+static const struct mode modes[] = {
+	{ .name = "unpack", .run = run_unpack },
+	{ .name = "overhead", .run = run_plot, .view = 1, .size = XPIX * ZPIX },
+	{ .name = "side", .run = run_plot, .view = 2, .size = ZPIX * YPIX },
+	{ .name = "front", .run = run_plot, .view = 3, .size = XPIX * YPIX },
+	{ .name = "record", .run = run_record },
+	{ .name = "replay", .run = run_replay },
+	{ .name = "overhead_grid", .run = run_grid, .size = XPIX * ZPIX, .draw_grid = draw_overhead_grid },
+	{ .name = "side_grid", .run = run_grid, .size = ZPIX * YPIX, .draw_grid = draw_side_grid },
+	{ .name = "front_grid", .run = run_grid, .size = XPIX * YPIX, .draw_grid = draw_front_grid },
+};
+
+static const struct mode *find_mode(const char *name)
+{
+	size_t i;
+
+	for(i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		if(!strcmp(name, modes[i].name)) {
+			return &modes[i];
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct mode *mode;
+	const char *name;
+	size_t i;
+
+	name = strrchr(argv[0], '/');
+	name = name ? name + 1 : argv[0];
+
+	mode = find_mode(name);
+	if(mode == NULL && argc >= 2) {
+		mode = find_mode(argv[1]);
+		argc--;
+		argv++;
+	}
+
+	if(mode == NULL) {
+		fprintf(stderr, "Usage: %s mode [options]\nModes:", name);
+		for(i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+			fprintf(stderr, " %s", modes[i].name);
+		}
+		fprintf(stderr, "\n");
+		return -1;
+	}
+
+	ku_init_unpack();
+
+	return mode->run(mode, argc, argv);
+}
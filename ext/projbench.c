@@ -0,0 +1,332 @@
+/*
+ * Compares the table-driven overhead/side/front projection against the
+ * original per-pixel world-space arithmetic: speed with warm and cold caches,
+ * table memory footprint, and how much of the tables each frame touches.
+ * (C)2026 Mike Bourgeous
+ *
+ * Usage: ./projbench [packed_11bit_frames.raw]
+ *
+ * Without a file, a synthetic room scene and a frame of uniformly random
+ * in-range depths are used.  Hardware cache miss counts are shown where
+ * perf_event_open() is permitted.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "unpack.h"
+
+#define ITERATIONS 100
+#define EVICT_SIZE (64 * 1024 * 1024)
+#define CACHE_LINE 64
+
+// The original arithmetic from unpack.c, used as the comparison baseline.
+#define OVPX(xw, zw) (((zw) * ZPIX / ZMAX) * XPIX + ((xw) * XPIX / XMAX + XPIX / 2))
+#define SVPX(zw, yw) (((-yw) * YPIX / YMAX + YPIX / 2) * ZPIX + ((zw) * ZPIX / ZMAX))
+#define FVPX(xw, yw) (((-yw) * YPIX / YMAX + YPIX / 2) * XPIX + ((-xw) * XPIX / XMAX + XPIX / 2))
+
+static inline void add_px(uint8_t *out, int opx, int size, int inc)
+{
+	int c;
+
+	if(opx < 0 || opx >= size) {
+		return;
+	}
+	c = out[opx] + inc;
+	out[opx] = c > 255 ? 255 : c;
+}
+
+// Plots the overhead, side, and front views using ku_xworld()/ku_yworld().
+static void plot_arith(const uint16_t *in, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	int y, x, pix, val, xw, yw, zw;
+
+	memset(overhead, 0, XPIX * ZPIX);
+	memset(side, 0, ZPIX * YPIX);
+	memset(front, 0, XPIX * YPIX);
+
+	for(pix = 0, y = 0; y < 480; y++) {
+		for(x = 0; x < 640; x++, pix++) {
+			val = (65535 - in[pix]) >> 5;
+			zw = ku_depth_lut[val];
+			if(val >= 2047 || zw >= ZMAX) {
+				continue;
+			}
+			xw = ku_xworld(x, zw);
+			yw = ku_yworld(y, zw);
+			add_px(overhead, OVPX(xw, zw), XPIX * ZPIX, 2);
+			add_px(side, SVPX(zw, yw), ZPIX * YPIX, 2);
+			add_px(front, FVPX(xw, yw), XPIX * YPIX, 1 + (zw - 512) / 256);
+		}
+	}
+}
+
+// Plots the same three views with the projection tables.
+static void plot_table(const uint16_t *in, uint8_t *overhead, uint8_t *side, uint8_t *front)
+{
+	plot_views(in, NULL, overhead, side, front);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Opens a hardware cache counter for this thread, or returns -1.
+static int open_counter(uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long read_counter(int fd)
+{
+	long long count;
+
+	if(fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count)) {
+		return -1;
+	}
+	return count;
+}
+
+// Writes a large buffer to push the tables and images out of the caches.
+static void evict(uint8_t *buf)
+{
+	static uint8_t n;
+	memset(buf, ++n, EVICT_SIZE);
+}
+
+typedef void (*plotfn)(const uint16_t *in, uint8_t *overhead, uint8_t *side, uint8_t *front);
+
+// Times ITERATIONS calls to plot, evicting the caches first if evict_buf is
+// not NULL.  Stores the fastest time in *best and returns the average, both
+// in milliseconds per frame.
+static double time_plot(plotfn plot, const uint16_t *in, uint8_t *views[3], uint8_t *evict_buf,
+		int l1_fd, int ll_fd, long long *l1_misses, long long *ll_misses, double *best)
+{
+	double total = 0, start, elapsed;
+	int i;
+
+	*best = 1e9;
+	*l1_misses = *ll_misses = 0;
+	for(i = 0; i < ITERATIONS; i++) {
+		if(evict_buf) {
+			evict(evict_buf);
+		}
+
+		if(l1_fd >= 0) {
+			ioctl(l1_fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(l1_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+		if(ll_fd >= 0) {
+			ioctl(ll_fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(ll_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+
+		start = now();
+		plot(in, views[0], views[1], views[2]);
+		elapsed = now() - start;
+		total += elapsed;
+		if(elapsed * 1000.0 < *best) {
+			*best = elapsed * 1000.0;
+		}
+
+		if(l1_fd >= 0) {
+			ioctl(l1_fd, PERF_EVENT_IOC_DISABLE, 0);
+			*l1_misses += read_counter(l1_fd);
+		}
+		if(ll_fd >= 0) {
+			ioctl(ll_fd, PERF_EVENT_IOC_DISABLE, 0);
+			*ll_misses += read_counter(ll_fd);
+		}
+	}
+
+	*l1_misses /= ITERATIONS;
+	*ll_misses /= ITERATIONS;
+	return total * 1000.0 / ITERATIONS;
+}
+
+// Counts the distinct table cache lines a frame reads.
+static size_t table_lines(const uint16_t *in)
+{
+	static uint8_t xcol_seen[sizeof(ku_proj_xcol) / CACHE_LINE + 1];
+	static uint8_t yrow_seen[sizeof(ku_proj_yrow) / CACHE_LINE + 1];
+	static uint8_t zcol_seen[sizeof(ku_proj_zcol) / CACHE_LINE + 1];
+	size_t lines = 0, i;
+	int x, y, pix, val;
+
+	memset(xcol_seen, 0, sizeof(xcol_seen));
+	memset(yrow_seen, 0, sizeof(yrow_seen));
+	memset(zcol_seen, 0, sizeof(zcol_seen));
+
+	for(pix = 0, y = 0; y < 480; y++) {
+		for(x = 0; x < 640; x++, pix++) {
+			val = (65535 - in[pix]) >> 5;
+			if(val >= KU_PROJ_DEPTHS || ku_depth_lut[val] >= ZMAX) {
+				continue;
+			}
+			xcol_seen[((uint8_t *)&ku_proj_xcol[val][x] - (uint8_t *)ku_proj_xcol) / CACHE_LINE] = 1;
+			yrow_seen[((uint8_t *)&ku_proj_yrow[y][val] - (uint8_t *)ku_proj_yrow) / CACHE_LINE] = 1;
+			zcol_seen[((uint8_t *)&ku_proj_zcol[val] - (uint8_t *)ku_proj_zcol) / CACHE_LINE] = 1;
+		}
+	}
+
+	for(i = 0; i < sizeof(xcol_seen); i++) {
+		lines += xcol_seen[i];
+	}
+	for(i = 0; i < sizeof(yrow_seen); i++) {
+		lines += yrow_seen[i];
+	}
+	for(i = 0; i < sizeof(zcol_seen); i++) {
+		lines += zcol_seen[i];
+	}
+
+	return lines;
+}
+
+// Fills a frame with a floor, back wall, and a few boxes, with a little noise.
+static void synthetic_frame(uint16_t *out)
+{
+	int x, y, val;
+
+	for(y = 0; y < 480; y++) {
+		for(x = 0; x < 640; x++) {
+			val = y > 300 ? 1000 - (y - 300) * 2 : 1000;
+			if(x > 100 && x < 220 && y > 150 && y < 400) {
+				val = 760;
+			} else if(x > 380 && x < 560 && y > 200 && y < 420) {
+				val = 880;
+			} else if(x > 260 && x < 320 && y > 60 && y < 300) {
+				val = 620;
+			}
+			val += rand() % 5 - 2;
+			out[y * 640 + x] = 65535 - (val << 5);
+		}
+	}
+}
+
+// Fills a frame with uniformly random depths closer than ZMAX, the worst case
+// for table locality.
+static void random_frame(uint16_t *out)
+{
+	int pix;
+
+	for(pix = 0; pix < 640 * 480; pix++) {
+		out[pix] = 65535 - ((rand() % 1040) << 5);
+	}
+}
+
+static void run(const char *name, const uint16_t *in, uint8_t *evict_buf, int l1_fd, int ll_fd)
+{
+	static uint8_t arith_views[3][XPIX * ZPIX], table_views[3][XPIX * ZPIX];
+	uint8_t *av[3] = { arith_views[0], arith_views[1], arith_views[2] };
+	uint8_t *tv[3] = { table_views[0], table_views[1], table_views[2] };
+	long long l1[4], ll[4];
+	double ms[4], best[4];
+	size_t lines;
+	int i;
+
+	ms[0] = time_plot(plot_arith, in, av, NULL, l1_fd, ll_fd, &l1[0], &ll[0], &best[0]);
+	ms[1] = time_plot(plot_table, in, tv, NULL, l1_fd, ll_fd, &l1[1], &ll[1], &best[1]);
+	ms[2] = time_plot(plot_arith, in, av, evict_buf, l1_fd, ll_fd, &l1[2], &ll[2], &best[2]);
+	ms[3] = time_plot(plot_table, in, tv, evict_buf, l1_fd, ll_fd, &l1[3], &ll[3], &best[3]);
+
+	lines = table_lines(in);
+
+	printf("\n%s frame (%s)\n", name, memcmp(arith_views, table_views, sizeof(arith_views)) ? "OUTPUT DIFFERS" : "identical output");
+	printf("  table working set: %zu lines (%zu KiB)\n", lines, lines * CACHE_LINE / 1024);
+	printf("  %-12s %10s %10s %14s %14s\n", "", "best ms", "mean ms", "L1D misses", "LLC misses");
+	for(i = 0; i < 4; i++) {
+		printf("  %-12s %10.3f %10.3f", (const char *[]){ "arith warm", "table warm", "arith cold", "table cold" }[i], best[i], ms[i]);
+		if(l1_fd >= 0) {
+			printf(" %14lld", l1[i]);
+		} else {
+			printf(" %14s", "n/a");
+		}
+		if(ll_fd >= 0) {
+			printf(" %14lld\n", ll[i]);
+		} else {
+			printf(" %14s\n", "n/a");
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static uint16_t frame[640 * 480];
+	uint8_t packed[640 * 480 * 11 / 8];
+	uint8_t *evict_buf;
+	char name[32];
+	int l1_fd, ll_fd;
+	FILE *f;
+	int i, n;
+
+	ku_init_lut();
+	srand(1);
+
+	evict_buf = malloc(EVICT_SIZE);
+	if(evict_buf == NULL) {
+		perror("Error allocating cache eviction buffer");
+		return -1;
+	}
+
+	l1_fd = open_counter(PERF_COUNT_HW_CACHE_L1D |
+			(PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	ll_fd = open_counter(PERF_COUNT_HW_CACHE_LL |
+			(PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+	printf("Projection table footprint:\n");
+	printf("  ku_proj_xcol: %zu bytes\n", sizeof(ku_proj_xcol));
+	printf("  ku_proj_yrow: %zu bytes\n", sizeof(ku_proj_yrow));
+	printf("  ku_proj_zcol: %zu bytes\n", sizeof(ku_proj_zcol));
+	printf("  total:        %zu bytes\n", sizeof(ku_proj_xcol) + sizeof(ku_proj_yrow) + sizeof(ku_proj_zcol));
+	printf("Arithmetic path: no tables (%zu byte depth LUT shared by both)\n", sizeof(ku_depth_lut));
+	printf("%d iterations per measurement; cold runs write %d MiB before each frame\n",
+			ITERATIONS, EVICT_SIZE / (1024 * 1024));
+
+	if(argc >= 2) {
+		f = fopen(argv[1], "rb");
+		if(f == NULL) {
+			perror("Error opening input file");
+			return -1;
+		}
+
+		for(n = 0; fread(packed, sizeof(packed), 1, f) == 1; n++) {
+			for(i = 0; i < 640 * 480 / 8; i++) {
+				unpack11_to_16(packed + i * 11, frame + i * 8);
+			}
+
+			snprintf(name, sizeof(name), "Input %d", n);
+			run(name, frame, evict_buf, l1_fd, ll_fd);
+		}
+
+		fclose(f);
+	} else {
+		synthetic_frame(frame);
+		run("Synthetic", frame, evict_buf, l1_fd, ll_fd);
+
+		random_frame(frame);
+		run("Random", frame, evict_buf, l1_fd, ll_fd);
+	}
+
+	free(evict_buf);
+
+	return 0;
+}
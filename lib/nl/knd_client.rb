@@ -6,7 +6,13 @@ module NL
 end
 
 require_relative 'knd_client/kinutils'
+require_relative 'knd_client/compact_zone'
 require_relative 'knd_client/simple_knd_client'
+require_relative 'knd_client/fake_knd_server'
+require_relative 'knd_client/latency_collector'
+require_relative 'knd_client/frame_scheduler'
+require_relative 'knd_client/frame_ring'
+require_relative 'knd_client/lazy_png'
 
 begin
   require 'eventmachine'
@@ -0,0 +1,36 @@
+module NL
+  module KndClient
+    # A zone from KND whose numeric attributes are stored in a packed native
+    # struct instead of a Hash, for applications with many zones.  Values are
+    # read and written with String keys like a Zone, and are converted to the
+    # same types as Zone#normalize! would produce.  Lines of key-value pairs
+    # from KND are parsed straight into the struct (see
+    # Kinutils::CompactZone#merge_kvp).
+    #
+    # Use EMKndClient.compact_zones = true to have EMKndClient use
+    # CompactZones instead of Zones.
+    #
+    # Example:
+    #     zone = NL::KndClient::CompactZone.new('xmin=-1000 ... name="Door" version=2')
+    #     zone['xmin'] # => -1000
+    #     zone.merge_kvp('pop=1200 occupied=1 name="Door"')
+    class CompactZone < Kinutils::CompactZone
+      # Merges with the other CompactZone, Zone, or Hash, converting known
+      # keys into their expected types, version 1 coordinates into
+      # millimeters, and names as Zone.fix_name! would.  Returns self.
+      def merge_zone(other)
+        merge!(other)
+      end
+
+      # Returns the zone as JSON, the same as a Zone with the same attributes.
+      def to_json(*args)
+        to_h.to_json(*args)
+      end
+
+      def inspect
+        "#<#{self.class.name} #{to_h.inspect}>"
+      end
+      alias to_s inspect
+    end
+  end
+end
@@ -61,9 +61,48 @@ module NL
       # call the proc.  Disables EMKndClient benchmarking if no block is given.
       # This is used by KNC to instrument
       def self.on_bench(&block)
+        @@bencher.stop if @@bencher.is_a?(LatencyCollector)
         @@bencher = block
       end
 
+      # Replaces any .on_bench block with a built-in LatencyCollector that
+      # keeps a latency histogram for each .bench stage and counts frames
+      # waiting to be processed, and returns the collector.  Use
+      # LatencyCollector#snapshot to read the statistics on demand.  If
+      # +interval+ is given, a snapshot is passed to the block (or logged, if
+      # there is no block) every +interval+ seconds, and the histograms are
+      # reset.
+      def self.collect_latency(interval = nil, &block)
+        collector = LatencyCollector.new
+        @@bencher.stop if @@bencher.is_a?(LatencyCollector)
+        @@bencher = collector
+
+        if interval
+          block ||= ->(snapshot) { log "Latency:\n#{LatencyCollector.format(snapshot)}" }
+          collector.report_every(interval, &block)
+        end
+
+        collector
+      end
+
+      # Returns the LatencyCollector enabled by .collect_latency, or nil.
+      def self.latency_collector
+        @@bencher if @@bencher.is_a?(LatencyCollector)
+      end
+
+      # Adds +delta+ to the number of frames waiting for the named stage, if a
+      # LatencyCollector is enabled.
+      def self.behind(name, delta)
+        @@bencher.behind(name, delta) if @@bencher.is_a?(LatencyCollector)
+      end
+
+      # Adds a duration in nanoseconds to the named stage, if a
+      # LatencyCollector is enabled.  Used for stages that finish outside of a
+      # .bench block, such as frames processed by a Kinutils::FramePool.
+      def self.record(name, ns)
+        @@bencher.record(name, ns) if @@bencher.is_a?(LatencyCollector)
+      end
+
       # Some EMKndClient functions call this method to wrap named sections of
       # code with optional instrumentation.  Use the .on_bench method to enable
       # benchmarking/instrumentation.
@@ -75,7 +114,10 @@ module NL
         end
       end
 
-      include EM::Protocols::LineText2
+      # Returns the monotonic clock in nanoseconds.
+      def self.clock_ns
+        Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+      end
 
       DEPTH_SIZE = 640 * 480 * 11 / 8
       VIDEO_SIZE = 640 * 480
@@ -85,8 +127,29 @@ module NL
         BLANK_IMAGE
       end
 
+      # Native threads and maximum frames in flight for each connection's
+      # Kinutils::FramePool
+      @@frame_threads = 2
+      @@frame_queue = 4
+
+      # How frames are dropped when processing falls behind (see
+      # FrameScheduler)
+      @@frame_mode = :latest_only
+      @@frame_backlog = nil
+
+      # Whether depth frames are unpacked and plotted as they arrive (see
+      # .stream_frames=)
+      @@stream_frames = false
+
       @@zones = {}
 
+      # The class used for zones in .zones (Zone or CompactZone)
+      @@zone_class = Zone
+
+      # Native copy of the zone list for client-side evaluation, kept up to
+      # date as zones are added, changed, and removed.
+      @@zone_set = Kinutils::ZoneSet.new
+
       @@images = {
         :depth => BLANK_IMAGE,
         :linear => BLANK_IMAGE,
@@ -107,10 +170,34 @@ module NL
       # The time of the last connection/disconnection event
       @@connection_time = Time.now
 
+      # Sequence number of the most recent depth or video frame
+      @@frame_sequence = 0
+
       # Returns the most recent PNG of the given type, an empty string if no
-      # data, or nil if an invalid type.
+      # data, or nil if an invalid type.  Images are encoded the first time
+      # they are fetched, then cached until the next frame replaces them.
       def self.png_data type
-        @@images[type]
+        image = @@images[type]
+        image.is_a?(LazyPng) ? image.png : image
+      end
+
+      # Returns the sequence number of the frame the most recent image of the
+      # given type came from, or nil if there is no image.  This can be used
+      # to tell whether .png_data will return a new image.
+      def self.image_sequence type
+        image = @@images[type]
+        image.sequence if image.is_a?(LazyPng)
+      end
+
+      # Returns the zlib compression level used for PNGs (see LazyPng.level).
+      def self.png_level
+        LazyPng.level
+      end
+
+      # Sets the zlib compression level (0-9) for PNGs, or nil to use
+      # NL::FastPng's compression (see LazyPng.level=).
+      def self.png_level= level
+        LazyPng.level = level
       end
 
       def self.clear_images
@@ -119,6 +206,79 @@ module NL
         end
       end
 
+      # Returns the number of native threads used to process depth frames.
+      def self.frame_threads
+        @@frame_threads
+      end
+
+      # Sets the number of native threads used to process depth frames (see
+      # Kinutils::FramePool).  Takes effect on the next connection.
+      def self.frame_threads= count
+        @@frame_threads = count
+      end
+
+      # Returns the maximum number of depth frames processed at once.
+      def self.frame_queue
+        @@frame_queue
+      end
+
+      # Sets the maximum number of depth frames that may be waiting or in
+      # processing at once.  Frames received beyond this are dropped and
+      # requested again.  Takes effect on the next connection.
+      def self.frame_queue= depth
+        @@frame_queue = depth
+      end
+
+      # Returns the FrameScheduler mode for depth and video frames.
+      def self.frame_mode
+        @@frame_mode
+      end
+
+      # Sets what happens to depth and video frames that arrive while earlier
+      # frames are still being processed (see FrameScheduler): :latest_only
+      # (the default) keeps only the newest waiting frame, :drop_oldest keeps
+      # up to +backlog+ frames, and :block stops reading from KND while
+      # +backlog+ frames are waiting.  Takes effect on the next connection.
+      def self.frame_mode= mode
+        new_frame_scheduler(mode)
+        @@frame_mode = mode
+      end
+
+      # Sets the number of frames that may wait for processing in the
+      # :drop_oldest and :block modes, or nil for the default.  Takes effect
+      # on the next connection.
+      def self.frame_backlog= backlog
+        @@frame_backlog = backlog
+      end
+
+      # Returns true if depth frames are unpacked and plotted as they arrive.
+      def self.stream_frames
+        @@stream_frames
+      end
+
+      # Sets whether depth frames are unpacked and plotted row by row while
+      # they are still arriving (see Kinutils::FrameAssembler), so their
+      # images are ready almost as soon as the last byte is received.  The
+      # work runs on the event loop between reads instead of in the
+      # connection's FramePool, and each frame is processed as it arrives
+      # rather than queued by .frame_mode=.  Off by default.  Takes effect on
+      # the next connection.
+      def self.stream_frames= enabled
+        @@stream_frames = !!enabled
+      end
+
+      # Returns a new FrameScheduler for the given mode and .frame_backlog=.
+      # The backlog is always 1 for :latest_only.
+      def self.new_frame_scheduler(mode = @@frame_mode)
+        FrameScheduler.new(mode: mode, capacity: mode == :latest_only ? nil : @@frame_backlog)
+      end
+
+      # Returns the current connection's frame statistics (see
+      # #frame_stats), or nil if not connected.
+      def self.frame_stats(reset: false)
+        @@instance && @@instance.frame_stats(reset: reset)
+      end
+
       # Whether the client is connected to the knd server
       def self.connected?
         @@connected || false
@@ -161,22 +321,31 @@ module NL
         @@zones
       end
 
-      def self.occupied
-        @@occupied
+      # Returns true if .zones holds CompactZones instead of Zones.
+      def self.compact_zones?
+        @@zone_class == CompactZone
       end
 
-      def self.fps
-        @@fps
+      # Sets whether zones are stored as CompactZones, which keep their
+      # numeric attributes in a native struct, instead of Zones (Hashes).
+      # Takes effect for zones received after the change, so this should be
+      # set before connecting.
+      def self.compact_zones= compact
+        @@zone_class = compact ? CompactZone : Zone
+      end
+
+      # A Kinutils::ZoneSet holding the same zones as .zones, for computing
+      # zone values from depth frames with Kinutils::ZoneSet#evaluate.
+      def self.zone_set
+        @@zone_set
       end
 
-      def enter_depth
-        @binary = :depth
-        set_binary_mode(DEPTH_SIZE)
+      def self.occupied
+        @@occupied
       end
 
-      def enter_video(length = VIDEO_SIZE)
-        @binary = :video
-        set_binary_mode(length)
+      def self.fps
+        @@fps
       end
 
       def leave_binary
@@ -191,6 +360,10 @@ module NL
         @quit = false
         @commands = []
         @active_command = nil
+        @decoder = Kinutils::LineDecoder.new(
+          zone_class: @@zone_class,
+          frame_buffer: @@stream_frames ? method(:depth_frame_buffer) : nil
+        )
         @@connected ||= false
         @tcp_ok = false
         @tcp_connected = false
@@ -210,6 +383,24 @@ module NL
         # The Mutex isn't necessary if all signaling takes place on the event loop
         @image_lock = Mutex.new
 
+        # Idle buffers for depth frame processing (see #acquire_frame_context)
+        @frame_contexts = []
+
+        # Native depth frame processing, started by the first frame (see
+        # #frame_pool)
+        @frame_pool = nil
+        @frame_watch = nil
+
+        # Frames waiting to be processed (see .frame_mode=)
+        @depth_frames = EMKndClient.new_frame_scheduler
+
+        # Depth frame being unpacked as it arrives (see .stream_frames=), and
+        # the sequence number and wanted images of the current frame
+        @assembler = nil
+        @stream_tag = nil
+        @video_frames = EMKndClient.new_frame_scheduler
+        @video_busy = false
+
         # Zone/status update callbacks (for protocol plugins like xAP)
         @cbs = []
       end
@@ -293,195 +484,162 @@ module NL
         Kernel.exit
       end
 
-      def receive_line(data)
+      # Splits data from KND into lines and binary frames with a
+      # Kinutils::LineDecoder, passing each decoded record to #receive_record.
+      def receive_data(data)
+        @decoder.feed(data) do |type, value, extra|
+          receive_record type, value, extra
+        end
+      rescue Kinutils::LineDecoder::ProtocolError => e
+        log "Invalid data from depth camera server: #{e.message}.  Disconnecting (connection #{@thiscon})."
+        close_connection
+      end
+
+      # Handles a record from Kinutils::LineDecoder#feed.  Zone messages
+      # arrive already parsed into zones of the configured class (see
+      # .compact_zones=).
+      def receive_record(type, value, extra)
         # Send lines to any command waiting for data
         if @active_command
-          @active_command = nil if @active_command.add_line data
+          @active_command = nil if @active_command.add_line value
           return
         end
 
-        type, message = data.split(" - ", 2)
-
         case type
-        when "DEPTH"
-          enter_depth
+        when :depth
+          @binary = :depth
+          receive_binary_data value
 
-        when 'VIDEO'
-          length = message.gsub(/[^0-9 ]+/, '').to_i
-          enter_video length
+        when :video
+          @binary = :video
+          receive_binary_data value
 
-        when 'BRIGHT'
-          line = message.kin_kvp
-          name = Zone.fix_name! line['name']
+        when :bright
+          name = value
           if @@zones.has_key? name
             match = @@zones[name]
-            match['bright'] = line['bright'].to_i
+            match['bright'] = extra.to_i
             call_cbs :change, match
           else
             log "=== NOTICE - BRIGHT line for missing zone #{name}"
           end
 
-        when "SUB"
-          zone = Zone.new(message)
+        when :sub
+          zone = value
           name = zone["name"]
           if !@@zones.has_key? name
             log "=== NOTICE - SUB added zone #{name} ==="
             @@zones[name] = zone
+            index_zone zone
             call_cbs :add, zone
           else
             match = @@zones[name]
             match.merge_zone zone
+            index_zone match
             call_cbs :change, match
           end
 
-        when "ADD"
-          zone = Zone.new(message)
+        when :add
+          zone = value
           name = zone["name"]
           @@zones[name] = zone
+          index_zone zone
           log "Zone #{name} added via ADD"
           call_cbs :add, zone
 
-        when "DEL"
-          name = message
+        when :del
+          name = value
           log "Zone #{name} removed via DEL"
-          if @@zones.include? message
-            zone = @@zones[message]
-            @@zones.delete message
+          if @@zones.include? name
+            zone = @@zones[name]
+            @@zones.delete name
+            @@zone_set.delete name
             call_cbs :del, zone
           else
             puts "=== ERROR - DEL received for nonexistent zone ==="
           end
 
-        when "OK"
+        when :ok
           if @commands.length == 0
             puts "=== ERROR - OK when no command was queued - disconnecting ==="
             close_connection
           else
             cmd = @commands.shift
-            active = cmd.ok_line message
-            @active_command = cmd unless active
+            active = cmd.ok_line value
+            unless active
+              # The response body must not be mistaken for other messages
+              @active_command = cmd
+              @decoder.raw_lines = cmd.linecount
+            end
           end
 
-        when "ERR"
+        when :err
           if @commands.length == 0
             puts "=== ERROR - ERR when no command was queued - disconnecting ==="
             close_connection
           end
-          @commands.shift.err_line message
+          @commands.shift.err_line value
 
         else
           puts "----- Unknown Response -----"
-          p data
+          p value
         end
       end
 
+      # Queues a depth or video frame on its FrameScheduler (see
+      # .frame_mode=), then starts processing waiting frames if there is room.
+      # In :block mode, reading from KND pauses while a queue is full.
       def receive_binary_data(d)
         case @binary
         when :depth
-          EM.defer do
-            data = d
-            begin
-              @image_lock.synchronize do
-                @depth_sent = false
-              end
-
-              unpacked = nil
-
-              if(check_requests(:front) or check_requests(:ovh) or check_requests(:depth) or
-                  check_requests(:side) or check_requests(:linear))
-                EMKndClient.bench('unpack') do
-                  unpacked = Kinutils.unpack11_to_16(data)
-                end
-              else
-                raise "---- Received an unneeded depth image"
-              end
-
-              if check_requests(:depth)
-                EMKndClient.bench('16png') do
-                  set_image :depth, NL::FastPng.store_png(640, 480, 16, unpacked)
-                end
-              end
-
-              if check_requests(:linear)
-                linbuf = nil
-                EMKndClient.bench('linear_plot') do
-                  linbuf = Kinutils.plot_linear(unpacked)
-                end
-                EMKndClient.bench('linear_png') do
-                  set_image :linear, NL::FastPng.store_png(640, 480, 8, linbuf)
-                end
-              end
-
-              if check_requests(:ovh)
-                ovhbuf = nil
-                EMKndClient.bench('ovh_plot') do
-                  ovhbuf = Kinutils.plot_overhead(unpacked)
-                end
-                EMKndClient.bench('ovh_png') do
-                  set_image :ovh, NL::FastPng.store_png(KNC_XPIX, KNC_ZPIX, 8, ovhbuf)
-                end
-              end
-
-              if check_requests(:side)
-                sidebuf = nil
-                EMKndClient.bench('side_plot') do
-                  sidebuf = Kinutils.plot_side(unpacked)
-                end
-                EMKndClient.bench('side_png') do
-                  set_image :side, NL::FastPng.store_png(KNC_ZPIX, KNC_YPIX, 8, sidebuf)
-                end
-              end
-
-              if check_requests(:front)
-                frontbuf = nil
-                EMKndClient.bench('front_plot') do
-                  frontbuf = Kinutils.plot_front(unpacked)
-                end
-                EMKndClient.bench('front_png') do
-                  set_image :front, NL::FastPng.store_png(KNC_XPIX, KNC_YPIX, 8, frontbuf)
-                end
-              end
-            rescue => e
-              log "Error in depth image processing task: #{e.to_s}"
-              log "\t#{e.backtrace.join("\n\t")}"
-            end
+          @image_lock.synchronize do
+            @depth_sent = false
+          end
+          if d.is_a?(Kinutils::FrameAssembler)
+            finish_streamed_frame d
+          else
+            schedule_frame @depth_frames, 'depth', d
+            pump_depth_frames
           end
 
         when :video
-          EM.defer do
-            data = d
-            begin
-              @image_lock.synchronize do
-                @video_sent = false
-              end
-
-              unpacked = nil
-
-              unless check_requests(:video)
-                raise "---- Received an unneeded video image"
-              end
-
-              if d.bytesize != VIDEO_SIZE
-                set_image :video, BLANK_IMAGE
-                raise "---- Unknown video image format with size #{d.bytesize}; expected #{VIDEO_SIZE}"
-              end
-
-              EMKndClient.bench('videopng') do
-                set_image :video, NL::FastPng.store_png(640, 480, 8, data)
-              end
-
-            rescue => e
-              log "Error in video image processing task: #{e.to_s}"
-              log "\t#{e.backtrace.join("\n\t")}"
-            end
+          @image_lock.synchronize do
+            @video_sent = false
           end
+          schedule_frame @video_frames, 'video', d
+          pump_video_frames
         end
 
         leave_binary
       end
 
+      # Returns FrameScheduler#stats for :depth and :video frames, including
+      # how many were dropped and how long they waited to be processed.
+      def frame_stats(reset: false)
+        {
+          depth: @depth_frames.stats(reset: reset),
+          video: @video_frames.stats(reset: reset),
+        }
+      end
+
       def unbind
         begin
+          # Frames waiting or in processing are discarded
+          EMKndClient.behind('depth', -(@depth_frames.size + (@frame_pool ? @frame_pool.pending : 0)))
+          EMKndClient.behind('video', -@video_frames.size)
+          @depth_frames.close
+          @video_frames.close
+
+          # A partly received streamed frame releases its FrameContext
+          @assembler.finish if @assembler
+
+          if @frame_pool
+            @frame_watch.detach
+            @frame_pool.close
+            @frame_watch = nil
+            @frame_pool = nil
+          end
+
           if @tcp_connected
             log "Disconnected from camera server (connection #{@thiscon})."
             @@connect_cb.call false if @@connect_cb
@@ -512,7 +670,7 @@ module NL
 
           @requests.each do |k, v|
             v.each do |req|
-              req.call @@images[k]
+              req.call EMKndClient.png_data(k)
             end
           end
 
@@ -569,8 +727,9 @@ module NL
           EMKndClient.bench('get_zones') do
             old_zones = @@zones
             zonelist = {}
-            cmd.lines.each do |line|
-              zone = Zone.new line
+            zones = EMKndClient.compact_zones? ? cmd.lines.map { |line| CompactZone.new(line) } :
+              Kinutils.parse_zone_list(cmd.lines).map { |attrs| Zone.new(attrs, false) }
+            zones.each do |zone|
               oldzone = @@zones[zone['name']]
               zone['bright'] = oldzone['bright'] if oldzone && oldzone.include?('bright')
               zonelist[zone['name']] = zone
@@ -578,6 +737,15 @@ module NL
 
             @@zones = zonelist
 
+            EMKndClient.bench('get_zones_index') do
+              zonelist.each_value do |zone|
+                index_zone zone
+              end
+              old_zones.each_key do |k|
+                @@zone_set.delete k unless zonelist.include? k
+              end
+            end
+
             # Notify protocol plugin callbacks about new zones
             EMKndClient.bench('get_zones_callbacks') do
               unless @cbs.empty?
@@ -655,7 +823,7 @@ module NL
 
           if block != nil
             cmd.callback { |cmd|
-              @@zones.has_key?(name) && @@zones[name].merge_zone(zone)
+              @@zones.has_key?(name) && index_zone(@@zones[name].merge_zone(zone))
               block.call true, cmd.message
             }
             cmd.errback {|cmd| block.call false, (cmd ? cmd.message : 'timeout')}
@@ -701,7 +869,10 @@ module NL
             end
             cmd = EMKndCommand.new 'setzone', name, k, v
             cmd.callback { |cmd|
-              @@zones.has_key?(name) && @@zones[name][k] = v
+              if @@zones.has_key?(name)
+                @@zones[name][k] = v
+                index_zone @@zones[name]
+              end
               func.call cmd.message
             }
             cmd.errback { |cmd|
@@ -768,6 +939,7 @@ module NL
         if block != nil
           cmd.callback { |cmd|
             @@zones.clear
+            @@zone_set.clear
             block.call true, cmd.message
           }
           cmd.errback { |cmd|
@@ -819,18 +991,264 @@ module NL
         return ret
       end
 
-      # Sets the PNG data for the given type of image
-      def set_image type, pngdata
+      # Returns an idle Kinutils::FrameContext for processing a depth frame,
+      # creating a new one only if all existing contexts are still in use by
+      # frames in #frame_pool.  Reusing contexts avoids allocating new image
+      # buffers for every frame.
+      def acquire_frame_context
         @image_lock.synchronize do
-          @@images[type] = pngdata
-          reqs = @requests[type].clone
-          EM.next_tick do
-            reqs.each do |v|
-              v.call pngdata
+          @frame_contexts.pop
+        end || Kinutils::FrameContext.new
+      end
+      private :acquire_frame_context
+
+      # Returns a FrameContext obtained from #acquire_frame_context for reuse.
+      def release_frame_context(ctx)
+        @image_lock.synchronize do
+          @frame_contexts.push(ctx)
+        end
+      end
+      private :release_frame_context
+
+      # Adds a frame to +frames+, numbering it and counting it as +name+ in
+      # EMKndClient.behind.  Pauses the connection if +frames+ is a full
+      # :block mode queue.
+      def schedule_frame frames, name, d
+        seq = @@frame_sequence += 1
+        dropped = frames.dropped
+
+        if frames.push([d, seq], wait: false)
+          EMKndClient.behind(name, 1 - (frames.dropped - dropped))
+        else
+          log "---- Dropped a #{name} image that arrived while its queue was full"
+        end
+
+        pause if frames.mode == :block && frames.full? && !paused?
+      end
+      private :schedule_frame
+
+      # Resumes reading from KND if it was paused by #schedule_frame and there
+      # is room for more frames.
+      def resume_frames
+        resume if paused? && !@depth_frames.full? && !@video_frames.full?
+      end
+      private :resume_frames
+
+      # Submits waiting depth frames to #frame_pool while it has an idle
+      # thread, so newer frames can replace older ones in a :latest_only or
+      # :drop_oldest queue instead of waiting behind them in the pool.
+      def pump_depth_frames
+        pool = frame_pool
+        while pool.pending < pool.threads && (item = @depth_frames.shift)
+          (d, seq), wait = item
+          EMKndClient.record('depth queue', (wait * 1_000_000_000).to_i)
+          process_depth_frame d, seq
+        end
+
+        resume_frames
+      end
+      private :pump_depth_frames
+
+      # Submits a depth frame to #frame_pool for the images that have
+      # pending requests.
+      def process_depth_frame d, seq
+        want_depth = check_requests(:depth)
+        want_linear = check_requests(:linear)
+        want_ovh = check_requests(:ovh)
+        want_side = check_requests(:side)
+        want_front = check_requests(:front)
+
+        unless want_depth || want_linear || want_ovh || want_side || want_front
+          raise "---- Received an unneeded depth image"
+        end
+
+        # The 16-bit frame is only needed for the depth PNG; views are
+        # plotted directly from the packed data.
+        ctx = acquire_frame_context
+        tag = [seq, EMKndClient.clock_ns, want_depth, want_linear, want_ovh, want_side, want_front]
+        unless frame_pool.submit(ctx, d, tag, depth: want_depth, linear: want_linear, overhead: want_ovh, side: want_side, front: want_front)
+          release_frame_context(ctx)
+          @image_lock.synchronize do
+            request_image :depth
+          end
+          raise "---- Dropped a depth image with #{frame_pool.queue} frames already in processing"
+        end
+      rescue => e
+        EMKndClient.behind('depth', -1)
+        log "Error in depth image processing: #{e.to_s}"
+        log "\t#{e.backtrace.join("\n\t")}"
+      end
+      private :process_depth_frame
+
+      # Starts processing the next waiting video frame on EM's thread pool,
+      # unless one is already being processed.
+      def pump_video_frames
+        return if @video_busy || (item = @video_frames.shift).nil?
+
+        (d, seq), wait = item
+        EMKndClient.record('video queue', (wait * 1_000_000_000).to_i)
+        @video_busy = true
+
+        EM.defer(
+          proc { process_video_frame d, seq },
+          proc {
+            @video_busy = false
+            pump_video_frames
+          }
+        )
+
+        resume_frames
+      end
+      private :pump_video_frames
+
+      # Publishes a video frame to pending requests.  Runs on EM's thread
+      # pool.
+      def process_video_frame d, seq
+        unless check_requests(:video)
+          raise "---- Received an unneeded video image"
+        end
+
+        if d.bytesize != VIDEO_SIZE
+          set_image :video, BLANK_IMAGE
+          raise "---- Unknown video image format with size #{d.bytesize}; expected #{VIDEO_SIZE}"
+        end
+
+        set_image :video, LazyPng.new(640, 480, 8, d, seq), 'videopng'
+
+      rescue => e
+        log "Error in video image processing task: #{e.to_s}"
+        log "\t#{e.backtrace.join("\n\t")}"
+      ensure
+        EMKndClient.behind('video', -1)
+      end
+      private :process_video_frame
+
+      # Returns the Kinutils::FramePool that unpacks and plots this
+      # connection's depth frames without holding the GVL, creating it and
+      # watching its completion descriptor on the first call.
+      def frame_pool
+        @frame_pool ||= Kinutils::FramePool.new(threads: @@frame_threads, queue: @@frame_queue).tap do |pool|
+          @frame_watch = EM.watch(pool.io, FramePoolWatch, self)
+          @frame_watch.notify_readable = true
+        end
+      end
+      private :frame_pool
+
+      # Publishes the images of depth frames finished by #frame_pool (see
+      # #publish_depth_images).  Called on the event loop when the pool
+      # signals that frames are done.
+      def collect_frames
+        @frame_pool.each_completed do |ctx, (seq, start, *wants)|
+          EMKndClient.record('frame_pool', EMKndClient.clock_ns - start)
+          EMKndClient.behind('depth', -1)
+          publish_depth_images ctx, seq, *wants
+        end
+
+        pump_depth_frames
+      end
+
+      # Returns a Kinutils::FrameAssembler started on an idle FrameContext
+      # for the images that have pending requests, so Kinutils::LineDecoder
+      # unpacks and plots an incoming depth frame while it arrives (see
+      # .stream_frames=).  Returns nil, receiving the frame into a String as
+      # usual, for other frames or if no images are wanted.
+      def depth_frame_buffer type, length
+        return nil unless type == :depth && length == DEPTH_SIZE
+
+        wants = [:depth, :linear, :ovh, :side, :front].map { |t| check_requests(t) }
+        return nil unless wants.any?
+
+        want_depth, want_linear, want_ovh, want_side, want_front = wants
+        @assembler ||= Kinutils::FrameAssembler.new
+        ctx = acquire_frame_context
+        @assembler.start(ctx, depth: want_depth, linear: want_linear, overhead: want_ovh, side: want_side, front: want_front)
+        ctx = nil # Released by #finish_streamed_frame from here on
+        @stream_tag = [@@frame_sequence += 1, EMKndClient.clock_ns, *wants]
+
+        @assembler
+      rescue => e
+        release_frame_context(ctx) if ctx
+        log "Error starting streamed depth frame: #{e.to_s}"
+        log "\t#{e.backtrace.join("\n\t")}"
+        nil
+      end
+      private :depth_frame_buffer
+
+      # Publishes the images of a depth frame received by #depth_frame_buffer's
+      # FrameAssembler, which has already unpacked and plotted all but its
+      # last rows.
+      def finish_streamed_frame assembler
+        seq, start, *wants = @stream_tag
+        ctx = assembler.finish
+        EMKndClient.record('depth stream', EMKndClient.clock_ns - start)
+        publish_depth_images ctx, seq, *wants
+      end
+      private :finish_streamed_frame
+
+      # Sets the requested images from a processed FrameContext.  The images
+      # are copied out of +ctx+ so it can be reused right away, then any
+      # pending requests are answered from EM's thread pool, since encoding
+      # their PNGs would stall the event loop.
+      def publish_depth_images ctx, seq, want_depth, want_linear, want_ovh, want_side, want_front
+        images = []
+        begin
+          images << [:depth, LazyPng.new(640, 480, 16, ctx.depth, seq), '16png'] if want_depth
+          images << [:linear, LazyPng.new(640, 480, 8, ctx.linear, seq), 'linear_png'] if want_linear
+          images << [:ovh, LazyPng.new(KNC_XPIX, KNC_ZPIX, 8, ctx.overhead, seq), 'ovh_png'] if want_ovh
+          images << [:side, LazyPng.new(KNC_ZPIX, KNC_YPIX, 8, ctx.side, seq), 'side_png'] if want_side
+          images << [:front, LazyPng.new(KNC_XPIX, KNC_YPIX, 8, ctx.front, seq), 'front_png'] if want_front
+        ensure
+          release_frame_context(ctx)
+        end
+
+        EM.defer do
+          begin
+            images.each do |type, image, bench_name|
+              set_image type, image, bench_name
             end
+          rescue => e
+            log "Error in depth image processing task: #{e.to_s}"
+            log "\t#{e.backtrace.join("\n\t")}"
           end
+        end
+      end
+      private :publish_depth_images
+
+      # Watches a Kinutils::FramePool's descriptor for finished frames.
+      module FramePoolWatch
+        def initialize(client)
+          @client = client
+        end
+
+        def notify_readable
+          @client.collect_frames
+        end
+      end
+
+      # Sets the image (a LazyPng, or PNG data) for the given type, and passes
+      # its PNG data to any pending requests.  If there are requests, the PNG
+      # is encoded on the calling thread (benchmarked as +bench_name+);
+      # otherwise it is left for .png_data to encode if anyone fetches it.
+      def set_image type, image, bench_name = nil
+        reqs = nil
+        @image_lock.synchronize do
+          @@images[type] = image
+          reqs = @requests[type].clone
           @requests[type].clear
         end
+
+        return if reqs.empty?
+
+        pngdata = image
+        if image.is_a?(LazyPng)
+          pngdata = EMKndClient.bench(bench_name || "#{type}_png") { image.png }
+        end
+
+        EM.next_tick do
+          reqs.each do |v|
+            v.call pngdata
+          end
+        end
       end
       private :set_image
 
@@ -896,6 +1314,15 @@ module NL
       end
       private :call_cbs
 
+      # Adds or updates a zone in the native zone set.  The zone index is only
+      # rebuilt for zones whose bounds changed.
+      def index_zone zone
+        @@zone_set.set zone['name'], zone
+      rescue ArgumentError => e
+        log "=== ERROR - Unable to index zone #{zone['name']}: #{e.message}"
+      end
+      private :index_zone
+
       def log(msg)
         EMKndClient.log(msg)
       end
@@ -0,0 +1,435 @@
+require 'socket'
+
+module NL
+  module KndClient
+    # A stand-in for KND that serves recorded or synthetic depth frames and
+    # zone updates over KND's line protocol, so the clients can be load tested
+    # without a Kinect.  Zone statistics are computed from the served frames
+    # with Kinutils::ZoneSet.
+    #
+    # Supported commands: ver, fps, zones, sub, unsub, getdepth, subdepth,
+    # unsubdepth, getvideo, getbright, addzone, setzone, rmzone, and clear.
+    #
+    # Example:
+    #     server = NL::KndClient::FakeKndServer.new(port: 0, fps: 60, count: 600)
+    #     server.start
+    #     knd = NL::KndClient::SimpleKndClient.new(port: server.port)
+    class FakeKndServer
+      DEPTH_SIZE = 640 * 480 * 11 / 8
+      VIDEO_SIZE = 640 * 480
+
+      # The port the server is listening on (useful when created with port 0).
+      attr_reader :port
+
+      # The number of frames produced so far.
+      attr_reader :frame_count
+
+      # The number of depth frames written to clients.
+      attr_reader :frames_sent
+
+      # The number of depth frames skipped because a client had too many
+      # frames waiting to be written.
+      attr_reader :frames_dropped
+
+      # Creates a server on the given host and port (0 picks a free port).
+      #
+      # +frames+ is nil for a synthetic scene, a Kinutils::Recording or the
+      # path to one, or an Array of packed depth frames; frames are served in
+      # a loop.  +fps+ is the frame rate, and +count+ stops the server's frames
+      # after that many (nil for no limit).  +zones+ is a Hash of zone names to
+      # Zones or Hashes with at least xmin, ymin, zmin, xmax, ymax, and zmax.
+      # Subscribed clients receive a SUB line for every zone +zone_rate+ times
+      # per second (0 for none).  Each client may have +max_queue+ frames
+      # waiting to be written before further frames are dropped for it.
+      def initialize(host: 'localhost', port: 14308, frames: nil, fps: 30, count: nil, zones: {}, zone_rate: 10, max_queue: 2)
+        @host = host
+        @port = port
+        @fps = fps
+        @count = count
+        @zone_rate = zone_rate
+        @max_queue = max_queue
+
+        @frames = frames.is_a?(String) ? Kinutils::Recording.new(frames) : frames
+        @synthetic = {} if @frames.nil?
+
+        @lock = Mutex.new
+        @zone_set = Kinutils::ZoneSet.new
+        @zones = {}
+        @zone_values = {}
+        zones.each do |name, zone|
+          set_zone(name, zone)
+        end
+
+        @clients = []
+        @frame_count = 0
+        @frames_sent = 0
+        @frames_dropped = 0
+        @frame = frame_at(0)
+      end
+
+      # Starts listening and serving frames.  Returns self.
+      def start
+        @server = TCPServer.new(@host, @port)
+        @port = @server.addr[1]
+        @run = true
+
+        @frame_thread = Thread.new do frame_loop end
+        @threads = [@frame_thread, Thread.new do accept_loop end]
+        @threads << Thread.new do zone_loop end if @zone_rate > 0
+
+        self
+      end
+
+      # Disconnects all clients and stops the server.
+      def stop
+        @run = false
+        @server&.close
+        @threads&.each(&:kill)
+        @lock.synchronize { @clients.dup }.each(&:close)
+        @threads = nil
+        @server = nil
+      end
+
+      # Waits until +count+ frames have been produced (forever if there is no
+      # count), or until +timeout+ seconds pass.  Returns true if the frames
+      # are done.
+      def wait(timeout = nil)
+        !!@frame_thread&.join(timeout)
+      end
+
+      # Returns the number of connected clients.
+      def client_count
+        @lock.synchronize { @clients.length }
+      end
+
+      private
+
+      # Returns the packed depth frame to serve as the +index+th frame.
+      def frame_at(index)
+        return synthetic_frame(index) if @frames.nil?
+        @frames[index % @frames.length]
+      end
+
+      # A wall that is nearer at the top of the image, with a box moving back
+      # and forth in front of it.  Frames are assembled from precomputed rows
+      # of 8-pixel (11-byte) groups, so building one is cheap.
+      def synthetic_frame(index)
+        box_x = (index % 120) < 60 ? index % 60 : 59 - index % 60
+
+        (0...480).map { |y|
+          wall = pixel_group(800 + y / 4)
+          if y >= 180 && y < 380
+            box = pixel_group(650 + (y - 180) / 20)
+            wall * box_x + box * 20 + wall * (60 - box_x)
+          else
+            wall * 80
+          end
+        }.join
+      end
+
+      # Returns 8 packed 11-bit pixels with the given raw depth value.
+      def pixel_group(value)
+        @synthetic[value] ||= [value.to_s(2).rjust(11, '0') * 8].pack('B*')
+      end
+
+      def accept_loop
+        while @run
+          client = Client.new(self, @server.accept, @max_queue)
+          @lock.synchronize { @clients << client }
+        end
+      rescue IOError, SystemCallError
+        # The server was closed
+      end
+
+      def frame_loop
+        interval = 1.0 / @fps
+        next_time = now
+
+        while @run && (@count.nil? || @frame_count < @count)
+          frame = frame_at(@frame_count)
+          @lock.synchronize do
+            @frame = frame
+            @frame_count += 1
+            @clients.each do |c|
+              case c.depth(frame)
+              when :sent
+                @frames_sent += 1
+              when :dropped
+                @frames_dropped += 1
+              end
+            end
+          end
+
+          next_time += interval
+          delay = next_time - now
+          if delay > 0
+            sleep delay
+          else
+            next_time = now
+          end
+        end
+      end
+
+      def zone_loop
+        interval = 1.0 / @zone_rate
+
+        while @run
+          @lock.synchronize do
+            @zone_values = @zone_set.evaluate(@frame) unless @zones.empty?
+            lines = @zones.each_key.map { |name| "SUB - #{zone_kvp(name)}" }
+            broadcast(lines)
+          end
+
+          sleep interval
+        end
+      end
+
+      def now
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+
+      # Sends lines to every client subscribed to zone updates.  Called with
+      # @lock held.
+      def broadcast(lines)
+        return if lines.empty?
+        @clients.each do |c|
+          c.send_lines(lines) if c.subscribed
+        end
+      end
+
+      # Adds or replaces a zone.  Called with @lock held, except from the
+      # constructor.
+      def set_zone(name, zone)
+        zone = zone.map { |k, v| [k.to_s, v] }.to_h
+        zone.delete('name')
+        zone['param'] ||= 'pop'
+        @zone_set.set(name, zone)
+        @zones[name] = zone
+      end
+
+      # Formats a zone's definition and latest statistics as key-value pairs.
+      def zone_kvp(name)
+        values = @zones[name].merge(@zone_values[name] || {})
+        values['bright'] = brightness(name)
+        values['name'] = name
+
+        values.map { |k, v|
+          v = v ? 1 : 0 if v == true || v == false
+          v = "\"#{v}\"" if v.is_a?(String)
+          "#{k}=#{v}"
+        }.join(' ')
+      end
+
+      # There is no video to measure brightness from, so a zone's brightness is
+      # its fraction of maximum population, from 0 to 1000.
+      def brightness(name)
+        values = @zone_values[name]
+        return 0 unless values && values['maxpop'] > 0
+        values['pop'] * 1000 / values['maxpop']
+      end
+
+      # Called by a Client's reader thread for each line it receives.  Returns
+      # the response line, or an Array of lines.
+      def command(client, line)
+        name, args = line.strip.split(' ', 2)
+        args = args.to_s.split(',')
+
+        @lock.synchronize do
+          case name
+          when 'ver'
+            'OK - Version 2'
+
+          when 'fps'
+            "OK - #{@run && (@count.nil? || @frame_count < @count) ? @fps.round : 0}"
+
+          when 'zones'
+            occupied = @zone_values.count { |_, v| v['occupied'] }
+            ["OK - #{@zones.length} zones, #{occupied} occupied", *@zones.each_key.map { |n| zone_kvp(n) }]
+
+          when 'sub'
+            client.subscribed = true
+            'OK - Subscribed to zone updates'
+
+          when 'unsub'
+            client.subscribed = false
+            'OK - Unsubscribed from zone updates'
+
+          when 'getdepth'
+            client.request_depth(1)
+            'OK - Depth image will be sent'
+
+          when 'subdepth'
+            client.request_depth(args.empty? ? nil : args[0].to_i)
+            'OK - Subscribed to depth images'
+
+          when 'unsubdepth'
+            client.request_depth(0)
+            'OK - Unsubscribed from depth images'
+
+          when 'getvideo'
+            client.video(Kinutils.plot_linear11(@frame))
+            'OK - Video image will be sent'
+
+          when 'getbright'
+            client.send_lines(@zones.each_key.map { |n| "BRIGHT - name=\"#{n}\" bright=#{brightness(n)}" })
+            'OK - Brightness will be sent'
+
+          when 'addzone'
+            next 'ERR - Expected name,xmin,ymin,zmin,xmax,ymax,zmax' unless args.length == 7
+            next "ERR - Zone #{args[0]} already exists" if @zones.include?(args[0])
+            set_zone(args[0], %w{xmin ymin zmin xmax ymax zmax}.zip(args[1..-1].map(&:to_i)).to_h)
+            broadcast(["ADD - #{zone_kvp(args[0])}"])
+            "OK - Zone #{args[0]} added"
+
+          when 'setzone'
+            zone = @zones[args[0]]
+            next "ERR - Zone #{args[0]} doesn't exist" unless zone
+            if args[1] == 'all' && args.length == 8
+              zone = zone.merge(%w{xmin ymin zmin xmax ymax zmax}.zip(args[2..-1].map(&:to_i)).to_h)
+            elsif args.length == 3
+              zone = zone.merge(args[1] => args[1] == 'param' ? args[2] : args[2].to_i)
+            else
+              next 'ERR - Expected name,all,xmin,ymin,zmin,xmax,ymax,zmax or name,param,value'
+            end
+            set_zone(args[0], zone)
+            broadcast(["SUB - #{zone_kvp(args[0])}"])
+            "OK - Zone #{args[0]} updated"
+
+          when 'rmzone'
+            next "ERR - Zone #{args[0]} doesn't exist" unless @zones.include?(args[0])
+            remove_zone(args[0])
+            "OK - Zone #{args[0]} removed"
+
+          when 'clear'
+            @zones.keys.each do |n| remove_zone(n) end
+            'OK - All zones removed'
+
+          else
+            "ERR - Unknown command #{name}"
+          end
+        end
+      end
+
+      # Removes a zone and tells subscribed clients.  Called with @lock held.
+      def remove_zone(name)
+        @zone_set.delete(name)
+        @zones.delete(name)
+        @zone_values.delete(name)
+        broadcast(["DEL - #{name}"])
+      end
+
+      # Called by a Client when its connection closes.
+      def remove_client(client)
+        @lock.synchronize { @clients.delete(client) }
+      end
+
+      # A connected client, with a thread reading commands and a thread
+      # writing responses and images.
+      class Client
+        attr_accessor :subscribed
+
+        def initialize(server, socket, max_queue)
+          @server = server
+          @socket = socket
+          @max_queue = max_queue
+          @subscribed = false
+
+          # Remaining depth frames to send; nil to send every frame
+          @depth_remaining = 0
+
+          @queue = []
+          @queued_frames = 0
+          @lock = Mutex.new
+          @cond = ConditionVariable.new
+
+          @reader = Thread.new do read_loop end
+          @writer = Thread.new do write_loop end
+        end
+
+        # Asks for the next +count+ depth frames (nil for all of them, 0 for
+        # none).
+        def request_depth(count)
+          @lock.synchronize { @depth_remaining = count }
+        end
+
+        # Queues a depth frame if the client asked for one.  Returns :sent if
+        # the frame was queued, :dropped if the queue was full, or nil.
+        def depth(frame)
+          @lock.synchronize do
+            return nil if @depth_remaining == 0
+            return :dropped if @queued_frames >= @max_queue
+
+            @depth_remaining -= 1 if @depth_remaining
+            @queued_frames += 1
+            push("DEPTH - #{DEPTH_SIZE} bytes of raw depth data follow\n", frame)
+            :sent
+          end
+        end
+
+        # Queues a video frame.
+        def video(image)
+          @lock.synchronize do
+            push("VIDEO - #{VIDEO_SIZE} bytes of video data follow\n", image)
+          end
+        end
+
+        # Queues lines of text.
+        def send_lines(lines)
+          @lock.synchronize do
+            push(lines.map { |l| "#{l}\n" }.join)
+          end
+        end
+
+        def close
+          @socket.close rescue nil
+          @reader.kill
+          @writer.kill
+        end
+
+        private
+
+        # Queues items for the writer thread.  Called with @lock held.
+        def push(*items)
+          @queue << items
+          @cond.signal
+        end
+
+        def read_loop
+          while (line = @socket.gets)
+            next if line.strip.empty?
+            send_lines(Array(@server.send(:command, self, line)))
+          end
+        rescue IOError, SystemCallError
+          # The client disconnected
+        ensure
+          shutdown
+        end
+
+        def write_loop
+          loop do
+            items = @lock.synchronize do
+              @cond.wait(@lock) while @queue.empty?
+              @queue.shift
+            end
+
+            items.each do |s|
+              @socket.write(s)
+            end
+
+            if items.length > 1 && items[0].start_with?('DEPTH')
+              @lock.synchronize { @queued_frames -= 1 }
+            end
+          end
+        rescue IOError, SystemCallError
+          # The client disconnected
+          shutdown
+        end
+
+        def shutdown
+          @server.send(:remove_client, self)
+          @socket.close rescue nil
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,72 @@
+module NL
+  module KndClient
+    # A fixed set of preallocated binary Strings that frames are received
+    # into, so steady-state frame reads allocate nothing.  #acquire lends out
+    # an idle buffer, and #release returns it to be overwritten by a later
+    # frame.  A FrameRing may be given to Kinutils::LineDecoder as its
+    # frame_buffer: option.
+    #
+    # Anything that keeps a frame after releasing it needs a copy.
+    # String#dup is enough: Ruby copies the shared bytes before the buffer is
+    # overwritten.
+    #
+    # When every buffer is lent out, #acquire returns nil so the caller
+    # allocates a new String instead, and the miss is counted.  Safe to call
+    # from multiple threads.
+    class FrameRing
+      attr_reader :count, :size
+
+      # Preallocates +count+ buffers of +size+ bytes (one packed depth frame
+      # by default).
+      def initialize(count: 4, size: 640 * 480 * 11 / 8)
+        raise ArgumentError, "Frame buffer count must be a positive Integer, not #{count.inspect}" unless count.is_a?(Integer) && count >= 1
+
+        @count = count
+        @size = size
+        @buffers = Array.new(count) { "\x00".b * size }
+        @free = @buffers.dup
+        @misses = 0
+        @lock = Mutex.new
+      end
+
+      # Returns an idle buffer for a frame of +length+ bytes, or nil if every
+      # buffer is lent out or +length+ is not the ring's buffer size.
+      def acquire(length = @size)
+        return nil unless length == @size
+
+        @lock.synchronize do
+          @misses += 1 if @free.empty?
+          @free.pop
+        end
+      end
+
+      # Calls #acquire, for use as Kinutils::LineDecoder's frame_buffer:.
+      def call(_type, length)
+        acquire(length)
+      end
+
+      # Returns a buffer obtained from #acquire so it can be reused.  Returns
+      # false (and does nothing) if +buffer+ is not one of this ring's lent
+      # buffers, e.g. a String allocated after a miss.
+      def release(buffer)
+        @lock.synchronize do
+          return false unless @buffers.any? { |b| b.equal?(buffer) }
+          return false if @free.any? { |b| b.equal?(buffer) }
+
+          @free.push(buffer)
+          true
+        end
+      end
+
+      # Returns the number of idle buffers.
+      def available
+        @lock.synchronize { @free.length }
+      end
+
+      # Returns the number of times #acquire found no idle buffer.
+      def misses
+        @lock.synchronize { @misses }
+      end
+    end
+  end
+end
@@ -0,0 +1,191 @@
+module NL
+  module KndClient
+    # Decides which depth or video frames reach a consumer when frames arrive
+    # faster than they can be processed.  Frames wait in a short queue between
+    # a producer (e.g. a client's read loop) and a consumer, and the mode
+    # chooses what happens when the queue is full:
+    #
+    # :latest_only - Only the newest frame waits; it replaces any older one.
+    # :drop_oldest - Up to +capacity+ frames wait; the oldest is dropped to
+    #                make room for a new one.
+    # :block       - Up to +capacity+ frames wait; #push waits for room, so
+    #                the producer slows to the consumer's pace.
+    #
+    # The time each frame spends waiting is kept in a histogram, and dropped
+    # frames are counted (see #stats).  Safe to call from multiple threads.
+    #
+    # Example:
+    #     frames = NL::KndClient::FrameScheduler.new(mode: :latest_only)
+    #     Thread.new { while (frame, _wait = frames.shift(true)) do process(frame) end }
+    #     frames.push(data)
+    class FrameScheduler
+      MODES = [:latest_only, :drop_oldest, :block].freeze
+
+      attr_reader :mode, :capacity
+
+      # Initializes a scheduler with the given +mode+ (see MODES) that holds
+      # up to +capacity+ waiting frames (1 for :latest_only, which is also the
+      # default; 2 by default for the other modes).  The optional block is
+      # called with each frame that is dropped or discarded by #close, e.g. to
+      # return its buffer to a FrameRing.
+      def initialize(mode: :latest_only, capacity: nil, &on_drop)
+        raise ArgumentError, "Unknown frame scheduling mode #{mode.inspect} (expected one of #{MODES.inspect})" unless MODES.include?(mode)
+
+        capacity ||= mode == :latest_only ? 1 : 2
+        raise ArgumentError, "Frame queue capacity must be a positive Integer, not #{capacity.inspect}" unless capacity.is_a?(Integer) && capacity >= 1
+        raise ArgumentError, "Frame queue capacity must be 1 for :latest_only (got #{capacity})" if mode == :latest_only && capacity != 1
+
+        @mode = mode
+        @capacity = capacity
+
+        @lock = Mutex.new
+        @not_empty = ConditionVariable.new
+        @not_full = ConditionVariable.new
+        @frames = [] # [frame, monotonic time in ns] pairs
+        @closed = false
+        @on_drop = on_drop
+
+        @pushed = 0
+        @delivered = 0
+        @dropped = 0
+        @queue_time = LatencyCollector::Histogram.new
+      end
+
+      # Adds a frame to the queue.  In :latest_only and :drop_oldest modes
+      # this never waits; the oldest waiting frames are dropped to make room.
+      # In :block mode a full queue makes this wait for room, or return false
+      # without adding the frame if +wait+ is false.  Also returns false if the
+      # scheduler is closed.  Returns true if the frame was added.
+      def push(frame, wait: true)
+        @lock.synchronize do
+          return false if @closed
+
+          if @frames.length >= @capacity
+            if @mode == :block
+              return false unless wait
+              @not_full.wait(@lock) while @frames.length >= @capacity && !@closed
+              return false if @closed
+            else
+              drop(@frames.shift(@frames.length - @capacity + 1))
+            end
+          end
+
+          @frames << [frame, clock_ns]
+          @pushed += 1
+          @not_empty.signal
+          true
+        end
+      end
+
+      # Removes the oldest waiting frame and returns it with the number of
+      # seconds it waited, as [frame, seconds].  Returns nil if no frame is
+      # waiting, unless +wait+ is true, in which case this waits for a frame
+      # and only returns nil once the scheduler is closed.
+      def shift(wait = false)
+        @lock.synchronize do
+          @not_empty.wait(@lock) while wait && @frames.empty? && !@closed
+          return nil if @frames.empty?
+
+          frame, start = @frames.shift
+          ns = clock_ns - start
+          @queue_time.record(ns)
+          @delivered += 1
+          @not_full.signal
+
+          [frame, ns / 1_000_000_000.0]
+        end
+      end
+
+      # Returns the number of frames waiting.
+      def size
+        @lock.synchronize { @frames.length }
+      end
+
+      # Returns true if no frames are waiting.
+      def empty?
+        size == 0
+      end
+
+      # Returns true if the next #push will drop a frame or (in :block mode)
+      # have to wait.
+      def full?
+        size >= @capacity
+      end
+
+      # Returns the number of frames dropped to make room for newer ones.
+      def dropped
+        @lock.synchronize { @dropped }
+      end
+
+      # Discards any waiting frames and wakes threads waiting in #push or
+      # #shift.  Later pushes are refused.
+      def close
+        frames = @lock.synchronize do
+          @closed = true
+          @not_empty.broadcast
+          @not_full.broadcast
+          @frames.slice!(0..-1)
+        end
+
+        frames.each do |frame, _| @on_drop.call(frame) end if @on_drop
+        nil
+      end
+
+      # Returns true if #close has been called.
+      def closed?
+        @closed
+      end
+
+      # Returns a Hash with the :mode, the number of frames :pushed,
+      # :delivered, and :dropped, the number :waiting now, and a :queue_time
+      # Hash of :count,
+      # :mean, :p50, :p90, :p99, and :max milliseconds that delivered frames
+      # waited, like LatencyCollector#snapshot.  If +reset+ is true, the
+      # counters and histogram are cleared.
+      def stats(reset: false)
+        @lock.synchronize do
+          h = @queue_time
+          result = {
+            mode: @mode,
+            pushed: @pushed,
+            delivered: @delivered,
+            dropped: @dropped,
+            waiting: @frames.length,
+            queue_time: {
+              count: h.count,
+              mean: ms(h.mean),
+              p50: ms(h.percentile(50)),
+              p90: ms(h.percentile(90)),
+              p99: ms(h.percentile(99)),
+              max: ms(h.max),
+            },
+          }
+
+          if reset
+            @pushed = @delivered = @dropped = 0
+            @queue_time = LatencyCollector::Histogram.new
+          end
+
+          result
+        end
+      end
+
+      private
+
+      # Counts dropped [frame, time] pairs and passes the frames to the
+      # on_drop block.
+      def drop(entries)
+        @dropped += entries.length
+        entries.each do |frame, _| @on_drop.call(frame) end if @on_drop
+      end
+
+      def clock_ns
+        Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+      end
+
+      def ms(ns)
+        (ns / 1_000_000.0).round(3)
+      end
+    end
+  end
+end
@@ -0,0 +1,194 @@
+module NL
+  module KndClient
+    # Collects per-stage latency histograms for code wrapped by
+    # EMKndClient.bench (see EMKndClient.collect_latency), along with counts
+    # of frames waiting to be processed.  Safe to call from multiple threads.
+    #
+    # Example:
+    #     collector = NL::KndClient::LatencyCollector.new
+    #     collector.call('unpack', -> { ctx.unpack(data) })
+    #     collector.snapshot['unpack'][:p99] # => milliseconds
+    class LatencyCollector
+      # A log-linear histogram of nanosecond durations, in the style of
+      # HdrHistogram.  Each power of two is split into 2**SUB_BITS buckets, so
+      # recorded values keep SUB_BITS + 1 significant bits (within 1/16, or
+      # 6.25%) no matter how large they are.
+      class Histogram
+        SUB_BITS = 4
+        SUB_COUNT = 1 << SUB_BITS
+
+        attr_reader :count, :max, :total
+
+        def initialize
+          @counts = []
+          @count = 0
+          @total = 0
+          @max = 0
+        end
+
+        # Adds a duration in nanoseconds.
+        def record(ns)
+          ns = 0 if ns < 0
+          i = Histogram.index(ns)
+          @counts[i] = (@counts[i] || 0) + 1
+          @count += 1
+          @total += ns
+          @max = ns if ns > @max
+        end
+
+        # Returns the smallest recorded value (within the histogram's
+        # precision) that +pct+ percent of values are at or below, in
+        # nanoseconds, or 0 if nothing was recorded.
+        def percentile(pct)
+          return 0 if @count == 0
+
+          target = [(pct * @count / 100.0).ceil, 1].max
+          seen = 0
+          @counts.each_with_index do |c, i|
+            next unless c
+            seen += c
+            return [Histogram.highest(i), @max].min if seen >= target
+          end
+
+          @max
+        end
+
+        # Returns the mean duration in nanoseconds.
+        def mean
+          @count == 0 ? 0 : @total / @count
+        end
+
+        # Returns the bucket index for a value.  Values below 2 * SUB_COUNT get
+        # their own bucket.
+        def self.index(ns)
+          shift = ns.bit_length - SUB_BITS - 1
+          return ns if shift <= 0
+          (shift << SUB_BITS) + (ns >> shift)
+        end
+
+        # Returns the largest value that falls into the bucket at +index+.
+        def self.highest(index)
+          return index if index < 2 * SUB_COUNT
+          shift = (index >> SUB_BITS) - 1
+          (((index & (SUB_COUNT - 1)) + SUB_COUNT + 1) << shift) - 1
+        end
+      end
+
+      def initialize
+        @lock = Mutex.new
+        @stages = {}
+        @behind = {}
+        @reporter = nil
+      end
+
+      # Times +block+ as the stage +name+ using the monotonic clock and returns
+      # its value.  This matches the interface of the block given to
+      # EMKndClient.on_bench, so a collector can be used in its place.
+      def call(name, block)
+        start = Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+        begin
+          block.call
+        ensure
+          record(name, Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond) - start)
+        end
+      end
+
+      # Adds a duration in nanoseconds to the stage +name+.
+      def record(name, ns)
+        @lock.synchronize do
+          (@stages[name] ||= Histogram.new).record(ns)
+        end
+      end
+
+      # Adds +delta+ to the number of frames waiting for +name+, e.g. +1 when
+      # a frame arrives and -1 when it has been processed.  The highest count
+      # since the last reset is kept as well.
+      def behind(name, delta)
+        @lock.synchronize do
+          counter = (@behind[name] ||= { behind: 0, max_behind: 0 })
+          counter[:behind] += delta
+          counter[:max_behind] = counter[:behind] if counter[:behind] > counter[:max_behind]
+        end
+      end
+
+      # Returns a Hash of stage names to Hashes of :count, :mean, :p50, :p90,
+      # :p99, and :max (in milliseconds), and/or :behind and :max_behind for
+      # frame counts.  If +reset+ is true, histograms and maximums are cleared
+      # (current frame counts are kept).
+      def snapshot(reset: false)
+        @lock.synchronize do
+          result = {}
+
+          @stages.each do |name, h|
+            result[name] = {
+              count: h.count,
+              mean: ms(h.mean),
+              p50: ms(h.percentile(50)),
+              p90: ms(h.percentile(90)),
+              p99: ms(h.percentile(99)),
+              max: ms(h.max),
+            }
+          end
+
+          @behind.each do |name, counter|
+            (result[name] ||= {}).merge!(counter)
+          end
+
+          if reset
+            @stages = {}
+            @behind.each_value do |counter|
+              counter[:max_behind] = counter[:behind]
+            end
+          end
+
+          result
+        end
+      end
+
+      # Clears all histograms and maximums.
+      def reset
+        snapshot(reset: true)
+        nil
+      end
+
+      # Starts a thread that calls +block+ with a snapshot every +interval+
+      # seconds, resetting the histograms each time, until #stop is called.
+      def report_every(interval, &block)
+        stop
+        @reporter = Thread.new do
+          loop do
+            sleep interval
+            begin
+              block.call(snapshot(reset: true))
+            rescue => e
+              EMKndClient.log "Error reporting latency: #{e}" if defined?(EMKndClient)
+            end
+          end
+        end
+        self
+      end
+
+      # Stops periodic reporting started by #report_every.
+      def stop
+        @reporter&.kill
+        @reporter = nil
+      end
+
+      # Formats a snapshot as one line per stage, slowest p99 first.
+      def self.format(snapshot)
+        snapshot.sort_by { |_, s| -(s[:p99] || 0) }.map { |name, s|
+          parts = []
+          parts << "#{s[:count]} calls, p50 #{s[:p50]}ms, p90 #{s[:p90]}ms, p99 #{s[:p99]}ms, max #{s[:max]}ms" if s[:count]
+          parts << "#{s[:behind]} frames behind (max #{s[:max_behind]})" if s[:behind]
+          "#{name}: #{parts.join('; ')}"
+        }.join("\n")
+      end
+
+      private
+
+      def ms(ns)
+        (ns / 1_000_000.0).round(3)
+      end
+    end
+  end
+end
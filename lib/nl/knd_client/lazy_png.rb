@@ -0,0 +1,81 @@
+require 'zlib'
+require 'nl/fast_png'
+
+module NL
+  module KndClient
+    # A grayscale image that keeps its raw pixels and is only encoded as a PNG
+    # the first time #png is called, so images nobody fetches are never
+    # compressed.  The encoded PNG is cached, and concurrent callers share a
+    # single encoding.
+    class LazyPng
+      PNG_SIGNATURE = "\x89PNG\r\n\x1a\n".b.freeze
+
+      @level = nil
+
+      class << self
+        # The zlib compression level (0-9) for encoding, or nil (the default)
+        # to use NL::FastPng's compression.
+        attr_reader :level
+
+        # Sets the zlib compression level (0-9) for encoding images, or nil to
+        # use NL::FastPng.  Low levels (e.g. 1) encode much faster than
+        # NL::FastPng at the cost of larger PNGs.
+        def level=(level)
+          raise ArgumentError, "PNG compression level must be nil or 0..9, not #{level.inspect}" unless level.nil? || (0..9).include?(level)
+          @level = level
+        end
+      end
+
+      attr_reader :width, :height, :depth, :sequence
+
+      # Copies +data+, +width+ x +height+ pixels of +depth+ (8 or 16) bits,
+      # with 16-bit samples in native byte order.  The optional +sequence+
+      # identifies the frame the image came from.
+      def initialize(width, height, depth, data, sequence = nil)
+        @width = width
+        @height = height
+        @depth = depth
+        @sequence = sequence
+
+        # Appending forces a copy, so the source buffer may be reused
+        @data = ''.b << data
+        @png = nil
+        @lock = Mutex.new
+      end
+
+      # Returns the image as PNG data, encoding it if this is the first call.
+      def png
+        @png || @lock.synchronize do
+          @png ||= encode.tap { @data = nil }
+        end
+      end
+
+      # Returns true if the PNG has already been encoded.
+      def encoded?
+        !@png.nil?
+      end
+
+      private
+
+      def encode
+        level = LazyPng.level
+        return NL::FastPng.store_png(@width, @height, @depth, @data) if level.nil?
+
+        # PNG samples are big-endian
+        data = @depth == 16 ? @data.unpack('S*').pack('n*') : @data
+        stride = @width * @depth / 8
+        filter = "\x00".b
+        raw = (0...@height).map { |y| filter + data.byteslice(y * stride, stride) }.join
+
+        PNG_SIGNATURE +
+          chunk('IHDR', [@width, @height, @depth, 0, 0, 0, 0].pack('NNCCCCC')) +
+          chunk('IDAT', Zlib::Deflate.deflate(raw, level)) +
+          chunk('IEND', ''.b)
+      end
+
+      def chunk(type, data)
+        [data.bytesize].pack('N') + type + data + [Zlib.crc32(type + data)].pack('N')
+      end
+    end
+  end
+end
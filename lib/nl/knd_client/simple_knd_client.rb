@@ -6,17 +6,55 @@ module NL
     # without EventMachine.  This client does not (yet) support all of KND's
     # features.
     class SimpleKndClient
-      def initialize(host: 'localhost', port: 14308)
+      # Depth frames are passed to callbacks on a separate thread from the
+      # one reading from KND.  The +frame_mode+ and +frame_backlog+ control
+      # what happens when callbacks fall behind (see FrameScheduler); by
+      # default callbacks only ever see the newest frame.  Use :block to
+      # receive every frame (e.g. for #record_depth) by slowing down reads.
+      #
+      # Depth frames are read into a FrameRing of +frame_buffers+
+      # preallocated buffers, and callbacks are given a borrowed buffer that
+      # is reused once every callback has returned.  Callbacks that keep a
+      # frame must copy it (String#dup), or set +copy_frames+ to give every
+      # callback its own copy.
+      #
+      # If +publish+ is a shared memory name (e.g. '/knd-frames'), the client
+      # subscribes to depth frames when opened, unpacks and plots every
+      # frame it processes, and publishes the results to a
+      # Kinutils::FramePublisher ring of +publish_slots+ frames, so other
+      # processes on the host can read them with Kinutils::SharedFrames
+      # instead of connecting to KND themselves.
+      def initialize(host: 'localhost', port: 14308, frame_mode: :latest_only, frame_backlog: nil, frame_buffers: 4, copy_frames: false,
+                     publish: nil, publish_slots: 4)
         @host = host
-        @port = 14308
+        @port = port
 
         @callbacks = {}
         @zones = {}
+
+        @frame_mode = frame_mode
+        @frame_backlog = frame_backlog
+        @frame_buffers = frame_buffers
+        @copy_frames = copy_frames
+        @frame_ring = FrameRing.new(count: frame_buffers)
+        @depth_frames = new_frame_scheduler
+
+        @publish = publish
+        @publish_slots = publish_slots
+        @publisher = nil
+        @publish_context = nil
+      end
+
+      # Returns FrameScheduler#stats for depth frames, including the number
+      # dropped and how long frames waited for the callbacks.
+      def frame_stats(reset: false)
+        @depth_frames.stats(reset: reset)
       end
 
       # Calls the given block with the current full state of a zone, the type of
       # command received for a zone, and the updates for the zone.  '! DEPTH' is a
-      # special zone name for depth images [HACK].
+      # special zone name for depth images [HACK], whose data is only valid
+      # until the block returns (see #initialize).
       def on_zone(name, &block)
         @callbacks[name] ||= []
         @callbacks[name] << block
@@ -32,17 +70,35 @@ module NL
       def open
         @socket = TCPSocket.new(@host, @port)
         @run = true
+        if @depth_frames.closed?
+          # A frame read partway when the last connection closed never
+          # returns to the old ring
+          @frame_ring = FrameRing.new(count: @frame_buffers)
+          @depth_frames = new_frame_scheduler
+        end
+        if @publish
+          @publisher ||= Kinutils::FramePublisher.new(@publish, slots: @publish_slots)
+          @publish_context ||= Kinutils::FrameContext.new
+        end
         @t = Thread.new do read_loop end
+        @frame_thread = Thread.new do frame_loop end
         @socket.puts('sub')
+        subscribe_depth if @publisher
       end
 
       # Close the connection to KND and stop the background thread.
       def close
+        stop_recording
         @run = false
+        @depth_frames.close
         @t&.wakeup
         @t&.kill
+        @frame_thread&.kill unless @frame_thread == Thread.current
         @socket&.close
+        @publisher&.close
+        @publisher = nil
         @t = nil
+        @frame_thread = nil
         @socket = nil
       end
 
@@ -64,7 +120,7 @@ module NL
         data = nil
         t = Thread.current
 
-        cb = ->(d) { data = d; t.wakeup }
+        cb = ->(d) { data = d.dup; t.wakeup }
         on_zone('! DEPTH', &cb)
 
         request_depth
@@ -77,42 +133,108 @@ module NL
         remove_callback('! DEPTH', &cb)
       end
 
+      # Subscribes to depth frames and writes each one to a new
+      # Kinutils::Recorder at +path+ until #stop_recording is called.  The
+      # optional +count+ limits the number of frames KND will send.  Returns
+      # the Recorder.
+      def record_depth(path, count = nil)
+        stop_recording
+
+        @recorder = Kinutils::Recorder.new(path)
+        @record_cb = ->(d) { @recorder&.add(d) }
+        on_zone('! DEPTH', &@record_cb)
+        subscribe_depth(count)
+
+        @recorder
+      end
+
+      # Stops a recording started by #record_depth and writes its index.
+      def stop_recording
+        return unless @recorder
+
+        remove_callback('! DEPTH', &@record_cb)
+        recorder = @recorder
+        @recorder = nil
+        @record_cb = nil
+        recorder.close
+      end
+
       private
 
       def read_loop
+        decoder = Kinutils::LineDecoder.new(frame_buffer: @frame_ring)
+        data = String.new
+
         while @run do
-          line = @socket.readline
+          @socket.readpartial(65536, data)
 
-          begin
-            type = line.split(' - ', 2).first
+          decoder.feed(data) do |type, value, extra|
+            begin
+              case type
+              when :depth
+                @frame_ring.release(value) unless @depth_frames.push(value)
 
-            case type
-            when 'DEL', 'OK'
-              next
+              when :sub, :add
+                update_zone(value.kin_kvp(symbolize_keys: true))
 
-            when 'DEPTH'
-              num_bytes = line.gsub(/\A[^0-9]*(\d+)[^0-9]*\z/, '\1').to_i
-              data = @socket.read(num_bytes)
-              @callbacks['! DEPTH']&.each do |cb|
-                cb.call(data) rescue puts "Error calling depth callback: #{MB::Sound::U.syntax($!.inspect)}"
+              when :bright
+                update_zone(name: value, bright: extra)
               end
 
-            else
-              kvp = line.kin_kvp(symbolize_keys: true)
-              name = kvp[:name] || (raise "No zone name was found")
-              @zones[name] ||= {}
-              @zones[name].merge!(kvp)
-
-              @callbacks[kvp[:name]]&.each do |cb|
-                cb.call(@zones[name]) rescue puts "Error calling callback: #{MB::Sound::U.syntax($!)}\n\t#{MB::Sound::U.syntax($!.backtrace.join("\n\t"))}"
-              end
+            rescue => e
+              puts "Error handling #{type} message #{value.inspect}: #{MB::Sound::U.syntax(e)}"
             end
+          end
+        end
+      end
 
-          rescue => e
-            puts "Error parsing line '#{line}': #{MB::Sound::U.syntax(e)}"
+      # Passes depth frames from the read loop to the depth callbacks, then
+      # returns their buffers to the ring.
+      def frame_loop
+        while (frame = @depth_frames.shift(true)) do
+          data = frame[0]
+          begin
+            publish_frame(data) if @publisher
+
+            @callbacks['! DEPTH']&.each do |cb|
+              cb.call(@copy_frames ? data.dup : data) rescue puts "Error calling depth callback: #{MB::Sound::U.syntax($!.inspect)}"
+            end
+          ensure
+            @frame_ring.release(data)
           end
         end
       end
+
+      # Unpacks and plots a depth frame and copies the results to the shared
+      # memory ring (see +publish+ in #initialize).
+      def publish_frame(data)
+        ctx = @publish_context
+        ctx.unpack(data)
+        ctx.plot_views(data, :linear, :overhead, :side, :front)
+        @publisher.publish(data, depth: ctx.depth, linear: ctx.linear, overhead: ctx.overhead, side: ctx.side, front: ctx.front)
+      rescue => e
+        puts "Error publishing depth frame: #{MB::Sound::U.syntax(e)}"
+      end
+
+      # Returns a FrameScheduler for depth frames that returns dropped frames
+      # to the ring.
+      def new_frame_scheduler
+        FrameScheduler.new(mode: @frame_mode, capacity: @frame_backlog) do |data|
+          @frame_ring.release(data)
+        end
+      end
+
+      # Merges +kvp+ into the state of the zone it names and calls the zone's
+      # callbacks.
+      def update_zone(kvp)
+        name = kvp[:name] || (raise "No zone name was found")
+        @zones[name] ||= {}
+        @zones[name].merge!(kvp)
+
+        @callbacks[name]&.each do |cb|
+          cb.call(@zones[name]) rescue puts "Error calling callback: #{MB::Sound::U.syntax($!)}\n\t#{MB::Sound::U.syntax($!.backtrace.join("\n\t"))}"
+        end
+      end
     end
   end
 end
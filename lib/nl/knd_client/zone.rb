@@ -44,10 +44,10 @@ module NL
 
       @@name_params = @@param_names.invert.freeze
 
-      # Merges with the other Hash or Zone, then converts known keys into
-      # their expected types.
+      # Merges with the other Hash, Zone, or CompactZone, then converts known
+      # keys into their expected types.
       def merge_zone other
-        merge! other
+        merge!(other.is_a?(Kinutils::CompactZone) ? other.to_h : other)
         normalize! unless other.is_a? Zone
         self
       end
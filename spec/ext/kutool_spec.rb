@@ -0,0 +1,46 @@
+require 'open3'
+
+RSpec.describe('ext/kutool') do
+  ext = File.expand_path('../../ext', __dir__)
+  packed_frame = 640 * 480 * 11 / 8
+
+  before(:all) do
+    built = File.directory?(ext) && system('make', '-s', '-C', ext, 'kutool', 'unpack', out: File::NULL, err: File::NULL)
+    skip 'The command-line tools could not be built' unless built
+  end
+
+  # Runs the unpack tool with the given input and arguments, returning its
+  # output, or raising if it fails or does not finish.
+  def unpack(ext, input, *args)
+    Open3.popen2(File.join(ext, 'unpack'), *args) do |stdin, stdout, wait|
+      stdin.binmode
+      stdout.binmode
+      writer = Thread.new { stdin.write(input) rescue nil; stdin.close }
+      reader = Thread.new { stdout.read }
+
+      unless wait.join(10)
+        Process.kill(:KILL, wait.pid)
+        reader.kill
+        raise 'unpack did not finish'
+      end
+
+      writer.join
+      raise "unpack exited with #{wait.value.exitstatus}" unless wait.value.success?
+      reader.value
+    end
+  end
+
+  it 'unpacks whole frames' do
+    data = Random.new(9).bytes(packed_frame * 2)
+    expect(unpack(ext, data)).to eq(NL::KndClient::Kinutils.unpack11_to_16(data))
+  end
+
+  it 'stops after a truncated last frame' do
+    [packed_frame - 10, packed_frame - 1, packed_frame * 2 - 1].each do |len|
+      data = Random.new(len).bytes(len)
+      padded = data + "\x00" * (-len % 11)
+
+      expect(unpack(ext, data)).to eq(NL::KndClient::Kinutils.unpack11_to_16(padded))
+    end
+  end
+end
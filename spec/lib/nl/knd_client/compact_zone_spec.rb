@@ -0,0 +1,90 @@
+RSpec.describe(NL::KndClient::CompactZone) do
+  let(:line) {
+    'xmin=-1000 ymin=-500 zmin=1000 xmax=1000 ymax=500 zmax=3000 px_xmin=100 px_ymin=80 px_zmin=400 ' \
+      'px_xmax=540 px_ymax=400 px_zmax=900 pop=1200 maxpop=140800 xc=500 yc=400 zc=300 sa=80 ' \
+      'occupied=1 negate=0 param=pop on_level=1000 off_level=900 on_delay=0 off_delay=2 name="Zone 1" version=2'
+  }
+  let(:zone) { NL::KndClient::CompactZone.new(line) }
+
+  describe '#initialize' do
+    it 'parses key-value lines the same way as Kinutils.parse_zone_list' do
+      expect(zone.to_h).to eq(NL::KndClient::Kinutils.parse_zone_list(line)[0])
+      expect(zone).to eq(NL::KndClient::Kinutils.parse_zone_list(line)[0])
+      expect(zone['name']).to eq('Zone_1')
+      expect(zone['occupied']).to eq(true)
+      expect(zone['version']).to eq(2)
+    end
+
+    it 'converts version 1 zones to millimeters' do
+      z = NL::KndClient::CompactZone.new('xmin=-0.5 zmax=2.25 name=old version=1')
+      expect(z['xmin']).to eq(-500)
+      expect(z['zmax']).to eq(2250)
+    end
+
+    it 'normalizes Hashes' do
+      z = NL::KndClient::CompactZone.new('xmin' => '12', :negate => 'true', 'occupied' => 1, 'param' => 'bogus', 'other' => :x)
+      expect(z.to_h).to eq('xmin' => 12, 'negate' => true, 'occupied' => true, 'other' => :x)
+    end
+  end
+
+  describe '#merge_kvp' do
+    it 'updates only the attributes on the line' do
+      zone.merge_kvp('occupied=0 pop=5 sa=3 name="Zone 1"')
+      expect(zone['pop']).to eq(5)
+      expect(zone['occupied']).to eq(false)
+      expect(zone['xmin']).to eq(-1000)
+      expect(zone.size).to eq(27)
+    end
+  end
+
+  describe '#merge_zone' do
+    it 'merges CompactZones, Zone results, and Hashes' do
+      zone.merge_zone(NL::KndClient::CompactZone.new('pop=7 name="Zone 1"'))
+      expect(zone['pop']).to eq(7)
+
+      zone.merge_zone('pop' => 9, 'occupied' => false)
+      expect(zone['pop']).to eq(9)
+      expect(zone['occupied']).to eq(false)
+    end
+
+    it 'normalizes Hashes the same way as Zone#merge_zone' do
+      attrs = { 'version' => 1, 'xmin' => '0.5', 'zmax' => 2.25, 'name' => "Back door,\tleft" }
+      zone.merge_zone(attrs)
+      expect(zone['xmin']).to eq(500)
+      expect(zone['zmax']).to eq(2250)
+      expect(zone['name']).to eq('Back_door_left')
+      expect(attrs['name']).to eq("Back door,\tleft")
+
+      zone.merge_zone(xmax: '1.5')
+      expect(zone['xmax']).to eq(1500)
+    end
+  end
+
+  describe 'Hash compatibility' do
+    it 'supports key lookup, deletion, and iteration' do
+      expect(zone.key?('pop')).to eq(true)
+      expect(zone[:pop]).to eq(1200)
+      expect(zone['missing']).to eq(nil)
+
+      expect(zone.delete('pop')).to eq(1200)
+      expect(zone.include?('pop')).to eq(false)
+      expect(zone.keys).not_to include('pop')
+      expect(zone.map { |k, _| k }).to eq(zone.keys)
+
+      zone['bright'] = '42'
+      expect(zone['bright']).to eq(42)
+    end
+
+    it 'copies on dup' do
+      copy = zone.dup
+      copy['pop'] = 1
+      expect(zone['pop']).to eq(1200)
+    end
+
+    it 'can be added to a Kinutils::ZoneSet' do
+      set = NL::KndClient::Kinutils::ZoneSet.new
+      set.set(zone['name'], zone)
+      expect(set.names).to eq(['Zone_1'])
+    end
+  end
+end
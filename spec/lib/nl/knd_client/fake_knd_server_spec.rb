@@ -0,0 +1,81 @@
+RSpec.describe(NL::KndClient::FakeKndServer) do
+  let(:zones) {
+    { 'Wall' => { 'xmin' => -3000, 'ymin' => -3000, 'zmin' => 100, 'xmax' => 3000, 'ymax' => 3000, 'zmax' => 5000 } }
+  }
+  let(:server) { NL::KndClient::FakeKndServer.new(port: 0, fps: 100, count: 50, zones: zones, zone_rate: 0).start }
+  let(:socket) { TCPSocket.new('localhost', server.port) }
+
+  after(:each) do
+    socket.close rescue nil
+    server.stop
+  end
+
+  def command(cmd)
+    socket.puts(cmd)
+    socket.gets.chomp
+  end
+
+  it 'answers the commands EMKndClient sends at startup' do
+    expect(command('ver')).to eq('OK - Version 2')
+    expect(command('fps')).to eq('OK - 100')
+    expect(command('sub')).to start_with('OK - ')
+
+    expect(command('zones')).to eq('OK - 1 zones, 0 occupied')
+    expect(socket.gets.kin_kvp).to include('name' => 'Wall', 'xmin' => -3000, 'zmax' => 5000)
+  end
+
+  it 'sends depth frames with a DEPTH header' do
+    expect(command('getdepth')).to start_with('OK - ')
+    expect(socket.gets).to eq("DEPTH - #{NL::KndClient::FakeKndServer::DEPTH_SIZE} bytes of raw depth data follow\n")
+
+    data = socket.read(NL::KndClient::FakeKndServer::DEPTH_SIZE)
+    expect(NL::KndClient::Kinutils.plot_linear11(data).bytesize).to eq(640 * 480)
+  end
+
+  it 'serves the given frames in a loop' do
+    frames = [
+      "\x12".b * NL::KndClient::FakeKndServer::DEPTH_SIZE,
+      "\x34".b * NL::KndClient::FakeKndServer::DEPTH_SIZE,
+    ]
+    server = NL::KndClient::FakeKndServer.new(port: 0, frames: frames, fps: 100, zone_rate: 0).start
+    socket = TCPSocket.new('localhost', server.port)
+
+    socket.puts('subdepth 3')
+    expect(socket.gets).to start_with('OK - ')
+    received = 3.times.map {
+      expect(socket.gets).to start_with('DEPTH - ')
+      socket.read(NL::KndClient::FakeKndServer::DEPTH_SIZE)
+    }
+    expect(received - frames).to eq([])
+    expect(received[0]).not_to eq(received[1])
+    expect(received[2]).to eq(received[0])
+  ensure
+    socket&.close
+    server&.stop
+  end
+
+  it 'stops producing frames after the frame count' do
+    expect(server.wait(5)).to eq(true)
+    expect(server.frame_count).to eq(50)
+    expect(command('fps')).to eq('OK - 0')
+  end
+
+  it 'sends ADD, SUB, and DEL lines to subscribers as zones change' do
+    command('sub')
+
+    socket.puts('addzone Door,0,0,1000,500,2000,1500')
+    expect(socket.gets).to start_with('ADD - ')
+    expect(socket.gets).to eq("OK - Zone Door added\n")
+
+    socket.puts('setzone Door,xmax,600')
+    expect(socket.gets.split(' - ', 2).last.kin_kvp).to include('name' => 'Door', 'xmax' => 600)
+    expect(socket.gets).to eq("OK - Zone Door updated\n")
+
+    socket.puts('rmzone Door')
+    expect(socket.gets).to eq("DEL - Door\n")
+    expect(socket.gets).to eq("OK - Zone Door removed\n")
+
+    expect(command('rmzone Door')).to start_with('ERR - ')
+    expect(command('nonsense')).to start_with('ERR - ')
+  end
+end
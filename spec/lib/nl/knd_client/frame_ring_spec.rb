@@ -0,0 +1,40 @@
+RSpec.describe(NL::KndClient::FrameRing) do
+  let(:ring) { NL::KndClient::FrameRing.new(count: 2, size: 16) }
+
+  it 'lends out each preallocated buffer once until it is released' do
+    a = ring.acquire(16)
+    b = ring.acquire(16)
+    expect(a).not_to equal(b)
+    expect(ring.acquire(16)).to eq(nil)
+    expect(ring.misses).to eq(1)
+
+    expect(ring.release(a)).to eq(true)
+    expect(ring.release(a)).to eq(false)
+    expect(ring.acquire(16)).to equal(a)
+  end
+
+  it 'only lends buffers for frames of its size' do
+    expect(ring.acquire(15)).to eq(nil)
+    expect(ring.available).to eq(2)
+    expect(ring.release('x' * 16)).to eq(false)
+  end
+
+  it 'receives frames from a LineDecoder without reallocating' do
+    decoder = NL::KndClient::Kinutils::LineDecoder.new(frame_buffer: ring)
+    frames = []
+
+    decoder.feed("DEPTH - 16\n#{'a' * 16}DEPTH - 16\n#{'b' * 8}") { |_, value, _| frames << value }
+    decoder.feed('b' * 8) { |_, value, _| frames << value }
+
+    expect(frames).to eq(['a' * 16, 'b' * 16])
+    expect(frames.map(&:encoding)).to all(eq(Encoding::BINARY))
+    expect(ring.available).to eq(0)
+
+    kept = frames[0].dup
+    ring.release(frames[0])
+    decoder.feed("DEPTH - 16\n#{'c' * 16}") { |_, value, _| frames << value }
+    expect(frames[2]).to equal(frames[0])
+    expect(frames[2]).to eq('c' * 16)
+    expect(kept).to eq('a' * 16)
+  end
+end
@@ -0,0 +1,74 @@
+RSpec.describe(NL::KndClient::FrameScheduler) do
+  it 'keeps only the newest frame in :latest_only mode' do
+    frames = NL::KndClient::FrameScheduler.new(mode: :latest_only)
+    expect(frames.push(1)).to eq(true)
+    expect(frames.push(2)).to eq(true)
+    expect(frames.push(3)).to eq(true)
+
+    expect(frames.shift[0]).to eq(3)
+    expect(frames.shift).to eq(nil)
+    expect(frames.dropped).to eq(2)
+  end
+
+  it 'drops the oldest frames beyond its capacity in :drop_oldest mode' do
+    frames = NL::KndClient::FrameScheduler.new(mode: :drop_oldest, capacity: 2)
+    (1..5).each do |f| frames.push(f) end
+
+    expect(frames.size).to eq(2)
+    expect(frames.shift[0]).to eq(4)
+    expect(frames.shift[0]).to eq(5)
+    expect(frames.dropped).to eq(3)
+  end
+
+  it 'refuses or waits for room in :block mode' do
+    frames = NL::KndClient::FrameScheduler.new(mode: :block, capacity: 1)
+    expect(frames.push(1)).to eq(true)
+    expect(frames.push(2, wait: false)).to eq(false)
+    expect(frames).to be_full
+
+    t = Thread.new { frames.push(3) }
+    sleep 0.05
+    expect(t).to be_alive
+
+    expect(frames.shift[0]).to eq(1)
+    expect(t.value).to eq(true)
+    expect(frames.shift[0]).to eq(3)
+    expect(frames.dropped).to eq(0)
+  end
+
+  it 'waits for frames and wakes waiters when closed' do
+    frames = NL::KndClient::FrameScheduler.new
+    t = Thread.new { frames.shift(true) }
+    sleep 0.05
+    frames.push(:a)
+    expect(t.value[0]).to eq(:a)
+
+    t = Thread.new { frames.shift(true) }
+    sleep 0.05
+    frames.close
+    expect(t.value).to eq(nil)
+    expect(frames.push(:b)).to eq(false)
+  end
+
+  it 'reports queue times and counts' do
+    frames = NL::KndClient::FrameScheduler.new(mode: :drop_oldest, capacity: 3)
+    frames.push(1)
+    frames.push(2)
+    sleep 0.01
+    _, wait = frames.shift
+    expect(wait).to be >= 0.01
+
+    stats = frames.stats(reset: true)
+    expect(stats).to include(mode: :drop_oldest, pushed: 2, delivered: 1, dropped: 0, waiting: 1)
+    expect(stats[:queue_time][:count]).to eq(1)
+    expect(stats[:queue_time][:max]).to be >= 10
+
+    expect(frames.stats[:pushed]).to eq(0)
+  end
+
+  it 'rejects unknown modes and invalid capacities' do
+    expect { NL::KndClient::FrameScheduler.new(mode: :newest) }.to raise_error(ArgumentError)
+    expect { NL::KndClient::FrameScheduler.new(mode: :block, capacity: 0) }.to raise_error(ArgumentError)
+    expect { NL::KndClient::FrameScheduler.new(mode: :latest_only, capacity: 2) }.to raise_error(ArgumentError)
+  end
+end
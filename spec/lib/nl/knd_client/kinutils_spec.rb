@@ -1,3 +1,7 @@
+require 'tmpdir'
+require 'open3'
+require 'fileutils'
+
 RSpec.describe(NL::KndClient::Kinutils) do
   describe 'String#kin_kvp' do
     it 'can parse simple key-value pairs with unquoted strings' do
@@ -92,6 +96,44 @@ RSpec.describe(NL::KndClient::Kinutils) do
     pending
   end
 
+  describe 'UNPACK_IMPLS' do
+    let(:frame) { Random.new(11).bytes(640 * 480 * 11 / 8) }
+    let(:odd_size) { Random.new(16).bytes(11 * 37 + 5) }
+
+    before(:each) do
+      @original_impl = NL::KndClient::Kinutils.unpack_impl
+    end
+
+    after(:each) do
+      NL::KndClient::Kinutils.unpack_impl = @original_impl
+    end
+
+    it 'always includes the scalar implementation' do
+      expect(NL::KndClient::Kinutils::UNPACK_IMPLS).to include('scalar')
+      expect(NL::KndClient::Kinutils::UNPACK_IMPLS).to include(NL::KndClient::Kinutils.unpack_impl)
+    end
+
+    it 'raises an error for an unknown implementation' do
+      expect { NL::KndClient::Kinutils.unpack_impl = 'mmx' }.to raise_error(ArgumentError)
+    end
+
+    NL::KndClient::Kinutils::UNPACK_IMPLS.each do |impl|
+      it "produces bit-exact results with the #{impl} implementation" do
+        NL::KndClient::Kinutils.unpack_impl = 'scalar'
+        expected = [frame, odd_size].map { |d|
+          [NL::KndClient::Kinutils.unpack11_to_16(d), NL::KndClient::Kinutils.unpack11_to_16_lut(d)]
+        }
+
+        NL::KndClient::Kinutils.unpack_impl = impl
+        result = [frame, odd_size].map { |d|
+          [NL::KndClient::Kinutils.unpack11_to_16(d), NL::KndClient::Kinutils.unpack11_to_16_lut(d)]
+        }
+
+        expect(result).to eq(expected)
+      end
+    end
+  end
+
   describe '.plot_linear' do
     pending
   end
@@ -108,6 +150,870 @@ RSpec.describe(NL::KndClient::Kinutils) do
     pending
   end
 
+  describe '.plot_views' do
+    let(:depth) { NL::KndClient::Kinutils.unpack11_to_16(Random.new(2).bytes(640 * 480 * 11 / 8)) }
+
+    it 'returns the same images as the individual plot functions' do
+      views = NL::KndClient::Kinutils.plot_views(depth, linear: true, overhead: true, side: true, front: true)
+
+      expect(views[:linear]).to eq(NL::KndClient::Kinutils.plot_linear(depth))
+      expect(views[:overhead]).to eq(NL::KndClient::Kinutils.plot_overhead(depth))
+      expect(views[:side]).to eq(NL::KndClient::Kinutils.plot_side(depth))
+      expect(views[:front]).to eq(NL::KndClient::Kinutils.plot_front(depth))
+    end
+
+    it 'only returns the requested views' do
+      expect(NL::KndClient::Kinutils.plot_views(depth, side: true, front: false).keys).to eq([:side])
+      expect(NL::KndClient::Kinutils.plot_views(depth)).to eq({})
+    end
+
+    it 'raises an error for unknown views' do
+      expect { NL::KndClient::Kinutils.plot_views(depth, top: true) }.to raise_error(ArgumentError)
+    end
+
+    it 'raises an error for short input' do
+      expect { NL::KndClient::Kinutils.plot_views('x' * 100, linear: true) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe 'packed 11-bit plotting' do
+    let(:packed) { Random.new(3).bytes(640 * 480 * 11 / 8) }
+    let(:depth) { NL::KndClient::Kinutils.unpack11_to_16(packed) }
+
+    it 'matches plotting from unpacked 16-bit data' do
+      expect(NL::KndClient::Kinutils.plot_linear11(packed)).to eq(NL::KndClient::Kinutils.plot_linear(depth))
+      expect(NL::KndClient::Kinutils.plot_overhead11(packed)).to eq(NL::KndClient::Kinutils.plot_overhead(depth))
+      expect(NL::KndClient::Kinutils.plot_side11(packed)).to eq(NL::KndClient::Kinutils.plot_side(depth))
+      expect(NL::KndClient::Kinutils.plot_front11(packed)).to eq(NL::KndClient::Kinutils.plot_front(depth))
+    end
+
+    it 'can plot several views at once' do
+      expect(NL::KndClient::Kinutils.plot_views11(packed, overhead: true, front: true)).to eq(
+        NL::KndClient::Kinutils.plot_views(depth, overhead: true, front: true)
+      )
+    end
+
+    it 'raises an error for short input' do
+      expect { NL::KndClient::Kinutils.plot_overhead11('x' * 1000) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe '.unpack_to_world' do
+    let(:packed) { Random.new(7).bytes(640 * 480 * 11 / 8) }
+
+    # Builds the expected points in Ruby, every stride'th pixel.
+    def ruby_points(packed, xstride, ystride)
+      d16 = NL::KndClient::Kinutils.unpack11_to_16_lut(packed).unpack('S*')
+      (0...480).step(ystride).flat_map { |y|
+        (0...640).step(xstride).map { |x|
+          v = d16[y * 640 + x]
+          zw = NL::KndClient::Kinutils::DEPTH_LUT[v]
+          if v < 2047 && zw > 0 && zw <= 32767
+            [NL::KndClient::Kinutils.xworld(x, zw), NL::KndClient::Kinutils.yworld(y, zw), zw]
+          end
+        }
+      }
+    end
+
+    it 'matches xworld/yworld for every valid pixel' do
+      points = NL::KndClient::Kinutils.unpack_to_world(packed).unpack('s*').each_slice(3).to_a
+      expect(points).to eq(ruby_points(packed, 1, 1).compact)
+    end
+
+    it 'writes invalid pixels as zeros when skip_invalid is false' do
+      points = NL::KndClient::Kinutils.unpack_to_world(packed, skip_invalid: false, stride: [11, 15])
+      expect(points.unpack('s*').each_slice(3).to_a).to eq(ruby_points(packed, 11, 15).map { |p| p || [0, 0, 0] })
+    end
+
+    it 'can write planar output' do
+      interleaved = NL::KndClient::Kinutils.unpack_to_world(packed, stride: 3).unpack('s*')
+      planar = NL::KndClient::Kinutils.unpack_to_world(packed, stride: 3, layout: :planar).unpack('s*')
+      expect(planar).to eq(interleaved.each_slice(3).to_a.transpose.flatten)
+    end
+
+    it 'can write float coordinates' do
+      ints = NL::KndClient::Kinutils.unpack_to_world(packed, stride: 5).unpack('s*')
+      floats = NL::KndClient::Kinutils.unpack_to_world(packed, stride: 5, format: :float32_xyz).unpack('f*')
+      expect(floats.size).to eq(ints.size)
+      expect(floats.zip(ints).all? { |f, i| (f - i).abs <= 1 }).to eq(true)
+    end
+
+    it 'raises an error for invalid options' do
+      expect { NL::KndClient::Kinutils.unpack_to_world(packed, format: :int8) }.to raise_error(ArgumentError)
+      expect { NL::KndClient::Kinutils.unpack_to_world(packed, stride: 0) }.to raise_error(ArgumentError)
+      expect { NL::KndClient::Kinutils.unpack_to_world(packed, layout: :columns) }.to raise_error(ArgumentError)
+      expect { NL::KndClient::Kinutils.unpack_to_world('x' * 1000) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe '.plot_threads' do
+    let(:packed) { Random.new(6).bytes(640 * 480 * 11 / 8) }
+    let(:depth) { NL::KndClient::Kinutils.unpack11_to_16(packed) }
+    let(:all_views) { { linear: true, overhead: true, side: true, front: true } }
+
+    after(:each) do
+      NL::KndClient::Kinutils.plot_threads = 1
+    end
+
+    it 'plots serially by default' do
+      expect(NL::KndClient::Kinutils.plot_threads).to eq(1)
+    end
+
+    [2, 3, 8].each do |threads|
+      it "produces bit-exact results with #{threads} threads" do
+        expected = [
+          NL::KndClient::Kinutils.plot_views11(packed, **all_views),
+          NL::KndClient::Kinutils.plot_views(depth, **all_views),
+          NL::KndClient::Kinutils.plot_overhead11(packed),
+          NL::KndClient::Kinutils.plot_front(depth),
+        ]
+
+        NL::KndClient::Kinutils.plot_threads = threads
+        expect(NL::KndClient::Kinutils.plot_threads).to eq(threads)
+
+        result = [
+          NL::KndClient::Kinutils.plot_views11(packed, **all_views),
+          NL::KndClient::Kinutils.plot_views(depth, **all_views),
+          NL::KndClient::Kinutils.plot_overhead11(packed),
+          NL::KndClient::Kinutils.plot_front(depth),
+        ]
+
+        expect(result).to eq(expected)
+      end
+    end
+
+    it 'uses at least one thread when set to 0' do
+      NL::KndClient::Kinutils.plot_threads = 0
+      expect(NL::KndClient::Kinutils.plot_threads).to be >= 1
+    end
+
+    it 'raises an error for an invalid thread count' do
+      expect { NL::KndClient::Kinutils.plot_threads = -1 }.to raise_error(ArgumentError)
+      expect { NL::KndClient::Kinutils.plot_threads = 1000 }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe 'output string reuse' do
+    let(:packed) { Random.new(4).bytes(640 * 480 * 11 / 8) }
+
+    it 'writes into and returns a given output string' do
+      out = String.new('old contents')
+      expect(NL::KndClient::Kinutils.plot_overhead11(packed, out)).to equal(out)
+      expect(out).to eq(NL::KndClient::Kinutils.plot_overhead11(packed))
+      expect(out.bytesize).to eq(KNC_XPIX * KNC_ZPIX)
+    end
+
+    it 'refuses to write into a frozen output string' do
+      expect { NL::KndClient::Kinutils.unpack11_to_16(packed, 'x'.freeze) }.to raise_error(FrozenError)
+    end
+  end
+
+  describe NL::KndClient::Kinutils::FrameContext do
+    let(:packed) { Random.new(5).bytes(640 * 480 * 11 / 8) }
+    let(:depth) { NL::KndClient::Kinutils.unpack11_to_16(packed) }
+    let(:ctx) { NL::KndClient::Kinutils::FrameContext.new }
+
+    it 'unpacks into its own frozen depth buffer' do
+      expect(ctx.unpack(packed)).to equal(ctx.depth)
+      expect(ctx.depth).to be_frozen
+      expect(ctx.depth).to eq(depth)
+    end
+
+    it 'reuses the same buffers for every frame' do
+      overhead = ctx.plot_overhead(packed)
+      expect(ctx.plot_overhead(packed.reverse)).to equal(overhead)
+      expect(overhead).to eq(NL::KndClient::Kinutils.plot_overhead11(packed.reverse))
+    end
+
+    it 'plots several views into its buffers' do
+      expect(ctx.plot_views(packed, linear: true, side: true)).to equal(ctx)
+      expect(ctx.linear).to eq(NL::KndClient::Kinutils.plot_linear(depth))
+      expect(ctx.side).to eq(NL::KndClient::Kinutils.plot_side(depth))
+
+      ctx.plot_views(packed, :overhead, :front)
+      expect(ctx.overhead).to eq(NL::KndClient::Kinutils.plot_overhead(depth))
+      expect(ctx.front).to eq(NL::KndClient::Kinutils.plot_front(depth))
+    end
+
+    it 'can write into caller-supplied strings' do
+      out = String.new
+      expect(ctx.plot_side(packed, out)).to equal(out)
+      expect(out).to eq(NL::KndClient::Kinutils.plot_side(depth))
+
+      front = String.new
+      ctx.plot_views(packed, front: front)
+      expect(front).to eq(NL::KndClient::Kinutils.plot_front(depth))
+    end
+
+    it 'raises an error for short input or unknown views' do
+      expect { ctx.unpack('x' * 100) }.to raise_error(ArgumentError)
+      expect { ctx.plot_views(packed, :top) }.to raise_error(ArgumentError)
+    end
+
+    describe '#plot_incremental' do
+      # Packs rows of raw 11-bit depth values into an otherwise empty frame.
+      def pack_rows(rows)
+        frame = "\xff".b * (640 * 480 * 11 / 8)
+        rows.each do |y, vals|
+          frame[y * 880, 880] = [vals.map { |v| v.to_s(2).rjust(11, '0') }.join].pack('B*')
+        end
+        frame
+      end
+
+      def expect_views(frame)
+        expect(ctx.linear).to eq(NL::KndClient::Kinutils.plot_linear11(frame))
+        expect(ctx.overhead).to eq(NL::KndClient::Kinutils.plot_overhead11(frame))
+        expect(ctx.side).to eq(NL::KndClient::Kinutils.plot_side11(frame))
+        expect(ctx.front).to eq(NL::KndClient::Kinutils.plot_front11(frame))
+      end
+
+      # Replaces count random 11-byte groups of frame with those of other.
+      def mix(frame, other, count, rng)
+        frame = frame.dup
+        count.times do
+          g = rng.rand(640 * 480 / 8)
+          frame[g * 11, 11] = other.byteslice(g * 11, 11)
+        end
+        frame
+      end
+
+      let(:rng) { Random.new(12) }
+      let(:tabled) { pack_rows((100...300).map { |y| [y, Array.new(640) { rng.rand(300...1050) }] }) }
+      let(:tabled2) { pack_rows((150...350).map { |y| [y, Array.new(640) { rng.rand(300...1050) }] }) }
+
+      it 'matches a full plot as frames change a little at a time' do
+        frame = tabled
+        expect(ctx.plot_incremental(frame)).to eq(200 * 640)
+        expect_views(frame)
+
+        expect(ctx.plot_incremental(frame)).to eq(0)
+        expect_views(frame)
+
+        5.times do
+          frame = mix(frame, tabled2, 200, rng)
+          expect(ctx.plot_incremental(frame)).to be_between(1, 200 * 8)
+          expect_views(frame)
+        end
+      end
+
+      it 'matches a full plot when depths outside the projection tables come and go' do
+        frames = [tabled, mix(tabled, packed, 50, rng), packed, tabled2, mix(tabled2, packed, 3000, rng), tabled]
+        frames.each do |frame|
+          ctx.plot_incremental(frame)
+          expect_views(frame)
+        end
+      end
+
+      it 'replots everything after another method writes to its buffers' do
+        ctx.plot_incremental(tabled)
+        ctx.plot_views(tabled2, :overhead)
+        expect(ctx.plot_incremental(tabled)).to eq(200 * 640)
+        expect_views(tabled)
+
+        ctx.plot_front(packed)
+        ctx.plot_incremental(tabled)
+        expect_views(tabled)
+      end
+
+      it 'raises an error for short input' do
+        expect { ctx.plot_incremental('x' * 100) }.to raise_error(ArgumentError)
+      end
+
+      it 'keeps its state when another plot is refused' do
+        ctx.plot_incremental(tabled)
+        expect { ctx.plot_overhead('x' * 100) }.to raise_error(ArgumentError)
+        expect { ctx.plot_views('x' * 100, :side, :front) }.to raise_error(ArgumentError)
+        expect(ctx.plot_incremental(tabled)).to eq(0)
+        expect_views(tabled)
+      end
+    end
+  end
+
+  describe NL::KndClient::Kinutils::ZoneSet do
+    let(:packed) { Random.new(8).bytes(640 * 480 * 11 / 8) }
+    let(:set) { NL::KndClient::Kinutils::ZoneSet.new }
+    let(:zones) {
+      {
+        'Left' => { 'xmin' => -1500, 'xmax' => -200, 'ymin' => -800, 'ymax' => 800, 'zmin' => 500, 'zmax' => 2500 },
+        'Right' => { 'xmin' => 0, 'xmax' => 1000, 'ymin' => -300, 'ymax' => 1200, 'zmin' => 1000, 'zmax' => 4000 },
+        'Empty' => { 'xmin' => -100, 'xmax' => 100, 'ymin' => -100, 'ymax' => 100, 'zmin' => 9000, 'zmax' => 9500 },
+      }
+    }
+
+    # Computes pop, centroid, and surface area for a zone in Ruby.
+    def ruby_stats(packed, zone)
+      d16 = NL::KndClient::Kinutils.unpack11_to_16_lut(packed).unpack('S*')
+      pop = 0
+      sums = [0, 0, 0]
+      sa = 0.0
+      480.times do |y|
+        640.times do |x|
+          v = d16[y * 640 + x]
+          next if v >= KNC_PXZMAX
+          zw = NL::KndClient::Kinutils::DEPTH_LUT[v]
+          xw = NL::KndClient::Kinutils.xworld(x, zw)
+          yw = NL::KndClient::Kinutils.yworld(y, zw)
+          next unless xw.between?(zone['xmin'], zone['xmax']) &&
+            yw.between?(zone['ymin'], zone['ymax']) &&
+            zw.between?(zone['zmin'], zone['zmax'])
+
+          pop += 1
+          sums = sums.zip([xw, yw, zw]).map { |s, v| s + v }
+          sa += (zw * 1089.0 / 2048 / 320) ** 2
+        end
+      end
+
+      # C integer division truncates toward zero
+      centers = sums.map { |s| pop == 0 ? 0 : (s.abs / pop) * (s <=> 0) }
+      { 'pop' => pop, 'xc' => centers[0], 'yc' => centers[1], 'zc' => centers[2], 'sa' => sa.round }
+    end
+
+    before(:each) do
+      zones.each { |name, z| set.set(name, z) }
+    end
+
+    it 'computes the same statistics as a per-pixel Ruby loop' do
+      result = set.evaluate(packed)
+      expect(result.keys).to match_array(zones.keys)
+      zones.each do |name, z|
+        expect(result[name].select { |k, _| %w{pop xc yc zc sa}.include?(k) }).to eq(ruby_stats(packed, z))
+      end
+      expect(result['Empty']['pop']).to eq(0)
+      expect(result['Left']['pop']).to be > 0
+    end
+
+    it 'produces values that merge into a Zone' do
+      zone = NL::KndClient::Zone.new(zones['Left'].merge('name' => 'Left'))
+      zone.merge_zone(set.evaluate(packed)['Left'])
+      expect(zone['occupied']).to eq(true)
+      expect(zone['maxpop']).to eq((zone['px_xmax'] - zone['px_xmin']) * (zone['px_ymax'] - zone['px_ymin']))
+    end
+
+    it 'applies thresholds, delays, and negation' do
+      set.set('Left', zones['Left'].merge('on_delay' => 1, 'off_delay' => 1))
+      set.set('Empty', zones['Empty'].merge('negate' => true))
+      empty = "\0" * (640 * 480 * 11 / 8)
+
+      expect(set.evaluate(packed)['Left']['occupied']).to eq(false)
+      expect(set.evaluate(packed)['Left']['occupied']).to eq(true)
+      expect(set.evaluate(empty)['Left']['occupied']).to eq(true)
+      expect(set.evaluate(empty)['Left']['occupied']).to eq(false)
+      expect(set.evaluate(empty)['Empty']['occupied']).to eq(true)
+
+      pop = set.evaluate(packed)['Right']['pop']
+      set.set('Right', zones['Right'].merge('on_level' => pop + 1, 'off_level' => pop + 1))
+      expect(set.evaluate(packed)['Right']['occupied']).to eq(false)
+      set.set('Right', zones['Right'].merge(param: :sa, on_level: 1))
+      expect(set.evaluate(packed)['Right']['occupied']).to eq(true)
+    end
+
+    it 'adds, replaces, and deletes zones' do
+      expect(set.size).to eq(3)
+      set.set('Left', zones['Right'])
+      expect(set.size).to eq(3)
+      expect(set.delete('Left')).to eq(true)
+      expect(set.delete('Left')).to eq(false)
+      expect(set.include?('Left')).to eq(false)
+      expect(set.names).to match_array(['Right', 'Empty'])
+      expect(set.evaluate(packed).keys).to match_array(['Right', 'Empty'])
+      expect(set.clear.size).to eq(0)
+      expect(set.evaluate(packed)).to eq({})
+    end
+
+    it 'gives the same results as a new set after zones are changed and removed' do
+      rng = Random.new(9)
+      current = zones.dup
+      40.times do |i|
+        name = "Zone#{rng.rand(12)}"
+        if rng.rand(3) == 0
+          expect(set.delete(name)).to eq(current.include?(name))
+          current.delete(name)
+        else
+          x, y, z = rng.rand(-2500..2000), rng.rand(-2000..1500), rng.rand(0..6000)
+          current[name] = {
+            'xmin' => x, 'xmax' => x + rng.rand(2500), 'ymin' => y, 'ymax' => y + rng.rand(2000),
+            'zmin' => z, 'zmax' => z + rng.rand(4000)
+          }
+          set.set(name, current[name])
+        end
+      end
+
+      fresh = NL::KndClient::Kinutils::ZoneSet.new
+      current.each { |name, z| fresh.set(name, z) }
+      expect(set.evaluate(packed)).to eq(fresh.evaluate(packed))
+    end
+
+    it 'raises an error for invalid zones or input' do
+      expect { set.set('Bad', 'xmin' => 0) }.to raise_error(ArgumentError)
+      expect { set.set('Bad', zones['Left'].merge('param' => 'volume')) }.to raise_error(ArgumentError)
+      expect { set.evaluate('x' * 100) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe NL::KndClient::Kinutils::OccupancyGrid do
+    let(:packed) { Random.new(10).bytes(640 * 480 * 11 / 8) }
+    let(:grid) { NL::KndClient::Kinutils::OccupancyGrid.new(packed, scale: 10) }
+
+    # Returns the world-space points that land in the overhead and side views.
+    def view_points(packed)
+      d16 = NL::KndClient::Kinutils.unpack11_to_16_lut(packed).unpack('S*')
+      points = []
+      480.times do |y|
+        640.times do |x|
+          v = d16[y * 640 + x]
+          next if v >= KNC_PXZMAX || NL::KndClient::Kinutils::DEPTH_LUT[v] >= KNC_ZMAX
+          zw = NL::KndClient::Kinutils::DEPTH_LUT[v]
+          xw = NL::KndClient::Kinutils.xworld(x, zw)
+          yw = NL::KndClient::Kinutils.yworld(y, zw)
+          col = (xw * KNC_XPIX).fdiv(KNC_XMAX).truncate + KNC_XPIX / 2
+          row = (-yw * KNC_YPIX).fdiv(KNC_YMAX).truncate + KNC_YPIX / 2
+          points << [xw, yw, zw] if col.between?(0, KNC_XPIX - 1) && row.between?(0, KNC_YPIX - 1)
+        end
+      end
+      points
+    end
+
+    it 'has the requested resolution' do
+      expect(grid.dimensions).to eq([50, 50, 50])
+      expect(grid.voxel_size[2]).to be_within(0.001).of(KNC_ZMAX * 10.0 / KNC_ZPIX)
+    end
+
+    it 'counts every point in a box that covers the whole view' do
+      expect(grid.count_boxes([[-100000, -100000, -100000, 100000, 100000, 100000]])).to eq([view_points(packed).size])
+    end
+
+    it 'counts at least the points in each box, and only other points near it' do
+      points = view_points(packed)
+
+      # Rounding toward zero makes the voxels at the center slightly wider
+      size = grid.voxel_size.map { |s| (s * 2).ceil }
+      rng = Random.new(11)
+      boxes = 20.times.map {
+        x, y, z = rng.rand(-3000..2000), rng.rand(-2500..1500), rng.rand(0..5000)
+        { xmin: x, ymin: y, zmin: z, xmax: x + rng.rand(3000), ymax: y + rng.rand(2500), zmax: z + rng.rand(3000) }
+      }
+
+      grid.count_boxes(boxes).zip(boxes).each do |count, b|
+        inside = points.count { |x, y, z|
+          x.between?(b[:xmin], b[:xmax]) && y.between?(b[:ymin], b[:ymax]) && z.between?(b[:zmin], b[:zmax])
+        }
+        near = points.count { |x, y, z|
+          x.between?(b[:xmin] - size[0], b[:xmax] + size[0]) &&
+            y.between?(b[:ymin] - size[1], b[:ymax] + size[1]) &&
+            z.between?(b[:zmin] - size[2], b[:zmax] + size[2])
+        }
+        expect(count).to be_between(inside, near)
+      end
+    end
+
+    it 'accepts Zones and Hashes with String keys' do
+      box = { 'xmin' => -1000, 'ymin' => -1000, 'zmin' => 500, 'xmax' => 1000, 'ymax' => 1000, 'zmax' => 4000 }
+      expect(grid.count_boxes([box, NL::KndClient::Zone.new(box)])).to eq(
+        grid.count_boxes([[-1000, -1000, 500, 1000, 1000, 4000]]) * 2
+      )
+    end
+
+    it 'returns zero for empty boxes and boxes outside the view' do
+      expect(grid.count_boxes([[10, 0, 0, 0, 0, 0], [0, 0, 8000, 100, 100, 9000]])).to eq([0, 0])
+    end
+
+    it 'replaces counts with each update' do
+      box = [[-100000, -100000, -100000, 100000, 100000, 100000]]
+      grid.update("\xff" * (640 * 480 * 11 / 8))
+      expect(grid.count_boxes(box)).to eq([0])
+    end
+
+    it 'raises an error for invalid input' do
+      expect { NL::KndClient::Kinutils::OccupancyGrid.new(scale: 0) }.to raise_error(ArgumentError)
+      expect { grid.update('x' * 100) }.to raise_error(ArgumentError)
+      expect { grid.count_boxes([[1, 2, 3]]) }.to raise_error(ArgumentError)
+      expect { grid.count_boxes([{ xmin: 1 }]) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe NL::KndClient::Kinutils::Recording do
+    let(:frames) { Array.new(3) { |i| Random.new(20 + i).bytes(640 * 480 * 11 / 8) } }
+    let(:start) { Time.at(1_600_000_000, 250_000, :usec) }
+    let(:dir) { Dir.mktmpdir }
+    let(:path) { File.join(dir, 'depth.knr') }
+
+    after(:each) { FileUtils.remove_entry(dir) }
+
+    def write_recording
+      NL::KndClient::Kinutils::Recorder.open(path) do |rec|
+        frames.each_with_index { |f, i| rec.add(f, start + Rational(i, 10)) }
+        rec.size
+      end
+    end
+
+    it 'reads back frames and times written by a Recorder' do
+      expect(write_recording).to eq(3)
+
+      rec = NL::KndClient::Kinutils::Recording.new(path)
+      expect(rec.size).to eq(3)
+      expect(rec[0]).to eq(frames[0])
+      expect(rec[-1]).to eq(frames[2])
+      expect(rec[3]).to be_nil
+      expect(rec.time(1)).to eq(start + Rational(1, 10))
+      expect(rec.each.map { |f, t| [f, t] }).to eq(frames.zip(Array.new(3) { |i| start + Rational(i, 10) }))
+    end
+
+    it 'seeks to the first frame at or after a time' do
+      write_recording
+      rec = NL::KndClient::Kinutils::Recording.new(path)
+
+      expect(rec.seek(start)).to eq(0)
+      expect(rec.seek(start + Rational(1, 20))).to eq(1)
+      expect(rec.seek(start + Rational(2, 10))).to eq(2)
+      expect(rec.seek(start + 1)).to eq(3)
+    end
+
+    it 'returns frozen frames that work with every packed-data function' do
+      write_recording
+      frame = NL::KndClient::Kinutils::Recording.new(path)[1]
+      GC.start
+
+      expect(frame).to be_frozen
+      expect(frame.bytesize).to eq(640 * 480 * 11 / 8)
+      expect(NL::KndClient::Kinutils.plot_overhead11(frame)).to eq(NL::KndClient::Kinutils.plot_overhead11(frames[1]))
+      expect(NL::KndClient::Kinutils.unpack_to_world(frame)).to eq(NL::KndClient::Kinutils.unpack_to_world(frames[1]))
+    end
+
+    it 'reads the frames of a recording that was never closed' do
+      rec = NL::KndClient::Kinutils::Recorder.new(path)
+      rec << frames[0] << frames[1]
+      File.open(path, 'ab') { |f| f.write('x' * 100) }
+
+      unclosed = NL::KndClient::Kinutils::Recording.new(path)
+      expect(unclosed.size).to eq(2)
+      expect(unclosed[1]).to eq(frames[1])
+      expect(unclosed.time(0)).to eq(Time.at(0))
+
+      rec.close
+      expect(rec).to be_closed
+      expect { rec << frames[0] }.to raise_error(IOError)
+    end
+
+    it 'raises errors for missing or invalid files and short frames' do
+      File.binwrite(path, frames[0])
+      expect { NL::KndClient::Kinutils::Recording.new(path) }.to raise_error(ArgumentError)
+      expect { NL::KndClient::Kinutils::Recording.new(File.join(dir, 'missing')) }.to raise_error(Errno::ENOENT)
+      expect { NL::KndClient::Kinutils::Recorder.open(path) { |r| r << 'x' * 100 } }.to raise_error(ArgumentError)
+    end
+
+    it 'rejects a recording whose index points past the end of the file' do
+      write_recording
+      header = File.binread(path, 64)
+      header[24, 16] = [1, 64].pack('Q<Q<') # One frame, index right after the header
+      File.binwrite(path, header + [0, 64].pack('Q<Q<') + 'x' * 20)
+
+      expect { NL::KndClient::Kinutils::Recording.new(path) }.to raise_error(ArgumentError)
+    end
+  end
+
+  describe '.parse_zone_list' do
+    let(:listing) {
+      [
+        'xmin=-1000 ymin=-500 zmin=1000 xmax=1000 ymax=500 zmax=3000 px_xmin=100 px_ymin=80 px_zmin=400 ' \
+          'px_xmax=540 px_ymax=400 px_zmax=900 pop=1200 maxpop=140800 xc=500 yc=400 zc=300 sa=80 ' \
+          'occupied=1 negate=0 param=pop on_level=1000 off_level=900 on_delay=0 off_delay=2 name="Zone 1" version=2',
+        '',
+        'xmin=-0.5 ymin=0 zmin=1.25 xmax=0.5 ymax=1 zmax=2 occupied=0 negate=true param=bogus name="a,b" version=1',
+      ].join("\n")
+    }
+
+    it 'parses one normalized Hash per zone line' do
+      zones = NL::KndClient::Kinutils.parse_zone_list(listing)
+      expect(zones.length).to eq(2)
+
+      expect(zones[0]).to include('name' => 'Zone_1', 'xmin' => -1000, 'pop' => 1200, 'occupied' => true, 'negate' => false, 'param' => 'pop', 'off_delay' => 2)
+      expect(zones[1]).to include('name' => 'ab', 'occupied' => false, 'negate' => true, 'version' => 1)
+      expect(zones[1]).not_to have_key('param')
+    end
+
+    it 'converts version 1 zones to millimeters' do
+      zone = NL::KndClient::Kinutils.parse_zone_list(listing)[1]
+      expect(zone.values_at('xmin', 'ymin', 'zmin', 'xmax', 'ymax', 'zmax')).to eq([-500, 0, 1250, 500, 1000, 2000])
+    end
+
+    it 'matches Zone#normalize!' do
+      zones = NL::KndClient::Kinutils.parse_zone_list(listing.lines)
+      expected = listing.lines.reject { |l| l.strip.empty? }.map { |l| NL::KndClient::Zone.new(l.kin_kvp) }
+      expect(zones).to eq(expected)
+      expect(NL::KndClient::Zone.new(zones[0], false)).to eq(expected[0])
+    end
+
+    it 'uses frozen keys' do
+      keys = NL::KndClient::Kinutils.parse_zone_list(listing).map(&:keys).flatten
+      expect(keys).to all(be_frozen)
+    end
+  end
+
+  describe NL::KndClient::Kinutils::LineDecoder do
+    let(:decoder) { NL::KndClient::Kinutils::LineDecoder.new(zone_class: Hash) }
+    let(:records) { [] }
+
+    def feed(*chunks)
+      chunks.each do |c|
+        decoder.feed(c) { |*r| records << r }
+      end
+      records
+    end
+
+    it 'classifies lines split across chunks' do
+      feed("OK - Version 2\r\nSUB - xmin=1 occ", "upied=1 name=\"a b\"\nBRIGHT - name=a bright=42\n", "DEL - a\nERR\nhello\n")
+      expect(records).to eq([
+        [:ok, 'Version 2', nil],
+        [:sub, { 'xmin' => 1, 'occupied' => true, 'name' => 'a_b' }, nil],
+        [:bright, 'a', 42],
+        [:del, 'a', nil],
+        [:err, nil, nil],
+        [:line, 'hello', nil],
+      ])
+    end
+
+    it 'collects binary frames of the given length' do
+      frame = (0..255).map(&:chr).join * 3
+      feed("DEPTH - #{frame.bytesize} bytes of raw depth data follow\n#{frame[0, 100]}", frame[100..-1] + "VIDEO - 0 bytes of video data follow\nOK")
+      feed("\n")
+      expect(records).to eq([[:depth, frame.b, nil], [:video, '', nil], [:ok, nil, nil]])
+    end
+
+    it 'passes raw lines through unclassified' do
+      feed("OK - 2 zones, 0 occupied\n")
+      decoder.raw_lines = 2
+      feed("name=a\nSUB - name=b\nSUB - name=c\n")
+      expect(records.map(&:first)).to eq([:ok, :line, :line, :sub])
+      expect(records[2][1]).to eq('SUB - name=b')
+    end
+
+    it 'parses zones into the zone class, or yields the message' do
+      compact = NL::KndClient::Kinutils::LineDecoder.new(zone_class: NL::KndClient::Kinutils::CompactZone)
+      compact.feed("ADD - name=z pop=3\n") { |*r| records << r }
+      NL::KndClient::Kinutils::LineDecoder.new.feed("SUB - name=z pop=3\n") { |*r| records << r }
+
+      expect(records[0][1]).to be_a(NL::KndClient::Kinutils::CompactZone)
+      expect(records[0][1].to_h).to eq('name' => 'z', 'pop' => 3)
+      expect(records[1]).to eq([:sub, 'name=z pop=3', nil])
+    end
+
+    it 'starts a new line after the block raises' do
+      expect { decoder.feed("OK - first\nDEL - a\n") { raise 'Block failed' } }.to raise_error(RuntimeError, 'Block failed')
+      feed("ERR\n")
+      expect(records).to eq([[:err, nil, nil]])
+    end
+
+    it 'raises an error for overlong lines' do
+      expect { feed('x' * (1024 * 1024 + 1)) }.to raise_error(NL::KndClient::Kinutils::LineDecoder::ProtocolError)
+    end
+  end
+
+  describe NL::KndClient::Kinutils::FramePool do
+    let(:packed) { Random.new(6).bytes(640 * 480 * 11 / 8) }
+    let(:depth) { NL::KndClient::Kinutils.unpack11_to_16(packed) }
+    let(:pool) { NL::KndClient::Kinutils::FramePool.new(threads: 2, queue: 2) }
+    let(:contexts) { Array.new(3) { NL::KndClient::Kinutils::FrameContext.new } }
+
+    after(:each) { pool.close }
+
+    # Collects finished frames until +count+ have been yielded.
+    def collect(count)
+      results = []
+      while results.length < count
+        IO.select([pool.io], nil, nil, 5) || raise('Timed out waiting for FramePool')
+        pool.each_completed { |ctx, tag| results << [ctx, tag] }
+      end
+      results
+    end
+
+    it 'processes frames into contexts and yields them in order' do
+      expect(pool.submit(contexts[0], packed, :a, depth: true, linear: true)).to eq(true)
+      expect(pool.submit(contexts[1], packed.reverse, :b, overhead: true)).to eq(true)
+
+      results = collect(2)
+      expect(results.map(&:last)).to eq([:a, :b])
+      expect(contexts[0].depth).to eq(depth)
+      expect(contexts[0].linear).to eq(NL::KndClient::Kinutils.plot_linear(depth))
+      expect(contexts[1].overhead).to eq(NL::KndClient::Kinutils.plot_overhead11(packed.reverse))
+      expect(pool.pending).to eq(0)
+    end
+
+    it 'refuses frames beyond its queue depth' do
+      pool.submit(contexts[0], packed, 1, front: true)
+      pool.submit(contexts[1], packed, 2, front: true)
+      expect(pool.submit(contexts[2], packed, 3, front: true)).to eq(false)
+      expect(pool.pending).to eq(2)
+
+      collect(2)
+      expect(pool.submit(contexts[2], packed, 3, front: true)).to eq(true)
+    end
+
+    it 'keeps contexts busy until their frames are collected' do
+      pool.submit(contexts[0], packed, nil, side: true)
+      expect { contexts[0].unpack(packed) }.to raise_error(RuntimeError)
+
+      collect(1)
+      expect(contexts[0].unpack(packed)).to eq(depth)
+    end
+
+    it 'releases uncollected contexts when closed' do
+      pool.submit(contexts[0], packed, nil, depth: true)
+      pool.close
+
+      expect(pool).to be_closed
+      expect(contexts[0].unpack(packed)).to eq(depth)
+      expect { pool.submit(contexts[1], packed) }.to raise_error(RuntimeError)
+    end
+
+    it 'can be garbage collected with frames pending' do
+      script = <<-RUBY
+        require 'nl/knd_client/kinutils'
+        packed = Random.new(6).bytes(640 * 480 * 11 / 8)
+        drop = lambda do
+          pool = NL::KndClient::Kinutils::FramePool.new(threads: 1, queue: 16)
+          16.times { pool.submit(NL::KndClient::Kinutils::FrameContext.new, packed.dup, nil, depth: true, overhead: true, front: true) }
+          nil
+        end
+        10.times { drop.call; GC.start; 20.times { Array.new(1000) { 'x' * 4000 } } }
+      RUBY
+
+      # Unmapping freed frame buffers makes writes to them crash reliably
+      env = { 'MALLOC_MMAP_THRESHOLD_' => '131072' }
+      output, status = Open3.capture2e(env, RbConfig.ruby, *$LOAD_PATH.map { |p| "-I#{p}" }, '-e', script)
+      expect(status).to be_success, output
+    end
+  end
+
+  describe NL::KndClient::Kinutils::FrameAssembler do
+    let(:packed) { Random.new(7).bytes(640 * 480 * 11 / 8) }
+    let(:expected) { NL::KndClient::Kinutils::FrameContext.new.tap { |c| c.unpack(packed); c.plot_views(packed, :linear, :overhead, :side, :front) } }
+    let(:ctx) { NL::KndClient::Kinutils::FrameContext.new }
+    let(:assembler) { NL::KndClient::Kinutils::FrameAssembler.new(rows: 4) }
+
+    it 'processes a frame added in chunks like the whole frame' do
+      assembler.start(ctx, depth: true, linear: true, overhead: true, side: true, front: true)
+      packed.bytes.each_slice(9001).map { |b| b.pack('C*') }.each do |chunk|
+        expect(assembler.add(chunk)).to eq(chunk.bytesize)
+      end
+      expect(assembler.add('extra')).to eq(0)
+      expect(assembler).to be_complete
+
+      expect(assembler.finish).to equal(ctx)
+      [:depth, :linear, :overhead, :side, :front].each do |view|
+        expect(ctx.send(view)).to eq(expected.send(view))
+      end
+    end
+
+    it 'receives depth frames from a LineDecoder' do
+      decoder = NL::KndClient::Kinutils::LineDecoder.new(
+        frame_buffer: ->(type, _len) { type == :depth ? assembler.start(ctx, overhead: true) : nil }
+      )
+      records = []
+      data = "DEPTH - #{packed.bytesize} bytes of raw depth data follow\n#{packed}VIDEO - 3 bytes of video data follow\nabc"
+      data.bytes.each_slice(65536) { |b| decoder.feed(b.pack('C*')) { |*r| records << r } }
+
+      expect(records.map(&:first)).to eq([:depth, :video])
+      expect(records[0][1]).to equal(assembler)
+      expect(records[1][1]).to eq('abc')
+      expect(assembler.finish.overhead).to eq(expected.overhead)
+    end
+
+    it 'returns copies of the data received so far' do
+      assembler.add(packed[0, 1000])
+      data = assembler.data
+      expect(data).to eq(packed[0, 1000])
+
+      data.clear
+      expect(assembler.add(packed[1000..-1])).to eq(packed.bytesize - 1000)
+      expect(assembler.data).to eq(packed)
+    end
+
+    it 'keeps its context busy until finished' do
+      assembler.start(ctx, depth: true)
+      expect { ctx.unpack(packed) }.to raise_error(RuntimeError)
+      expect { assembler.start(NL::KndClient::Kinutils::FrameContext.new) }.to raise_error(RuntimeError)
+
+      assembler.finish
+      expect(ctx.unpack(packed)).to eq(expected.depth)
+    end
+  end
+
+  describe NL::KndClient::Kinutils::SharedFrames do
+    let(:name) { "/knd-spec-#{$$}" }
+    let(:packed) { Random.new(8).bytes(640 * 480 * 11 / 8) }
+    let(:ctx) { NL::KndClient::Kinutils::FrameContext.new.tap { |c| c.unpack(packed); c.plot_views(packed, :overhead) } }
+    let(:publisher) { NL::KndClient::Kinutils::FramePublisher.new(name, slots: 2) }
+    let(:frames) { publisher; NL::KndClient::Kinutils::SharedFrames.new(name) }
+
+    after(:each) { NL::KndClient::Kinutils::FramePublisher.unlink(name) }
+
+    it 'reads published frames from shared memory without copying' do
+      expect(frames.latest).to eq(nil)
+      expect(publisher.publish(packed, depth: ctx.depth, overhead: ctx.overhead, time: Time.at(1234.5))).to eq(1)
+
+      frame = frames.frame
+      expect(frame).to include(frame: 1, time: Time.at(1234.5), linear: nil)
+      expect(frame[:packed]).to eq(packed)
+      expect(frame[:depth]).to eq(ctx.depth)
+      expect(frame[:overhead]).to eq(ctx.overhead)
+      expect(frame[:packed]).to be_frozen
+
+      publisher.publish(packed.reverse)
+      expect(frames.read { |f| f[:packed] == packed.reverse && f[:frame] }).to eq(2)
+    end
+
+    it 'detects frames overwritten by newer frames' do
+      publisher.publish(packed)
+      expect(frames.valid?(1)).to eq(true)
+      2.times { publisher.publish(packed.reverse) }
+
+      expect(frames.valid?(1)).to eq(false)
+      expect(frames.frame(1)).to eq(nil)
+      expect(frames.frame(1, copy: true)).to eq(nil)
+      expect(frames.read(1) { raise 'Should not be called' }).to eq(nil)
+      expect(frames.valid?(3)).to eq(true)
+    end
+
+    it 'copies frames that outlive the publisher overwriting them' do
+      publisher.publish(packed, overhead: ctx.overhead)
+      copy = frames.frame(1, copy: true)
+      read = frames.read(copy: true) { |f| f }
+      2.times { publisher.publish(packed.reverse, overhead: ctx.overhead.reverse) }
+
+      expect(copy).to include(frame: 1, packed: packed, overhead: ctx.overhead, depth: nil)
+      expect(read).to include(frame: 1, packed: packed, overhead: ctx.overhead)
+      expect(copy[:packed]).not_to be_frozen
+      expect(frames.frame(3, copy: true)[:packed]).to eq(packed.reverse)
+    end
+
+    it 'keeps frame numbers when a publisher reopens the ring' do
+      publisher.publish(packed)
+      publisher.close
+      expect { publisher.publish(packed) }.to raise_error(IOError)
+
+      reopened = NL::KndClient::Kinutils::FramePublisher.new(name, slots: 2)
+      expect(reopened.publish(packed)).to eq(2)
+      expect(frames.latest).to eq(2)
+      reopened.close
+
+      expect { NL::KndClient::Kinutils::SharedFrames.new('/knd-spec-missing') }.to raise_error(Errno::ENOENT)
+    end
+
+    it 'stops reading frames when a publisher resizes the ring' do
+      publisher.publish(packed)
+      publisher.close
+      expect(frames.frame(1)).not_to eq(nil)
+
+      resized = NL::KndClient::Kinutils::FramePublisher.new(name, slots: 3)
+      expect(resized.publish(packed)).to eq(1)
+      resized.close
+
+      expect(frames.frame(1)).to eq(nil)
+      expect(frames.valid?(1)).to eq(false)
+      expect(NL::KndClient::Kinutils::SharedFrames.new(name).frame(1)).to include(frame: 1)
+    end
+  end
+
   pending '.xworld'
   pending '.yworld'
   pending '.unpack11_to_16_lut'
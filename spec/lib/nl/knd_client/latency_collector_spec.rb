@@ -0,0 +1,119 @@
+RSpec.describe(NL::KndClient::LatencyCollector) do
+  let(:collector) { NL::KndClient::LatencyCollector.new }
+
+  describe NL::KndClient::LatencyCollector::Histogram do
+    let(:hist) { NL::KndClient::LatencyCollector::Histogram.new }
+
+    it 'keeps small values exactly' do
+      (0...32).each do |v| hist.record(v) end
+      expect(hist.percentile(50)).to eq(15)
+      expect(hist.percentile(100)).to eq(31)
+      expect(hist.max).to eq(31)
+    end
+
+    it 'keeps large values within 1/16' do
+      [1_000, 123_456, 7_654_321, 2_000_000_000].each do |v|
+        h = NL::KndClient::LatencyCollector::Histogram.new
+        h.record(v)
+        h.record(0)
+        expect(h.percentile(50)).to eq(0)
+        expect(h.percentile(100)).to eq(v)
+
+        i = NL::KndClient::LatencyCollector::Histogram.index(v)
+        expect(NL::KndClient::LatencyCollector::Histogram.highest(i)).to be >= v
+        expect(NL::KndClient::LatencyCollector::Histogram.highest(i)).to be <= v * 17 / 16
+      end
+    end
+
+    it 'gives bucket indices in value order' do
+      values = (0..40).map { |b| [2**b - 1, 2**b, 2**b + 2**b / 3] }.flatten.uniq.sort
+      indices = values.map { |v| NL::KndClient::LatencyCollector::Histogram.index(v) }
+      expect(indices).to eq(indices.sort)
+    end
+
+    it 'computes percentiles from the distribution' do
+      (1..1000).each do |v| hist.record(v * 1000) end
+      expect(hist.count).to eq(1000)
+      expect(hist.mean).to eq(500_500)
+      expect(hist.percentile(50)).to be_within(500_000 / 16).of(500_000)
+      expect(hist.percentile(90)).to be_within(900_000 / 16).of(900_000)
+      expect(hist.percentile(99)).to be_within(990_000 / 16).of(990_000)
+      expect(hist.percentile(100)).to eq(1_000_000)
+    end
+
+    it 'returns 0 when empty' do
+      expect(hist.percentile(99)).to eq(0)
+      expect(hist.mean).to eq(0)
+    end
+  end
+
+  describe '#call' do
+    it 'returns the value of the block and records its duration' do
+      expect(collector.call('stage', -> { sleep 0.01; 5 })).to eq(5)
+      snap = collector.snapshot['stage']
+      expect(snap[:count]).to eq(1)
+      expect(snap[:max]).to be_between(9.0, 200.0)
+      expect(snap[:p50]).to eq(snap[:max])
+    end
+
+    it 'records a duration when the block raises' do
+      expect { collector.call('fail', -> { raise 'oops' }) }.to raise_error(RuntimeError)
+      expect(collector.snapshot['fail'][:count]).to eq(1)
+    end
+  end
+
+  describe '#snapshot' do
+    it 'reports milliseconds for each stage' do
+      collector.record('a', 2_000_000)
+      collector.record('a', 4_000_000)
+      collector.record('b', 500_000)
+
+      snap = collector.snapshot
+      expect(snap.keys.sort).to eq(['a', 'b'])
+      expect(snap['a']).to include(count: 2, mean: 3.0, p90: 4.0, max: 4.0)
+      expect(snap['a'][:p50]).to be_within(2.0 / 16).of(2.0)
+      expect(snap['b']).to include(count: 1, p99: 0.5)
+    end
+
+    it 'includes frames behind and their maximum' do
+      collector.behind('depth', 1)
+      collector.behind('depth', 1)
+      collector.behind('depth', -1)
+      expect(collector.snapshot['depth']).to eq(behind: 1, max_behind: 2)
+
+      collector.snapshot(reset: true)
+      expect(collector.snapshot['depth']).to eq(behind: 1, max_behind: 1)
+    end
+
+    it 'clears histograms when reset' do
+      collector.record('a', 1000)
+      expect(collector.snapshot(reset: true)['a'][:count]).to eq(1)
+      expect(collector.snapshot).to eq({})
+    end
+  end
+
+  describe '#report_every' do
+    it 'calls the block with snapshots periodically' do
+      snapshots = Queue.new
+      collector.record('a', 1000)
+      collector.report_every(0.01) do |snap| snapshots << snap end
+
+      expect(snapshots.pop['a'][:count]).to eq(1)
+      expect(snapshots.pop).to eq({})
+    ensure
+      collector.stop
+    end
+  end
+
+  describe '.format' do
+    it 'lists the stages with the slowest p99 first' do
+      collector.record('fast', 1_000_000)
+      collector.record('slow', 9_000_000)
+      collector.behind('depth', 2)
+
+      lines = NL::KndClient::LatencyCollector.format(collector.snapshot).lines.map(&:chomp)
+      expect(lines[0]).to start_with('slow: 1 calls, p50 9.0ms')
+      expect(lines).to include('depth: 2 frames behind (max 2)')
+    end
+  end
+end
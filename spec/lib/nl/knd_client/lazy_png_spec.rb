@@ -0,0 +1,69 @@
+require 'zlib'
+
+RSpec.describe(NL::KndClient::LazyPng) do
+  # Returns the width, height, bit depth, and unfiltered pixel data of a PNG.
+  def decode(png)
+    expect(png.byteslice(0, 8)).to eq(NL::KndClient::LazyPng::PNG_SIGNATURE)
+
+    pos = 8
+    chunks = {}
+    while pos < png.bytesize
+      len, type = png.byteslice(pos, 8).unpack('Na4')
+      data = png.byteslice(pos + 8, len)
+      expect(png.byteslice(pos + 8 + len, 4).unpack('N').first).to eq(Zlib.crc32(type + data))
+      (chunks[type] ||= ''.b) << data
+      pos += 12 + len
+    end
+
+    width, height, depth = chunks['IHDR'].unpack('NNC')
+    stride = width * depth / 8
+    raw = Zlib::Inflate.inflate(chunks['IDAT'])
+    rows = (0...height).map { |y|
+      expect(raw.getbyte(y * (stride + 1))).to eq(0)
+      raw.byteslice(y * (stride + 1) + 1, stride)
+    }
+
+    [width, height, depth, rows.join]
+  end
+
+  after(:each) do
+    NL::KndClient::LazyPng.level = nil
+  end
+
+  let(:gray) { (0...(40 * 30)).map { |i| i % 256 }.pack('C*') }
+  let(:deep) { (0...(40 * 30)).map { |i| i * 37 }.pack('S*') }
+
+  it 'encodes 8-bit images with the configured zlib level' do
+    NL::KndClient::LazyPng.level = 1
+    expect(decode(NL::KndClient::LazyPng.new(40, 30, 8, gray).png)).to eq([40, 30, 8, gray])
+  end
+
+  it 'encodes 16-bit images with big-endian samples' do
+    NL::KndClient::LazyPng.level = 6
+    expect(decode(NL::KndClient::LazyPng.new(40, 30, 16, deep).png)).to eq([40, 30, 16, deep.unpack('S*').pack('n*')])
+  end
+
+  it 'does not encode until the PNG is fetched, then caches it' do
+    NL::KndClient::LazyPng.level = 1
+    image = NL::KndClient::LazyPng.new(40, 30, 8, gray, 7)
+    expect(image.encoded?).to eq(false)
+    expect(image.sequence).to eq(7)
+
+    png = image.png
+    expect(image.encoded?).to eq(true)
+    expect(image.png).to equal(png)
+  end
+
+  it 'keeps a copy of the pixels' do
+    NL::KndClient::LazyPng.level = 0
+    data = gray.dup
+    image = NL::KndClient::LazyPng.new(40, 30, 8, data)
+    data.setbyte(0, 99)
+    expect(decode(image.png)[3]).to eq(gray)
+  end
+
+  it 'rejects invalid compression levels' do
+    expect { NL::KndClient::LazyPng.level = 10 }.to raise_error(ArgumentError)
+    expect { NL::KndClient::LazyPng.level = 'fast' }.to raise_error(ArgumentError)
+  end
+end